@@ -0,0 +1,5 @@
+ALTER TABLE playlist_items ADD COLUMN position INTEGER NOT NULL DEFAULT -1;
+
+CREATE INDEX idx_playlist_items_playlist_position ON playlist_items (playlist, position);
+
+UPDATE schema_version SET version=52;
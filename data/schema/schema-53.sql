@@ -0,0 +1,25 @@
+CREATE TABLE songs_changes (
+  version INTEGER PRIMARY KEY AUTOINCREMENT,
+  song_id INTEGER NOT NULL,
+  filename TEXT NOT NULL,
+  deleted INTEGER NOT NULL DEFAULT 0,
+  UNIQUE (song_id, filename) ON CONFLICT REPLACE
+);
+
+CREATE TRIGGER songs_changes_insert AFTER INSERT ON songs BEGIN
+  INSERT INTO songs_changes (song_id, filename, deleted) VALUES (new.ROWID, new.filename, 0);
+END;
+
+CREATE TRIGGER songs_changes_update AFTER UPDATE ON songs BEGIN
+  INSERT INTO songs_changes (song_id, filename, deleted) VALUES (new.ROWID, new.filename, 0);
+END;
+
+CREATE TRIGGER songs_changes_rename AFTER UPDATE OF filename ON songs WHEN old.filename != new.filename BEGIN
+  INSERT INTO songs_changes (song_id, filename, deleted) VALUES (old.ROWID, old.filename, 1);
+END;
+
+CREATE TRIGGER songs_changes_delete AFTER DELETE ON songs BEGIN
+  INSERT INTO songs_changes (song_id, filename, deleted) VALUES (old.ROWID, old.filename, 1);
+END;
+
+UPDATE schema_version SET version=53;
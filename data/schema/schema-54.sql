@@ -0,0 +1,11 @@
+CREATE TABLE moodbars (
+  song_id INTEGER PRIMARY KEY,
+  mtime INTEGER NOT NULL,
+  data BLOB
+);
+
+CREATE TRIGGER moodbars_delete AFTER DELETE ON songs BEGIN
+  DELETE FROM moodbars WHERE song_id = old.ROWID;
+END;
+
+UPDATE schema_version SET version=54;
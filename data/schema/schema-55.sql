@@ -0,0 +1,15 @@
+CREATE TABLE subsonic_albums (
+  album_id TEXT PRIMARY KEY,
+  fingerprint TEXT NOT NULL
+);
+
+CREATE TABLE subsonic_album_songs (
+  album_id TEXT NOT NULL,
+  filename TEXT NOT NULL
+);
+
+CREATE INDEX idx_subsonic_album_songs_album_id ON subsonic_album_songs (album_id);
+
+CREATE INDEX idx_subsonic_songs_filename ON subsonic_songs (filename);
+
+UPDATE schema_version SET version=55;
@@ -0,0 +1,15 @@
+CREATE TABLE songs_changes_database (
+  database_id INTEGER NOT NULL
+);
+
+INSERT INTO songs_changes_database (database_id) VALUES (abs(random() % 2147483647) + 1);
+
+DROP TRIGGER songs_changes_update;
+
+CREATE TRIGGER songs_changes_update AFTER UPDATE OF title, album, artist, albumartist, composer, track, disc, bpm, year, genre, comment, effective_compilation, bitrate, samplerate, filename, filesize, art_automatic, art_manual, filetype, rating, beginning, length, cue_path, unavailable, effective_albumartist, performer, grouping, lyrics, originalyear, effective_originalyear ON songs
+WHEN old.title IS NOT new.title OR old.album IS NOT new.album OR old.artist IS NOT new.artist OR old.albumartist IS NOT new.albumartist OR old.composer IS NOT new.composer OR old.track IS NOT new.track OR old.disc IS NOT new.disc OR old.bpm IS NOT new.bpm OR old.year IS NOT new.year OR old.genre IS NOT new.genre OR old.comment IS NOT new.comment OR old.effective_compilation IS NOT new.effective_compilation OR old.bitrate IS NOT new.bitrate OR old.samplerate IS NOT new.samplerate OR old.filename IS NOT new.filename OR old.filesize IS NOT new.filesize OR old.art_automatic IS NOT new.art_automatic OR old.art_manual IS NOT new.art_manual OR old.filetype IS NOT new.filetype OR old.rating IS NOT new.rating OR old.beginning IS NOT new.beginning OR old.length IS NOT new.length OR old.cue_path IS NOT new.cue_path OR old.unavailable IS NOT new.unavailable OR old.effective_albumartist IS NOT new.effective_albumartist OR old.performer IS NOT new.performer OR old.grouping IS NOT new.grouping OR old.lyrics IS NOT new.lyrics OR old.originalyear IS NOT new.originalyear OR old.effective_originalyear IS NOT new.effective_originalyear
+BEGIN
+  INSERT INTO songs_changes (song_id, filename, deleted) VALUES (new.ROWID, new.filename, 0);
+END;
+
+UPDATE schema_version SET version=56;
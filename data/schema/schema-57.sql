@@ -0,0 +1,22 @@
+CREATE TABLE moodbars_by_filename (
+  filename TEXT PRIMARY KEY,
+  mtime INTEGER NOT NULL,
+  data BLOB
+);
+
+INSERT OR REPLACE INTO moodbars_by_filename (filename, mtime, data)
+  SELECT s.filename, m.mtime, m.data FROM moodbars AS m, songs AS s
+  WHERE s.ROWID = m.song_id;
+
+DROP TRIGGER moodbars_delete;
+
+DROP TABLE moodbars;
+
+ALTER TABLE moodbars_by_filename RENAME TO moodbars;
+
+CREATE TRIGGER moodbars_delete AFTER DELETE ON songs BEGIN
+  DELETE FROM moodbars WHERE filename = old.filename
+    AND NOT EXISTS (SELECT 1 FROM songs WHERE filename = old.filename);
+END;
+
+UPDATE schema_version SET version=57;
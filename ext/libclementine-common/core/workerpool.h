@@ -74,6 +74,7 @@ class WorkerPool : public _WorkerPoolBase {
   // Sets the number of worker process to use.  Defaults to
   // 1 <= (processors / 2) <= 2.
   void SetWorkerCount(int count);
+  int worker_count() const { return worker_count_; }
 
   // Sets the prefix to use for the local server (on unix this is a named pipe
   // in /tmp).  Defaults to QApplication::applicationName().  A random number
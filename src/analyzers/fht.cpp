@@ -23,11 +23,16 @@
 #include <cmath>
 #include "fht.h"
 
-FHT::FHT(int n) : num_((n < 3) ? 0 : 1 << n), exp2_((n < 3) ? -1 : n) {
+FHT::FHT(int n, Backend backend)
+    : num_((n < 3) ? 0 : 1 << n),
+      exp2_((n < 3) ? -1 : n),
+      backend_(backend) {
   if (n > 3) {
     buf_vector_.resize(num_);
     tab_vector_.resize(num_ * 2);
     makeCasTable();
+
+    if (backend_ == Backend_FFT) fft_.reset(new RealFFT(num_));
   }
 }
 
@@ -55,10 +60,18 @@ void FHT::makeCasTable(void) {
 }
 
 void FHT::scale(float* p, float d) {
+  if (fft_) {
+    fft_->Scale(p, num_ / 2, d);
+    return;
+  }
   for (int i = 0; i < (num_ / 2); i++) *p++ *= d;
 }
 
 void FHT::ewma(float* d, float* s, float w) {
+  if (fft_) {
+    fft_->Ewma(d, s, num_ / 2, w);
+    return;
+  }
   for (int i = 0; i < (num_ / 2); i++, d++, s++) *d = *d * w + *s * (1 - w);
 }
 
@@ -106,6 +119,11 @@ void FHT::power(float* p) {
 }
 
 void FHT::power2(float* p) {
+  if (fft_) {
+    fft_->Power2(p, p);
+    return;
+  }
+
   _transform(p, num_, 0);
 
   *p = static_cast<float>(2 * pow(*p, 2));
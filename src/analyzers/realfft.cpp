@@ -0,0 +1,410 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "realfft.h"
+
+#include <cmath>
+
+// The SIMD kernels are compiled with per-function target attributes so the
+// rest of the program doesn't need to be built with -mavx2.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || __GNUC__ > 4 ||                             \
+     (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+struct RealFFT::Kernels {
+  // Runs one stage of the complex FFT over all n values, combining pairs of
+  // transforms of length m.  wr and wi are the twiddle factors for the stage.
+  void (*stage)(float* re, float* im, int n, int m, const float* wr,
+                const float* wi);
+  // Separates the complex FFT of the packed real input into the spectrum of
+  // the real input and writes its power to out.
+  void (*power)(const float* re, const float* im, const float* pr,
+                const float* pi, int half, float* out);
+  void (*scale)(float* p, int count, float d);
+  void (*ewma)(float* d, const float* s, int count, float w);
+};
+
+namespace {
+
+void StageScalar(float* re, float* im, int n, int m, const float* wr,
+                 const float* wi) {
+  for (int k = 0; k < n; k += 2 * m) {
+    for (int j = 0; j < m; ++j) {
+      const int a = k + j;
+      const int b = a + m;
+      const float tr = re[b] * wr[j] - im[b] * wi[j];
+      const float ti = re[b] * wi[j] + im[b] * wr[j];
+      re[b] = re[a] - tr;
+      im[b] = im[a] - ti;
+      re[a] += tr;
+      im[a] += ti;
+    }
+  }
+}
+
+// Computes the power of bin k.  j is the mirrored bin (half - k) % half.
+inline float PowerOfBin(const float* re, const float* im, const float* pr,
+                        const float* pi, int k, int j) {
+  const float er = (re[k] + re[j]) * 0.5f;
+  const float ei = (im[k] - im[j]) * 0.5f;
+  const float fr = (im[k] + im[j]) * 0.5f;
+  const float fi = (re[j] - re[k]) * 0.5f;
+  const float xr = er + pr[k] * fr - pi[k] * fi;
+  const float xi = ei + pr[k] * fi + pi[k] * fr;
+  return 2 * (xr * xr + xi * xi);
+}
+
+void PowerScalar(const float* re, const float* im, const float* pr,
+                 const float* pi, int half, float* out) {
+  for (int k = 0; k < half; ++k) {
+    out[k] = PowerOfBin(re, im, pr, pi, k, (half - k) & (half - 1));
+  }
+}
+
+void ScaleScalar(float* p, int count, float d) {
+  for (int i = 0; i < count; ++i) p[i] *= d;
+}
+
+void EwmaScalar(float* d, const float* s, int count, float w) {
+  for (int i = 0; i < count; ++i) d[i] = d[i] * w + s[i] * (1 - w);
+}
+
+const RealFFT::Kernels kScalarKernels = {&StageScalar, &PowerScalar,
+                                         &ScaleScalar, &EwmaScalar};
+
+#ifdef HAVE_X86_KERNELS
+
+__attribute__((target("sse2"))) void StageSSE2(float* re, float* im, int n,
+                                               int m, const float* wr,
+                                               const float* wi) {
+  if (m < 4) {
+    StageScalar(re, im, n, m, wr, wi);
+    return;
+  }
+
+  for (int k = 0; k < n; k += 2 * m) {
+    for (int j = 0; j < m; j += 4) {
+      float* ar = re + k + j;
+      float* ai = im + k + j;
+      float* br = ar + m;
+      float* bi = ai + m;
+
+      const __m128 vwr = _mm_loadu_ps(wr + j);
+      const __m128 vwi = _mm_loadu_ps(wi + j);
+      const __m128 vbr = _mm_loadu_ps(br);
+      const __m128 vbi = _mm_loadu_ps(bi);
+      const __m128 var = _mm_loadu_ps(ar);
+      const __m128 vai = _mm_loadu_ps(ai);
+
+      const __m128 tr =
+          _mm_sub_ps(_mm_mul_ps(vbr, vwr), _mm_mul_ps(vbi, vwi));
+      const __m128 ti =
+          _mm_add_ps(_mm_mul_ps(vbr, vwi), _mm_mul_ps(vbi, vwr));
+
+      _mm_storeu_ps(br, _mm_sub_ps(var, tr));
+      _mm_storeu_ps(bi, _mm_sub_ps(vai, ti));
+      _mm_storeu_ps(ar, _mm_add_ps(var, tr));
+      _mm_storeu_ps(ai, _mm_add_ps(vai, ti));
+    }
+  }
+}
+
+__attribute__((target("sse2"))) inline __m128 ReverseSSE2(__m128 v) {
+  return _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 1, 2, 3));
+}
+
+__attribute__((target("sse2"))) void PowerSSE2(const float* re,
+                                               const float* im,
+                                               const float* pr,
+                                               const float* pi, int half,
+                                               float* out) {
+  const __m128 v_half = _mm_set1_ps(0.5f);
+  const __m128 v_two = _mm_set1_ps(2.0f);
+
+  out[0] = PowerOfBin(re, im, pr, pi, 0, 0);
+
+  // Bins k..k+3 are paired with half-k..half-k-3, which are loaded in one go
+  // and reversed.
+  int k = 1;
+  for (; k + 4 <= half; k += 4) {
+    const int j = half - k - 3;
+    const __m128 rk = _mm_loadu_ps(re + k);
+    const __m128 ik = _mm_loadu_ps(im + k);
+    const __m128 rj = ReverseSSE2(_mm_loadu_ps(re + j));
+    const __m128 ij = ReverseSSE2(_mm_loadu_ps(im + j));
+    const __m128 vpr = _mm_loadu_ps(pr + k);
+    const __m128 vpi = _mm_loadu_ps(pi + k);
+
+    const __m128 er = _mm_mul_ps(_mm_add_ps(rk, rj), v_half);
+    const __m128 ei = _mm_mul_ps(_mm_sub_ps(ik, ij), v_half);
+    const __m128 fr = _mm_mul_ps(_mm_add_ps(ik, ij), v_half);
+    const __m128 fi = _mm_mul_ps(_mm_sub_ps(rj, rk), v_half);
+
+    const __m128 xr = _mm_add_ps(
+        er, _mm_sub_ps(_mm_mul_ps(vpr, fr), _mm_mul_ps(vpi, fi)));
+    const __m128 xi = _mm_add_ps(
+        ei, _mm_add_ps(_mm_mul_ps(vpr, fi), _mm_mul_ps(vpi, fr)));
+
+    _mm_storeu_ps(out + k,
+                  _mm_mul_ps(v_two, _mm_add_ps(_mm_mul_ps(xr, xr),
+                                               _mm_mul_ps(xi, xi))));
+  }
+
+  for (; k < half; ++k) {
+    out[k] = PowerOfBin(re, im, pr, pi, k, half - k);
+  }
+}
+
+__attribute__((target("sse2"))) void ScaleSSE2(float* p, int count, float d) {
+  const __m128 vd = _mm_set1_ps(d);
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    _mm_storeu_ps(p + i, _mm_mul_ps(_mm_loadu_ps(p + i), vd));
+  }
+  ScaleScalar(p + i, count - i, d);
+}
+
+__attribute__((target("sse2"))) void EwmaSSE2(float* d, const float* s,
+                                              int count, float w) {
+  const __m128 vw = _mm_set1_ps(w);
+  const __m128 vw1 = _mm_set1_ps(1 - w);
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    _mm_storeu_ps(d + i, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(d + i), vw),
+                                    _mm_mul_ps(_mm_loadu_ps(s + i), vw1)));
+  }
+  EwmaScalar(d + i, s + i, count - i, w);
+}
+
+__attribute__((target("avx2"))) void StageAVX2(float* re, float* im, int n,
+                                               int m, const float* wr,
+                                               const float* wi) {
+  if (m < 8) {
+    StageSSE2(re, im, n, m, wr, wi);
+    return;
+  }
+
+  for (int k = 0; k < n; k += 2 * m) {
+    for (int j = 0; j < m; j += 8) {
+      float* ar = re + k + j;
+      float* ai = im + k + j;
+      float* br = ar + m;
+      float* bi = ai + m;
+
+      const __m256 vwr = _mm256_loadu_ps(wr + j);
+      const __m256 vwi = _mm256_loadu_ps(wi + j);
+      const __m256 vbr = _mm256_loadu_ps(br);
+      const __m256 vbi = _mm256_loadu_ps(bi);
+      const __m256 var = _mm256_loadu_ps(ar);
+      const __m256 vai = _mm256_loadu_ps(ai);
+
+      const __m256 tr =
+          _mm256_sub_ps(_mm256_mul_ps(vbr, vwr), _mm256_mul_ps(vbi, vwi));
+      const __m256 ti =
+          _mm256_add_ps(_mm256_mul_ps(vbr, vwi), _mm256_mul_ps(vbi, vwr));
+
+      _mm256_storeu_ps(br, _mm256_sub_ps(var, tr));
+      _mm256_storeu_ps(bi, _mm256_sub_ps(vai, ti));
+      _mm256_storeu_ps(ar, _mm256_add_ps(var, tr));
+      _mm256_storeu_ps(ai, _mm256_add_ps(vai, ti));
+    }
+  }
+}
+
+__attribute__((target("avx2"))) inline __m256 ReverseAVX2(__m256 v) {
+  const __m256 swapped = _mm256_permute_ps(v, _MM_SHUFFLE(0, 1, 2, 3));
+  return _mm256_permute2f128_ps(swapped, swapped, 1);
+}
+
+__attribute__((target("avx2"))) void PowerAVX2(const float* re,
+                                               const float* im,
+                                               const float* pr,
+                                               const float* pi, int half,
+                                               float* out) {
+  const __m256 v_half = _mm256_set1_ps(0.5f);
+  const __m256 v_two = _mm256_set1_ps(2.0f);
+
+  out[0] = PowerOfBin(re, im, pr, pi, 0, 0);
+
+  int k = 1;
+  for (; k + 8 <= half; k += 8) {
+    const int j = half - k - 7;
+    const __m256 rk = _mm256_loadu_ps(re + k);
+    const __m256 ik = _mm256_loadu_ps(im + k);
+    const __m256 rj = ReverseAVX2(_mm256_loadu_ps(re + j));
+    const __m256 ij = ReverseAVX2(_mm256_loadu_ps(im + j));
+    const __m256 vpr = _mm256_loadu_ps(pr + k);
+    const __m256 vpi = _mm256_loadu_ps(pi + k);
+
+    const __m256 er = _mm256_mul_ps(_mm256_add_ps(rk, rj), v_half);
+    const __m256 ei = _mm256_mul_ps(_mm256_sub_ps(ik, ij), v_half);
+    const __m256 fr = _mm256_mul_ps(_mm256_add_ps(ik, ij), v_half);
+    const __m256 fi = _mm256_mul_ps(_mm256_sub_ps(rj, rk), v_half);
+
+    const __m256 xr = _mm256_add_ps(
+        er, _mm256_sub_ps(_mm256_mul_ps(vpr, fr), _mm256_mul_ps(vpi, fi)));
+    const __m256 xi = _mm256_add_ps(
+        ei, _mm256_add_ps(_mm256_mul_ps(vpr, fi), _mm256_mul_ps(vpi, fr)));
+
+    _mm256_storeu_ps(
+        out + k, _mm256_mul_ps(v_two, _mm256_add_ps(_mm256_mul_ps(xr, xr),
+                                                    _mm256_mul_ps(xi, xi))));
+  }
+
+  for (; k < half; ++k) {
+    out[k] = PowerOfBin(re, im, pr, pi, k, half - k);
+  }
+}
+
+__attribute__((target("avx2"))) void ScaleAVX2(float* p, int count, float d) {
+  const __m256 vd = _mm256_set1_ps(d);
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    _mm256_storeu_ps(p + i, _mm256_mul_ps(_mm256_loadu_ps(p + i), vd));
+  }
+  ScaleSSE2(p + i, count - i, d);
+}
+
+__attribute__((target("avx2"))) void EwmaAVX2(float* d, const float* s,
+                                              int count, float w) {
+  const __m256 vw = _mm256_set1_ps(w);
+  const __m256 vw1 = _mm256_set1_ps(1 - w);
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    _mm256_storeu_ps(
+        d + i, _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(d + i), vw),
+                             _mm256_mul_ps(_mm256_loadu_ps(s + i), vw1)));
+  }
+  EwmaSSE2(d + i, s + i, count - i, w);
+}
+
+const RealFFT::Kernels kSSE2Kernels = {&StageSSE2, &PowerSSE2, &ScaleSSE2,
+                                       &EwmaSSE2};
+const RealFFT::Kernels kAVX2Kernels = {&StageAVX2, &PowerAVX2, &ScaleAVX2,
+                                       &EwmaAVX2};
+
+#endif  // HAVE_X86_KERNELS
+
+}  // namespace
+
+RealFFT::RealFFT(int size, Kernel kernel)
+    : size_(size),
+      half_(size / 2),
+      kernel_(kernel),
+      kernels_(&kScalarKernels),
+      bit_reverse_(half_),
+      twiddle_re_(half_),
+      twiddle_im_(half_),
+      post_re_(half_),
+      post_im_(half_),
+      re_(half_),
+      im_(half_) {
+  if (kernel_ == Kernel_Auto) {
+    if (IsSupported(Kernel_AVX2)) {
+      kernel_ = Kernel_AVX2;
+    } else if (IsSupported(Kernel_SSE2)) {
+      kernel_ = Kernel_SSE2;
+    } else {
+      kernel_ = Kernel_Scalar;
+    }
+  } else if (!IsSupported(kernel_)) {
+    kernel_ = Kernel_Scalar;
+  }
+
+#ifdef HAVE_X86_KERNELS
+  if (kernel_ == Kernel_AVX2) {
+    kernels_ = &kAVX2Kernels;
+  } else if (kernel_ == Kernel_SSE2) {
+    kernels_ = &kSSE2Kernels;
+  }
+#endif
+
+  int bits = 0;
+  while ((1 << bits) < half_) ++bits;
+
+  for (int i = 0; i < half_; ++i) {
+    int reversed = 0;
+    for (int b = 0; b < bits; ++b) {
+      if (i & (1 << b)) reversed |= 1 << (bits - 1 - b);
+    }
+    bit_reverse_[i] = reversed;
+  }
+
+  for (int m = 1; m < half_; m <<= 1) {
+    for (int j = 0; j < m; ++j) {
+      const double angle = -M_PI * j / m;
+      twiddle_re_[m + j] = cos(angle);
+      twiddle_im_[m + j] = sin(angle);
+    }
+  }
+
+  for (int k = 0; k < half_; ++k) {
+    const double angle = -2 * M_PI * k / size_;
+    post_re_[k] = cos(angle);
+    post_im_[k] = sin(angle);
+  }
+}
+
+bool RealFFT::IsSupported(Kernel kernel) {
+  switch (kernel) {
+    case Kernel_Auto:
+    case Kernel_Scalar:
+      return true;
+
+#ifdef HAVE_X86_KERNELS
+    case Kernel_SSE2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("sse2");
+    case Kernel_AVX2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2");
+#endif
+
+    default:
+      return false;
+  }
+}
+
+void RealFFT::Power2(const float* in, float* out) {
+  float* re = re_.data();
+  float* im = im_.data();
+  const int* bit_reverse = bit_reverse_.constData();
+
+  // Pack pairs of real samples into complex values, in bit reversed order.
+  for (int i = 0; i < half_; ++i) {
+    re[bit_reverse[i]] = in[2 * i];
+    im[bit_reverse[i]] = in[2 * i + 1];
+  }
+
+  for (int m = 1; m < half_; m <<= 1) {
+    kernels_->stage(re, im, half_, m, twiddle_re_.constData() + m,
+                    twiddle_im_.constData() + m);
+  }
+
+  kernels_->power(re, im, post_re_.constData(), post_im_.constData(), half_,
+                  out);
+}
+
+void RealFFT::Scale(float* p, int count, float d) const {
+  kernels_->scale(p, count, d);
+}
+
+void RealFFT::Ewma(float* d, const float* s, int count, float w) const {
+  kernels_->ewma(d, s, count, w);
+}
@@ -0,0 +1,76 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ANALYZERS_REALFFT_H_
+#define ANALYZERS_REALFFT_H_
+
+#include <QVector>
+
+// Iterative radix-2 FFT of real input, used by FHT to compute power spectra.
+// The N real samples are packed into an N/2 point complex FFT and the halves
+// are separated again afterwards.  The butterflies, the final power
+// computation and the scale/ewma helpers have SSE2 and AVX2 versions that are
+// picked at runtime depending on what the CPU supports.
+class RealFFT {
+ public:
+  enum Kernel {
+    Kernel_Auto,
+    Kernel_Scalar,
+    Kernel_SSE2,
+    Kernel_AVX2,
+  };
+
+  // size must be a power of two and at least 16.  Kernel_Auto picks the best
+  // kernel the CPU supports; asking for an unsupported one falls back to
+  // Kernel_Scalar.
+  RealFFT(int size, Kernel kernel = Kernel_Auto);
+
+  int size() const { return size_; }
+  Kernel kernel() const { return kernel_; }
+
+  static bool IsSupported(Kernel kernel);
+
+  // Writes 2 * |X[k]|^2 for the size()/2 lowest frequencies of in to out -
+  // the same values as FHT::power2.  in and out may be the same array.
+  void Power2(const float* in, float* out);
+
+  // p[i] *= d for count values.
+  void Scale(float* p, int count, float d) const;
+  // d[i] = d[i] * w + s[i] * (1 - w) for count values.
+  void Ewma(float* d, const float* s, int count, float w) const;
+
+  struct Kernels;
+
+ private:
+  const int size_;
+  const int half_;
+  Kernel kernel_;
+  const Kernels* kernels_;
+
+  QVector<int> bit_reverse_;
+  // Twiddle factors for the complex FFT.  The ones for the stage that combines
+  // transforms of length m start at index m.
+  QVector<float> twiddle_re_;
+  QVector<float> twiddle_im_;
+  // exp(-2 pi i k / size) for separating the real transform.
+  QVector<float> post_re_;
+  QVector<float> post_im_;
+
+  QVector<float> re_;
+  QVector<float> im_;
+};
+
+#endif  // ANALYZERS_REALFFT_H_
@@ -39,6 +39,7 @@
 #include <QDir>
 #include <QLibrary>
 #include <QLibraryInfo>
+#include <QSettings>
 #include <QSqlDriver>
 #include <QSqlQuery>
 #include <QtDebug>
@@ -47,8 +48,9 @@
 #include <QVariant>
 
 const char* Database::kDatabaseFilename = "clementine.db";
-const int Database::kSchemaVersion = 51;
+const int Database::kSchemaVersion = 57;
 const char* Database::kMagicAllSongsTables = "%allsongstables";
+const char* Database::kSettingsGroup = "Database";
 
 int Database::sNextConnectionId = 1;
 QMutex Database::sNextConnectionIdMutex;
@@ -211,7 +213,12 @@ Database::Database(Application* app, QObject* parent,
                    const QString& database_name)
     : QObject(parent),
       app_(app),
+      replace_generation_(0),
       mutex_(QMutex::Recursive),
+      wal_(false),
+      cache_size_(0),
+      mmap_size_(0),
+      concurrent_reads_(false),
       injected_database_name_(database_name),
       query_hash_(0),
       startup_schema_version_(-1) {
@@ -220,6 +227,8 @@ Database::Database(Application* app, QObject* parent,
     connection_id_ = sNextConnectionId++;
   }
 
+  ReloadSettings();
+
   directory_ =
       QDir::toNativeSeparators(Utilities::GetConfigPath(Utilities::Path_Root));
 
@@ -246,63 +255,35 @@ QSqlDatabase Database::Connect() {
   // Try to find an existing connection for this thread
   QSqlDatabase db = QSqlDatabase::database(connection_id);
   if (db.isOpen()) {
+    ReattachReplacedDatabases(db, false);
     return db;
   }
 
   db = QSqlDatabase::addDatabase("QSQLITE", connection_id);
-
-  if (!injected_database_name_.isNull())
-    db.setDatabaseName(injected_database_name_);
-  else
-    db.setDatabaseName(directory_ + "/" + kDatabaseFilename);
-
-  if (!db.open()) {
-    app_->AddError("Database: " + db.lastError().text());
+  if (!OpenConnection(db)) {
     return db;
   }
 
-  // Find Sqlite3 functions in the Qt plugin.
-  StaticInit();
-
-  {
-    QSqlQuery set_fts_tokenizer("SELECT fts3_tokenizer(:name, :pointer)", db);
-    set_fts_tokenizer.bindValue(":name", "unicode");
-    set_fts_tokenizer.bindValue(
-        ":pointer", QByteArray(reinterpret_cast<const char*>(&sFTSTokenizer),
-                               sizeof(&sFTSTokenizer)));
-    if (!set_fts_tokenizer.exec()) {
-      qLog(Warning) << "Couldn't register FTS3 tokenizer";
-    }
-    // Implicit invocation of ~QSqlQuery() when leaving the scope
-    // to release any remaining database locks!
-  }
-
   if (db.tables().count() == 0) {
     // Set up initial schema
     qLog(Info) << "Creating initial database schema";
     UpdateDatabaseSchema(0, db);
   }
 
-  // Attach external databases
-  for (const QString& key : attached_databases_.keys()) {
-    QString filename = attached_databases_[key].filename_;
-
-    if (!injected_database_name_.isNull()) filename = injected_database_name_;
-
-    // Attach the db
-    QSqlQuery q("ATTACH DATABASE :filename AS :alias", db);
-    q.bindValue(":filename", filename);
-    q.bindValue(":alias", key);
-    if (!q.exec()) {
-      qFatal("Couldn't attach external database '%s'",
-             key.toAscii().constData());
-    }
-  }
+  AttachDatabases(db, false);
+  SetPragmas(db, false);
+  connection_generations_[connection_id] = replace_generation_;
 
   if (startup_schema_version_ == -1) {
     UpdateMainSchema(&db);
   }
 
+  InitAttachedSchemas(db);
+
+  return db;
+}
+
+void Database::InitAttachedSchemas(QSqlDatabase& db) {
   // We might have to initialise the schema in some attached databases now, if
   // they were deleted and don't match up with the main schema version.
   for (const QString& key : attached_databases_.keys()) {
@@ -319,10 +300,202 @@ QSqlDatabase Database::Connect() {
       ExecSchemaCommandsFromFile(db, attached_databases_[key].schema_, 0);
     }
   }
+}
+
+QSqlDatabase Database::ConnectReadOnly() {
+  if (!concurrent_reads_) {
+    return Connect();
+  }
+
+  // The constructor has already created the schema and any attached
+  // databases through a writer connection, so this thread doesn't need one.
+  QMutexLocker l(&connect_mutex_);
+
+  const QString connection_id =
+      QString("%1_thread_%2_readonly")
+          .arg(connection_id_)
+          .arg(reinterpret_cast<quint64>(QThread::currentThread()));
+
+  // Try to find an existing connection for this thread
+  QSqlDatabase db = QSqlDatabase::database(connection_id);
+  if (db.isOpen()) {
+    ReattachReplacedDatabases(db, true);
+    return db;
+  }
+
+  db = QSqlDatabase::addDatabase("QSQLITE", connection_id);
+  db.setConnectOptions("QSQLITE_OPEN_READONLY");
+  if (!OpenConnection(db)) {
+    return db;
+  }
+
+  AttachDatabases(db, true);
+  SetPragmas(db, true);
+  connection_generations_[connection_id] = replace_generation_;
 
   return db;
 }
 
+void Database::ReloadSettings() {
+  QSettings s;
+  s.beginGroup(kSettingsGroup);
+  // WAL changes the on-disk format and adds -wal and -shm files next to the
+  // database, so it has to be turned on.
+  wal_ = s.value("wal", false).toBool();
+  // Zero or empty values leave SQLite's defaults alone.  synchronous=NORMAL is
+  // safe from corruption in WAL mode and much quicker than FULL, but the last
+  // transactions can be lost in a power cut, so that's opt-in as well.
+  cache_size_ = s.value("cache_size", 0).toInt();
+  mmap_size_ = s.value("mmap_size", 0).toLongLong();
+  synchronous_ = s.value("synchronous").toString();
+
+  // Each connection to an in-memory database gets a different database, so
+  // they can't have separate read-only connections.
+  concurrent_reads_ = wal_ && injected_database_name_ != ":memory:";
+}
+
+bool Database::OpenConnection(QSqlDatabase& db) {
+  if (!injected_database_name_.isNull())
+    db.setDatabaseName(injected_database_name_);
+  else
+    db.setDatabaseName(directory_ + "/" + kDatabaseFilename);
+
+  if (!db.open()) {
+    app_->AddError("Database: " + db.lastError().text());
+    return false;
+  }
+
+  // Find Sqlite3 functions in the Qt plugin.
+  StaticInit();
+
+  RegisterTokenizer(db);
+  return true;
+}
+
+void Database::RegisterTokenizer(QSqlDatabase& db) {
+  QSqlQuery set_fts_tokenizer("SELECT fts3_tokenizer(:name, :pointer)", db);
+  set_fts_tokenizer.bindValue(":name", "unicode");
+  set_fts_tokenizer.bindValue(
+      ":pointer", QByteArray(reinterpret_cast<const char*>(&sFTSTokenizer),
+                             sizeof(&sFTSTokenizer)));
+  if (!set_fts_tokenizer.exec()) {
+    qLog(Warning) << "Couldn't register FTS3 tokenizer";
+  }
+}
+
+QString Database::AttachedDbFilename(const QString& database_name) const {
+  const QString filename = attached_databases_.value(database_name).filename_;
+
+  // Tests use their own database instead of the ones in the config directory.
+  if (!injected_database_name_.isNull() && filename.startsWith(directory_)) {
+    return injected_database_name_;
+  }
+  return filename;
+}
+
+void Database::AttachDatabases(QSqlDatabase& db, bool read_only) {
+  // Attach external databases
+  for (const QString& key : attached_databases_.keys()) {
+    AttachDatabaseFile(db, key, read_only);
+  }
+}
+
+bool Database::AttachDatabaseFile(QSqlDatabase& db,
+                                  const QString& database_name,
+                                  bool read_only) {
+  const QString filename = AttachedDbFilename(database_name);
+
+  // Attach the db
+  QSqlQuery q("ATTACH DATABASE :filename AS :alias", db);
+  q.bindValue(":filename", filename);
+  q.bindValue(":alias", database_name);
+  if (!q.exec()) {
+    qLog(Error) << "Couldn't attach external database" << database_name
+                << filename << q.lastError().text();
+    if (read_only) {
+      // Readers can't create a database that doesn't exist yet.  Queries on
+      // its tables will fail on this connection, but the rest of the database
+      // can still be read.
+      return false;
+    }
+    qFatal("Couldn't attach external database '%s'",
+           database_name.toAscii().constData());
+  }
+  return true;
+}
+
+void Database::ReattachReplacedDatabases(QSqlDatabase& db, bool read_only) {
+  const int seen = connection_generations_.value(db.connectionName());
+  if (seen == replace_generation_) return;
+
+  QStringList attached;
+  {
+    QSqlQuery q("PRAGMA database_list", db);
+    if (!q.exec()) return;
+    while (q.next()) attached << q.value(1).toString();
+  }
+
+  bool ok = true;
+  for (const QString& key : database_generations_.keys()) {
+    if (database_generations_[key] <= seen ||
+        !attached_databases_.contains(key)) {
+      continue;
+    }
+
+    if (attached.contains(key)) {
+      // This fails while the connection is in a transaction, so it's tried
+      // again the next time the thread connects.
+      QSqlQuery q("DETACH DATABASE :alias", db);
+      q.bindValue(":alias", key);
+      if (!q.exec()) {
+        qLog(Warning) << "Failed to detach database" << key
+                      << q.lastError().text();
+        ok = false;
+        continue;
+      }
+    }
+
+    if (!AttachDatabaseFile(db, key, read_only)) ok = false;
+  }
+  if (!ok) return;
+
+  // The new files need the same settings as the old ones, and the writer
+  // creates the schema in any that were recreated empty.
+  SetPragmas(db, read_only);
+  if (!read_only) InitAttachedSchemas(db);
+
+  connection_generations_[db.connectionName()] = replace_generation_;
+}
+
+void Database::SetPragmas(QSqlDatabase& db, bool read_only) {
+  QStringList pragmas;
+
+  // The journal mode is stored in the database file, so only the writer sets
+  // it.  Without a schema name it applies to the attached databases too.
+  // Turning WAL off again puts the files back in the default rollback journal
+  // mode.
+  if (!read_only && injected_database_name_ != ":memory:") {
+    pragmas << QString("PRAGMA journal_mode = %1")
+                   .arg(concurrent_reads_ ? "WAL" : "DELETE");
+  }
+  if (!synchronous_.isEmpty() && !read_only) {
+    pragmas << QString("PRAGMA synchronous = %1").arg(synchronous_);
+  }
+  if (cache_size_ != 0) {
+    pragmas << QString("PRAGMA cache_size = %1").arg(cache_size_);
+  }
+  if (mmap_size_ != 0) {
+    pragmas << QString("PRAGMA mmap_size = %1").arg(mmap_size_);
+  }
+
+  for (const QString& pragma : pragmas) {
+    QSqlQuery q(db);
+    if (!q.exec(pragma)) {
+      qLog(Warning) << "Couldn't set" << pragma << q.lastError().text();
+    }
+  }
+}
+
 void Database::UpdateMainSchema(QSqlDatabase* db) {
   // Get the database's schema version
   int schema_version = 0;
@@ -349,35 +522,85 @@ void Database::UpdateMainSchema(QSqlDatabase* db) {
 }
 
 void Database::RecreateAttachedDb(const QString& database_name) {
+  // With nothing to replace it with, Connect() creates an empty one.
+  ReplaceAttachedDb(database_name, QString());
+}
+
+bool Database::ReplaceAttachedDb(const QString& database_name,
+                                 const QString& new_filename) {
   if (!attached_databases_.contains(database_name)) {
     qLog(Warning) << "Attached database does not exist:" << database_name;
-    return;
+    return false;
   }
 
-  const QString filename = attached_databases_[database_name].filename_;
+  const QString filename = AttachedDbFilename(database_name);
 
   QMutexLocker l(&mutex_);
+  bool ok = true;
   {
     QSqlDatabase db(Connect());
 
+    // Other connections keep using the old file until they attach it again.
+    // Emptying the WAL first means they only need the file itself.
+    QSqlQuery checkpoint(
+        QString("PRAGMA %1.wal_checkpoint(TRUNCATE)").arg(database_name), db);
+    if (!checkpoint.exec()) {
+      qLog(Warning) << "Failed to checkpoint database" << database_name
+                    << checkpoint.lastError().text();
+    }
+    checkpoint.finish();
+
     QSqlQuery q("DETACH DATABASE :alias", db);
     q.bindValue(":alias", database_name);
     if (!q.exec()) {
       qLog(Warning) << "Failed to detach database" << database_name;
-      return;
+      return false;
+    }
+
+    // Windows can't delete a file another connection still has open, so the
+    // old database stays where it is and the caller has to fall back to
+    // replacing its rows instead.
+    if (!RemoveDatabaseFiles(filename)) {
+      AttachDatabaseFile(db, database_name, false);
+      SetPragmas(db, false);
+      return false;
     }
 
-    if (!QFile::remove(filename)) {
-      qLog(Warning) << "Failed to remove file" << filename;
+    if (!new_filename.isEmpty() && !QFile::rename(new_filename, filename)) {
+      qLog(Warning) << "Failed to rename" << new_filename << "to" << filename;
+      ok = false;
     }
   }
 
-  // We can't just re-attach the database now because it needs to be done for
-  // each thread.  Close all the database connections, so each thread will
-  // re-attach it when they next connect.
-  for (const QString& name : QSqlDatabase::connectionNames()) {
-    QSqlDatabase::removeDatabase(name);
+  {
+    QMutexLocker connect_lock(&connect_mutex_);
+    database_generations_[database_name] = ++replace_generation_;
+  }
+
+  // A connection can only be used by the thread that made it, so this one
+  // attaches the new file now and the others do it when they next connect.
+  Connect();
+  return ok;
+}
+
+bool Database::RemoveDatabaseFiles(const QString& filename) {
+  if (QFile::exists(filename) && !QFile::remove(filename)) {
+    // The journal files still belong to the database, so leave them alone.
+    qLog(Warning) << "Failed to remove file" << filename;
+    return false;
+  }
+
+  // A WAL left behind would be replayed into whatever database is created
+  // with this name next.
+  for (const QString& suffix : QStringList() << "-wal"
+                                             << "-shm"
+                                             << "-journal") {
+    const QString sidecar = filename + suffix;
+    if (QFile::exists(sidecar) && !QFile::remove(sidecar)) {
+      qLog(Warning) << "Failed to remove file" << sidecar;
+    }
   }
+  return true;
 }
 
 void Database::AttachDatabase(const QString& database_name,
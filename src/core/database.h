@@ -64,12 +64,34 @@ class Database : public QObject {
   static const int kSchemaVersion;
   static const char* kDatabaseFilename;
   static const char* kMagicAllSongsTables;
+  static const char* kSettingsGroup;
 
+  // Returns this thread's connection.  Anything that writes to the database
+  // must hold Mutex() while it uses the connection, so writers are serialized.
   QSqlDatabase Connect();
   bool CheckErrors(const QSqlQuery& query);
   QMutex* Mutex() { return &mutex_; }
 
+  // Returns a connection for queries that only read from the database, and
+  // the mutex to hold while using it.  When concurrent reads are enabled
+  // this is a separate read-only connection for this thread, and the mutex is
+  // NULL - in WAL mode readers don't have to wait for a writer to finish.
+  // Otherwise this is the same as Connect() and Mutex().
+  QSqlDatabase ConnectReadOnly();
+  QMutex* ReadMutex() { return concurrent_reads_ ? nullptr : &mutex_; }
+  bool concurrent_reads() const { return concurrent_reads_; }
+
+  // Deletes an attached database and creates an empty one in its place.
   void RecreateAttachedDb(const QString& database_name);
+  // Replaces the file of an attached database with another one, which
+  // mustn't be attached to any connection.  This thread's connection sees
+  // the new database straight away, and every other connection attaches it
+  // again the next time its thread connects.  The old file can only be
+  // removed while other connections have it open on POSIX systems; where it
+  // can't be, this returns false and leaves the old database attached.
+  bool ReplaceAttachedDb(const QString& database_name,
+                         const QString& new_filename);
+  QString AttachedDbFilename(const QString& database_name) const;
   void ExecSchemaCommands(QSqlDatabase& db, const QString& schema,
                           int schema_version, bool in_transaction = false);
 
@@ -92,6 +114,22 @@ class Database : public QObject {
  private:
   void UpdateMainSchema(QSqlDatabase* db);
 
+  // Removes a database file and the journal files SQLite keeps next to it.
+  // Returns false if the database file itself couldn't be removed.
+  static bool RemoveDatabaseFiles(const QString& filename);
+
+  void ReloadSettings();
+  bool OpenConnection(QSqlDatabase& db);
+  void RegisterTokenizer(QSqlDatabase& db);
+  void AttachDatabases(QSqlDatabase& db, bool read_only);
+  bool AttachDatabaseFile(QSqlDatabase& db, const QString& database_name,
+                          bool read_only);
+  void InitAttachedSchemas(QSqlDatabase& db);
+  void SetPragmas(QSqlDatabase& db, bool read_only);
+  // Attaches the databases whose files were replaced since this connection
+  // last attached them.  Called with connect_mutex_ held.
+  void ReattachReplacedDatabases(QSqlDatabase& db, bool read_only);
+
   void ExecSchemaCommandsFromFile(QSqlDatabase& db, const QString& filename,
                                   int schema_version,
                                   bool in_transaction = false);
@@ -110,10 +148,24 @@ class Database : public QObject {
   // Alias -> filename
   QMap<QString, AttachedDatabase> attached_databases_;
 
+  // ReplaceAttachedDb counts the files it replaces, and remembers which
+  // replacement each database last had and which one each connection has
+  // seen.  Guarded by connect_mutex_.
+  int replace_generation_;
+  QMap<QString, int> database_generations_;
+  QMap<QString, int> connection_generations_;
+
   QString directory_;
   QMutex connect_mutex_;
   QMutex mutex_;
 
+  // Connection settings, see ReloadSettings().
+  bool wal_;
+  int cache_size_;
+  qint64 mmap_size_;
+  QString synchronous_;
+  bool concurrent_reads_;
+
   // This ID makes the QSqlDatabase name unique to the object as well as the
   // thread
   int connection_id_;
@@ -0,0 +1,245 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "filecopier.h"
+
+#include <memory>
+
+#include <QAtomicInt>
+#include <QFile>
+
+#include "core/logging.h"
+
+#ifdef Q_OS_LINUX
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Big enough that the kernel copies aren't slowed down by the number of
+// calls, small enough that progress is updated a few times a second on a slow
+// disk.
+const qint64 FileCopier::kChunkSize = 8 * 1024 * 1024;  // 8MB
+
+namespace {
+
+const qint64 kBufferSize = 1024 * 1024;  // 1MB
+
+QAtomicInt sFirstMethod(FileCopier::Method_Clone);
+
+void ReportProgress(const FileCopier::ProgressFunction& progress,
+                    qint64 copied, qint64 total) {
+  if (progress) progress(copied, total);
+}
+
+#ifndef Q_OS_LINUX
+bool CopyWithQFile(const QString& source, const QString& destination,
+                   const FileCopier::ProgressFunction& progress) {
+  QFile in(source);
+  QFile out(destination);
+  if (out.exists()) return false;
+  if (!in.open(QIODevice::ReadOnly) || !out.open(QIODevice::WriteOnly)) {
+    return false;
+  }
+
+  const qint64 total = in.size();
+  qint64 copied = 0;
+  std::unique_ptr<char[]> buffer(new char[kBufferSize]);
+
+  forever {
+    const qint64 bytes_read = in.read(buffer.get(), kBufferSize);
+    if (bytes_read == 0) break;
+    if (bytes_read == -1 || out.write(buffer.get(), bytes_read) != bytes_read) {
+      out.remove();
+      return false;
+    }
+
+    copied += bytes_read;
+    ReportProgress(progress, copied, total);
+  }
+
+  out.setPermissions(in.permissions());
+  return true;
+}
+#endif  // Q_OS_LINUX
+
+#ifdef Q_OS_LINUX
+
+// errno values that mean the method isn't supported for these files, rather
+// than that the copy failed.
+bool IsUnsupported(int error) {
+  return error == ENOSYS || error == EXDEV || error == EINVAL ||
+         error == EOPNOTSUPP || error == ENOTTY || error == EBADF ||
+         error == ETXTBSY;
+}
+
+// These copy from the current offset of in to the current offset of
+// out and advance them, so a method can take over part way through from the
+// one before it.
+ssize_t CopyFileRange(int in, int out, size_t count) {
+#ifdef SYS_copy_file_range
+  return syscall(SYS_copy_file_range, in, nullptr, out, nullptr, count, 0);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+ssize_t Sendfile(int in, int out, size_t count) {
+  return sendfile(out, in, nullptr, count);
+}
+
+bool ReadWrite(int in, int out, qint64 copied, qint64 total,
+               const FileCopier::ProgressFunction& progress) {
+  std::unique_ptr<char[]> buffer(new char[kBufferSize]);
+
+  forever {
+    const ssize_t bytes_read = read(in, buffer.get(), kBufferSize);
+    if (bytes_read == 0) return true;
+    if (bytes_read == -1) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+
+    ssize_t written = 0;
+    while (written < bytes_read) {
+      const ssize_t ret =
+          write(out, buffer.get() + written, bytes_read - written);
+      if (ret == -1) {
+        if (errno == EINTR) continue;
+        return false;
+      }
+      written += ret;
+    }
+
+    copied += bytes_read;
+    ReportProgress(progress, copied, total);
+  }
+}
+
+bool CopyFds(int in, int out, qint64 total,
+             const FileCopier::ProgressFunction& progress,
+             FileCopier::Method* method) {
+  const int first_method = sFirstMethod;
+
+#ifdef FICLONE
+  if (first_method <= FileCopier::Method_Clone && total > 0 &&
+      ioctl(out, FICLONE, in) == 0) {
+    *method = FileCopier::Method_Clone;
+    ReportProgress(progress, total, total);
+    return true;
+  }
+#endif
+
+  typedef ssize_t (*CopyFunction)(int, int, size_t);
+  struct {
+    FileCopier::Method method_;
+    CopyFunction function_;
+  } kernel_methods[] = {
+      {FileCopier::Method_CopyFileRange, &CopyFileRange},
+      {FileCopier::Method_Sendfile, &Sendfile},
+  };
+
+  qint64 copied = 0;
+  for (const auto& m : kernel_methods) {
+    if (m.method_ < first_method) continue;
+    *method = m.method_;
+
+    forever {
+      const ssize_t ret = m.function_(in, out, FileCopier::kChunkSize);
+      if (ret == 0) return true;
+      if (ret == -1) {
+        if (errno == EINTR) continue;
+        if (IsUnsupported(errno)) break;  // Try the next one
+
+        qLog(Warning) << "Copy failed:" << strerror(errno);
+        return false;
+      }
+
+      copied += ret;
+      ReportProgress(progress, copied, total);
+    }
+  }
+
+  *method = FileCopier::Method_ReadWrite;
+  if (!ReadWrite(in, out, copied, total, progress)) {
+    qLog(Warning) << "Copy failed:" << strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+bool CopyLinux(const QString& source, const QString& destination,
+               const FileCopier::ProgressFunction& progress,
+               FileCopier::Method* method) {
+  const QByteArray source_name = QFile::encodeName(source);
+  const QByteArray destination_name = QFile::encodeName(destination);
+
+  const int in = open(source_name.constData(), O_RDONLY | O_CLOEXEC);
+  if (in == -1) {
+    qLog(Warning) << "Couldn't open" << source << strerror(errno);
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(in, &st) == -1) {
+    close(in);
+    return false;
+  }
+
+  const int out = open(destination_name.constData(),
+                       O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                       st.st_mode & 0777);
+  if (out == -1) {
+    qLog(Warning) << "Couldn't create" << destination << strerror(errno);
+    close(in);
+    return false;
+  }
+
+  bool ok = CopyFds(in, out, st.st_size, progress, method);
+  if (ok) fchmod(out, st.st_mode & 07777);
+
+  close(in);
+  if (close(out) == -1) ok = false;
+
+  if (!ok) unlink(destination_name.constData());
+  return ok;
+}
+
+#endif  // Q_OS_LINUX
+
+}  // namespace
+
+bool FileCopier::Copy(const QString& source, const QString& destination,
+                      const ProgressFunction& progress, Method* method) {
+  Method method_used = Method_ReadWrite;
+#ifdef Q_OS_LINUX
+  const bool ok = CopyLinux(source, destination, progress, &method_used);
+#else
+  const bool ok = CopyWithQFile(source, destination, progress);
+#endif
+
+  if (method) *method = method_used;
+  return ok;
+}
+
+void FileCopier::set_first_method(Method method) { sFirstMethod = method; }
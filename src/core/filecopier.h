@@ -0,0 +1,55 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORE_FILECOPIER_H_
+#define CORE_FILECOPIER_H_
+
+#include <functional>
+
+#include <QString>
+
+// Copies a file, letting the kernel do the work where it can so the data
+// doesn't have to pass through userspace.  On Linux it first tries to clone
+// the file (a reflink, on filesystems that support them), then
+// copy_file_range, then sendfile, and falls back to reading and writing.
+//
+// Like QFile::copy the destination mustn't exist, and it gets the source's
+// permissions.  Thread-safe.
+class FileCopier {
+ public:
+  enum Method {
+    Method_Clone,
+    Method_CopyFileRange,
+    Method_Sendfile,
+    Method_ReadWrite,
+  };
+
+  // Called with the number of bytes copied so far and the size of the file.
+  typedef std::function<void(qint64 copied, qint64 total)> ProgressFunction;
+
+  static const qint64 kChunkSize;
+
+  // Returns false and removes the partly written destination if the copy
+  // failed.  method is set to the method that finished the copy.
+  static bool Copy(const QString& source, const QString& destination,
+                   const ProgressFunction& progress = ProgressFunction(),
+                   Method* method = nullptr);
+
+  // Stops Copy from trying anything before the given method.  Only for tests.
+  static void set_first_method(Method method);
+};
+
+#endif  // CORE_FILECOPIER_H_
@@ -21,6 +21,7 @@
 */
 
 #include "filesystemmusicstorage.h"
+#include "core/filecopier.h"
 #include "core/logging.h"
 #include "core/utilities.h"
 
@@ -28,6 +29,8 @@
 #include <QFile>
 #include <QUrl>
 
+const int FilesystemMusicStorage::kMaxParallelCopies = 4;
+
 FilesystemMusicStorage::FilesystemMusicStorage(const QString& root)
     : root_(root) {}
 
@@ -45,14 +48,42 @@ bool FilesystemMusicStorage::CopyToStorage(const CopyJob& job) {
     return false;
   }
 
-  // Remove the destination file if it exists and we want to overwrite
-  if (job.overwrite_ && dest.exists()) QFile::remove(dest.absoluteFilePath());
+  // Only replace an existing file if we've been asked to
+  if (dest.exists()) {
+    if (!job.overwrite_) return false;
+    QFile::remove(dest.absoluteFilePath());
+  }
 
-  // Copy or move
-  if (job.remove_original_)
-    return QFile::rename(src.absoluteFilePath(), dest.absoluteFilePath());
-  else
-    return QFile::copy(src.absoluteFilePath(), dest.absoluteFilePath());
+  // Moves within a filesystem are just a rename
+  if (job.remove_original_ &&
+      QDir().rename(src.absoluteFilePath(), dest.absoluteFilePath())) {
+    if (job.progress_) job.progress_(1.0);
+    return true;
+  }
+
+  // Otherwise copy the file, letting the kernel do it if it can
+  FileCopier::ProgressFunction progress;
+  if (job.progress_) {
+    progress = [&job](qint64 copied, qint64 total) {
+      if (total > 0) job.progress_(float(copied) / total);
+    };
+  }
+
+  if (!FileCopier::Copy(src.absoluteFilePath(), dest.absoluteFilePath(),
+                        progress)) {
+    qLog(Warning) << "Failed to copy" << src.absoluteFilePath() << "to"
+                  << dest.absoluteFilePath();
+    return false;
+  }
+
+  // Finish moving between filesystems
+  if (job.remove_original_ && !QFile::remove(src.absoluteFilePath())) {
+    qLog(Warning) << "Failed to remove" << src.absoluteFilePath();
+    QFile::remove(dest.absoluteFilePath());
+    return false;
+  }
+
+  return true;
 }
 
 bool FilesystemMusicStorage::DeleteFromStorage(const DeleteJob& job) {
@@ -27,7 +27,12 @@ class FilesystemMusicStorage : public virtual MusicStorage {
   explicit FilesystemMusicStorage(const QString& root);
   ~FilesystemMusicStorage() {}
 
+  // Local disks cope with a few files being written at once, and it hides
+  // the time spent opening and closing each one.
+  static const int kMaxParallelCopies;
+
   QString LocalPath() const { return root_; }
+  int MaxParallelCopies() const { return kMaxParallelCopies; }
 
   bool CopyToStorage(const CopyJob& job);
   bool DeleteFromStorage(const DeleteJob& job);
@@ -39,6 +39,7 @@
 #include "internet/somafm/somafmservice.h"
 #include "library/directory.h"
 #include "playlist/playlist.h"
+#include "playlist/playlistbackend.h"
 #include "songinfo/collapsibleinfopane.h"
 #include "ui/equalizer.h"
 
@@ -70,6 +71,8 @@ void RegisterMetaTypes() {
   qRegisterMetaType<GstElement*>("GstElement*");
   qRegisterMetaType<GstEngine::OutputDetails>("GstEngine::OutputDetails");
   qRegisterMetaType<GstEnginePipeline*>("GstEnginePipeline*");
+  qRegisterMetaType<PlaylistBackend::ChangeList>(
+      "PlaylistBackend::ChangeList");
   qRegisterMetaType<PlaylistItemList>("PlaylistItemList");
   qRegisterMetaType<PlaylistItemPtr>("PlaylistItemPtr");
   qRegisterMetaType<PodcastEpisodeList>("PodcastEpisodeList");
@@ -72,6 +72,10 @@ class MusicStorage {
     return true;
   }
 
+  // The number of CopyToStorage calls that can be made at the same time, from
+  // different threads.  Calls are never made concurrently by default.
+  virtual int MaxParallelCopies() const { return 1; }
+
   virtual bool StartCopy(QList<Song::FileType>* supported_types) {
     return true;
   }
@@ -25,20 +25,23 @@
 
 #include <QDir>
 #include <QFileInfo>
+#include <QMutexLocker>
 #include <QTimer>
 #include <QThread>
+#include <QThreadPool>
 #include <QUrl>
 
 #include "musicstorage.h"
 #include "taskmanager.h"
+#include "core/closure.h"
+#include "core/concurrentrun.h"
 #include "core/logging.h"
 #include "core/tagreaderclient.h"
 #include "core/utilities.h"
 
 using std::placeholders::_1;
 
-const int Organise::kBatchSize = 10;
-const int Organise::kTranscodeProgressInterval = 500;
+const int Organise::kProgressInterval = 500;
 
 Organise::Organise(TaskManager* task_manager,
                    std::shared_ptr<MusicStorage> destination,
@@ -57,10 +60,12 @@ Organise::Organise(TaskManager* task_manager,
       task_count_(songs_info.count()),
       transcode_suffix_(1),
       tasks_complete_(0),
+      copy_pool_(new QThreadPool(this)),
+      next_copy_id_(0),
       started_(false),
-      task_id_(0),
-      current_copy_progress_(0) {
+      task_id_(0) {
   original_thread_ = thread();
+  copy_pool_->setMaxThreadCount(qMax(1, destination_->MaxParallelCopies()));
 
   for (const NewSongInfo& song_info : songs_info) {
     tasks_pending_ << Task(song_info);
@@ -93,128 +98,178 @@ void Organise::ProcessSomeFiles() {
       tasks_pending_.clear();
     }
     started_ = true;
+
+    QueueTranscodeJobs();
+  }
+
+  // Keep as many files copying as the destination can take.  Files that need
+  // transcoding only get here once FileTranscoded has put them back in the
+  // queue.
+  while (!tasks_pending_.isEmpty() &&
+         tasks_copying_.count() < copy_pool_->maxThreadCount()) {
+    StartCopy(tasks_pending_.takeFirst());
   }
 
-  // None left?
-  if (tasks_pending_.isEmpty()) {
+  if (!tasks_copying_.isEmpty() || !tasks_transcoding_.isEmpty()) {
+    // Just wait - CopyFinished or FileTranscoded will start us off again in a
+    // little while
     if (!tasks_transcoding_.isEmpty()) {
-      // Just wait - FileTranscoded will start us off again in a little while
       qLog(Debug) << "Waiting for transcoding jobs";
-      transcode_progress_timer_.start(kTranscodeProgressInterval, this);
-      return;
     }
+    if (!progress_timer_.isActive()) {
+      progress_timer_.start(kProgressInterval, this);
+    }
+    return;
+  }
 
-    UpdateProgress();
+  // None left
+  progress_timer_.stop();
+  UpdateProgress();
 
-    destination_->FinishCopy(files_with_errors_.isEmpty());
-    if (eject_after_) destination_->Eject();
+  destination_->FinishCopy(files_with_errors_.isEmpty());
+  if (eject_after_) destination_->Eject();
 
-    task_manager_->SetTaskFinished(task_id_);
+  task_manager_->SetTaskFinished(task_id_);
 
-    emit Finished(files_with_errors_);
+  emit Finished(files_with_errors_);
 
-    // Move back to the original thread so deleteLater() can get called in
-    // the main thread's event loop
-    moveToThread(original_thread_);
-    deleteLater();
+  // Move back to the original thread so deleteLater() can get called in
+  // the main thread's event loop
+  moveToThread(original_thread_);
+  deleteLater();
 
-    // Stop this thread
-    thread_->quit();
-    return;
+  // Stop this thread
+  thread_->quit();
+}
+
+void Organise::StartCopy(const Task& task) {
+  qLog(Info) << "Processing" << task.song_info_.song_.url().toLocalFile();
+
+  // Use a Song instead of a tag reader
+  Song song = task.song_info_.song_;
+  if (!song.is_valid()) return;
+
+  // Maybe this file is one that's been transcoded already?
+  if (!task.transcoded_filename_.isEmpty()) {
+    qLog(Debug) << "This file has already been transcoded";
+
+    // Set the new filetype on the song so the formatter gets it right
+    song.set_filetype(task.new_filetype_);
+
+    // Fiddle the filename extension as well to match the new type
+    song.set_url(QUrl::fromLocalFile(Utilities::FiddleFileExtension(
+        song.basefilename(), task.new_extension_)));
+    song.set_basefilename(Utilities::FiddleFileExtension(
+        song.basefilename(), task.new_extension_));
+
+    // Have to set this to the size of the new file or else funny stuff
+    // happens
+    song.set_filesize(QFileInfo(task.transcoded_filename_).size());
   }
 
-  // We process files in batches so we can be cancelled part-way through.
-  for (int i = 0; i < kBatchSize; ++i) {
-    SetSongProgress(0);
-
-    if (tasks_pending_.isEmpty()) break;
-
-    Task task = tasks_pending_.takeFirst();
-    qLog(Info) << "Processing" << task.song_info_.song_.url().toLocalFile();
-
-    // Use a Song instead of a tag reader
-    Song song = task.song_info_.song_;
-    if (!song.is_valid()) continue;
-
-    // Maybe this file is one that's been transcoded already?
-    if (!task.transcoded_filename_.isEmpty()) {
-      qLog(Debug) << "This file has already been transcoded";
-
-      // Set the new filetype on the song so the formatter gets it right
-      song.set_filetype(task.new_filetype_);
-
-      // Fiddle the filename extension as well to match the new type
-      song.set_url(QUrl::fromLocalFile(Utilities::FiddleFileExtension(
-          song.basefilename(), task.new_extension_)));
-      song.set_basefilename(Utilities::FiddleFileExtension(
-          song.basefilename(), task.new_extension_));
-
-      // Have to set this to the size of the new file or else funny stuff
-      // happens
-      song.set_filesize(QFileInfo(task.transcoded_filename_).size());
-    } else {
-      // Figure out if we need to transcode it
-      Song::FileType dest_type = CheckTranscode(song.filetype());
-      if (dest_type != Song::Type_Unknown) {
-        // Get the preset
-        TranscoderPreset preset = Transcoder::PresetForFileType(dest_type);
-        qLog(Debug) << "Transcoding with" << preset.name_;
-
-        // Get a temporary name for the transcoded file
-        task.transcoded_filename_ = transcode_temp_name_.fileName() + "-" +
-                                    QString::number(transcode_suffix_++);
-        task.new_extension_ = preset.extension_;
-        task.new_filetype_ = dest_type;
-        tasks_transcoding_[task.song_info_.song_.url().toLocalFile()] = task;
-
-        qLog(Debug) << "Transcoding to" << task.transcoded_filename_;
-
-        // Start the transcoding - this will happen in the background and
-        // FileTranscoded() will get called when it's done.  At that point the
-        // task will get re-added to the pending queue with the new filename.
-        transcoder_->AddJob(task.song_info_.song_.url().toLocalFile(), preset,
-                            task.transcoded_filename_);
-        transcoder_->Start();
-        continue;
-      }
-    }
+  const int copy_id = next_copy_id_++;
+
+  MusicStorage::CopyJob job;
+  job.source_ = task.transcoded_filename_.isEmpty()
+                    ? task.song_info_.song_.url().toLocalFile()
+                    : task.transcoded_filename_;
+  job.destination_ = task.song_info_.new_filename_;
+  job.metadata_ = song;
+  job.overwrite_ = overwrite_;
+  job.mark_as_listened_ = mark_as_listened_;
+  job.remove_original_ = !copy_;
+  job.progress_ = std::bind(&Organise::SetSongProgress, this, copy_id, _1,
+                            !task.transcoded_filename_.isEmpty());
+
+  CopyingTask copying;
+  copying.task_ = task;
+  copying.song_ = song;
+  tasks_copying_[copy_id] = copying;
+
+  std::shared_ptr<MusicStorage> destination = destination_;
+  QFuture<bool> future = ConcurrentRun::Run<bool>(
+      copy_pool_, [destination, job]() {
+        return destination->CopyToStorage(job);
+      });
+  NewClosure(future, this, SLOT(CopyFinished(QFuture<bool>, int)), future,
+             copy_id);
+}
 
-    MusicStorage::CopyJob job;
-    job.source_ = task.transcoded_filename_.isEmpty()
-                      ? task.song_info_.song_.url().toLocalFile()
-                      : task.transcoded_filename_;
-    job.destination_ = task.song_info_.new_filename_;
-    job.metadata_ = song;
-    job.overwrite_ = overwrite_;
-    job.mark_as_listened_ = mark_as_listened_;
-    job.remove_original_ = !copy_;
-    job.progress_ = std::bind(&Organise::SetSongProgress, this, _1,
-                              !task.transcoded_filename_.isEmpty());
-
-    if (!destination_->CopyToStorage(job)) {
-      files_with_errors_ << task.song_info_.song_.basefilename();
-    } else {
-      if (job.remove_original_) {
-        // Notify other aspects of system that song has been invalidated
-        QString root = destination_->LocalPath();
-        QFileInfo new_file = QFileInfo(
-             root + "/" + task.song_info_.new_filename_);
-        emit SongPathChanged(song, new_file);
-      }
-      if (job.mark_as_listened_) {
-        emit FileCopied(job.metadata_.id());
-      }
+void Organise::CopyFinished(QFuture<bool> future, int copy_id) {
+  const CopyingTask copying = tasks_copying_.take(copy_id);
+  const Task& task = copying.task_;
+
+  {
+    QMutexLocker l(&copy_progress_mutex_);
+    copy_progress_.remove(copy_id);
+  }
+
+  if (!future.result()) {
+    files_with_errors_ << task.song_info_.song_.basefilename();
+  } else {
+    if (!copy_) {
+      // Notify other aspects of system that song has been invalidated
+      QString root = destination_->LocalPath();
+      QFileInfo new_file = QFileInfo(
+           root + "/" + task.song_info_.new_filename_);
+      emit SongPathChanged(copying.song_, new_file);
+    }
+    if (mark_as_listened_) {
+      emit FileCopied(copying.song_.id());
     }
+  }
+
+  // Clean up the temporary transcoded file
+  if (!task.transcoded_filename_.isEmpty())
+    QFile::remove(task.transcoded_filename_);
 
-    // Clean up the temporary transcoded file
-    if (!task.transcoded_filename_.isEmpty())
-      QFile::remove(task.transcoded_filename_);
+  tasks_complete_++;
+  UpdateProgress();
 
-    tasks_complete_++;
+  ProcessSomeFiles();
+}
+
+void Organise::QueueTranscodeJobs() {
+  // Give the transcoder all the files up front, so it can start with the
+  // longest ones and keep every thread busy until the end.  Files that don't
+  // need transcoding are copied in the meantime.
+  QList<Task>::iterator it = tasks_pending_.begin();
+  while (it != tasks_pending_.end()) {
+    Task& task = *it;
+    const Song& song = task.song_info_.song_;
+
+    Song::FileType dest_type =
+        song.is_valid() ? CheckTranscode(song.filetype()) : Song::Type_Unknown;
+    if (dest_type == Song::Type_Unknown) {
+      ++it;
+      continue;
+    }
+
+    // Get the preset
+    TranscoderPreset preset = Transcoder::PresetForFileType(dest_type);
+    qLog(Debug) << "Transcoding" << song.url().toLocalFile() << "with"
+                << preset.name_;
+
+    // Get a temporary name for the transcoded file
+    task.transcoded_filename_ = transcode_temp_name_.fileName() + "-" +
+                                QString::number(transcode_suffix_++);
+    task.new_extension_ = preset.extension_;
+    task.new_filetype_ = dest_type;
+    tasks_transcoding_[song.url().toLocalFile()] = task;
+
+    qLog(Debug) << "Transcoding to" << task.transcoded_filename_;
+
+    // This will happen in the background and FileTranscoded() will get called
+    // when it's done.  At that point the task will get re-added to the pending
+    // queue with the new filename.
+    transcoder_->AddJob(song.url().toLocalFile(), preset,
+                        task.transcoded_filename_, song.length_nanosec());
+    it = tasks_pending_.erase(it);
   }
-  SetSongProgress(0);
 
-  QTimer::singleShot(0, this, SLOT(ProcessSomeFiles()));
+  if (transcoder_->QueuedJobsCount()) {
+    transcoder_->Start();
+  }
 }
 
 Song::FileType Organise::CheckTranscode(Song::FileType original_type) const {
@@ -246,22 +301,26 @@ Song::FileType Organise::CheckTranscode(Song::FileType original_type) const {
   return Song::Type_Unknown;
 }
 
-void Organise::SetSongProgress(float progress, bool transcoded) {
+void Organise::SetSongProgress(int copy_id, float progress, bool transcoded) {
+  // Called from the copy threads, UpdateProgress picks it up later
   const int max = transcoded ? 50 : 100;
-  current_copy_progress_ = (transcoded ? 50 : 0) +
-                           qBound(0, static_cast<int>(progress * max), max - 1);
-  UpdateProgress();
+  const int value = (transcoded ? 50 : 0) +
+                    qBound(0, static_cast<int>(progress * max), max - 1);
+
+  QMutexLocker l(&copy_progress_mutex_);
+  copy_progress_[copy_id] = value;
 }
 
 void Organise::UpdateProgress() {
   const int total = task_count_ * 100;
 
   // Update transcoding progress
-  QMap<QString, float> transcode_progress = transcoder_->GetProgress();
+  QMap<QString, Transcoder::JobProgress> transcode_progress =
+      transcoder_->GetProgress();
   for (const QString& filename : transcode_progress.keys()) {
     if (!tasks_transcoding_.contains(filename)) continue;
     tasks_transcoding_[filename].transcode_progress_ =
-        transcode_progress[filename];
+        transcode_progress[filename].progress;
   }
 
   // Count the progress of all tasks that are in the queue.  Files that need
@@ -276,15 +335,17 @@ void Organise::UpdateProgress() {
     progress += qBound(0, static_cast<int>(task.transcode_progress_ * 50), 50);
   }
 
-  // Add the progress of the track that's currently copying
-  progress += current_copy_progress_;
+  // Add the progress of the tracks that are currently copying
+  {
+    QMutexLocker l(&copy_progress_mutex_);
+    for (int copy_progress : copy_progress_) progress += copy_progress;
+  }
 
   task_manager_->SetTaskProgress(task_id_, progress, total);
 }
 
 void Organise::FileTranscoded(const QString& input, const QString& output, bool success) {
   qLog(Info) << "File finished" << input << success;
-  transcode_progress_timer_.stop();
 
   Task task = tasks_transcoding_.take(input);
   if (!success) {
@@ -298,7 +359,7 @@ void Organise::FileTranscoded(const QString& input, const QString& output, bool
 void Organise::timerEvent(QTimerEvent* e) {
   QObject::timerEvent(e);
 
-  if (e->timerId() == transcode_progress_timer_.timerId()) {
+  if (e->timerId() == progress_timer_.timerId()) {
     UpdateProgress();
   }
 }
@@ -26,6 +26,9 @@
 
 #include <QFileInfo>
 #include <QBasicTimer>
+#include <QFuture>
+#include <QMap>
+#include <QMutex>
 #include <QObject>
 #include <QTemporaryFile>
 
@@ -34,6 +37,7 @@
 
 class MusicStorage;
 class TaskManager;
+class QThreadPool;
 
 class Organise : public QObject {
   Q_OBJECT
@@ -53,8 +57,7 @@ class Organise : public QObject {
            bool mark_as_listened, const NewSongInfoList& songs,
            bool eject_after);
 
-  static const int kBatchSize;
-  static const int kTranscodeProgressInterval;
+  static const int kProgressInterval;
 
   void Start();
 
@@ -69,10 +72,12 @@ class Organise : public QObject {
  private slots:
   void ProcessSomeFiles();
   void FileTranscoded(const QString& input, const QString& output, bool success);
+  void CopyFinished(QFuture<bool> future, int copy_id);
 
  private:
-  void SetSongProgress(float progress, bool transcoded = false);
+  void SetSongProgress(int copy_id, float progress, bool transcoded);
   void UpdateProgress();
+  void QueueTranscodeJobs();
   Song::FileType CheckTranscode(Song::FileType original_type) const;
 
  private:
@@ -88,6 +93,13 @@ class Organise : public QObject {
     Song::FileType new_filetype_;
   };
 
+  struct CopyingTask {
+    Task task_;
+    Song song_;
+  };
+
+  void StartCopy(const Task& task);
+
   QThread* thread_;
   QThread* original_thread_;
   TaskManager* task_manager_;
@@ -102,7 +114,7 @@ class Organise : public QObject {
   const bool eject_after_;
   int task_count_;
 
-  QBasicTimer transcode_progress_timer_;
+  QBasicTimer progress_timer_;
   QTemporaryFile transcode_temp_name_;
   int transcode_suffix_;
 
@@ -110,10 +122,19 @@ class Organise : public QObject {
   QMap<QString, Task> tasks_transcoding_;
   int tasks_complete_;
 
+  // Files are copied on this pool, at most MaxParallelCopies() at a time.
+  QThreadPool* copy_pool_;
+  int next_copy_id_;
+  QMap<int, CopyingTask> tasks_copying_;
+
+  // Copy ID -> progress of that copy out of 100.  Written from the copy
+  // threads.
+  QMutex copy_progress_mutex_;
+  QMap<int, int> copy_progress_;
+
   bool started_;
 
   int task_id_;
-  int current_copy_progress_;
 
   QStringList files_with_errors_;
 };
@@ -28,6 +28,7 @@
 #include <QUrl>
 
 const char* TagReaderClient::kWorkerExecutableName = "clementine-tagreader";
+const int TagReaderClient::kReadFilesBatchSize = 32;
 TagReaderClient* TagReaderClient::sInstance = nullptr;
 
 TagReaderClient::TagReaderClient(QObject* parent)
@@ -57,6 +58,17 @@ TagReaderReply* TagReaderClient::ReadFile(const QString& filename) {
   return worker_pool_->SendMessageWithReply(&message);
 }
 
+TagReaderReply* TagReaderClient::ReadFiles(const QStringList& filenames) {
+  pb::tagreader::Message message;
+  pb::tagreader::ReadFilesRequest* req = message.mutable_read_files_request();
+
+  for (const QString& filename : filenames) {
+    req->add_filenames(DataCommaSizeFromQString(filename));
+  }
+
+  return worker_pool_->SendMessageWithReply(&message);
+}
+
 TagReaderReply* TagReaderClient::SaveFile(const QString& filename,
                                           const Song& metadata) {
   pb::tagreader::Message message;
@@ -151,6 +163,35 @@ void TagReaderClient::ReadFileBlocking(const QString& filename, Song* song) {
   reply->deleteLater();
 }
 
+void TagReaderClient::ReadFilesBlocking(const QStringList& filenames,
+                                        SongList* songs) {
+  Q_ASSERT(QThread::currentThread() != thread());
+  Q_ASSERT(filenames.count() == songs->count());
+
+  // Send all the batches first so the workers read them in parallel.
+  QList<TagReaderReply*> replies;
+  for (int i = 0; i < filenames.count(); i += kReadFilesBatchSize) {
+    replies << ReadFiles(filenames.mid(i, kReadFilesBatchSize));
+  }
+
+  int index = 0;
+  for (TagReaderReply* reply : replies) {
+    const int batch_size =
+        reply->request_message().read_files_request().filenames_size();
+
+    if (reply->WaitForFinished()) {
+      const pb::tagreader::ReadFilesResponse& response =
+          reply->message().read_files_response();
+      for (int i = 0; i < batch_size && i < response.metadata_size(); ++i) {
+        (*songs)[index + i].InitFromProtobuf(response.metadata(i));
+      }
+    }
+    reply->deleteLater();
+
+    index += batch_size;
+  }
+}
+
 bool TagReaderClient::SaveFileBlocking(const QString& filename,
                                        const Song& metadata) {
   Q_ASSERT(QThread::currentThread() != thread());
@@ -42,9 +42,17 @@ class TagReaderClient : public QObject {
 
   static const char* kWorkerExecutableName;
 
+  // The maximum number of files ReadFilesBlocking puts in one request.
+  static const int kReadFilesBatchSize;
+
   void Start();
 
+  // The number of worker processes requests are shared between.
+  int worker_count() const { return worker_pool_->worker_count(); }
+
   ReplyType* ReadFile(const QString& filename);
+  // Reads the tags of all the files with a single request to one worker.
+  ReplyType* ReadFiles(const QStringList& filenames);
   ReplyType* SaveFile(const QString& filename, const Song& metadata);
   ReplyType* UpdateSongStatistics(const Song& metadata);
   ReplyType* UpdateSongRating(const Song& metadata);
@@ -58,6 +66,10 @@ class TagReaderClient : public QObject {
   // response.  These block the calling thread with a semaphore, and must NOT
   // be called from the TagReaderClient's thread.
   void ReadFileBlocking(const QString& filename, Song* song);
+  // Like ReadFileBlocking, but the files are split into batches that are read
+  // in parallel by all the workers.  songs must contain one Song for each
+  // filename, in the same order.
+  void ReadFilesBlocking(const QStringList& filenames, SongList* songs);
   bool SaveFileBlocking(const QString& filename, const Song& metadata);
   bool UpdateSongStatisticsBlocking(const Song& metadata);
   bool UpdateSongRatingBlocking(const Song& metadata);
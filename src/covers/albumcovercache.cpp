@@ -0,0 +1,140 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "albumcovercache.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFileInfo>
+#include <QMutexLocker>
+
+#include "core/logging.h"
+
+const int AlbumCoverCache::kDefaultMaxMemoryBytes = 32 * 1024 * 1024;  // 32MB
+const int AlbumCoverCache::kMaxDiskImageSize = 256;
+const qint64 AlbumCoverCache::kMaxDiskBytes = 64 * 1024 * 1024;  // 64MB
+
+AlbumCoverCacheStatistics::AlbumCoverCacheStatistics()
+    : memory_hits_(0),
+      disk_hits_(0),
+      misses_(0),
+      insertions_(0),
+      memory_bytes_(0) {}
+
+AlbumCoverCacheStatistics& AlbumCoverCacheStatistics::operator+=(
+    const AlbumCoverCacheStatistics& other) {
+  memory_hits_ += other.memory_hits_;
+  disk_hits_ += other.disk_hits_;
+  misses_ += other.misses_;
+  insertions_ += other.insertions_;
+  memory_bytes_ += other.memory_bytes_;
+  return *this;
+}
+
+double AlbumCoverCacheStatistics::HitRatio() const {
+  if (requests() == 0) return 0.0;
+  return static_cast<double>(memory_hits_ + disk_hits_) / requests();
+}
+
+AlbumCoverCache::AlbumCoverCache(int max_memory_bytes)
+    : memory_(max_memory_bytes) {}
+
+void AlbumCoverCache::SetDiskCacheDir(const QString& dir) {
+  QMutexLocker l(&mutex_);
+  disk_cache_dir_ = dir;
+  if (disk_cache_dir_.isEmpty()) return;
+
+  QDir().mkpath(disk_cache_dir_);
+  PruneDiskCache();
+}
+
+QString AlbumCoverCache::DiskCacheFilename(const QString& key) const {
+  return disk_cache_dir_ + "/" +
+         QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1)
+             .toHex() +
+         ".png";
+}
+
+QImage AlbumCoverCache::Get(const QString& key) {
+  QMutexLocker l(&mutex_);
+
+  QImage* image = memory_.object(key);
+  if (image) {
+    statistics_.memory_hits_++;
+    return *image;
+  }
+
+  if (!disk_cache_dir_.isEmpty()) {
+    QImage disk_image(DiskCacheFilename(key));
+    if (!disk_image.isNull()) {
+      statistics_.disk_hits_++;
+      memory_.insert(key, new QImage(disk_image), disk_image.byteCount());
+      return disk_image;
+    }
+  }
+
+  statistics_.misses_++;
+  return QImage();
+}
+
+void AlbumCoverCache::Insert(const QString& key, const QImage& image) {
+  if (image.isNull()) return;
+
+  QMutexLocker l(&mutex_);
+  statistics_.insertions_++;
+  memory_.insert(key, new QImage(image), image.byteCount());
+
+  if (!disk_cache_dir_.isEmpty() && image.width() <= kMaxDiskImageSize &&
+      image.height() <= kMaxDiskImageSize) {
+    const QString filename = DiskCacheFilename(key);
+    if (!QFile::exists(filename) && !image.save(filename, "PNG")) {
+      qLog(Warning) << "Failed to save cover thumbnail" << filename;
+    }
+  }
+}
+
+void AlbumCoverCache::Clear() {
+  QMutexLocker l(&mutex_);
+  memory_.clear();
+}
+
+AlbumCoverCacheStatistics AlbumCoverCache::statistics() const {
+  QMutexLocker l(&mutex_);
+  AlbumCoverCacheStatistics ret = statistics_;
+  ret.memory_bytes_ = memory_.totalCost();
+  return ret;
+}
+
+void AlbumCoverCache::PruneDiskCache() {
+  // Newest first, so everything past the budget is the oldest.
+  QFileInfoList files = QDir(disk_cache_dir_).entryInfoList(
+      QStringList() << "*.png", QDir::Files, QDir::Time);
+
+  qint64 total_bytes = 0;
+  int removed = 0;
+  for (const QFileInfo& file : files) {
+    total_bytes += file.size();
+    if (total_bytes > kMaxDiskBytes) {
+      QFile::remove(file.absoluteFilePath());
+      removed++;
+    }
+  }
+
+  if (removed) {
+    qLog(Debug) << "Removed" << removed << "old cover thumbnails from"
+                << disk_cache_dir_;
+  }
+}
@@ -0,0 +1,79 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COVERS_ALBUMCOVERCACHE_H_
+#define COVERS_ALBUMCOVERCACHE_H_
+
+#include <QCache>
+#include <QImage>
+#include <QMutex>
+#include <QString>
+
+struct AlbumCoverCacheStatistics {
+  AlbumCoverCacheStatistics();
+
+  AlbumCoverCacheStatistics& operator+=(const AlbumCoverCacheStatistics& other);
+
+  quint64 memory_hits_;
+  quint64 disk_hits_;
+  quint64 misses_;
+  quint64 insertions_;
+
+  // Bytes used by the decoded images currently held in memory.
+  quint64 memory_bytes_;
+
+  quint64 requests() const { return memory_hits_ + disk_hits_ + misses_; }
+  // Fraction of lookups that didn't have to decode the original image.
+  double HitRatio() const;
+};
+
+// Holds scaled and padded album covers, keyed by where the cover came from and
+// the options it was scaled with, so the same image doesn't have to be decoded
+// and scaled again every time it's shown.  Decoded images are kept in memory
+// up to a byte budget, least recently used first out.  Small images can also
+// be written to a directory on disk so they survive restarts.
+//
+// Thread-safe.
+class AlbumCoverCache {
+ public:
+  explicit AlbumCoverCache(int max_memory_bytes = kDefaultMaxMemoryBytes);
+
+  static const int kDefaultMaxMemoryBytes;
+  static const int kMaxDiskImageSize;
+  static const qint64 kMaxDiskBytes;
+
+  // Enables the on-disk tier.  The directory is created if it doesn't exist
+  // and pruned down to kMaxDiskBytes.  An empty string disables it again.
+  void SetDiskCacheDir(const QString& dir);
+
+  // Returns a null image if key isn't in the cache.
+  QImage Get(const QString& key);
+  void Insert(const QString& key, const QImage& image);
+  void Clear();
+
+  AlbumCoverCacheStatistics statistics() const;
+
+ private:
+  QString DiskCacheFilename(const QString& key) const;
+  void PruneDiskCache();
+
+  mutable QMutex mutex_;
+  QCache<QString, QImage> memory_;
+  QString disk_cache_dir_;
+  AlbumCoverCacheStatistics statistics_;
+};
+
+#endif  // COVERS_ALBUMCOVERCACHE_H_
@@ -22,13 +22,17 @@
 #include "albumcoverloader.h"
 
 #include <QPainter>
+#include <QDateTime>
 #include <QDir>
+#include <QFileInfo>
 #include <QCoreApplication>
 #include <QUrl>
 #include <QNetworkReply>
+#include <QThread>
 
 #include "config.h"
 #include "core/closure.h"
+#include "core/concurrentrun.h"
 #include "core/logging.h"
 #include "core/network.h"
 #include "core/tagreaderclient.h"
@@ -39,33 +43,81 @@
 AlbumCoverLoader::AlbumCoverLoader(QObject* parent)
     : QObject(parent),
       stop_requested_(false),
+      decoding_count_(0),
+      max_decoding_count_(qMax(2, QThread::idealThreadCount())),
       next_id_(1),
       network_(new NetworkAccessManager(this)),
-      connected_spotify_(false) {}
+      connected_spotify_(false) {
+  cache_.SetDiskCacheDir(ImageCacheDir() + "/thumbnails");
+
+  // Loading embedded covers blocks on the tag reader, so the decodes get
+  // their own threads instead of tying up the global pool.
+  decode_pool_.setMaxThreadCount(max_decoding_count_);
+}
+
+AlbumCoverLoader::~AlbumCoverLoader() {
+  // Tasks in the thread pool still use this object.
+  QMutexLocker l(&mutex_);
+  stop_requested_ = true;
+  while (decoding_count_ > 0) {
+    decoding_finished_.wait(&mutex_);
+  }
+}
 
 QString AlbumCoverLoader::ImageCacheDir() {
   return Utilities::GetConfigPath(Utilities::Path_AlbumCovers);
 }
 
 void AlbumCoverLoader::CancelTask(quint64 id) {
+  CancelTasks(QSet<quint64>() << id);
+}
+
+void AlbumCoverLoader::CancelTasks(const QSet<quint64>& ids) {
   QMutexLocker l(&mutex_);
-  for (QQueue<Task>::iterator it = tasks_.begin(); it != tasks_.end(); ++it) {
-    if (it->id == id) {
-      tasks_.erase(it);
-      break;
+  for (QQueue<Task>* queue : {&priority_tasks_, &tasks_}) {
+    for (QQueue<Task>::iterator it = queue->begin(); it != queue->end();) {
+      if (ids.contains(it->id)) {
+        // Tasks that went back to the queue for another try are still marked
+        // as running.
+        running_tasks_.remove(it->id);
+        it = queue->erase(it);
+      } else {
+        ++it;
+      }
     }
   }
+
+  // Tasks that are already running notice this the next time they check, and
+  // their results are thrown away.
+  for (quint64 id : ids) {
+    if (running_tasks_.contains(id)) cancelled_tasks_.insert(id);
+  }
 }
 
-void AlbumCoverLoader::CancelTasks(const QSet<quint64>& ids) {
+void AlbumCoverLoader::PrioritizeTasks(const QSet<quint64>& ids) {
   QMutexLocker l(&mutex_);
+
+  QQueue<Task> priority;
+  QQueue<Task> demoted;
+  for (const Task& task : priority_tasks_) {
+    if (ids.contains(task.id)) {
+      priority.enqueue(task);
+    } else {
+      demoted.enqueue(task);
+    }
+  }
   for (QQueue<Task>::iterator it = tasks_.begin(); it != tasks_.end();) {
     if (ids.contains(it->id)) {
+      priority.enqueue(*it);
       it = tasks_.erase(it);
     } else {
       ++it;
     }
   }
+
+  demoted += tasks_;
+  priority_tasks_ = priority;
+  tasks_ = demoted;
 }
 
 quint64 AlbumCoverLoader::LoadImageAsync(const AlbumCoverLoaderOptions& options,
@@ -98,42 +150,207 @@ void AlbumCoverLoader::ProcessTasks() {
     Task task;
     {
       QMutexLocker l(&mutex_);
-      if (tasks_.isEmpty()) return;
-      task = tasks_.dequeue();
+      if (decoding_count_ >= max_decoding_count_) return;
+
+      if (!priority_tasks_.isEmpty()) {
+        task = priority_tasks_.dequeue();
+      } else if (!tasks_.isEmpty()) {
+        task = tasks_.dequeue();
+      } else {
+        return;
+      }
+      running_tasks_.insert(task.id);
     }
 
-    ProcessTask(&task);
+    StartDecoding(task);
   }
 }
 
-void AlbumCoverLoader::ProcessTask(Task* task) {
-  TryLoadResult result = TryLoadImage(*task);
-  if (result.started_async) {
-    // The image is being loaded from a remote URL, we'll carry on later
-    // when it's done
-    return;
+void AlbumCoverLoader::StartDecoding(const Task& task) {
+  {
+    QMutexLocker l(&mutex_);
+    decoding_count_++;
   }
 
-  if (result.loaded_success) {
-    QImage scaled = ScaleAndPad(task->options, result.image);
-    emit ImageLoaded(task->id, scaled);
-    emit ImageLoaded(task->id, scaled, result.image);
-    return;
+  QFuture<DecodeResult> future = ConcurrentRun::Run<DecodeResult>(
+      &decode_pool_, [this, task]() { return RunDecodeTask(task); });
+  NewClosure(future, this, SLOT(DecodeFinished(QFuture<DecodeResult>)),
+             future);
+}
+
+AlbumCoverLoader::DecodeResult AlbumCoverLoader::RunDecodeTask(Task task) {
+  DecodeResult ret = DecodeTask(task);
+
+  QMutexLocker l(&mutex_);
+  decoding_count_--;
+  decoding_finished_.wakeAll();
+  return ret;
+}
+
+AlbumCoverLoader::DecodeResult AlbumCoverLoader::DecodeTask(const Task& task) {
+  DecodeResult ret;
+  ret.task = task;
+
+  if (IsCancelled(task.id)) {
+    ret.type = DecodeResult::Type_Cancelled;
+    return ret;
+  }
+
+  // Only look in the cache the first time round - a task that comes back here
+  // after a failed remote fetch has already missed.
+  if (task.state == State_TryingManual &&
+      !task.options.need_original_image_) {
+    const QString key = CacheKey(task);
+    if (!key.isEmpty()) {
+      QImage scaled = cache_.Get(key);
+      if (!scaled.isNull()) {
+        ret.type = DecodeResult::Type_Loaded;
+        ret.scaled = scaled;
+        ret.original = scaled;
+        return ret;
+      }
+    }
+  }
+
+  forever {
+    TryLoadResult result = TryLoadImage(ret.task);
+    if (result.remote) {
+      ret.type = DecodeResult::Type_Remote;
+      return ret;
+    }
+
+    if (result.loaded_success) {
+      ret.type = DecodeResult::Type_Loaded;
+      ret.original = result.image;
+      ret.scaled = ScaleAndCache(ret.task, result.image);
+      return ret;
+    }
+
+    if (ret.task.state != State_TryingManual) {
+      ret.type = DecodeResult::Type_Failed;
+      return ret;
+    }
+
+    if (IsCancelled(task.id)) {
+      ret.type = DecodeResult::Type_Cancelled;
+      return ret;
+    }
+
+    // Try the automatic one next
+    ret.task.state = State_TryingAuto;
+  }
+}
+
+void AlbumCoverLoader::DecodeFinished(QFuture<DecodeResult> future) {
+  DecodeResult result = future.result();
+
+  switch (result.type) {
+    case DecodeResult::Type_Loaded:
+      EmitImageLoaded(result.task, result.scaled, result.original);
+      break;
+
+    case DecodeResult::Type_Failed:
+      NextState(&result.task);
+      break;
+
+    case DecodeResult::Type_Remote:
+      if (IsCancelled(result.task.id)) {
+        TaskFinished(result.task.id);
+      } else {
+        StartRemoteFetch(result.task);
+      }
+      break;
+
+    case DecodeResult::Type_Cancelled:
+      TaskFinished(result.task.id);
+      break;
   }
 
-  NextState(task);
+  // There's room for another one now.
+  ProcessTasks();
+}
+
+QImage AlbumCoverLoader::ScaleAndCache(const Task& task, const QImage& image) {
+  QImage scaled = ScaleAndPad(task.options, image);
+
+  // The default image depends on who's asking, so it's not worth keeping.
+  if (image.cacheKey() != task.options.default_output_image_.cacheKey()) {
+    const QString key = CacheKey(task);
+    if (!key.isEmpty()) cache_.Insert(key, scaled);
+  }
+
+  return scaled;
+}
+
+void AlbumCoverLoader::FinishTask(const Task& task, const QImage& image) {
+  EmitImageLoaded(task, ScaleAndCache(task, image), image);
+}
+
+void AlbumCoverLoader::EmitImageLoaded(const Task& task, const QImage& scaled,
+                                       const QImage& original) {
+  if (!TaskFinished(task.id)) return;
+
+  emit ImageLoaded(task.id, scaled);
+  emit ImageLoaded(task.id, scaled, original);
+}
+
+bool AlbumCoverLoader::IsCancelled(quint64 id) {
+  QMutexLocker l(&mutex_);
+  return stop_requested_ || cancelled_tasks_.contains(id);
+}
+
+bool AlbumCoverLoader::TaskFinished(quint64 id) {
+  QMutexLocker l(&mutex_);
+  running_tasks_.remove(id);
+  return !cancelled_tasks_.remove(id);
+}
+
+QString AlbumCoverLoader::CacheKey(const Task& task) {
+  // Images passed in directly don't have anything to identify them by.
+  if (!task.embedded_image.isNull()) return QString();
+
+  // Local files can be replaced with a different image under the same name,
+  // so the key includes their modification time.
+  auto source_key = [&task](const QString& filename) -> QString {
+    if (filename.isEmpty() || filename == Song::kManuallyUnsetCover) {
+      return filename;
+    }
+
+    QString path = filename;
+    if (filename == Song::kEmbeddedCover) {
+      if (task.song_filename.isEmpty()) return filename;
+      path = task.song_filename;
+    } else if (filename.contains("://")) {
+      return filename;
+    }
+
+    return filename + "@" +
+           QString::number(QFileInfo(path).lastModified().toTime_t());
+  };
+
+  return QString("%1|%2|%3|%4|%5")
+      .arg(source_key(task.art_manual), source_key(task.art_automatic))
+      .arg(task.options.desired_height_)
+      .arg(task.options.scale_output_image_ ? 1 : 0)
+      .arg(task.options.pad_output_image_ ? 1 : 0);
 }
 
 void AlbumCoverLoader::NextState(Task* task) {
   if (task->state == State_TryingManual) {
     // Try the automatic one next
     task->state = State_TryingAuto;
-    ProcessTask(task);
+
+    // Go through the queue again so no more than max_decoding_count_ tasks
+    // are decoding at once.
+    {
+      QMutexLocker l(&mutex_);
+      priority_tasks_.prepend(*task);
+    }
+    ProcessTasks();
   } else {
     // Give up
-    emit ImageLoaded(task->id, task->options.default_output_image_);
-    emit ImageLoaded(task->id, task->options.default_output_image_,
-                     task->options.default_output_image_);
+    EmitImageLoaded(*task, task->options.default_output_image_,
+                    task->options.default_output_image_);
   }
 }
 
@@ -168,15 +385,22 @@ AlbumCoverLoader::TryLoadResult AlbumCoverLoader::TryLoadImage(
   }
 
   if (filename.toLower().startsWith("http://") ||
-      filename.toLower().startsWith("https://")) {
-    QUrl url(filename);
-    QNetworkReply* reply = network_->get(QNetworkRequest(url));
-    NewClosure(reply, SIGNAL(finished()), this,
-               SLOT(RemoteFetchFinished(QNetworkReply*)), reply);
-
-    remote_tasks_.insert(reply, task);
+      filename.toLower().startsWith("https://") ||
+      filename.toLower().startsWith("spotify://image/")) {
     return TryLoadResult(true, false, QImage());
-  } else if (filename.toLower().startsWith("spotify://image/")) {
+  }
+
+  QImage image(filename);
+  return TryLoadResult(
+      false, !image.isNull(),
+      image.isNull() ? task.options.default_output_image_ : image);
+}
+
+void AlbumCoverLoader::StartRemoteFetch(const Task& task) {
+  const QString filename =
+      task.state == State_TryingManual ? task.art_manual : task.art_automatic;
+
+  if (filename.toLower().startsWith("spotify://image/")) {
     // HACK: we should add generic image URL handlers
     SpotifyService* spotify = InternetModel::Service<SpotifyService>();
 
@@ -195,13 +419,15 @@ AlbumCoverLoader::TryLoadResult AlbumCoverLoader::TryLoadImage(
     // Need to schedule this in the spotify service's thread
     QMetaObject::invokeMethod(spotify, "LoadImage", Qt::QueuedConnection,
                               Q_ARG(QString, id));
-    return TryLoadResult(true, false, QImage());
+    return;
   }
 
-  QImage image(filename);
-  return TryLoadResult(
-      false, !image.isNull(),
-      image.isNull() ? task.options.default_output_image_ : image);
+  QUrl url(filename);
+  QNetworkReply* reply = network_->get(QNetworkRequest(url));
+  NewClosure(reply, SIGNAL(finished()), this,
+             SLOT(RemoteFetchFinished(QNetworkReply*)), reply);
+
+  remote_tasks_.insert(reply, task);
 }
 
 void AlbumCoverLoader::SpotifyImageLoaded(const QString& id,
@@ -209,9 +435,7 @@ void AlbumCoverLoader::SpotifyImageLoaded(const QString& id,
   if (!remote_spotify_tasks_.contains(id)) return;
 
   Task task = remote_spotify_tasks_.take(id);
-  QImage scaled = ScaleAndPad(task.options, image);
-  emit ImageLoaded(task.id, scaled);
-  emit ImageLoaded(task.id, scaled, image);
+  FinishTask(task, image);
 }
 
 void AlbumCoverLoader::RemoteFetchFinished(QNetworkReply* reply) {
@@ -224,6 +448,7 @@ void AlbumCoverLoader::RemoteFetchFinished(QNetworkReply* reply) {
       reply->attribute(QNetworkRequest::RedirectionTargetAttribute);
   if (redirect.isValid()) {
     if (++task.redirects > kMaxRedirects) {
+      TaskFinished(task.id);
       return;  // Give up.
     }
     QNetworkRequest request = reply->request();
@@ -240,9 +465,7 @@ void AlbumCoverLoader::RemoteFetchFinished(QNetworkReply* reply) {
     // Try to load the image
     QImage image;
     if (image.load(reply, 0)) {
-      QImage scaled = ScaleAndPad(task.options, image);
-      emit ImageLoaded(task.id, scaled);
-      emit ImageLoaded(task.id, scaled, image);
+      FinishTask(task, image);
       return;
     }
   }
@@ -21,14 +21,19 @@
 #ifndef COVERS_ALBUMCOVERLOADER_H_
 #define COVERS_ALBUMCOVERLOADER_H_
 
+#include "albumcovercache.h"
 #include "albumcoverloaderoptions.h"
 #include "core/song.h"
 
+#include <QFuture>
 #include <QImage>
 #include <QMutex>
 #include <QObject>
 #include <QQueue>
+#include <QSet>
+#include <QThreadPool>
 #include <QUrl>
+#include <QWaitCondition>
 
 class NetworkAccessManager;
 class QNetworkReply;
@@ -38,6 +43,7 @@ class AlbumCoverLoader : public QObject {
 
  public:
   explicit AlbumCoverLoader(QObject* parent = nullptr);
+  ~AlbumCoverLoader();
 
   void Stop() { stop_requested_ = true; }
 
@@ -54,11 +60,22 @@ class AlbumCoverLoader : public QObject {
   void CancelTask(quint64 id);
   void CancelTasks(const QSet<quint64>& ids);
 
+  // Moves the given tasks ahead of everything else in the queue, for covers
+  // that are currently on screen.  Tasks that were prioritized by an earlier
+  // call and aren't in ids go back to the normal queue.
+  void PrioritizeTasks(const QSet<quint64>& ids);
+
   static QPixmap TryLoadPixmap(const QString& automatic, const QString& manual,
                                const QString& filename = QString());
   static QImage ScaleAndPad(const AlbumCoverLoaderOptions& options,
                             const QImage& image);
 
+  // Thumbnails of loaded covers are kept here between requests.
+  AlbumCoverCache* cache() { return &cache_; }
+  AlbumCoverCacheStatistics cache_statistics() const {
+    return cache_.statistics();
+  }
+
  signals:
   void ImageLoaded(quint64 id, const QImage& image);
   void ImageLoaded(quint64 id, const QImage& scaled, const QImage& original);
@@ -86,22 +103,69 @@ class AlbumCoverLoader : public QObject {
   };
 
   struct TryLoadResult {
-    TryLoadResult(bool async, bool success, const QImage& i)
-        : started_async(async), loaded_success(success), image(i) {}
+    TryLoadResult(bool remote, bool success, const QImage& i)
+        : remote(remote), loaded_success(success), image(i) {}
 
-    bool started_async;
+    // The image has to be fetched over the network by StartRemoteFetch.
+    bool remote;
     bool loaded_success;
     QImage image;
   };
 
-  void ProcessTask(Task* task);
+  struct DecodeResult {
+    enum Type { Type_Loaded, Type_Failed, Type_Remote, Type_Cancelled, };
+
+    DecodeResult() : type(Type_Failed) {}
+
+    Type type;
+    Task task;
+    QImage scaled;
+    QImage original;
+  };
+
+ protected slots:
+  void DecodeFinished(QFuture<DecodeResult> future);
+
+ protected:
+  // Runs a task on decode_pool_.
+  void StartDecoding(const Task& task);
+  // Called in decode_pool_.  Loads the image from the cache, a local file
+  // or the song's tags, trying the manual then the automatic cover.
+  DecodeResult RunDecodeTask(Task task);
+  DecodeResult DecodeTask(const Task& task);
+
   void NextState(Task* task);
   TryLoadResult TryLoadImage(const Task& task);
+  void StartRemoteFetch(const Task& task);
+
+  // Scales the image and adds it to the cache.  Thread-safe.
+  QImage ScaleAndCache(const Task& task, const QImage& image);
+  // Scales the image, adds it to the cache and emits ImageLoaded.
+  void FinishTask(const Task& task, const QImage& image);
+  void EmitImageLoaded(const Task& task, const QImage& scaled,
+                       const QImage& original);
+  static QString CacheKey(const Task& task);
+
+  bool IsCancelled(quint64 id);
+  // Forgets about a task that's done.  Returns false if it was cancelled while
+  // it was running, in which case nothing should be emitted for it.
+  bool TaskFinished(quint64 id);
 
   bool stop_requested_;
 
   QMutex mutex_;
   QQueue<Task> tasks_;
+  QQueue<Task> priority_tasks_;
+  // Tasks that have been taken off the queues but haven't finished yet, and
+  // the ones among those that have been cancelled since.
+  QSet<quint64> running_tasks_;
+  QSet<quint64> cancelled_tasks_;
+  // Number of tasks in decode_pool_, which is kept below max_decoding_count_
+  // so the rest wait in the queues above and priority tasks can jump ahead.
+  int decoding_count_;
+  const int max_decoding_count_;
+  QThreadPool decode_pool_;
+  QWaitCondition decoding_finished_;
   QMap<QNetworkReply*, Task> remote_tasks_;
   QMap<QString, Task> remote_spotify_tasks_;
   quint64 next_id_;
@@ -110,6 +174,8 @@ class AlbumCoverLoader : public QObject {
 
   bool connected_spotify_;
 
+  AlbumCoverCache cache_;
+
   static const int kMaxRedirects = 3;
 };
 
@@ -26,11 +26,16 @@ struct AlbumCoverLoaderOptions {
   AlbumCoverLoaderOptions()
       : desired_height_(120),
         scale_output_image_(true),
-        pad_output_image_(true) {}
+        pad_output_image_(true),
+        need_original_image_(false) {}
 
   int desired_height_;
   bool scale_output_image_;
   bool pad_output_image_;
+  // Set this if you use the original image from the three argument version of
+  // ImageLoaded.  Otherwise the loader may return a cached scaled image there
+  // instead of decoding the original again.
+  bool need_original_image_;
   QImage default_output_image_;
 };
 
@@ -39,7 +39,10 @@ const char* KittenLoader::kFlickrKittenUrl =
 const char* KittenLoader::kFlickrPhotoUrl =
     "https://farm%1.static.flickr.com/%2/%3_%4_m.jpg";
 
-KittenLoader::KittenLoader(QObject* parent) : AlbumCoverLoader(parent) {}
+KittenLoader::KittenLoader(QObject* parent) : AlbumCoverLoader(parent) {
+  // Every kitten is different, there's no point keeping them around.
+  cache_.SetDiskCacheDir(QString());
+}
 
 quint64 KittenLoader::LoadKitten(const AlbumCoverLoaderOptions& options) {
   if (!kitten_urls_.isEmpty()) {
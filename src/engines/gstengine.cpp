@@ -95,7 +95,6 @@ GstEngine::GstEngine(TaskManager* task_manager)
     : Engine::Base(),
       task_manager_(task_manager),
       buffering_task_id_(-1),
-      latest_buffer_(nullptr),
       equalizer_enabled_(false),
       stereo_balance_(0.0f),
       rg_enabled_(false),
@@ -111,8 +110,9 @@ GstEngine::GstEngine(TaskManager* task_manager)
       next_element_id_(0),
       is_fading_out_to_pause_(false),
       has_faded_out_(false),
-      scope_chunk_(0),
-      have_new_buffer_(false) {
+      scope_pipeline_id_(-1),
+      scope_position_(0),
+      scope_last_written_(0) {
   seek_timer_->setSingleShot(true);
   seek_timer_->setInterval(kSeekDelayNanosec / kNsecPerMsec);
   connect(seek_timer_, SIGNAL(timeout()), SLOT(SeekNow()));
@@ -249,101 +249,41 @@ Engine::State GstEngine::state() const {
   }
 }
 
-void GstEngine::ConsumeBuffer(GstBuffer* buffer, int pipeline_id) {
-  // Schedule this to run in the GUI thread.  The buffer gets added to the
-  // queue and unreffed by UpdateScope.
-  if (!QMetaObject::invokeMethod(this, "AddBufferToScope",
-                                 Q_ARG(GstBuffer*, buffer),
-                                 Q_ARG(int, pipeline_id))) {
-    qLog(Warning) << "Failed to invoke AddBufferToScope on GstEngine";
-  }
-}
-
-void GstEngine::AddBufferToScope(GstBuffer* buf, int pipeline_id) {
-  if (!current_pipeline_ || current_pipeline_->id() != pipeline_id) {
-    gst_buffer_unref(buf);
-    return;
-  }
-
-  if (latest_buffer_ != nullptr) {
-    gst_buffer_unref(latest_buffer_);
-  }
-
-  latest_buffer_ = buf;
-  have_new_buffer_ = true;
-}
-
 const Engine::Scope& GstEngine::scope(int chunk_length) {
-  // the new buffer could have a different size
-  if (have_new_buffer_) {
-    if (latest_buffer_ != nullptr) {
-      scope_chunks_ = ceil(((double)GST_BUFFER_DURATION(latest_buffer_) /
-                            (double)(chunk_length * kNsecPerMsec)));
-    }
+  if (!current_pipeline_) return scope_;
 
-    // if the buffer is shorter than the chunk length
-    if (scope_chunks_ <= 0) {
-      scope_chunks_ = 1;
-    }
+  const PcmRingBuffer& buffer = current_pipeline_->scope_buffer();
+  const quint32 written = buffer.write_position();
+  const int window = scope_.size();
 
-    scope_chunk_ = 0;
-    have_new_buffer_ = false;
+  if (current_pipeline_->id() != scope_pipeline_id_) {
+    scope_pipeline_id_ = current_pipeline_->id();
+    scope_position_ = 0;
+    scope_last_written_ = 0;
   }
 
-  if (latest_buffer_ != nullptr) {
-    UpdateScope(chunk_length);
+  // When new samples arrive start stepping through them from the beginning,
+  // one chunk_length at a time, like they are being played.
+  if (written != scope_last_written_) {
+    scope_position_ = scope_last_written_;
+    scope_last_written_ = written;
   }
 
-  return scope_;
-}
-
-void GstEngine::UpdateScope(int chunk_length) {
-  typedef Engine::Scope::value_type sample_type;
-
-  // prevent dbz or invalid chunk size
-  if (!GST_CLOCK_TIME_IS_VALID(GST_BUFFER_DURATION(latest_buffer_))) return;
-  if (GST_BUFFER_DURATION(latest_buffer_) == 0) return;
-
-  GstMapInfo map;
-  gst_buffer_map(latest_buffer_, &map, GST_MAP_READ);
-
-  // determine where to split the buffer
-  int chunk_density =
-      (map.size * kNsecPerMsec) / GST_BUFFER_DURATION(latest_buffer_);
-
-  int chunk_size = chunk_length * chunk_density;
-
-  // in case a buffer doesn't arrive in time
-  if (scope_chunk_ >= scope_chunks_) {
-    scope_chunk_ = 0;
-    return;
+  // Don't fall behind what's still in the buffer or run past the end of it
+  if (written - scope_position_ > static_cast<quint32>(buffer.capacity()) ||
+      static_cast<qint32>(written - scope_position_) < window) {
+    scope_position_ = written - window;
   }
 
-  const sample_type* source = reinterpret_cast<sample_type*>(map.data);
-  sample_type* dest = scope_.data();
-  source += (chunk_size / sizeof(sample_type)) * scope_chunk_;
-
-  int bytes = 0;
-
-  // make sure we don't go beyond the end of the buffer
-  if (scope_chunk_ == scope_chunks_ - 1) {
-    bytes = qMin(static_cast<Engine::Scope::size_type>(
-                     map.size - (chunk_size * scope_chunk_)),
-                 scope_.size() * sizeof(sample_type));
-  } else {
-    bytes = qMin(static_cast<Engine::Scope::size_type>(chunk_size),
-                 scope_.size() * sizeof(sample_type));
+  // If the samples were overwritten while they were being copied, keep
+  // showing the previous window rather than a torn one.
+  scope_read_buffer_.resize(window);
+  if (buffer.Read(scope_position_, scope_read_buffer_.data(), window)) {
+    scope_.swap(scope_read_buffer_);
   }
+  scope_position_ += buffer.samples_per_second() * chunk_length / kMsecPerSec;
 
-  scope_chunk_++;
-  memcpy(dest, source, bytes);
-
-  gst_buffer_unmap(latest_buffer_, &map);
-
-  if (scope_chunk_ == scope_chunks_) {
-    gst_buffer_unref(latest_buffer_);
-    latest_buffer_ = nullptr;
-  }
+  return scope_;
 }
 
 void GstEngine::StartPreloading(const QUrl& url, bool force_stop_at_end,
@@ -804,7 +744,6 @@ shared_ptr<GstEnginePipeline> GstEngine::CreatePipeline() {
   ret->set_mono_playback(mono_playback_);
   ret->set_sample_rate(sample_rate_);
 
-  ret->AddBufferConsumer(this);
   for (BufferConsumer* consumer : buffer_consumers_) {
     ret->AddBufferConsumer(consumer);
   }
@@ -54,7 +54,7 @@ typedef struct _GTlsDatabase GTlsDatabase;
  * @short GStreamer engine plugin
  * @author Mark Kretschmann <markey@web.de>
  */
-class GstEngine : public Engine::Base, public BufferConsumer {
+class GstEngine : public Engine::Base {
   Q_OBJECT
 
  public:
@@ -91,9 +91,6 @@ class GstEngine : public Engine::Base, public BufferConsumer {
 
   GstElement* CreateElement(const QString& factoryName, GstElement* bin = 0);
 
-  // BufferConsumer
-  void ConsumeBuffer(GstBuffer* buffer, int pipeline_id);
-
  public slots:
   void StartPreloading(const QUrl& url, bool force_stop_at_end,
                        qint64 beginning_nanosec, qint64 end_nanosec);
@@ -133,7 +130,6 @@ class GstEngine : public Engine::Base, public BufferConsumer {
   void HandlePipelineError(int pipeline_id, const QString& message, int domain,
                            int error_code);
   void NewMetaData(int pipeline_id, const Engine::SimpleMetaBundle& bundle);
-  void AddBufferToScope(GstBuffer* buf, int pipeline_id);
   void FadeoutFinished();
   void FadeoutPauseFinished();
   void SeekNow();
@@ -165,8 +161,6 @@ class GstEngine : public Engine::Base, public BufferConsumer {
   std::shared_ptr<GstEnginePipeline> CreatePipeline(const QUrl& url,
                                                     qint64 end_nanosec);
 
-  void UpdateScope(int chunk_length);
-
   int AddBackgroundStream(std::shared_ptr<GstEnginePipeline> pipeline);
 
   static QUrl FixupUrl(const QUrl& url);
@@ -194,8 +188,6 @@ class GstEngine : public Engine::Base, public BufferConsumer {
 
   QList<BufferConsumer*> buffer_consumers_;
 
-  GstBuffer* latest_buffer_;
-
   bool equalizer_enabled_;
   int equalizer_preamp_;
   QList<int> equalizer_gains_;
@@ -229,9 +221,12 @@ class GstEngine : public Engine::Base, public BufferConsumer {
   bool is_fading_out_to_pause_;
   bool has_faded_out_;
 
-  int scope_chunk_;
-  bool have_new_buffer_;
-  int scope_chunks_;
+  // Where the next scope is read from in the current pipeline's scope buffer,
+  // and how far that buffer had been written the last time we looked.
+  int scope_pipeline_id_;
+  quint32 scope_position_;
+  quint32 scope_last_written_;
+  Engine::Scope scope_read_buffer_;
 
   QList<DeviceFinder*> device_finders_;
 
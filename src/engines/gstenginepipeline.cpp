@@ -41,6 +41,8 @@ const int GstEnginePipeline::kGstStateTimeoutNanosecs = 10000000;
 const int GstEnginePipeline::kFaderFudgeMsec = 2000;
 
 const int GstEnginePipeline::kEqBandCount = 10;
+// About 0.75 seconds of stereo audio at 44.1kHz
+const int GstEnginePipeline::kScopeBufferSamples = 1 << 16;
 const int GstEnginePipeline::kEqBandFrequencies[] = {
     60, 170, 310, 600, 1000, 3000, 6000, 12000, 14000, 16000};
 
@@ -53,6 +55,7 @@ GstEnginePipeline::GstEnginePipeline(GstEngine* engine)
       id_(sId++),
       valid_(false),
       sink_(GstEngine::kAutoSink),
+      scope_buffer_(kScopeBufferSamples),
       segment_start_(0),
       segment_start_received_(false),
       emit_track_ended_on_stream_start_(false),
@@ -851,6 +854,22 @@ GstPadProbeReturn GstEnginePipeline::HandoffCallback(GstPad*,
   GstEnginePipeline* instance = reinterpret_cast<GstEnginePipeline*>(self);
   GstBuffer* buf = gst_pad_probe_info_get_buffer(info);
 
+  // Keep a copy of the samples around for the analyzers.  This pad is after
+  // the converter that forces 16 bit samples.
+  GstMapInfo map;
+  if (gst_buffer_map(buf, &map, GST_MAP_READ)) {
+    const int samples = map.size / sizeof(qint16);
+    instance->scope_buffer_.Write(reinterpret_cast<const qint16*>(map.data),
+                                  samples);
+    gst_buffer_unmap(buf, &map);
+
+    const GstClockTime duration = GST_BUFFER_DURATION(buf);
+    if (GST_CLOCK_TIME_IS_VALID(duration) && duration > 0) {
+      instance->scope_buffer_.set_samples_per_second(samples * kNsecPerSec /
+                                                     duration);
+    }
+  }
+
   QList<BufferConsumer*> consumers;
   {
     QMutexLocker l(&instance->buffer_consumers_mutex_);
@@ -31,6 +31,7 @@
 #include <gst/gst.h>
 
 #include "engine_fwd.h"
+#include "pcmringbuffer.h"
 
 class GstElementDeleter;
 class GstEngine;
@@ -66,6 +67,10 @@ class GstEnginePipeline : public QObject {
   void RemoveBufferConsumer(BufferConsumer* consumer);
   void RemoveAllBufferConsumers();
 
+  // The most recent audio data as 16 bit samples, for analyzers.  Written by
+  // the streaming thread, can be read from any thread.
+  const PcmRingBuffer& scope_buffer() const { return scope_buffer_; }
+
   // Control the music playback
   QFuture<GstStateChangeReturn> SetState(GstState state);
   Q_INVOKABLE bool Seek(qint64 nanosec);
@@ -172,6 +177,7 @@ signals:
   static const int kFaderFudgeMsec;
   static const int kEqBandCount;
   static const int kEqBandFrequencies[];
+  static const int kScopeBufferSamples;
 
   static GstElementDeleter* sElementDeleter;
 
@@ -193,6 +199,7 @@ signals:
   // These get called when there is a new audio buffer available
   QList<BufferConsumer*> buffer_consumers_;
   QMutex buffer_consumers_mutex_;
+  PcmRingBuffer scope_buffer_;
   qint64 segment_start_;
   bool segment_start_received_;
   bool emit_track_ended_on_stream_start_;
@@ -0,0 +1,95 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pcmringbuffer.h"
+
+#include <cstring>
+
+namespace {
+
+int NextPowerOfTwo(int value) {
+  int ret = 1;
+  while (ret < value) ret <<= 1;
+  return ret;
+}
+
+}  // namespace
+
+PcmRingBuffer::PcmRingBuffer(int capacity)
+    : capacity_(NextPowerOfTwo(capacity)),
+      mask_(capacity_ - 1),
+      samples_(new qint16[capacity_]),
+      reserved_(0),
+      written_(0),
+      samples_per_second_(0) {
+  memset(samples_, 0, capacity_ * sizeof(qint16));
+}
+
+PcmRingBuffer::~PcmRingBuffer() { delete[] samples_; }
+
+void PcmRingBuffer::Write(const qint16* samples, int count) {
+  // Only the newest samples would survive anyway
+  if (count > capacity_) {
+    samples += count - capacity_;
+    count = capacity_;
+  }
+
+  // There's only one writer, so nothing else can move these under us.
+  const quint32 start = static_cast<quint32>(written_.fetchAndAddAcquire(0));
+  const quint32 end = start + count;
+  reserved_.fetchAndStoreOrdered(static_cast<int>(end));
+
+  const int offset = start & mask_;
+  const int first = qMin(count, capacity_ - offset);
+  memcpy(samples_ + offset, samples, first * sizeof(qint16));
+  memcpy(samples_, samples + first, (count - first) * sizeof(qint16));
+
+  written_.fetchAndStoreRelease(static_cast<int>(end));
+}
+
+void PcmRingBuffer::set_samples_per_second(int samples_per_second) {
+  samples_per_second_.fetchAndStoreRelaxed(samples_per_second);
+}
+
+quint32 PcmRingBuffer::write_position() const {
+  return static_cast<quint32>(written_.fetchAndAddAcquire(0));
+}
+
+int PcmRingBuffer::samples_per_second() const {
+  return samples_per_second_.fetchAndAddRelaxed(0);
+}
+
+bool PcmRingBuffer::Read(quint32 position, qint16* dest, int count) const {
+  if (count > capacity_) return false;
+
+  // Have all the samples been written?
+  const quint32 written = write_position();
+  if (static_cast<qint32>(written - position) < count) return false;
+
+  CopyOut(position, dest, count);
+
+  // Make sure the writer didn't start overwriting them while we were copying.
+  const quint32 reserved =
+      static_cast<quint32>(reserved_.fetchAndAddOrdered(0));
+  return reserved - position <= static_cast<quint32>(capacity_);
+}
+
+void PcmRingBuffer::CopyOut(quint32 position, qint16* dest, int count) const {
+  const int offset = position & mask_;
+  const int first = qMin(count, capacity_ - offset);
+  memcpy(dest, samples_ + offset, first * sizeof(qint16));
+  memcpy(dest + first, samples_, (count - first) * sizeof(qint16));
+}
@@ -0,0 +1,70 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PCMRINGBUFFER_H
+#define PCMRINGBUFFER_H
+
+#include <QAtomicInt>
+#include <QtGlobal>
+
+// A ring of interleaved 16 bit PCM samples with a single writer and any number
+// of readers.  The GStreamer streaming thread writes every buffer into it and
+// the GUI thread reads windows of recent samples out of it, neither of them
+// taking a lock.
+//
+// Positions count samples written since the buffer was created and wrap around
+// at 2^32, so they should always be compared by subtracting them.
+class PcmRingBuffer {
+ public:
+  // The capacity is rounded up to a power of two.
+  explicit PcmRingBuffer(int capacity);
+  ~PcmRingBuffer();
+
+  int capacity() const { return capacity_; }
+
+  // Called only from the writing thread.
+  void Write(const qint16* samples, int count);
+  void set_samples_per_second(int samples_per_second);
+
+  // The position just after the newest sample in the buffer.
+  quint32 write_position() const;
+  // Interleaved samples (ie. including all channels) per second of audio, or 0
+  // if it isn't known yet.
+  int samples_per_second() const;
+
+  // Copies count samples starting at position into dest.  Returns false if
+  // some of those samples haven't been written yet or have already been
+  // overwritten.
+  bool Read(quint32 position, qint16* dest, int count) const;
+
+ private:
+  Q_DISABLE_COPY(PcmRingBuffer);
+
+  void CopyOut(quint32 position, qint16* dest, int count) const;
+
+  const int capacity_;
+  const quint32 mask_;
+  qint16* samples_;
+
+  // The writer moves reserved_ forward before it starts overwriting old
+  // samples and written_ once the new ones are in place, so a reader can tell
+  // whether a copy raced with a write.
+  mutable QAtomicInt reserved_;
+  mutable QAtomicInt written_;
+  mutable QAtomicInt samples_per_second_;
+};
+
+#endif  // PCMRINGBUFFER_H
@@ -0,0 +1,442 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "librarysearchindex.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <QMutexLocker>
+#include <QReadLocker>
+#include <QRegExp>
+#include <QWriteLocker>
+
+namespace {
+
+// How much a match in each of Song::kFtsColumns counts towards a song's
+// score, in the same order.
+const int kColumnWeights[] = {10,  // title
+                              6,   // album
+                              8,   // artist
+                              6,   // albumartist
+                              3,   // composer
+                              3,   // performer
+                              2,   // grouping
+                              2,   // genre
+                              1,   // comment
+                              2};  // year
+
+int ColumnWeight(quint16 columns) {
+  int ret = 0;
+  for (int i = 0; columns; ++i, columns >>= 1) {
+    if (columns & 1) ret = qMax(ret, kColumnWeights[i]);
+  }
+  return ret;
+}
+
+bool ByScore(const std::pair<int, int>& a, const std::pair<int, int>& b) {
+  // Higher scores first, then in the order the songs were added.
+  if (a.second != b.second) return a.second > b.second;
+  return a.first < b.first;
+}
+
+// Values in the per-term token masks built by Search.
+enum TokenMatch { TokenMatch_None = 0, TokenMatch_Prefix, TokenMatch_Exact };
+
+}  // namespace
+
+LibrarySearchIndex::LibrarySearchIndex()
+    : trie_(1),
+      dead_documents_(0),
+      generation_(0),
+      loading_(false),
+      last_generation_(-1) {}
+
+QStringList LibrarySearchIndex::Tokenize(const QString& text) {
+  // This has to match Database::FTSOpen, otherwise searches would find
+  // different things depending on which of the two handles them.
+  QStringList ret;
+  QString token;
+
+  const QString lower = text.toLower();
+  for (const QChar& c : lower) {
+    if (!c.isLetterOrNumber()) {
+      if (!token.isEmpty()) {
+        ret << token;
+        token.clear();
+      }
+    } else if (c.decompositionTag() != QChar::NoDecomposition) {
+      token.append(c.decomposition()[0]);
+    } else {
+      token.append(c);
+    }
+  }
+  if (!token.isEmpty()) ret << token;
+
+  return ret;
+}
+
+LibrarySearchIndex::TermList LibrarySearchIndex::ParseQuery(
+    const QString& query) {
+  // The same munging as LibraryQuery does with its filter, except the words
+  // are kept apart instead of being joined into an FTS query.
+  TermList ret;
+
+  for (QString token : query.split(QRegExp("\\s+"), QString::SkipEmptyParts)) {
+    token.remove('(');
+    token.remove(')');
+    token.remove('"');
+
+    int column = -1;
+    if (token.contains(':')) {
+      const int index = Song::kFtsColumns.indexOf(
+          "fts" + token.section(':', 0, 0).toLower());
+      if (index != -1) {
+        column = index;
+        token = token.section(':', 1, -1);
+      }
+    }
+
+    for (const QString& word : Tokenize(token)) {
+      ret << Term(word, column);
+    }
+  }
+
+  return ret;
+}
+
+bool LibrarySearchIndex::IsRefinement(const TermList& old_terms,
+                                      const TermList& new_terms) {
+  // Every song matching the new terms also matches the old ones if each old
+  // term has a corresponding new term that's at least as specific.
+  if (old_terms.isEmpty() || new_terms.count() < old_terms.count()) {
+    return false;
+  }
+
+  for (int i = 0; i < old_terms.count(); ++i) {
+    const Term& o = old_terms[i];
+    const Term& n = new_terms[i];
+    if (!n.prefix.startsWith(o.prefix)) return false;
+    if (o.column != -1 && o.column != n.column) return false;
+  }
+  return true;
+}
+
+void LibrarySearchIndex::BeginLoad() {
+  QWriteLocker l(&lock_);
+  loading_ = true;
+  changed_while_loading_.clear();
+}
+
+void LibrarySearchIndex::LoadSong(int id, const QStringList& fields) {
+  QWriteLocker l(&lock_);
+  if (changed_while_loading_.contains(id)) return;
+
+  RemoveDocument(id);
+  AddDocument(id, fields);
+}
+
+void LibrarySearchIndex::EndLoad() {
+  QWriteLocker l(&lock_);
+  loading_ = false;
+  changed_while_loading_.clear();
+  CompactIfNeeded();
+}
+
+void LibrarySearchIndex::AddOrUpdateSongs(const SongList& songs) {
+  QWriteLocker l(&lock_);
+
+  for (const Song& song : songs) {
+    if (song.id() == -1) continue;
+
+    QStringList fields;
+    fields << song.title() << song.album() << song.artist()
+           << song.albumartist() << song.composer() << song.performer()
+           << song.grouping() << song.genre() << song.comment()
+           << (song.year() > 0 ? QString::number(song.year()) : QString());
+
+    RemoveDocument(song.id());
+    AddDocument(song.id(), fields);
+    if (loading_) changed_while_loading_.insert(song.id());
+  }
+}
+
+void LibrarySearchIndex::RemoveSongs(const SongList& songs) {
+  QWriteLocker l(&lock_);
+
+  for (const Song& song : songs) {
+    RemoveDocument(song.id());
+    if (loading_) changed_while_loading_.insert(song.id());
+  }
+  CompactIfNeeded();
+}
+
+void LibrarySearchIndex::Clear() {
+  QWriteLocker l(&lock_);
+
+  token_ids_.clear();
+  tokens_.clear();
+  postings_.clear();
+  trie_ = QVector<TrieNode>(1);
+  documents_.clear();
+  documents_by_song_id_.clear();
+  dead_documents_ = 0;
+  changed_while_loading_.clear();
+  generation_++;
+}
+
+int LibrarySearchIndex::song_count() const {
+  QReadLocker l(&lock_);
+  return documents_by_song_id_.count();
+}
+
+int LibrarySearchIndex::TokenId(const QString& token) {
+  QHash<QString, int>::const_iterator it = token_ids_.constFind(token);
+  if (it != token_ids_.constEnd()) return it.value();
+
+  const int id = tokens_.count();
+  token_ids_.insert(token, id);
+  tokens_ << token;
+  postings_.append(PostingList());
+
+  // Add it to the trie
+  int node = 0;
+  for (const QChar& c : token) {
+    int child = trie_[node].first_child;
+    while (child != -1 && trie_[child].c != c) {
+      child = trie_[child].next_sibling;
+    }
+
+    if (child == -1) {
+      child = trie_.count();
+      TrieNode new_node(c);
+      new_node.next_sibling = trie_[node].first_child;
+      trie_.append(new_node);
+      trie_[node].first_child = child;
+    }
+    node = child;
+  }
+  trie_[node].token = id;
+
+  return id;
+}
+
+void LibrarySearchIndex::AddDocument(int song_id, const QStringList& fields) {
+  Document doc;
+  doc.song_id = song_id;
+  doc.alive = true;
+
+  const int doc_index = documents_.count();
+  const int column_count = qMin(fields.count(), Song::kFtsColumns.count());
+  for (int column = 0; column < column_count; ++column) {
+    for (const QString& token : Tokenize(fields[column])) {
+      const int token_id = TokenId(token);
+
+      // Songs only have a handful of tokens, so a linear search is fine.
+      bool found = false;
+      for (Posting& posting : doc.tokens) {
+        if (posting.id == token_id) {
+          posting.columns |= 1 << column;
+          found = true;
+          break;
+        }
+      }
+      if (!found) doc.tokens.append(Posting(token_id, 1 << column));
+    }
+  }
+
+  for (const Posting& posting : doc.tokens) {
+    postings_[posting.id].append(Posting(doc_index, posting.columns));
+  }
+
+  documents_.append(doc);
+  documents_by_song_id_[song_id] = doc_index;
+  generation_++;
+}
+
+void LibrarySearchIndex::RemoveDocument(int song_id) {
+  QHash<int, int>::iterator it = documents_by_song_id_.find(song_id);
+  if (it == documents_by_song_id_.end()) return;
+
+  // The document is left in the posting lists until the next compaction,
+  // searches skip it in the meantime.
+  Document& doc = documents_[it.value()];
+  doc.alive = false;
+  doc.tokens.clear();
+  documents_by_song_id_.erase(it);
+  dead_documents_++;
+  generation_++;
+}
+
+void LibrarySearchIndex::CompactIfNeeded() {
+  if (loading_ || dead_documents_ * 2 <= documents_.count()) return;
+
+  QVector<Document> documents;
+  documents.reserve(documents_.count() - dead_documents_);
+  documents_by_song_id_.clear();
+  for (PostingList& postings : postings_) postings.clear();
+
+  for (const Document& doc : documents_) {
+    if (!doc.alive) continue;
+
+    const int doc_index = documents.count();
+    for (const Posting& posting : doc.tokens) {
+      postings_[posting.id].append(Posting(doc_index, posting.columns));
+    }
+    documents_by_song_id_[doc.song_id] = doc_index;
+    documents << doc;
+  }
+
+  documents_ = documents;
+  dead_documents_ = 0;
+  generation_++;
+}
+
+void LibrarySearchIndex::TokensWithPrefix(const QString& prefix,
+                                          QVector<int>* tokens) const {
+  int node = 0;
+  for (const QChar& c : prefix) {
+    node = trie_[node].first_child;
+    while (node != -1 && trie_[node].c != c) {
+      node = trie_[node].next_sibling;
+    }
+    if (node == -1) return;
+  }
+
+  // Collect every token under this node
+  QVector<int> stack;
+  stack << node;
+  while (!stack.isEmpty()) {
+    const TrieNode& n = trie_[stack.last()];
+    stack.pop_back();
+
+    if (n.token != -1) tokens->append(n.token);
+    for (int child = n.first_child; child != -1;
+         child = trie_[child].next_sibling) {
+      stack << child;
+    }
+  }
+}
+
+QList<int> LibrarySearchIndex::Search(const QString& query, int max_results) {
+  const TermList terms = ParseQuery(query);
+  if (terms.isEmpty() || max_results <= 0) return QList<int>();
+
+  QReadLocker l(&lock_);
+
+  // For each term, which tokens match it and how well.
+  QVector<QVector<int> > term_tokens(terms.count());
+  QVector<QVector<quint8> > term_masks(terms.count());
+  int rarest_term = -1;
+  int rarest_count = 0;
+  for (int i = 0; i < terms.count(); ++i) {
+    TokensWithPrefix(terms[i].prefix, &term_tokens[i]);
+    if (term_tokens[i].isEmpty()) return QList<int>();
+
+    term_masks[i].fill(TokenMatch_None, tokens_.count());
+    int count = 0;
+    for (int token : term_tokens[i]) {
+      term_masks[i][token] = tokens_[token].length() == terms[i].prefix.length()
+                                 ? TokenMatch_Exact
+                                 : TokenMatch_Prefix;
+      count += postings_[token].count();
+    }
+
+    if (rarest_term == -1 || count < rarest_count) {
+      rarest_term = i;
+      rarest_count = count;
+    }
+  }
+
+  // Find the songs that might match.  If the user just typed a bit more
+  // since the last search these are the previous matches, otherwise they're
+  // the songs containing the least common term.
+  QVector<int> candidates;
+  {
+    QMutexLocker cache_lock(&last_search_mutex_);
+    if (last_generation_ == generation_ && IsRefinement(last_terms_, terms)) {
+      candidates = last_matches_;
+    }
+  }
+
+  if (candidates.isEmpty()) {
+    const quint16 column_mask =
+        terms[rarest_term].column == -1 ? 0xffff
+                                        : 1 << terms[rarest_term].column;
+    QVector<bool> seen(documents_.count(), false);
+    candidates.reserve(rarest_count);
+    for (int token : term_tokens[rarest_term]) {
+      for (const Posting& posting : postings_[token]) {
+        if (!(posting.columns & column_mask) || seen[posting.id]) continue;
+        if (!documents_[posting.id].alive) continue;
+        seen[posting.id] = true;
+        candidates << posting.id;
+      }
+    }
+    std::sort(candidates.begin(), candidates.end());
+  }
+
+  // Check every candidate against all the terms and score it.
+  QVector<int> matches;
+  std::vector<std::pair<int, int> > scored;
+  for (int doc_index : candidates) {
+    const Document& doc = documents_[doc_index];
+    if (!doc.alive) continue;
+
+    int score = 0;
+    bool matched = true;
+    for (int i = 0; i < terms.count() && matched; ++i) {
+      const quint8* mask = term_masks[i].constData();
+      const quint16 column_mask =
+          terms[i].column == -1 ? 0xffff : 1 << terms[i].column;
+
+      int best = 0;
+      for (const Posting& posting : doc.tokens) {
+        const quint8 match = mask[posting.id];
+        if (match == TokenMatch_None || !(posting.columns & column_mask)) {
+          continue;
+        }
+        best = qMax(best, ColumnWeight(posting.columns & column_mask) *
+                              (match == TokenMatch_Exact ? 2 : 1));
+      }
+
+      if (best == 0) matched = false;
+      score += best;
+    }
+
+    if (!matched) continue;
+    matches << doc_index;
+    scored.push_back(std::make_pair(doc_index, score));
+  }
+
+  {
+    QMutexLocker cache_lock(&last_search_mutex_);
+    last_generation_ = generation_;
+    last_terms_ = terms;
+    last_matches_ = matches;
+  }
+
+  const int count = qMin(max_results, int(scored.size()));
+  std::partial_sort(scored.begin(), scored.begin() + count, scored.end(),
+                    ByScore);
+
+  QList<int> ret;
+  ret.reserve(count);
+  for (int i = 0; i < count; ++i) {
+    ret << documents_[scored[i].first].song_id;
+  }
+  return ret;
+}
@@ -0,0 +1,156 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GLOBALSEARCH_LIBRARYSEARCHINDEX_H_
+#define GLOBALSEARCH_LIBRARYSEARCHINDEX_H_
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QSet>
+#include <QStringList>
+#include <QVector>
+
+#include "core/song.h"
+
+// An in-memory full text index of the songs in a library, covering the same
+// columns as the library's FTS table (Song::kFtsColumns).  Queries are
+// handled like LibraryQuery handles its filter: every word is a prefix that
+// has to appear somewhere in the song, or in one column if it's written as
+// "column:word".
+//
+// Tokens are kept in a dictionary with a prefix trie over them, and each one
+// has a posting list of the songs it appears in.  Each song also keeps its own
+// list of tokens, so a query that only adds to the previous one is answered by
+// checking the previous query's matches again instead of starting over.
+//
+// Thread-safe - any number of searches can run while the index is updated.
+class LibrarySearchIndex {
+ public:
+  LibrarySearchIndex();
+
+  // Loading the whole library takes a while, and songs can be added or
+  // removed while it happens.  Between BeginLoad() and EndLoad(), LoadSong()
+  // ignores songs that AddOrUpdateSongs() or RemoveSongs() have already
+  // seen, since the information they got is newer.
+  void BeginLoad();
+  // fields are the values of Song::kFtsColumns, in order.
+  void LoadSong(int id, const QStringList& fields);
+  void EndLoad();
+
+  void AddOrUpdateSongs(const SongList& songs);
+  void RemoveSongs(const SongList& songs);
+  void Clear();
+
+  int song_count() const;
+
+  // Returns the IDs of the songs matching query, best matches first.  At most
+  // max_results are returned.
+  QList<int> Search(const QString& query, int max_results);
+
+  // Splits text into lower-cased words without accents, the same way the
+  // "unicode" FTS tokenizer in Database does.
+  static QStringList Tokenize(const QString& text);
+
+ private:
+  struct Posting {
+    Posting(int id = -1, quint16 columns = 0) : id(id), columns(columns) {}
+
+    // A document index in a posting list, or a token ID in a document.
+    int id;
+    // Bit mask of the kFtsColumns the token appears in.
+    quint16 columns;
+  };
+  typedef QVector<Posting> PostingList;
+
+  struct Document {
+    Document() : song_id(-1), alive(false) {}
+
+    int song_id;
+    bool alive;
+    PostingList tokens;
+  };
+
+  struct TrieNode {
+    TrieNode(QChar c = QChar()) : c(c), first_child(-1), next_sibling(-1),
+                                  token(-1) {}
+
+    QChar c;
+    int first_child;
+    int next_sibling;
+    // The token that ends at this node, or -1.
+    int token;
+  };
+
+  struct Term {
+    Term(const QString& prefix = QString(), int column = -1)
+        : prefix(prefix), column(column) {}
+
+    QString prefix;
+    // Index into kFtsColumns, or -1 for any column.
+    int column;
+  };
+  typedef QList<Term> TermList;
+
+  struct Match {
+    Match(int doc = -1, int score = 0) : doc(doc), score(score) {}
+
+    int doc;
+    int score;
+  };
+
+  // The following must be called with lock_ held for writing.
+  void AddDocument(int song_id, const QStringList& fields);
+  void RemoveDocument(int song_id);
+  int TokenId(const QString& token);
+  void CompactIfNeeded();
+
+  // The following must be called with lock_ held.
+  void TokensWithPrefix(const QString& prefix, QVector<int>* tokens) const;
+  bool MatchDocument(const Document& doc, const TermList& terms,
+                     int* score) const;
+
+  static TermList ParseQuery(const QString& query);
+  static bool IsRefinement(const TermList& old_terms,
+                           const TermList& new_terms);
+
+  mutable QReadWriteLock lock_;
+
+  // Token dictionary.
+  QHash<QString, int> token_ids_;
+  QStringList tokens_;
+  QVector<PostingList> postings_;
+  QVector<TrieNode> trie_;
+
+  QVector<Document> documents_;
+  QHash<int, int> documents_by_song_id_;
+  int dead_documents_;
+
+  // Changes whenever document indices might have changed meaning.
+  int generation_;
+
+  bool loading_;
+  QSet<int> changed_while_loading_;
+
+  // The last query and all of its matches, for narrowing down.
+  QMutex last_search_mutex_;
+  int last_generation_;
+  TermList last_terms_;
+  QVector<int> last_matches_;
+};
+
+#endif  // GLOBALSEARCH_LIBRARYSEARCHINDEX_H_
@@ -25,13 +25,17 @@
 
 #include <QStack>
 
+const int LibrarySearchProvider::kMaxResults = 500;
+
 LibrarySearchProvider::LibrarySearchProvider(LibraryBackendInterface* backend,
                                              const QString& name,
                                              const QString& id,
                                              const QIcon& icon,
                                              bool enabled_by_default,
                                              Application* app, QObject* parent)
-    : BlockingSearchProvider(app, parent), backend_(backend) {
+    : BlockingSearchProvider(app, parent),
+      backend_(backend),
+      index_loaded_(false) {
   Hints hints =
       WantsSerialisedArtQueries | ArtIsInSongMetadata | CanGiveSuggestions;
 
@@ -40,10 +44,122 @@ LibrarySearchProvider::LibrarySearchProvider(LibraryBackendInterface* backend,
   }
 
   Init(name, id, icon, hints);
+
+  // The index is thread-safe, so keep it up to date from whichever thread the
+  // backend emits these in instead of waiting for the GUI thread.
+  connect(backend_, SIGNAL(SongsDiscovered(SongList)),
+          SLOT(SongsDiscovered(SongList)), Qt::DirectConnection);
+  connect(backend_, SIGNAL(SongsDeleted(SongList)),
+          SLOT(SongsDeleted(SongList)), Qt::DirectConnection);
+  connect(backend_, SIGNAL(DatabaseReset()), SLOT(DatabaseReset()),
+          Qt::DirectConnection);
+}
+
+void LibrarySearchProvider::SongsDiscovered(const SongList& songs) {
+  index_.AddOrUpdateSongs(songs);
+}
+
+void LibrarySearchProvider::SongsDeleted(const SongList& songs) {
+  index_.RemoveSongs(songs);
+}
+
+void LibrarySearchProvider::DatabaseReset() {
+  QMutexLocker l(&load_mutex_);
+  index_.Clear();
+  index_loaded_ = false;
+}
+
+bool LibrarySearchProvider::EnsureIndexLoaded() {
+  if (!load_mutex_.tryLock()) return false;
+
+  if (!index_loaded_) {
+    QStringList columns;
+    for (const QString& column : Song::kFtsColumns) {
+      columns << column.mid(3);  // Without the "fts" prefix
+    }
+
+    LibraryQuery q;
+    q.SetColumnSpec("ROWID, " + columns.join(", "));
+
+    index_.BeginLoad();
+    if (backend_->ExecQuery(&q)) {
+      while (q.Next()) {
+        QStringList fields;
+        for (int i = 0; i < columns.count(); ++i) {
+          const QVariant value = q.Value(i + 1);
+          // Unknown years are stored as 0 or -1, and aren't indexed by the
+          // FTS table either.
+          if (i == columns.count() - 1 && value.toInt() <= 0) {
+            fields << QString();
+          } else {
+            fields << value.toString();
+          }
+        }
+        index_.LoadSong(q.Value(0).toInt(), fields);
+      }
+      index_loaded_ = true;
+    }
+    index_.EndLoad();
+
+    qLog(Debug) << "Loaded" << index_.song_count() << "songs into the"
+                << name() << "search index";
+  }
+
+  const bool ret = index_loaded_;
+  load_mutex_.unlock();
+  return ret;
 }
 
 SearchProvider::ResultList LibrarySearchProvider::Search(int id,
                                                          const QString& query) {
+  if (!EnsureIndexLoaded()) {
+    return SearchDatabase(query);
+  }
+
+  const QList<int> ids = index_.Search(query, kMaxResults);
+  if (ids.isEmpty()) {
+    return ResultList();
+  }
+
+  QStringList id_strings;
+  QHash<int, int> rank;
+  for (int i = 0; i < ids.count(); ++i) {
+    id_strings << QString::number(ids[i]);
+    rank[ids[i]] = i;
+  }
+
+  LibraryQuery q;
+  q.SetColumnSpec("%songs_table.ROWID, " + Song::kColumnSpec);
+  q.AddWhere("ROWID", id_strings, "IN");
+
+  if (!backend_->ExecQuery(&q)) {
+    return ResultList();
+  }
+
+  // Put the results back in the order the index ranked them
+  ResultList ret;
+  ret.reserve(ids.count());
+  QVector<Result> ranked(ids.count());
+  QVector<bool> found(ids.count(), false);
+  while (q.Next()) {
+    Result result(this);
+    result.metadata_.InitFromQuery(q, true);
+
+    QHash<int, int>::const_iterator it = rank.constFind(result.metadata_.id());
+    if (it == rank.constEnd()) continue;
+    ranked[it.value()] = result;
+    found[it.value()] = true;
+  }
+
+  for (int i = 0; i < ranked.count(); ++i) {
+    if (found[i]) ret << ranked[i];
+  }
+
+  return ret;
+}
+
+SearchProvider::ResultList LibrarySearchProvider::SearchDatabase(
+    const QString& query) {
   QueryOptions options;
   options.set_filter(query);
 
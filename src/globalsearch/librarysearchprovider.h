@@ -18,11 +18,16 @@
 #ifndef LIBRARYSEARCHPROVIDER_H
 #define LIBRARYSEARCHPROVIDER_H
 
+#include <QMutex>
+
+#include "librarysearchindex.h"
 #include "searchprovider.h"
 
 class LibraryBackendInterface;
 
 class LibrarySearchProvider : public BlockingSearchProvider {
+  Q_OBJECT
+
  public:
   LibrarySearchProvider(LibraryBackendInterface* backend, const QString& name,
                         const QString& id, const QIcon& icon,
@@ -33,8 +38,26 @@ class LibrarySearchProvider : public BlockingSearchProvider {
   MimeData* LoadTracks(const ResultList& results);
   QStringList GetSuggestions(int count);
 
+  // Searches only return the best matches, up to this many.
+  static const int kMaxResults;
+
+ private slots:
+  void SongsDiscovered(const SongList& songs);
+  void SongsDeleted(const SongList& songs);
+  void DatabaseReset();
+
  private:
+  // Fills the index from the database the first time it's needed.  Returns
+  // false if the index can't be used yet, either because loading it failed or
+  // because another search is still loading it.
+  bool EnsureIndexLoaded();
+  ResultList SearchDatabase(const QString& query);
+
   LibraryBackendInterface* backend_;
+
+  QMutex load_mutex_;
+  bool index_loaded_;
+  LibrarySearchIndex index_;
 };
 
 #endif  // LIBRARYSEARCHPROVIDER_H
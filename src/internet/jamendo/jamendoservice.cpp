@@ -40,11 +40,11 @@
 #include "core/logging.h"
 #include "core/mergedproxymodel.h"
 #include "core/network.h"
-#include "core/scopedtransaction.h"
 #include "core/taskmanager.h"
 #include "core/timeconstants.h"
 #include "globalsearch/globalsearch.h"
 #include "globalsearch/librarysearchprovider.h"
+#include "library/catalogimport.h"
 #include "library/librarybackend.h"
 #include "library/libraryfilterwidget.h"
 #include "library/librarymodel.h"
@@ -75,7 +75,6 @@ const char* JamendoService::kTrackIdsColumn = "track_id";
 
 const char* JamendoService::kSettingsGroup = "Jamendo";
 
-const int JamendoService::kBatchSize = 10000;
 const int JamendoService::kApproxDatabaseSize = 450000;
 
 JamendoService::JamendoService(Application* app, InternetModel* parent)
@@ -213,6 +212,13 @@ void JamendoService::DownloadDirectoryFinished() {
   app_->task_manager()->SetTaskFinished(load_database_task_id_);
   load_database_task_id_ = 0;
 
+  if (reply->error() != QNetworkReply::NoError) {
+    qLog(Error) << "Couldn't download the Jamendo catalogue"
+                << reply->errorString();
+    reply->deleteLater();
+    return;
+  }
+
   // TODO(John Maguire): Not leak reply.
   QtIOCompressor* gzip = new QtIOCompressor(reply);
   gzip->setStreamFormat(QtIOCompressor::GzipFormat);
@@ -231,72 +237,47 @@ void JamendoService::DownloadDirectoryFinished() {
 }
 
 void JamendoService::ParseDirectory(QIODevice* device) const {
-  int total_count = 0;
-
-  // Bit of a hack: don't update the model while we're parsing the xml
-  disconnect(library_backend_, SIGNAL(SongsDiscovered(SongList)),
-             library_model_, SLOT(SongsDiscovered(SongList)));
-  disconnect(library_backend_, SIGNAL(TotalSongCountUpdated(int)), this,
-             SLOT(UpdateTotalSongCount(int)));
-
-  // Delete the database and recreate it.  This is faster than dropping tables
-  // or removing rows.
-  library_backend_->db()->RecreateAttachedDb("jamendo");
-
-  TrackIdList track_ids;
-  SongList songs;
-  QXmlStreamReader reader(device);
-  while (!reader.atEnd()) {
-    reader.readNext();
-    if (reader.tokenType() == QXmlStreamReader::StartElement &&
-        reader.name() == "artist") {
-      songs << ReadArtist(&reader, &track_ids);
+  // The catalogue is written to a new database file that replaces the old one
+  // when it's complete, so the model doesn't see any of the songs until then.
+  CatalogImport import(library_backend_);
+  import.set_attached_database("jamendo");
+  import.AddTable(kTrackIdsTable);
+  import.set_progress_function([this](int count) {
+    app_->task_manager()->SetTaskProgress(load_database_task_id_, count,
+                                          kApproxDatabaseSize);
+  });
+
+  const bool ok = import.Run(device, [this](QIODevice* xml,
+                                            CatalogImport* import) {
+    QXmlStreamReader reader(xml);
+    while (!reader.atEnd()) {
+      reader.readNext();
+      if (reader.tokenType() == QXmlStreamReader::StartElement &&
+          reader.name() == "artist") {
+        TrackIdList track_ids;
+        import->AddSongs(ReadArtist(&reader, &track_ids));
+
+        QList<QVariantList> rows;
+        for (int id : track_ids) rows << (QVariantList() << id);
+        import->AddRows(kTrackIdsTable, QStringList() << kTrackIdsColumn, rows);
+      }
     }
 
-    if (songs.count() >= kBatchSize) {
-      // Add the songs to the database in batches
-      library_backend_->AddOrUpdateSongs(songs);
-      InsertTrackIds(track_ids);
-
-      total_count += songs.count();
-      songs.clear();
-      track_ids.clear();
-
-      // Update progress info
-      app_->task_manager()->SetTaskProgress(load_database_task_id_, total_count,
-                                            kApproxDatabaseSize);
+    if (reader.hasError()) {
+      qLog(Warning) << "Error parsing the Jamendo catalogue"
+                    << reader.errorString();
+      return false;
     }
-  }
-
-  library_backend_->AddOrUpdateSongs(songs);
-  InsertTrackIds(track_ids);
-
-  connect(library_backend_, SIGNAL(SongsDiscovered(SongList)), library_model_,
-          SLOT(SongsDiscovered(SongList)));
-  connect(library_backend_, SIGNAL(TotalSongCountUpdated(int)),
-          SLOT(UpdateTotalSongCount(int)));
-
-  library_backend_->UpdateTotalSongCount();
-}
-
-void JamendoService::InsertTrackIds(const TrackIdList& ids) const {
-  QMutexLocker l(library_backend_->db()->Mutex());
-  QSqlDatabase db(library_backend_->db()->Connect());
+    return true;
+  });
 
-  ScopedTransaction t(&db);
-
-  QSqlQuery insert(QString("INSERT INTO %1 (%2) VALUES (:id)")
-                       .arg(kTrackIdsTable, kTrackIdsColumn),
-                   db);
-
-  for (int id : ids) {
-    insert.bindValue(":id", id);
-    if (!insert.exec()) {
-      qLog(Warning) << "Query failed" << insert.lastQuery();
-    }
+  if (!ok) {
+    qLog(Warning) << "Failed to import the Jamendo catalogue";
+    return;
   }
 
-  t.Commit();
+  qLog(Info) << "Imported" << import.song_count() << "Jamendo songs";
+  library_backend_->UpdateTotalSongCount();
 }
 
 SongList JamendoService::ReadArtist(QXmlStreamReader* reader,
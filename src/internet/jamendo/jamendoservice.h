@@ -71,7 +71,6 @@ class JamendoService : public InternetService {
 
   static const char* kSettingsGroup;
 
-  static const int kBatchSize;
   static const int kApproxDatabaseSize;
 
  private:
@@ -85,7 +84,6 @@ class JamendoService : public InternetService {
   Song ReadTrack(const QString& artist, const QString& album,
                  const QString& album_cover, int album_id,
                  QXmlStreamReader* reader, TrackIdList* track_ids) const;
-  void InsertTrackIds(const TrackIdList& ids) const;
 
   void EnsureMenuCreated();
 
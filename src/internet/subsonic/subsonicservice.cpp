@@ -22,6 +22,7 @@
 
 #include "subsonicservice.h"
 
+#include <QDateTime>
 #include <QMenu>
 #include <QNetworkAccessManager>
 #include <QNetworkCookieJar>
@@ -32,6 +33,7 @@
 
 #include "core/application.h"
 #include "core/closure.h"
+#include "core/concurrentrun.h"
 #include "core/database.h"
 #include "core/logging.h"
 #include "core/mergedproxymodel.h"
@@ -42,6 +44,7 @@
 #include "globalsearch/globalsearch.h"
 #include "globalsearch/librarysearchprovider.h"
 #include "internet/core/internetmodel.h"
+#include "internet/subsonic/subsonicsyncstore.h"
 #include "internet/subsonic/subsonicurlhandler.h"
 #include "internet/subsonic/subsonicdynamicplaylist.h"
 #include "library/librarybackend.h"
@@ -59,12 +62,15 @@ const char* SubsonicService::kSongsTable = "subsonic_songs";
 const char* SubsonicService::kFtsTable = "subsonic_songs_fts";
 
 const int SubsonicService::kMaxRedirects = 10;
+const int SubsonicService::kFullSyncIntervalDays = 7;
 
 SubsonicService::SubsonicService(Application* app, InternetModel* parent)
     : InternetService(kServiceName, app, parent, parent),
       network_(new QNetworkAccessManager(this)),
       url_handler_(new SubsonicUrlHandler(this, this)),
       scanner_(new SubsonicLibraryScanner(this, this)),
+      full_sync_(false),
+      saving_library_(false),
       load_database_task_id_(0),
       context_menu_(nullptr),
       root_(nullptr),
@@ -84,6 +90,7 @@ SubsonicService::SubsonicService(Application* app, InternetModel* parent)
   library_backend_->moveToThread(app_->database()->thread());
   library_backend_->Init(app_->database(), kSongsTable, QString::null,
                          QString::null, kFtsTable);
+  sync_store_.reset(new SubsonicSyncStore(library_backend_));
   connect(library_backend_, SIGNAL(TotalSongCountUpdated(int)),
           SLOT(UpdateTotalSongCount(int)));
 
@@ -277,26 +284,89 @@ void SubsonicService::UpdateTotalSongCount(int count) {
 }
 
 void SubsonicService::ReloadDatabase() {
+  if (scanner_->is_scanning() || saving_library_) return;
+
   if (!load_database_task_id_) {
     load_database_task_id_ =
         app_->task_manager()->StartTask(tr("Fetching Subsonic library"));
   }
-  scanner_->Scan();
+
+  // Only albums that have changed since the last sync are fetched again.
+  // Fingerprints only cover the albums' own attributes though, so play counts
+  // and edits to songs in otherwise unchanged albums are only picked up by
+  // fetching everything again every kFullSyncIntervalDays.
+  QSettings s;
+  s.beginGroup(kSettingsGroup);
+  const QDateTime last_full_sync = s.value("last_full_sync").toDateTime();
+
+  QMap<QString, QString> fingerprints;
+  if (last_full_sync.isValid() &&
+      last_full_sync.daysTo(QDateTime::currentDateTime()) <
+          kFullSyncIntervalDays) {
+    fingerprints = sync_store_->AlbumFingerprints();
+  }
+
+  full_sync_ = fingerprints.isEmpty();
+  scanner_->Scan(fingerprints);
 }
 
 void SubsonicService::ReloadDatabaseFinished() {
+  if (!scanner_->succeeded()) {
+    app_->task_manager()->SetTaskFinished(load_database_task_id_);
+    load_database_task_id_ = 0;
+    qLog(Warning) << "Subsonic library scan failed, keeping the old one";
+    return;
+  }
+
+  // Writing a big library to the database takes a while, so it's done on
+  // another thread and the task stays open until it's finished.
+  SubsonicSyncStore* store = sync_store_.get();
+  const QMap<QString, SongList> albums = scanner_->changed_albums();
+  const QMap<QString, QString> fingerprints = scanner_->album_fingerprints();
+
+  QFuture<bool> future;
+  if (full_sync_) {
+    future = ConcurrentRun::Run<bool>(
+        &sync_pool_, [store, albums, fingerprints]() {
+          return store->Replace(albums, fingerprints);
+        });
+  } else {
+    const QStringList removed = scanner_->RemovedAlbums();
+    future = ConcurrentRun::Run<bool>(
+        &sync_pool_, [store, removed, albums, fingerprints]() {
+          store->Update(removed, albums, fingerprints);
+          return true;
+        });
+  }
+
+  saving_library_ = true;
+  NewClosure(future, this, SLOT(SaveLibraryFinished(QFuture<bool>, bool)),
+             future, full_sync_);
+}
+
+void SubsonicService::SaveLibraryFinished(QFuture<bool> future,
+                                          bool full_sync) {
+  saving_library_ = false;
   app_->task_manager()->SetTaskFinished(load_database_task_id_);
   load_database_task_id_ = 0;
 
-  library_backend_->DeleteAll();
-  library_backend_->AddOrUpdateSongs(scanner_->GetSongs());
-  library_model_->Reset();
+  if (!full_sync) return;
+  if (!future.result()) {
+    qLog(Error) << "Couldn't replace the Subsonic library";
+    return;
+  }
+
+  QSettings s;
+  s.beginGroup(kSettingsGroup);
+  s.setValue("last_full_sync", QDateTime::currentDateTime());
 }
 
 void SubsonicService::OnLoginStateChanged(
     SubsonicService::LoginState newstate) {
-  // TODO(Alan Briolat): library refresh logic?
-  if (newstate != LoginState_Loggedin) library_backend_->DeleteAll();
+  if (newstate != LoginState_Loggedin) {
+    library_backend_->DeleteAll();
+    sync_store_->Clear();
+  }
 }
 
 void SubsonicService::OnPingFinished(QNetworkReply* reply) {
@@ -405,27 +475,85 @@ const int SubsonicLibraryScanner::kAlbumChunkSize = 500;
 const int SubsonicLibraryScanner::kConcurrentRequests = 8;
 const int SubsonicLibraryScanner::kCoverArtSize = 1024;
 
-SubsonicLibraryScanner::SubsonicLibraryScanner(SubsonicService* service,
+namespace {
+
+// Changes whenever songs are added to or removed from an album, or the album
+// is renamed.  OpenSubsonic servers also send when it last changed.
+QString AlbumFingerprint(const QXmlStreamAttributes& attributes) {
+  const QStringList names = QStringList() << "name"
+                                         << "artist"
+                                         << "songCount"
+                                         << "duration"
+                                         << "created"
+                                         << "changed";
+  QStringList ret;
+  for (const QString& name : names) {
+    ret << attributes.value(name).toString();
+  }
+  return ret.join("\t");
+}
+
+}  // namespace
+
+SubsonicLibraryScanner::SubsonicLibraryScanner(SubsonicApiClient* client,
                                                QObject* parent)
-    : QObject(parent), service_(service), scanning_(false) {}
+    : QObject(parent),
+      client_(client),
+      scanning_(false),
+      succeeded_(false),
+      next_offset_(0),
+      album_list_finished_(false) {}
 
 SubsonicLibraryScanner::~SubsonicLibraryScanner() {}
 
-void SubsonicLibraryScanner::Scan() {
+void SubsonicLibraryScanner::Scan(const QMap<QString, QString>& known_albums) {
   if (scanning_) {
     return;
   }
 
+  known_albums_ = known_albums;
+  next_offset_ = 0;
+  album_list_finished_ = false;
   album_queue_.clear();
   pending_requests_.clear();
-  songs_.clear();
+  album_fingerprints_.clear();
+  changed_albums_.clear();
+  succeeded_ = false;
   scanning_ = true;
-  GetAlbumList(0);
+
+  // Only one page of albums is requested until it's clear there's more than
+  // one.
+  GetAlbumList(next_offset_);
+}
+
+QStringList SubsonicLibraryScanner::RemovedAlbums() const {
+  QStringList ret;
+  for (const QString& id : known_albums_.keys()) {
+    if (!album_fingerprints_.contains(id)) ret << id;
+  }
+  return ret;
+}
+
+void SubsonicLibraryScanner::StartRequests() {
+  while (pending_requests_.count() < kConcurrentRequests) {
+    if (!album_list_finished_) {
+      GetAlbumList(next_offset_);
+    } else if (!album_queue_.isEmpty()) {
+      GetAlbum(album_queue_.dequeue());
+    } else {
+      break;
+    }
+  }
+
+  if (pending_requests_.isEmpty()) {
+    Finish(true);
+  }
 }
 
 void SubsonicLibraryScanner::OnGetAlbumListFinished(QNetworkReply* reply,
                                                     int offset) {
   reply->deleteLater();
+  if (!pending_requests_.remove(reply)) return;
 
   bool skip_read_albums = false;
 
@@ -468,32 +596,35 @@ void SubsonicLibraryScanner::OnGetAlbumListFinished(QNetworkReply* reply,
         return;
       }
 
-      album_queue_ << reader.attributes().value("id").toString();
+      const QString id = reader.attributes().value("id").toString();
+      const QString fingerprint = AlbumFingerprint(reader.attributes());
       albums_added++;
       reader.skipCurrentElement();
+
+      if (album_fingerprints_.contains(id)) continue;
+      album_fingerprints_[id] = fingerprint;
+
+      if (known_albums_.value(id) != fingerprint) {
+        album_queue_ << id;
+      }
     }
   }
 
-  if (albums_added > 0) {
-    // Non-empty reply means potentially more albums to fetch
-    GetAlbumList(offset + kAlbumChunkSize);
-  } else if (album_queue_.size() == 0) {
-    // Empty reply and no albums means an empty Subsonic server
-    scanning_ = false;
-    emit ScanFinished();
-  } else {
-    // Empty reply but we have some albums, time to start fetching songs
-    // Start up the maximum number of concurrent requests, finished requests get
-    // replaced with new ones
-    for (int i = 0; i < kConcurrentRequests && !album_queue_.empty(); ++i) {
-      GetAlbum(album_queue_.dequeue());
-    }
+  if (albums_added < kAlbumChunkSize) {
+    // A short page means there's nothing after this offset.  Pages that were
+    // requested past the end come back empty.
+    album_list_finished_ = true;
   }
+
+  qLog(Debug) << "Subsonic album list at" << offset << "had" << albums_added
+              << "albums," << album_queue_.count() << "to fetch";
+  StartRequests();
 }
 
-void SubsonicLibraryScanner::OnGetAlbumFinished(QNetworkReply* reply) {
+void SubsonicLibraryScanner::OnGetAlbumFinished(QNetworkReply* reply,
+                                                const QString& album_id) {
   reply->deleteLater();
-  pending_requests_.remove(reply);
+  if (!pending_requests_.remove(reply)) return;
 
   QXmlStreamReader reader(reply);
   reader.readNextStartElement();
@@ -504,7 +635,11 @@ void SubsonicLibraryScanner::OnGetAlbumFinished(QNetworkReply* reply) {
   }
 
   if (reader.attributes().value("status") != "ok") {
-    // TODO(Alan Briolat): error handling
+    // Leave the album as it was last time, so it's fetched again next time
+    qLog(Warning) << "Failed to fetch Subsonic album" << album_id;
+    known_albums_.remove(album_id);
+    album_fingerprints_.remove(album_id);
+    StartRequests();
     return;
   }
 
@@ -518,6 +653,7 @@ void SubsonicLibraryScanner::OnGetAlbumFinished(QNetworkReply* reply) {
   QString album_artist = reader.attributes().value("artist").toString();
 
   // Read song information
+  SongList songs;
   while (reader.readNextStartElement()) {
     if (reader.name() != "song") {
       ParsingError("song tag expected. Aborting scan.");
@@ -539,7 +675,7 @@ void SubsonicLibraryScanner::OnGetAlbumFinished(QNetworkReply* reply) {
     length *= kNsecPerSec;
     song.set_length_nanosec(length);
     QUrl url = QUrl(QString("subsonic://%1").arg(id));
-    QUrl cover_url = service_->BuildRequestUrl("getCoverArt");
+    QUrl cover_url = client_->BuildRequestUrl("getCoverArt");
     cover_url.addQueryItem("id", id);
     song.set_art_automatic(cover_url.toEncoded());
     song.set_url(url);
@@ -554,46 +690,53 @@ void SubsonicLibraryScanner::OnGetAlbumFinished(QNetworkReply* reply) {
           reader.attributes().value("playCount").toString().toInt());
     }
 
-    songs_ << song;
+    songs << song;
     reader.skipCurrentElement();
   }
 
-  // Start the next request if albums remain
-  if (!album_queue_.empty()) {
-    GetAlbum(album_queue_.dequeue());
-  }
-
-  // If this was the last response, we're done!
-  if (album_queue_.empty() && pending_requests_.empty()) {
-    scanning_ = false;
-    emit ScanFinished();
-  }
+  changed_albums_[album_id] = songs;
+  StartRequests();
 }
 
 void SubsonicLibraryScanner::GetAlbumList(int offset) {
-  QUrl url = service_->BuildRequestUrl("getAlbumList2");
+  QUrl url = client_->BuildRequestUrl("getAlbumList2");
   url.addQueryItem("type", "alphabeticalByName");
   url.addQueryItem("size", QString::number(kAlbumChunkSize));
   url.addQueryItem("offset", QString::number(offset));
-  QNetworkReply* reply = service_->Send(url);
+  QNetworkReply* reply = client_->Send(url);
   NewClosure(reply, SIGNAL(finished()), this,
              SLOT(OnGetAlbumListFinished(QNetworkReply*, int)), reply, offset);
+  pending_requests_.insert(reply);
+  next_offset_ = offset + kAlbumChunkSize;
 }
 
 void SubsonicLibraryScanner::GetAlbum(const QString& id) {
-  QUrl url = service_->BuildRequestUrl("getAlbum");
+  QUrl url = client_->BuildRequestUrl("getAlbum");
   url.addQueryItem("id", id);
-  if (service_->IsAmpache()) {
+  if (client_->IsAmpache()) {
     url.addQueryItem("ampache", "1");
   }
-  QNetworkReply* reply = service_->Send(url);
+  QNetworkReply* reply = client_->Send(url);
   NewClosure(reply, SIGNAL(finished()), this,
-             SLOT(OnGetAlbumFinished(QNetworkReply*)), reply);
+             SLOT(OnGetAlbumFinished(QNetworkReply*, QString)), reply, id);
   pending_requests_.insert(reply);
 }
 
 void SubsonicLibraryScanner::ParsingError(const QString& message) {
   qLog(Warning) << "Subsonic parsing error: " << message;
+  Finish(false);
+}
+
+void SubsonicLibraryScanner::Finish(bool succeeded) {
   scanning_ = false;
+  succeeded_ = succeeded;
+
+  // The replies are ignored once they're not pending
+  const QSet<QNetworkReply*> pending = pending_requests_;
+  pending_requests_.clear();
+  for (QNetworkReply* reply : pending) {
+    reply->abort();
+  }
+
   emit ScanFinished();
 }
@@ -22,7 +22,12 @@
 #ifndef INTERNET_SUBSONIC_SUBSONICSERVICE_H_
 #define INTERNET_SUBSONIC_SUBSONICSERVICE_H_
 
+#include <memory>
+
 #include <QQueue>
+#include <QFuture>
+#include <QSet>
+#include <QThreadPool>
 
 #include "internet/core/internetmodel.h"
 #include "internet/core/internetservice.h"
@@ -35,8 +40,20 @@ class QXmlStreamReader;
 
 class SubsonicUrlHandler;
 class SubsonicLibraryScanner;
+class SubsonicSyncStore;
+
+// The requests SubsonicLibraryScanner makes, so it can be pointed at something
+// other than SubsonicService.
+class SubsonicApiClient {
+ public:
+  virtual ~SubsonicApiClient() {}
+
+  virtual QUrl BuildRequestUrl(const QString& view) const = 0;
+  virtual QNetworkReply* Send(const QUrl& url) = 0;
+  virtual bool IsAmpache() const = 0;
+};
 
-class SubsonicService : public InternetService {
+class SubsonicService : public InternetService, public SubsonicApiClient {
   Q_OBJECT
   Q_ENUMS(LoginState)
   Q_ENUMS(ApiError)
@@ -123,6 +140,7 @@ class SubsonicService : public InternetService {
 
   static const int kMaxRedirects;
   static const int kCoverArtSize;
+  static const int kFullSyncIntervalDays;
 
 
 signals:
@@ -137,6 +155,13 @@ signals:
   SubsonicUrlHandler* url_handler_;
 
   SubsonicLibraryScanner* scanner_;
+  std::unique_ptr<SubsonicSyncStore> sync_store_;
+  // Whether the scan that's running fetches every album
+  bool full_sync_;
+  // Whether the results of the last scan are still being written to the
+  // database by sync_pool_
+  bool saving_library_;
+  QThreadPool sync_pool_;
   int load_database_task_id_;
 
   QMenu* context_menu_;
@@ -164,22 +189,44 @@ signals:
   void UpdateTotalSongCount(int count);
   void ReloadDatabase();
   void ReloadDatabaseFinished();
+  void SaveLibraryFinished(QFuture<bool> future, bool full_sync);
   void OnLoginStateChanged(SubsonicService::LoginState newstate);
   void OnPingFinished(QNetworkReply* reply);
 
   void ShowConfig();
 };
 
+// Fetches the songs on a Subsonic server, album by album.  Every album is
+// listed with getAlbumList2 first, and only the albums whose fingerprint
+// differs from the one they had last time are fetched with getAlbum.  Both
+// kinds of request are made kConcurrentRequests at a time.
 class SubsonicLibraryScanner : public QObject {
   Q_OBJECT
 
  public:
-  explicit SubsonicLibraryScanner(SubsonicService* service,
+  explicit SubsonicLibraryScanner(SubsonicApiClient* client,
                                   QObject* parent = nullptr);
   ~SubsonicLibraryScanner();
 
-  void Scan();
-  const SongList& GetSongs() const { return songs_; }
+  // known_albums maps album IDs to the fingerprints they had when they were
+  // last fetched.  Pass an empty map to fetch everything.
+  void Scan(const QMap<QString, QString>& known_albums =
+                QMap<QString, QString>());
+  bool is_scanning() const { return scanning_; }
+
+  // The results of the last scan.  If it failed part way through nothing
+  // should be changed.
+  bool succeeded() const { return succeeded_; }
+  // Every album on the server, mapped to its current fingerprint.
+  const QMap<QString, QString>& album_fingerprints() const {
+    return album_fingerprints_;
+  }
+  // Songs of the albums that were new or had changed.
+  const QMap<QString, SongList>& changed_albums() const {
+    return changed_albums_;
+  }
+  // Known albums that aren't on the server any more.
+  QStringList RemovedAlbums() const;
 
   static const int kAlbumChunkSize;
   static const int kConcurrentRequests;
@@ -191,19 +238,31 @@ signals:
  private slots:
   // Step 1: use getAlbumList2 type=alphabeticalByName to list all albums
   void OnGetAlbumListFinished(QNetworkReply* reply, int offset);
-  // Step 2: use getAlbum id=? to list all songs for each album
-  void OnGetAlbumFinished(QNetworkReply* reply);
+  // Step 2: use getAlbum id=? to list all songs for each changed album
+  void OnGetAlbumFinished(QNetworkReply* reply, const QString& album_id);
 
  private:
+  // Starts as many requests as there's room for, or finishes the scan if
+  // there's nothing left to do.
+  void StartRequests();
   void GetAlbumList(int offset);
   void GetAlbum(const QString& id);
   void ParsingError(const QString& message);
+  void Finish(bool succeeded);
 
-  SubsonicService* service_;
+  SubsonicApiClient* client_;
   bool scanning_;
+  bool succeeded_;
+
+  QMap<QString, QString> known_albums_;
+  int next_offset_;
+  bool album_list_finished_;
+
   QQueue<QString> album_queue_;
   QSet<QNetworkReply*> pending_requests_;
-  SongList songs_;
+
+  QMap<QString, QString> album_fingerprints_;
+  QMap<QString, SongList> changed_albums_;
 };
 
 #endif  // INTERNET_SUBSONIC_SUBSONICSERVICE_H_
@@ -0,0 +1,202 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "subsonicsyncstore.h"
+
+#include <QHash>
+#include <QMutexLocker>
+#include <QSqlQuery>
+#include <QVariant>
+
+#include "core/database.h"
+#include "core/logging.h"
+#include "core/scopedtransaction.h"
+#include "library/catalogimport.h"
+#include "library/librarybackend.h"
+
+const char* SubsonicSyncStore::kAlbumsTable = "subsonic_albums";
+const char* SubsonicSyncStore::kAlbumSongsTable = "subsonic_album_songs";
+
+namespace {
+// The maximum number of album IDs bound in one "IN (...)" list.
+const int kMaxAlbumsPerQuery = 500;
+
+QStringList Tables() {
+  return QStringList() << SubsonicSyncStore::kAlbumsTable
+                       << SubsonicSyncStore::kAlbumSongsTable;
+}
+
+QString Placeholders(int count) {
+  QStringList ret;
+  for (int i = 0; i < count; ++i) ret << "?";
+  return ret.join(",");
+}
+}  // namespace
+
+SubsonicSyncStore::SubsonicSyncStore(LibraryBackend* backend)
+    : backend_(backend) {}
+
+QMap<QString, QString> SubsonicSyncStore::AlbumFingerprints() {
+  Database* db = backend_->db();
+  QMutexLocker l(db->ReadMutex());
+  QSqlDatabase connection(db->ConnectReadOnly());
+
+  QSqlQuery q(
+      QString("SELECT album_id, fingerprint FROM %1").arg(kAlbumsTable),
+      connection);
+  q.exec();
+
+  QMap<QString, QString> ret;
+  if (db->CheckErrors(q)) return ret;
+
+  while (q.next()) {
+    ret[q.value(0).toString()] = q.value(1).toString();
+  }
+  return ret;
+}
+
+QList<int> SubsonicSyncStore::SongIds(const QStringList& album_ids) {
+  Database* db = backend_->db();
+  QMutexLocker l(db->ReadMutex());
+  QSqlDatabase connection(db->ConnectReadOnly());
+
+  QList<int> ret;
+  for (int i = 0; i < album_ids.count(); i += kMaxAlbumsPerQuery) {
+    const QStringList chunk = album_ids.mid(i, kMaxAlbumsPerQuery);
+
+    QSqlQuery q(QString("SELECT s.ROWID FROM %1 AS s, %2 AS a"
+                        " WHERE a.album_id IN (%3) AND s.filename = a.filename")
+                    .arg(backend_->songs_table(), kAlbumSongsTable,
+                         Placeholders(chunk.count())),
+                connection);
+    for (const QString& album_id : chunk) q.addBindValue(album_id);
+    q.exec();
+    if (db->CheckErrors(q)) return QList<int>();
+
+    while (q.next()) ret << q.value(0).toInt();
+  }
+  return ret;
+}
+
+bool SubsonicSyncStore::Replace(const QMap<QString, SongList>& albums,
+                                const QMap<QString, QString>& fingerprints) {
+  SongList songs;
+  for (const SongList& album_songs : albums) songs << album_songs;
+
+  CatalogImport import(backend_);
+  if (!import.Run(songs)) return false;
+
+  Clear();
+  RecordAlbums(QStringList(), albums, fingerprints);
+  return true;
+}
+
+void SubsonicSyncStore::Update(const QStringList& removed_albums,
+                               const QMap<QString, SongList>& changed_albums,
+                               const QMap<QString, QString>& fingerprints) {
+  // The songs that were in these albums last time, by URL
+  const QList<int> old_ids =
+      SongIds(removed_albums + changed_albums.keys());
+
+  QHash<QByteArray, Song> old_songs;
+  if (!old_ids.isEmpty()) {
+    for (const Song& song : backend_->GetSongsById(old_ids)) {
+      old_songs[song.url().toEncoded()] = song;
+    }
+  }
+
+  // Songs that are still there are updated in place
+  SongList songs;
+  for (const SongList& album_songs : changed_albums) {
+    for (Song song : album_songs) {
+      const Song old_song = old_songs.take(song.url().toEncoded());
+      if (old_song.id() != -1) song.set_id(old_song.id());
+      songs << song;
+    }
+  }
+
+  qLog(Debug) << "Subsonic sync:" << removed_albums.count()
+              << "albums removed," << changed_albums.count()
+              << "albums changed," << old_songs.count() << "songs removed";
+
+  if (!old_songs.isEmpty()) backend_->DeleteSongs(old_songs.values());
+  if (!songs.isEmpty()) backend_->AddOrUpdateSongs(songs);
+
+  RecordAlbums(removed_albums, changed_albums, fingerprints);
+}
+
+void SubsonicSyncStore::Clear() {
+  Database* db = backend_->db();
+  QMutexLocker l(db->Mutex());
+  QSqlDatabase connection(db->Connect());
+  ScopedTransaction t(&connection);
+
+  for (const QString& table : Tables()) {
+    QSqlQuery q("DELETE FROM " + table, connection);
+    q.exec();
+    if (db->CheckErrors(q)) return;
+  }
+
+  t.Commit();
+}
+
+void SubsonicSyncStore::RecordAlbums(
+    const QStringList& removed_albums, const QMap<QString, SongList>& albums,
+    const QMap<QString, QString>& fingerprints) {
+  Database* db = backend_->db();
+  QMutexLocker l(db->Mutex());
+  QSqlDatabase connection(db->Connect());
+  ScopedTransaction t(&connection);
+
+  const QStringList stale = removed_albums + albums.keys();
+  for (int i = 0; i < stale.count(); i += kMaxAlbumsPerQuery) {
+    const QStringList chunk = stale.mid(i, kMaxAlbumsPerQuery);
+
+    for (const QString& table : Tables()) {
+      QSqlQuery q(QString("DELETE FROM %1 WHERE album_id IN (%2)")
+                      .arg(table, Placeholders(chunk.count())),
+                  connection);
+      for (const QString& album_id : chunk) q.addBindValue(album_id);
+      q.exec();
+      if (db->CheckErrors(q)) return;
+    }
+  }
+
+  QSqlQuery add_album(QString("INSERT INTO %1 (album_id, fingerprint)"
+                              " VALUES (:album_id, :fingerprint)")
+                          .arg(kAlbumsTable),
+                      connection);
+  QSqlQuery add_song(QString("INSERT INTO %1 (album_id, filename)"
+                             " VALUES (:album_id, :filename)")
+                         .arg(kAlbumSongsTable),
+                     connection);
+
+  for (auto it = albums.constBegin(); it != albums.constEnd(); ++it) {
+    add_album.bindValue(":album_id", it.key());
+    add_album.bindValue(":fingerprint", fingerprints.value(it.key()));
+    add_album.exec();
+    if (db->CheckErrors(add_album)) return;
+
+    for (const Song& song : it.value()) {
+      add_song.bindValue(":album_id", it.key());
+      add_song.bindValue(":filename", song.url().toEncoded());
+      add_song.exec();
+      if (db->CheckErrors(add_song)) return;
+    }
+  }
+
+  t.Commit();
+}
@@ -0,0 +1,68 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INTERNET_SUBSONIC_SUBSONICSYNCSTORE_H_
+#define INTERNET_SUBSONIC_SUBSONICSYNCSTORE_H_
+
+#include <QMap>
+#include <QStringList>
+
+#include "core/song.h"
+
+class LibraryBackend;
+
+// Remembers what each album on the Subsonic server looked like when it was
+// last fetched, and which songs came from it, so a sync only has to fetch the
+// albums that have changed since.  An album's fingerprint is made from the
+// attributes getAlbumList2 returns for it, so it changes whenever songs are
+// added to or removed from the album, or it's renamed.  Changes to a song that
+// leave its album's attributes alone, like its play count, aren't noticed
+// until the next full sync.
+//
+// The songs themselves live in the backend's songs table.
+class SubsonicSyncStore {
+ public:
+  explicit SubsonicSyncStore(LibraryBackend* backend);
+
+  static const char* kAlbumsTable;
+  static const char* kAlbumSongsTable;
+
+  // Album ID -> fingerprint.  Empty if the catalogue has never been synced.
+  QMap<QString, QString> AlbumFingerprints();
+
+  // Replaces the whole catalogue with the songs of these albums.
+  bool Replace(const QMap<QString, SongList>& albums,
+               const QMap<QString, QString>& fingerprints);
+
+  // Deletes the songs of the removed albums and replaces the songs of the
+  // changed ones.  Songs still on the server keep their ROWIDs.
+  void Update(const QStringList& removed_albums,
+              const QMap<QString, SongList>& changed_albums,
+              const QMap<QString, QString>& fingerprints);
+
+  // Forgets every album, so the next sync fetches everything.
+  void Clear();
+
+ private:
+  QList<int> SongIds(const QStringList& album_ids);
+  void RecordAlbums(const QStringList& removed_albums,
+                    const QMap<QString, SongList>& albums,
+                    const QMap<QString, QString>& fingerprints);
+
+  LibraryBackend* backend_;
+};
+
+#endif  // INTERNET_SUBSONIC_SUBSONICSYNCSTORE_H_
@@ -0,0 +1,535 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "catalogimport.h"
+
+#include <cstring>
+
+#include <QFile>
+#include <QIODevice>
+#include <QMutexLocker>
+#include <QRegExp>
+#include <QSqlQuery>
+#include <QThread>
+
+#include "librarybackend.h"
+#include "core/database.h"
+#include "core/logging.h"
+#include "core/scopedtransaction.h"
+#include "core/utilities.h"
+
+const int CatalogImport::kBatchSize = 10000;
+const int CatalogImport::kMaxQueuedBatches = 4;
+const int CatalogImport::kReadBufferSize = 64 * 1024;  // 64KB
+
+namespace {
+
+const char* kStagingDatabase = "catalog_import";
+
+// Passes the catalogue from the reader thread to the parser thread.  Reads
+// block until there's some data or the reader has finished.
+class BlockingPipe : public QIODevice {
+ public:
+  explicit BlockingPipe(qint64 capacity)
+      : capacity_(capacity), size_(0), closed_(false), aborted_(false) {}
+
+  bool isSequential() const { return true; }
+
+  qint64 bytesAvailable() const {
+    QMutexLocker l(&mutex_);
+    return size_ + QIODevice::bytesAvailable();
+  }
+
+  // Called by the reader thread.  Returns false if the parser has stopped
+  // reading.
+  bool Push(const QByteArray& data) {
+    QMutexLocker l(&mutex_);
+    while (size_ >= capacity_ && !aborted_) changed_.wait(&mutex_);
+    if (aborted_) return false;
+
+    chunks_.enqueue(data);
+    size_ += data.size();
+    changed_.wakeAll();
+    return true;
+  }
+
+  // Called by the reader thread when there's nothing left to read.
+  void CloseWrite() {
+    QMutexLocker l(&mutex_);
+    closed_ = true;
+    changed_.wakeAll();
+  }
+
+  // Makes reads and pushes fail from now on.
+  void Abort() {
+    QMutexLocker l(&mutex_);
+    aborted_ = true;
+    changed_.wakeAll();
+  }
+
+ protected:
+  qint64 readData(char* data, qint64 max_size) {
+    QMutexLocker l(&mutex_);
+    while (chunks_.isEmpty() && !closed_ && !aborted_) changed_.wait(&mutex_);
+    if (chunks_.isEmpty() || aborted_) return -1;
+
+    qint64 read = 0;
+    while (read < max_size && !chunks_.isEmpty()) {
+      QByteArray& chunk = chunks_.head();
+      const qint64 count = qMin(max_size - read, qint64(chunk.size()));
+      memcpy(data + read, chunk.constData(), count);
+      read += count;
+
+      if (count == chunk.size()) {
+        chunks_.dequeue();
+      } else {
+        chunk.remove(0, count);
+      }
+    }
+
+    size_ -= read;
+    changed_.wakeAll();
+    return read;
+  }
+
+  qint64 writeData(const char*, qint64) { return -1; }
+
+ private:
+  const qint64 capacity_;
+
+  mutable QMutex mutex_;
+  QWaitCondition changed_;
+  QQueue<QByteArray> chunks_;
+  qint64 size_;
+  bool closed_;
+  bool aborted_;
+};
+
+class FunctionThread : public QThread {
+ public:
+  explicit FunctionThread(const std::function<void()>& function)
+      : function_(function) {}
+
+ protected:
+  void run() { function_(); }
+
+ private:
+  std::function<void()> function_;
+};
+
+}  // namespace
+
+CatalogImport::CatalogImport(LibraryBackend* backend)
+    : backend_(backend),
+      song_count_(0),
+      parsing_finished_(false),
+      failed_(false) {}
+
+CatalogImport::~CatalogImport() { Cleanup(); }
+
+void CatalogImport::AddTable(const QString& table) { extra_tables_ << table; }
+
+QString CatalogImport::TableName(const QString& table) {
+  return table.section('.', -1);
+}
+
+QString CatalogImport::Qualified(const QString& table) const {
+  return QString("%1.%2").arg(kStagingDatabase, TableName(table));
+}
+
+void CatalogImport::AddSongs(const SongList& songs) {
+  pending_songs_ << songs;
+  if (pending_songs_.count() < kBatchSize) return;
+
+  Batch batch;
+  batch.songs_ = pending_songs_;
+  pending_songs_.clear();
+  Enqueue(batch);
+}
+
+void CatalogImport::AddRows(const QString& table, const QStringList& columns,
+                            const QList<QVariantList>& rows) {
+  Batch& pending = pending_rows_[table];
+  pending.table_ = table;
+  pending.columns_ = columns;
+  pending.rows_ << rows;
+  if (pending.rows_.count() < kBatchSize) return;
+
+  Batch batch = pending;
+  pending_rows_.remove(table);
+  Enqueue(batch);
+}
+
+void CatalogImport::Enqueue(const Batch& batch) {
+  QMutexLocker l(&mutex_);
+  while (queue_.count() >= kMaxQueuedBatches && !failed_) {
+    queue_changed_.wait(&mutex_);
+  }
+  if (failed_) return;
+
+  queue_.enqueue(batch);
+  queue_changed_.wakeAll();
+}
+
+void CatalogImport::FinishParsing() {
+  // Send whatever's left
+  if (!pending_songs_.isEmpty()) {
+    Batch batch;
+    batch.songs_ = pending_songs_;
+    pending_songs_.clear();
+    Enqueue(batch);
+  }
+  for (const Batch& batch : pending_rows_) {
+    Enqueue(batch);
+  }
+  pending_rows_.clear();
+
+  QMutexLocker l(&mutex_);
+  parsing_finished_ = true;
+  queue_changed_.wakeAll();
+}
+
+bool CatalogImport::Run(QIODevice* device, const ParseFunction& parse) {
+  if (!Begin()) {
+    Cleanup();
+    return false;
+  }
+
+  BlockingPipe pipe(kReadBufferSize * kMaxQueuedBatches);
+  pipe.open(QIODevice::ReadOnly);
+
+  // Reading is usually decompressing too, so it gets a thread of its own.
+  bool read_ok = true;
+  FunctionThread reader([device, &pipe, &read_ok]() {
+    QByteArray data(kReadBufferSize, '\0');
+    forever {
+      const qint64 count = device->read(data.data(), kReadBufferSize);
+      if (count < 0) {
+        qLog(Warning) << "Error reading catalogue" << device->errorString();
+        read_ok = false;
+        break;
+      }
+      if (count == 0 || !pipe.Push(data.left(count))) break;
+    }
+    pipe.CloseWrite();
+  });
+
+  bool parse_ok = true;
+  FunctionThread parser([this, &pipe, &parse, &parse_ok]() {
+    parse_ok = parse(&pipe, this);
+
+    // The parser might have stopped before the end
+    pipe.Abort();
+    FinishParsing();
+  });
+
+  reader.start();
+  parser.start();
+
+  bool ok = WriteQueuedBatches();
+  if (!ok) {
+    // Let the other threads finish quickly
+    pipe.Abort();
+  }
+
+  parser.wait();
+  reader.wait();
+
+  if (!read_ok || !parse_ok) {
+    qLog(Warning) << "Catalogue is incomplete, keeping the old one";
+    ok = false;
+  }
+
+  ok = ok && Commit();
+  Cleanup();
+  if (ok) backend_->AllSongsReplaced();
+  return ok;
+}
+
+bool CatalogImport::Run(const SongList& songs) {
+  bool ok = Begin();
+
+  for (int i = 0; ok && i < songs.count(); i += kBatchSize) {
+    Batch batch;
+    batch.songs_ = songs.mid(i, kBatchSize);
+    ok = WriteBatch(batch);
+  }
+
+  ok = ok && Commit();
+  Cleanup();
+  if (ok) backend_->AllSongsReplaced();
+  return ok;
+}
+
+bool CatalogImport::Exec(const QString& sql) {
+  QSqlQuery q(sql, db_);
+  q.exec();
+  return !backend_->db()->CheckErrors(q);
+}
+
+bool CatalogImport::AttachStaging() {
+  Database* db = backend_->db();
+  db_ = db->Connect();
+  QSqlQuery attach("ATTACH DATABASE :filename AS :alias", db_);
+  attach.bindValue(":filename", staging_filename_);
+  attach.bindValue(":alias", kStagingDatabase);
+  attach.exec();
+  return !db->CheckErrors(attach);
+}
+
+bool CatalogImport::Begin() {
+  Database* db = backend_->db();
+  song_count_ = 0;
+  parsing_finished_ = false;
+  failed_ = false;
+
+  // A replacement database file has to be next to the one it's replacing so
+  // it can be renamed over it.
+  if (attached_database_.isEmpty()) {
+    staging_filename_ = Utilities::GetTemporaryFileName();
+  } else {
+    staging_filename_ = db->AttachedDbFilename(attached_database_) + ".import";
+  }
+  QFile::remove(staging_filename_);
+
+  // Nothing else knows about the staging database, so writing to it doesn't
+  // need the database mutex until it's swapped in.
+  if (!AttachStaging()) return false;
+
+  // If anything goes wrong the file gets thrown away, so it doesn't need to
+  // survive a crash.
+  Exec(QString("PRAGMA %1.journal_mode = OFF").arg(kStagingDatabase));
+  Exec(QString("PRAGMA %1.synchronous = OFF").arg(kStagingDatabase));
+
+  // Copy the schema of the tables being replaced.  The indexes are left until
+  // the end.
+  QString schema = attached_database_;
+  if (schema.isEmpty()) {
+    schema = backend_->songs_table().contains('.')
+                 ? backend_->songs_table().section('.', 0, 0)
+                 : "main";
+  }
+
+  QStringList wanted_tables;
+  wanted_tables << TableName(backend_->songs_table());
+  for (const QString& table : extra_tables_) wanted_tables << TableName(table);
+
+  QList<QStringList> objects;
+  QStringList virtual_tables;
+  {
+    QMutexLocker l(db->Mutex());
+    QSqlQuery q(QString("SELECT type, name, sql FROM %1.sqlite_master "
+                        "WHERE sql NOT NULL AND name NOT LIKE 'sqlite_%'")
+                    .arg(schema),
+                db_);
+    q.exec();
+    if (db->CheckErrors(q)) return false;
+
+    while (q.next()) {
+      const QString name = q.value(1).toString();
+      const QString sql = q.value(2).toString();
+      objects << (QStringList() << q.value(0).toString() << name << sql);
+      if (sql.startsWith("CREATE VIRTUAL TABLE", Qt::CaseInsensitive)) {
+        virtual_tables << name;
+      }
+    }
+  }
+
+  QRegExp create_re(
+      "^(CREATE\\s+(?:VIRTUAL\\s+|UNIQUE\\s+)?(?:TABLE|INDEX)\\s+"
+      "(?:IF\\s+NOT\\s+EXISTS\\s+)?)",
+      Qt::CaseInsensitive);
+  const QString qualified_create = QString("\\1%1.").arg(kStagingDatabase);
+
+  index_sql_.clear();
+  for (const QStringList& object : objects) {
+    const QString& type = object[0];
+    const QString& name = object[1];
+    const QString sql = QString(object[2]).replace(create_re, qualified_create);
+
+    if (type == "table") {
+      // Skip the FTS index's own tables - they're created along with it
+      bool shadow = false;
+      for (const QString& virtual_table : virtual_tables) {
+        if (name.startsWith(virtual_table + "_")) shadow = true;
+      }
+      if (shadow) continue;
+
+      // When only copying rows, the FTS index is rebuilt in place.
+      if (attached_database_.isEmpty() && !wanted_tables.contains(name)) {
+        continue;
+      }
+      if (!Exec(sql)) return false;
+      wanted_tables.removeAll(name);
+    } else if (type == "index" && !attached_database_.isEmpty()) {
+      index_sql_ << sql;
+    }
+  }
+
+  if (!wanted_tables.isEmpty()) {
+    qLog(Warning) << "Tables missing from the catalogue:" << wanted_tables;
+    return false;
+  }
+
+  return true;
+}
+
+bool CatalogImport::WriteQueuedBatches() {
+  forever {
+    Batch batch;
+    {
+      QMutexLocker l(&mutex_);
+      while (queue_.isEmpty() && !parsing_finished_) {
+        queue_changed_.wait(&mutex_);
+      }
+      if (queue_.isEmpty()) return true;
+
+      batch = queue_.dequeue();
+      queue_changed_.wakeAll();
+    }
+
+    if (!WriteBatch(batch)) {
+      QMutexLocker l(&mutex_);
+      failed_ = true;
+      queue_.clear();
+      queue_changed_.wakeAll();
+      return false;
+    }
+
+    if (progress_ && !batch.songs_.isEmpty()) progress_(song_count_);
+  }
+}
+
+bool CatalogImport::WriteBatch(const Batch& batch) {
+  Database* db = backend_->db();
+  ScopedTransaction t(&db_);
+
+  if (!batch.songs_.isEmpty()) {
+    QSqlQuery q(QString("INSERT INTO %1 (" + Song::kColumnSpec +
+                        ") VALUES (" + Song::kBindSpec + ")")
+                    .arg(Qualified(backend_->songs_table())),
+                db_);
+
+    for (const Song& song : batch.songs_) {
+      song.BindToQuery(&q);
+      q.exec();
+      if (db->CheckErrors(q)) return false;
+    }
+    song_count_ += batch.songs_.count();
+  }
+
+  if (!batch.rows_.isEmpty()) {
+    QStringList placeholders;
+    for (int i = 0; i < batch.columns_.count(); ++i) placeholders << "?";
+
+    QSqlQuery q(QString("INSERT INTO %1 (%2) VALUES (%3)")
+                    .arg(Qualified(batch.table_), batch.columns_.join(", "),
+                         placeholders.join(", ")),
+                db_);
+
+    for (const QVariantList& row : batch.rows_) {
+      for (const QVariant& value : row) q.addBindValue(value);
+      q.exec();
+      if (db->CheckErrors(q)) return false;
+    }
+  }
+
+  t.Commit();
+  return true;
+}
+
+bool CatalogImport::Commit() {
+  Database* db = backend_->db();
+  const QString songs_table = backend_->songs_table();
+  const QString fts_table = backend_->fts_table();
+
+  if (!attached_database_.isEmpty()) {
+    // Building the indexes in one go is much quicker than keeping them up to
+    // date with every insert.
+    ScopedTransaction t(&db_);
+    if (!Exec(QString("INSERT INTO %1 (ROWID, " + Song::kFtsColumnSpec +
+                      ") SELECT ROWID, %2 FROM %3")
+                  .arg(Qualified(fts_table),
+                       LibraryBackend::kFtsSourceColumnSpec,
+                       Qualified(songs_table)))) {
+      return false;
+    }
+    for (const QString& sql : index_sql_) {
+      if (!Exec(sql)) return false;
+    }
+    t.Commit();
+
+    if (!Exec(QString("DETACH DATABASE %1").arg(kStagingDatabase))) {
+      return false;
+    }
+    db_ = QSqlDatabase();
+
+    if (db->ReplaceAttachedDb(attached_database_, staging_filename_)) {
+      return true;
+    }
+
+    // The old file is still open somewhere (on Windows it can't be removed
+    // until it's closed), so copy the rows into it instead.
+    if (!QFile::exists(staging_filename_)) return false;
+    qLog(Warning) << "Couldn't replace" << attached_database_
+                  << "- copying the catalogue into it instead";
+    if (!AttachStaging()) return false;
+  }
+
+  // Otherwise swap the rows in one transaction, so readers see either the old
+  // catalogue or the new one.
+  QMutexLocker l(db->Mutex());
+  ScopedTransaction t(&db_);
+
+  if (!Exec("DELETE FROM " + fts_table)) return false;
+  if (!Exec("DELETE FROM " + songs_table)) return false;
+  if (!Exec(QString("INSERT INTO %1 (ROWID, " + Song::kColumnSpec +
+                    ") SELECT ROWID, " + Song::kColumnSpec + " FROM %2")
+                .arg(songs_table, Qualified(songs_table)))) {
+    return false;
+  }
+
+  for (const QString& table : extra_tables_) {
+    if (!Exec("DELETE FROM " + table)) return false;
+    if (!Exec(QString("INSERT INTO %1 SELECT * FROM %2")
+                  .arg(table, Qualified(table)))) {
+      return false;
+    }
+  }
+
+  if (!Exec(QString("INSERT INTO %1 (ROWID, " + Song::kFtsColumnSpec +
+                    ") SELECT ROWID, %2 FROM %3")
+                .arg(fts_table, LibraryBackend::kFtsSourceColumnSpec,
+                     songs_table))) {
+    return false;
+  }
+
+  t.Commit();
+  return true;
+}
+
+void CatalogImport::Cleanup() {
+  if (db_.isValid()) {
+    QSqlQuery q(QString("DETACH DATABASE %1").arg(kStagingDatabase), db_);
+    q.exec();
+    db_ = QSqlDatabase();
+  }
+
+  if (!staging_filename_.isEmpty()) {
+    QFile::remove(staging_filename_);
+    staging_filename_.clear();
+  }
+}
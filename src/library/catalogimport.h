@@ -0,0 +1,140 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBRARY_CATALOGIMPORT_H_
+#define LIBRARY_CATALOGIMPORT_H_
+
+#include <functional>
+
+#include <QList>
+#include <QMap>
+#include <QMutex>
+#include <QQueue>
+#include <QSqlDatabase>
+#include <QStringList>
+#include <QVariantList>
+#include <QWaitCondition>
+
+#include "core/song.h"
+
+class LibraryBackend;
+
+class QIODevice;
+
+// Replaces all the songs in a LibraryBackend with a new catalogue, like the
+// ones the Jamendo, Magnatune and Subsonic services download.
+//
+// Reading (and decompressing) the catalogue, parsing it and writing it to the
+// database each happen on their own thread.  The songs are written to a new
+// staging database without any indexes, the indexes and the FTS index are
+// built once everything is there, and then the staging database replaces the
+// old catalogue in one go, so nothing ever sees a half loaded one.
+//
+// If the songs have an attached database of their own the whole file is
+// replaced.  Otherwise the rows are copied over in one transaction.
+//
+// Run() blocks, so it should be called from a worker thread.
+class CatalogImport {
+ public:
+  // Called on the parser thread with the catalogue.  It should pass the songs
+  // it finds to AddSongs as it goes, and return false if the catalogue
+  // couldn't be parsed, so a partial one isn't used.
+  typedef std::function<bool(QIODevice*, CatalogImport*)> ParseFunction;
+  // Called on the Run() thread with the number of songs written so far.
+  typedef std::function<void(int)> ProgressFunction;
+
+  explicit CatalogImport(LibraryBackend* backend);
+  ~CatalogImport();
+
+  static const int kBatchSize;
+  static const int kMaxQueuedBatches;
+  static const int kReadBufferSize;
+
+  // Other tables that are part of the catalogue and are replaced along with
+  // the songs, like Jamendo's track IDs.  They must be in the same database as
+  // the songs.
+  void AddTable(const QString& table);
+
+  // Replace the whole attached database instead of copying rows.  Everything
+  // in it is replaced, so it mustn't hold anything but the catalogue.
+  void set_attached_database(const QString& name) { attached_database_ = name; }
+
+  void set_progress_function(const ProgressFunction& progress) {
+    progress_ = progress;
+  }
+
+  // Queues songs or rows for one of the extra tables to be written to the
+  // staging database.  Songs and rows are written in the order they're added
+  // so the nth song gets ROWID n.  These block while the writer is too far
+  // behind.
+  void AddSongs(const SongList& songs);
+  void AddRows(const QString& table, const QStringList& columns,
+               const QList<QVariantList>& rows);
+
+  // Reads the catalogue from device on one thread and parses it with parse on
+  // another.  Returns false and leaves the old catalogue alone if anything
+  // went wrong, including a read from device returning -1 or parse returning
+  // false.  Otherwise the backend emits DatabaseReset().
+  bool Run(QIODevice* device, const ParseFunction& parse);
+  // For catalogues that have already been parsed.
+  bool Run(const SongList& songs);
+
+  int song_count() const { return song_count_; }
+
+ private:
+  struct Batch {
+    QString table_;
+    QStringList columns_;
+    QList<QVariantList> rows_;
+    SongList songs_;
+  };
+
+  bool AttachStaging();
+  bool Begin();
+  bool WriteQueuedBatches();
+  bool WriteBatch(const Batch& batch);
+  bool Commit();
+  void Cleanup();
+  bool Exec(const QString& sql);
+
+  void Enqueue(const Batch& batch);
+  void FinishParsing();
+
+  QString Qualified(const QString& table) const;
+  static QString TableName(const QString& table);
+
+  LibraryBackend* backend_;
+  QString attached_database_;
+  QStringList extra_tables_;
+  ProgressFunction progress_;
+
+  QSqlDatabase db_;
+  QString staging_filename_;
+  QStringList index_sql_;
+  int song_count_;
+
+  // Only touched by the parser thread
+  SongList pending_songs_;
+  QMap<QString, Batch> pending_rows_;
+
+  QMutex mutex_;
+  QWaitCondition queue_changed_;
+  QQueue<Batch> queue_;
+  bool parsing_finished_;
+  bool failed_;
+};
+
+#endif  // LIBRARY_CATALOGIMPORT_H_
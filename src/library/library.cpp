@@ -157,6 +157,10 @@ void Library::Init() {
           SLOT(AddOrUpdateSubdirs(SubdirectoryList)));
   connect(watcher_, SIGNAL(SubdirsMTimeUpdated(SubdirectoryList)), backend_,
           SLOT(AddOrUpdateSubdirs(SubdirectoryList)));
+  connect(watcher_, SIGNAL(BulkInsertStarted(int)), backend_,
+          SLOT(BeginBulkInsert(int)));
+  connect(watcher_, SIGNAL(BulkInsertFinished(int)), backend_,
+          SLOT(EndBulkInsert(int)));
   connect(watcher_, SIGNAL(CompilationsNeedUpdating()), backend_,
           SLOT(UpdateCompilations()));
   connect(app_->playlist_manager(), SIGNAL(CurrentSongChanged(Song)),
@@ -29,12 +29,22 @@
 #include <QDateTime>
 #include <QDir>
 #include <QFileInfo>
+#include <QHash>
 #include <QSettings>
 #include <QVariant>
 #include <QtDebug>
 
 const char* LibraryBackend::kSettingsGroup = "LibraryBackend";
 
+const char* LibraryBackend::kFtsSourceColumnSpec =
+    "title, album, artist, albumartist, composer, performer, grouping, genre, "
+    "comment, year";
+
+namespace {
+// The maximum number of IDs put in one "IN (...)" list.
+const int kMaxIdsPerQuery = 1000;
+}
+
 const char* LibraryBackend::kNewScoreSql =
     "case when playcount <= 0 then (%1 * 100 + score) / 2"
     "     else (score * (playcount + skipcount) + %1 * 100) / (playcount + "
@@ -99,6 +109,11 @@ void LibraryBackend::LoadDirectories() {
   QMutexLocker l(db_->Mutex());
   QSqlDatabase db(db_->Connect());
 
+  // A bulk insert only remembers its songs in memory, so if Clementine quit
+  // during one they were never indexed.  The directory gets an incremental
+  // scan this time, which won't index them either.
+  if (bulk_insert_depth_.isEmpty()) AddMissingToFtsIndex(db);
+
   for (const Directory& dir : dirs) {
     emit DirectoryDiscovered(dir, SubdirsInDirectory(dir.id, db));
   }
@@ -359,8 +374,6 @@ void LibraryBackend::AddOrUpdateSongs(const SongList& songs) {
   QMutexLocker l(db_->Mutex());
   QSqlDatabase db(db_->Connect());
 
-  QSqlQuery check_dir(
-      QString("SELECT ROWID FROM %1 WHERE ROWID = :id").arg(dirs_table_), db);
   QSqlQuery add_song(QString("INSERT INTO %1 (" + Song::kColumnSpec +
                              ")"
                              " VALUES (" +
@@ -369,31 +382,56 @@ void LibraryBackend::AddOrUpdateSongs(const SongList& songs) {
   QSqlQuery update_song(QString("UPDATE %1 SET " + Song::kUpdateSpec +
                                 " WHERE ROWID = :id").arg(songs_table_),
                         db);
-  QSqlQuery add_song_fts(
-      QString("INSERT INTO %1 (ROWID, " + Song::kFtsColumnSpec +
-              ")"
-              " VALUES (:id, " +
-              Song::kFtsBindSpec + ")").arg(fts_table_),
-      db);
   QSqlQuery update_song_fts(QString("UPDATE %1 SET " + Song::kFtsUpdateSpec +
                                     " WHERE ROWID = :id").arg(fts_table_),
                             db);
 
   ScopedTransaction transaction(&db);
 
+  // Do a sanity check first - make sure the songs' directories still exist.
+  // This is to fix a possible race condition when a directory is removed
+  // while LibraryWatcher is scanning it.
+  QSet<int> existing_dirs;
+  if (!dirs_table_.isEmpty() && !songs.isEmpty()) {
+    QStringList dir_ids;
+    for (const Song& song : songs) {
+      const QString dir_id = QString::number(song.directory_id());
+      if (!dir_ids.contains(dir_id)) dir_ids << dir_id;
+    }
+
+    QSqlQuery check_dirs(QString("SELECT ROWID FROM %1 WHERE ROWID IN (%2)")
+                             .arg(dirs_table_, dir_ids.join(",")),
+                         db);
+    check_dirs.exec();
+    if (db_->CheckErrors(check_dirs)) return;
+
+    while (check_dirs.next()) {
+      existing_dirs << check_dirs.value(0).toInt();
+    }
+  }
+
+  // Get the previous data of all the songs being updated in one go.
+  QStringList old_ids;
+  for (const Song& song : songs) {
+    if (song.id() != -1) old_ids << QString::number(song.id());
+  }
+
+  QHash<int, Song> old_songs;
+  for (int i = 0; i < old_ids.count(); i += kMaxIdsPerQuery) {
+    for (const Song& old_song :
+         GetSongsById(old_ids.mid(i, kMaxIdsPerQuery), db)) {
+      old_songs[old_song.id()] = old_song;
+    }
+  }
+
   SongList added_songs;
   SongList deleted_songs;
+  QList<int> added_ids;
 
   for (const Song& song : songs) {
-    // Do a sanity check first - make sure the song's directory still exists
-    // This is to fix a possible race condition when a directory is removed
-    // while LibraryWatcher is scanning it.
-    if (!dirs_table_.isEmpty()) {
-      check_dir.bindValue(":id", song.directory_id());
-      check_dir.exec();
-      if (db_->CheckErrors(check_dir)) continue;
-
-      if (!check_dir.next()) continue;  // Directory didn't exist
+    if (!dirs_table_.isEmpty() &&
+        !existing_dirs.contains(song.directory_id())) {
+      continue;  // Directory didn't exist
     }
 
     if (song.id() == -1) {
@@ -404,21 +442,21 @@ void LibraryBackend::AddOrUpdateSongs(const SongList& songs) {
       add_song.exec();
       if (db_->CheckErrors(add_song)) continue;
 
-      // Get the new ID
+      // Get the new ID.  Songs in a directory that's being bulk inserted
+      // into are added to the FTS index when the bulk insert ends.
       const int id = add_song.lastInsertId().toInt();
-
-      // Add to the FTS index
-      add_song_fts.bindValue(":id", id);
-      song.BindToFtsQuery(&add_song_fts);
-      add_song_fts.exec();
-      if (db_->CheckErrors(add_song_fts)) continue;
+      if (bulk_insert_depth_.contains(song.directory_id())) {
+        bulk_inserted_ids_[song.directory_id()] << id;
+      } else {
+        added_ids << id;
+      }
 
       Song copy(song);
       copy.set_id(id);
       added_songs << copy;
     } else {
       // Get the previous song data first
-      Song old_song(GetSongById(song.id()));
+      Song old_song(old_songs.value(song.id()));
       if (!old_song.is_valid()) continue;
 
       // Update
@@ -437,6 +475,9 @@ void LibraryBackend::AddOrUpdateSongs(const SongList& songs) {
     }
   }
 
+  // Add the new songs to the FTS index
+  AddToFtsIndex(added_ids, db);
+
   transaction.Commit();
 
   if (!deleted_songs.isEmpty()) emit SongsDeleted(deleted_songs);
@@ -446,6 +487,62 @@ void LibraryBackend::AddOrUpdateSongs(const SongList& songs) {
   UpdateTotalSongCountAsync();
 }
 
+void LibraryBackend::AddToFtsIndex(const QList<int>& ids, QSqlDatabase& db) {
+  QStringList str_ids;
+  for (int id : ids) {
+    str_ids << QString::number(id);
+  }
+
+  for (int i = 0; i < str_ids.count(); i += kMaxIdsPerQuery) {
+    QSqlQuery q(QString("INSERT INTO %1 (ROWID, " + Song::kFtsColumnSpec +
+                        ")"
+                        " SELECT ROWID, %2 FROM %3 WHERE ROWID IN (%4)")
+                    .arg(fts_table_, kFtsSourceColumnSpec, songs_table_,
+                         QStringList(str_ids.mid(i, kMaxIdsPerQuery))
+                             .join(",")),
+                db);
+    q.exec();
+    db_->CheckErrors(q);
+  }
+}
+
+void LibraryBackend::AddMissingToFtsIndex(QSqlDatabase& db) {
+  QSqlQuery q(QString("INSERT INTO %1 (ROWID, " + Song::kFtsColumnSpec +
+                      ")"
+                      " SELECT ROWID, %2 FROM %3"
+                      " WHERE ROWID NOT IN (SELECT ROWID FROM %1)")
+                  .arg(fts_table_, kFtsSourceColumnSpec, songs_table_),
+              db);
+  q.exec();
+  if (db_->CheckErrors(q)) return;
+
+  if (q.numRowsAffected() > 0) {
+    qLog(Info) << "Added" << q.numRowsAffected()
+               << "songs missing from the search index";
+  }
+}
+
+void LibraryBackend::BeginBulkInsert(int directory_id) {
+  QMutexLocker l(db_->Mutex());
+  bulk_insert_depth_[directory_id]++;
+}
+
+void LibraryBackend::EndBulkInsert(int directory_id) {
+  QMutexLocker l(db_->Mutex());
+
+  Q_ASSERT(bulk_insert_depth_.value(directory_id) > 0);
+  if (--bulk_insert_depth_[directory_id] > 0) return;
+  bulk_insert_depth_.remove(directory_id);
+
+  const QList<int> ids = bulk_inserted_ids_.take(directory_id);
+  if (ids.isEmpty()) return;
+
+  QSqlDatabase db(db_->Connect());
+  ScopedTransaction transaction(&db);
+  AddToFtsIndex(ids, db);
+  transaction.Commit();
+}
+
 void LibraryBackend::UpdateMTimesOnly(const SongList& songs) {
   QMutexLocker l(db_->Mutex());
   QSqlDatabase db(db_->Connect());
@@ -1081,6 +1178,11 @@ bool LibraryBackend::ExecQuery(LibraryQuery* q) {
   return !db_->CheckErrors(q->Exec(db_->Connect(), songs_table_, fts_table_));
 }
 
+bool LibraryBackend::ExecReadOnlyQuery(LibraryQuery* q) {
+  return !db_->CheckErrors(
+      q->Exec(db_->ConnectReadOnly(), songs_table_, fts_table_));
+}
+
 SongList LibraryBackend::FindSongs(const smart_playlists::Search& search) {
   QMutexLocker l(db_->Mutex());
   QSqlDatabase db(db_->Connect());
@@ -1103,6 +1205,22 @@ SongList LibraryBackend::FindSongs(const smart_playlists::Search& search) {
   return ret;
 }
 
+QList<int> LibraryBackend::FindSongIds(
+    const smart_playlists::Search& search) {
+  QMutexLocker l(db_->ReadMutex());
+  QSqlDatabase db(db_->ConnectReadOnly());
+
+  QList<int> ret;
+  QSqlQuery query(search.ToIdSql(songs_table()), db);
+  query.exec();
+  if (db_->CheckErrors(query)) return ret;
+
+  while (query.next()) {
+    ret << query.value(0).toInt();
+  }
+  return ret;
+}
+
 SongList LibraryBackend::GetAllSongs() {
   // Get all the songs!
   return FindSongs(smart_playlists::Search(
@@ -1223,3 +1341,8 @@ void LibraryBackend::DeleteAll() {
 
   emit DatabaseReset();
 }
+
+void LibraryBackend::AllSongsReplaced() {
+  emit DatabaseReset();
+  UpdateTotalSongCountAsync();
+}
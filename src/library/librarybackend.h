@@ -18,6 +18,7 @@
 #ifndef LIBRARYBACKEND_H
 #define LIBRARYBACKEND_H
 
+#include <QMap>
 #include <QObject>
 #include <QSet>
 #include <QUrl>
@@ -130,6 +131,10 @@ class LibraryBackend : public LibraryBackendInterface {
  public:
   static const char* kSettingsGroup;
 
+  // The columns of the songs table the FTS columns are populated from, in the
+  // same order as Song::kFtsColumns.
+  static const char* kFtsSourceColumnSpec;
+
   Q_INVOKABLE LibraryBackend(QObject* parent = nullptr);
   void Init(Database* db, const QString& songs_table, const QString& dirs_table,
             const QString& subdirs_table, const QString& fts_table);
@@ -139,6 +144,7 @@ class LibraryBackend : public LibraryBackendInterface {
   QString songs_table() const { return songs_table_; }
   QString dirs_table() const { return dirs_table_; }
   QString subdirs_table() const { return subdirs_table_; }
+  QString fts_table() const { return fts_table_; }
 
   // Get a list of directories in the library.  Emits DirectoriesDiscovered.
   void LoadDirectoriesAsync();
@@ -189,8 +195,12 @@ class LibraryBackend : public LibraryBackendInterface {
   void RemoveDirectory(const Directory& dir);
 
   bool ExecQuery(LibraryQuery* q);
+  // Like ExecQuery, but on the database's read-only connection.  Callers must
+  // hold db()->ReadMutex() instead of db()->Mutex().
+  bool ExecReadOnlyQuery(LibraryQuery* q);
   SongList ExecLibraryQuery(LibraryQuery* query);
   SongList FindSongs(const smart_playlists::Search& search);
+  QList<int> FindSongIds(const smart_playlists::Search& search);
   SongList GetAllSongs();
 
   void IncrementPlayCountAsync(int id);
@@ -200,6 +210,9 @@ class LibraryBackend : public LibraryBackendInterface {
   void UpdateSongsRatingAsync(const QList<int>& ids, float rating);
 
   void DeleteAll();
+  // Tells everything showing these songs that they were all replaced at once,
+  // by something like CatalogImport that writes to the tables itself.
+  void AllSongsReplaced();
 
  public slots:
   void LoadDirectories();
@@ -219,6 +232,16 @@ class LibraryBackend : public LibraryBackendInterface {
   void ResetStatistics(int id);
   void UpdateSongRating(int id, float rating);
   void UpdateSongsRating(const QList<int>& id_list, float rating);
+
+  // Between these calls AddOrUpdateSongs doesn't add new songs in the
+  // directory to the FTS index one by one - EndBulkInsert indexes them all at
+  // once instead.  This is much quicker for big imports like the first scan of
+  // a directory, but songs added to it in the meantime can't be found by
+  // searching.  Songs in other directories are indexed as usual.  Calls can be
+  // nested.
+  void BeginBulkInsert(int directory_id);
+  void EndBulkInsert(int directory_id);
+
   // Tells the library model that a song path has changed
   void SongPathChanged(const Song& song, const QFileInfo& new_file);
 
@@ -259,6 +282,11 @@ signals:
   Song GetSongById(int id, QSqlDatabase& db);
   SongList GetSongsById(const QStringList& ids, QSqlDatabase& db);
 
+  // Populates the FTS index for the given songs from the songs table.
+  void AddToFtsIndex(const QList<int>& ids, QSqlDatabase& db);
+  // Indexes every song that isn't in the FTS index.
+  void AddMissingToFtsIndex(QSqlDatabase& db);
+
  private:
   Database* db_;
   QString songs_table_;
@@ -267,6 +295,12 @@ signals:
   QString fts_table_;
   bool save_statistics_in_file_;
   bool save_ratings_in_file_;
+
+  // Directory ID -> the number of bulk inserts into it that are running, and
+  // the songs they've added that aren't in the FTS index yet.  Guarded by the
+  // database mutex.
+  QMap<int, int> bulk_insert_depth_;
+  QMap<int, QList<int>> bulk_inserted_ids_;
 };
 
 #endif  // LIBRARYBACKEND_H
@@ -63,6 +63,22 @@ const char* LibraryModel::kSavedGroupingsSettingsGroup = "SavedGroupings";
 const int LibraryModel::kSmartPlaylistsVersion = 4;
 const int LibraryModel::kPrettyCoverSize = 32;
 const qint64 LibraryModel::kIconCacheSize = 100000000;  //~100MB
+const int LibraryModel::kMinResetBatchSize = 100;
+const double LibraryModel::kResetBatchFraction = 0.5;
+const int LibraryModel::kMaxPrefetchChildren = 8;
+
+namespace {
+
+// A node that SongsDiscovered is going to add under an existing parent.
+struct PendingLibraryItem {
+  LibraryModel::GroupBy type;
+  int container_level;
+  QString key;
+  Song song;
+  bool compilation_artist;
+};
+
+}  // namespace
 
 static bool IsArtistGroupBy(const LibraryModel::GroupBy by) {
   return by == LibraryModel::GroupBy_Artist ||
@@ -88,6 +104,8 @@ LibraryModel::LibraryModel(LibraryBackend* backend, Application* app,
       playlist_icon_(IconLoader::Load("x-clementine-albums", IconLoader::Base)),
       icon_cache_(new QNetworkDiskCache(this)),
       init_task_id_(-1),
+      async_populate_(false),
+      next_populate_id_(0),
       use_pretty_covers_(false),
       show_dividers_(true) {
   root_->lazy_loaded = true;
@@ -100,8 +118,11 @@ LibraryModel::LibraryModel(LibraryBackend* backend, Application* app,
   cover_loader_options_.pad_output_image_ = true;
   cover_loader_options_.scale_output_image_ = true;
 
-  connect(app_->album_cover_loader(), SIGNAL(ImageLoaded(quint64, QImage)),
-          SLOT(AlbumArtLoaded(quint64, QImage)));
+  // The tests don't have an Application.
+  if (app_) {
+    connect(app_->album_cover_loader(), SIGNAL(ImageLoaded(quint64, QImage)),
+            SLOT(AlbumArtLoaded(quint64, QImage)));
+  }
 
   icon_cache_->setCacheDirectory(
       Utilities::GetConfigPath(Utilities::Path_CacheRoot) + "/pixmapcache");
@@ -157,6 +178,8 @@ void LibraryModel::SaveGrouping(QString name) {
 }
 
 void LibraryModel::Init(bool async) {
+  async_populate_ = async;
+
   if (async) {
     // Show a loading indicator in the model.
     LibraryItem* loading =
@@ -166,7 +189,9 @@ void LibraryModel::Init(bool async) {
     reset();
 
     // Show a loading indicator in the status bar too.
-    init_task_id_ = app_->task_manager()->StartTask(tr("Loading songs"));
+    if (app_) {
+      init_task_id_ = app_->task_manager()->StartTask(tr("Loading songs"));
+    }
 
     ResetAsync();
   } else {
@@ -174,7 +199,80 @@ void LibraryModel::Init(bool async) {
   }
 }
 
+QString LibraryModel::ContainerKey(GroupBy type, const Song& song) {
+  QString key;
+  switch (type) {
+    case GroupBy_Album:
+      key = song.album();
+      break;
+    case GroupBy_Artist:
+      key = song.artist();
+      break;
+    case GroupBy_Composer:
+      key = song.composer();
+      break;
+    case GroupBy_Performer:
+      key = song.performer();
+      break;
+    case GroupBy_Disc:
+      key = QString::number(song.disc());
+      break;
+    case GroupBy_Grouping:
+      key = song.grouping();
+      break;
+    case GroupBy_Genre:
+      key = song.genre();
+      break;
+    case GroupBy_AlbumArtist:
+      key = song.effective_albumartist();
+      break;
+    case GroupBy_Year:
+      key = QString::number(qMax(0, song.year()));
+      break;
+    case GroupBy_OriginalYear:
+      key = QString::number(qMax(0, song.effective_originalyear()));
+      break;
+    case GroupBy_YearAlbum:
+      key = PrettyYearAlbum(qMax(0, song.year()), song.album());
+      break;
+    case GroupBy_OriginalYearAlbum:
+      key = PrettyYearAlbum(qMax(0, song.effective_originalyear()),
+                            song.album());
+      break;
+    case GroupBy_FileType:
+      key = song.filetype();
+      break;
+    case GroupBy_Bitrate:
+      key = song.bitrate();
+      break;
+    case GroupBy_None:
+      qLog(Error) << "GroupBy_None";
+      break;
+  }
+  return key;
+}
+
+int LibraryModel::LoadedNodeCount() const {
+  return song_nodes_.count() + container_nodes_[0].count() +
+         container_nodes_[1].count() + container_nodes_[2].count() +
+         divider_nodes_.count();
+}
+
+bool LibraryModel::ShouldResetForBatch(int changed_nodes) const {
+  return changed_nodes >= kMinResetBatchSize &&
+         changed_nodes > LoadedNodeCount() * kResetBatchFraction;
+}
+
 void LibraryModel::SongsDiscovered(const SongList& songs) {
+  // First work out which nodes need adding under which existing parents,
+  // so each parent gets one rowsInserted signal for all its new children.
+  QList<LibraryItem*> parents;
+  QHash<LibraryItem*, QList<PendingLibraryItem>> pending;
+  QSet<QString> pending_containers[3];
+  QSet<LibraryItem*> pending_compilation_parents;
+  QSet<int> pending_song_ids;
+  int pending_count = 0;
+
   for (const Song& song : songs) {
     // Sanity check to make sure we don't add songs that are outside the user's
     // filter
@@ -191,6 +289,13 @@ void LibraryModel::SongsDiscovered(const SongList& songs) {
 
     // Find parent containers in the tree
     LibraryItem* container = root_;
+    PendingLibraryItem item;
+    item.type = GroupBy_None;
+    item.container_level = -1;
+    item.song = song;
+    item.compilation_artist = false;
+    bool needs_item = true;
+
     for (int i = 0; i < 3; ++i) {
       GroupBy type = group_by_[i];
       if (type == GroupBy_None) break;
@@ -198,82 +303,114 @@ void LibraryModel::SongsDiscovered(const SongList& songs) {
       // Special case: if the song is a compilation and the current GroupBy
       // level is Artists, then we want the Various Artists node :(
       if (IsArtistGroupBy(type) && song.is_compilation()) {
-        if (container->compilation_artist_node_ == nullptr)
-          CreateCompilationArtistNode(true, container);
+        if (container->compilation_artist_node_ == nullptr) {
+          item.compilation_artist = true;
+          break;
+        }
         container = container->compilation_artist_node_;
       } else {
         // Otherwise find the proper container at this level based on the
         // item's key
-        QString key;
-        switch (type) {
-          case GroupBy_Album:
-            key = song.album();
-            break;
-          case GroupBy_Artist:
-            key = song.artist();
-            break;
-          case GroupBy_Composer:
-            key = song.composer();
-            break;
-          case GroupBy_Performer:
-            key = song.performer();
-            break;
-          case GroupBy_Disc:
-            key = QString::number(song.disc());
-            break;
-          case GroupBy_Grouping:
-            key = song.grouping();
-            break;
-          case GroupBy_Genre:
-            key = song.genre();
-            break;
-          case GroupBy_AlbumArtist:
-            key = song.effective_albumartist();
-            break;
-          case GroupBy_Year:
-            key = QString::number(qMax(0, song.year()));
-            break;
-          case GroupBy_OriginalYear:
-            key = QString::number(qMax(0, song.effective_originalyear()));
-            break;
-          case GroupBy_YearAlbum:
-            key = PrettyYearAlbum(qMax(0, song.year()), song.album());
-            break;
-          case GroupBy_OriginalYearAlbum:
-            key = PrettyYearAlbum(qMax(0, song.effective_originalyear()),
-                                  song.album());
-            break;
-          case GroupBy_FileType:
-            key = song.filetype();
-            break;
-          case GroupBy_Bitrate:
-            key = song.bitrate();
-            break;
-          case GroupBy_None:
-            qLog(Error) << "GroupBy_None";
-            break;
-        }
+        const QString key = ContainerKey(type, song);
 
         // Does it exist already?
         if (!container_nodes_[i].contains(key)) {
-          // Create the container
-          container_nodes_[i][key] =
-              ItemFromSong(type, true, i == 0, container, song, i);
+          // Create the container, unless another song in this batch already
+          // will.  It'll get lazy-loaded properly later, so we don't need to
+          // continue into it any further.
+          if (pending_containers[i].contains(key)) {
+            needs_item = false;
+          } else {
+            pending_containers[i] << key;
+            item.type = type;
+            item.container_level = i;
+            item.key = key;
+          }
+          break;
         }
         container = container_nodes_[i][key];
       }
 
-      // If we just created the damn thing then we don't need to continue into
-      // it any further because it'll get lazy-loaded properly later.
-      if (!container->lazy_loaded) break;
+      // If it hasn't been lazy loaded then it'll get the song when it is.
+      if (!container->lazy_loaded) {
+        needs_item = false;
+        break;
+      }
+
+      // Or if it's being loaded right now, the query might have missed the
+      // song so it needs to be run again.
+      if (populating_.contains(container)) {
+        populate_stale_ << container;
+        needs_item = false;
+        break;
+      }
+    }
+
+    if (!needs_item) continue;
+    if (item.compilation_artist) {
+      // Several songs might want the same Various Artists node.
+      if (pending_compilation_parents.contains(container)) continue;
+      pending_compilation_parents << container;
+    } else if (item.type == GroupBy_None) {
+      if (pending_song_ids.contains(song.id())) continue;
+      pending_song_ids << song.id();
     }
 
-    if (!container->lazy_loaded) continue;
+    if (!pending.contains(container)) parents << container;
+    pending[container] << item;
+    pending_count++;
+  }
+
+  if (pending_count == 0) return;
+
+  // A big import is quicker to show by loading the tree again.
+  if (ShouldResetForBatch(pending_count)) {
+    Reset();
+    return;
+  }
+
+  QStringList new_divider_keys;
+  for (LibraryItem* parent : parents) {
+    const QList<PendingLibraryItem>& items = pending[parent];
+    const int first = parent->children.count();
+
+    beginInsertRows(ItemToIndex(parent), first, first + items.count() - 1);
+    for (const PendingLibraryItem& item : items) {
+      if (item.compilation_artist) {
+        CreateCompilationArtistNode(false, parent);
+      } else if (item.type == GroupBy_None) {
+        song_nodes_[item.song.id()] =
+            ItemFromSong(GroupBy_None, false, false, parent, item.song, -1);
+      } else {
+        LibraryItem* node = ItemFromSong(item.type, false, false, parent,
+                                         item.song, item.container_level);
+        container_nodes_[item.container_level][item.key] = node;
+
+        // The divider is part of the sort text, so it has to be there before
+        // the views see the new rows.
+        if (item.container_level == 0 && show_dividers_) {
+          const QString divider_key = DividerKey(item.type, node);
+          node->sort_text.prepend(divider_key);
+
+          if (!divider_key.isEmpty() && !divider_nodes_.contains(divider_key) &&
+              !new_divider_keys.contains(divider_key)) {
+            new_divider_keys << divider_key;
+          }
+        }
+      }
+    }
+    endInsertRows();
+  }
 
-    // We've gone all the way down to the deepest level and everything was
-    // already lazy loaded, so now we have to create the song in the container.
-    song_nodes_[song.id()] =
-        ItemFromSong(GroupBy_None, true, false, container, song, -1);
+  // Add any dividers the new top level containers need in one go as well.
+  if (!new_divider_keys.isEmpty()) {
+    const int first = root_->children.count();
+    beginInsertRows(ItemToIndex(root_), first,
+                    first + new_divider_keys.count() - 1);
+    for (const QString& divider_key : new_divider_keys) {
+      CreateDividerItem(group_by_[0], divider_key);
+    }
+    endInsertRows();
   }
 }
 
@@ -392,20 +529,11 @@ QString LibraryModel::DividerDisplayText(GroupBy type,
 }
 
 void LibraryModel::SongsDeleted(const SongList& songs) {
-  // Delete the actual song nodes first, keeping track of each parent so we
-  // might check to see if they're empty later.
-  QSet<LibraryItem*> parents;
+  QList<LibraryItem*> song_items;
+  QSet<int> song_ids;
   for (const Song& song : songs) {
-    if (song_nodes_.contains(song.id())) {
-      LibraryItem* node = song_nodes_[song.id()];
-
-      if (node->parent != root_) parents << node->parent;
-
-      beginRemoveRows(ItemToIndex(node->parent), node->row, node->row);
-      node->parent->Delete(node->row);
-      song_nodes_.remove(song.id());
-      endRemoveRows();
-    } else {
+    if (song_ids.contains(song.id())) continue;
+    if (!song_nodes_.contains(song.id())) {
       // If we get here it means some of the songs we want to delete haven't
       // been lazy-loaded yet.  This is bad, because it would mean that to
       // clean up empty parents we would need to lazy-load them all
@@ -414,21 +542,37 @@ void LibraryModel::SongsDeleted(const SongList& songs) {
       Reset();
       return;
     }
+    song_ids << song.id();
+    song_items << song_nodes_[song.id()];
   }
 
-  // Now delete empty parents
+  if (song_items.isEmpty()) return;
+
+  // Removing most of the tree is quicker done by loading it again.
+  if (ShouldResetForBatch(song_items.count())) {
+    Reset();
+    return;
+  }
+
+  // Delete the actual song nodes first, keeping track of each parent so we
+  // might check to see if they're empty later.
+  QSet<LibraryItem*> parents;
+  for (LibraryItem* node : song_items) {
+    if (node->parent != root_) parents << node->parent;
+  }
+  for (int id : song_ids) song_nodes_.remove(id);
+  RemoveItems(song_items);
+
+  // Now delete empty parents, a level at a time
   QSet<QString> divider_keys;
   while (!parents.isEmpty()) {
-    // Since we are going to remove elements from the container, we
-    // need a copy to iterate over. If we iterate over the original,
-    // the behavior will be undefined.
-    QSet<LibraryItem*> parents_copy = parents;
-    for (LibraryItem* node : parents_copy) {
-      parents.remove(node);
+    QList<LibraryItem*> empty_items;
+    QSet<LibraryItem*> next_parents;
+    for (LibraryItem* node : parents) {
       if (node->children.count() != 0) continue;
 
       // Consider its parent for the next round
-      if (node->parent != root_) parents << node->parent;
+      if (node->parent != root_) next_parents << node->parent;
 
       // Maybe consider its divider node
       if (node->container_level == 0)
@@ -441,13 +585,14 @@ void LibraryModel::SongsDeleted(const SongList& songs) {
         container_nodes_[node->container_level].remove(node->key);
 
       // It was empty - delete it
-      beginRemoveRows(ItemToIndex(node->parent), node->row, node->row);
-      node->parent->Delete(node->row);
-      endRemoveRows();
+      empty_items << node;
     }
+    RemoveItems(empty_items);
+    parents = next_parents;
   }
 
   // Delete empty dividers
+  QList<LibraryItem*> empty_dividers;
   for (const QString& divider_key : divider_keys) {
     if (!divider_nodes_.contains(divider_key)) continue;
 
@@ -463,11 +608,47 @@ void LibraryModel::SongsDeleted(const SongList& songs) {
     if (found) continue;
 
     // Remove the divider
-    int row = divider_nodes_[divider_key]->row;
-    beginRemoveRows(ItemToIndex(root_), row, row);
-    root_->Delete(row);
-    endRemoveRows();
-    divider_nodes_.remove(divider_key);
+    empty_dividers << divider_nodes_.take(divider_key);
+  }
+  RemoveItems(empty_dividers);
+}
+
+void LibraryModel::RemoveItems(const QList<LibraryItem*>& items) {
+  QList<LibraryItem*> parents;
+  QHash<LibraryItem*, QList<int>> rows;
+  for (LibraryItem* item : items) {
+    if (!rows.contains(item->parent)) parents << item->parent;
+    rows[item->parent] << item->row;
+
+    // Forget about any query that's loading its children
+    populating_.remove(item);
+    populate_stale_.remove(item);
+  }
+
+  for (LibraryItem* parent : parents) {
+    QList<int>& parent_rows = rows[parent];
+    qSort(parent_rows.begin(), parent_rows.end(), qGreater<int>());
+
+    // Work from the bottom up so the rows of the ranges still to be removed
+    // stay the same.
+    const QModelIndex parent_index = ItemToIndex(parent);
+    int i = 0;
+    while (i < parent_rows.count()) {
+      const int last = parent_rows[i];
+      int first = last;
+      while (++i < parent_rows.count() && parent_rows[i] == first - 1) {
+        first--;
+      }
+
+      beginRemoveRows(parent_index, first, last);
+      for (int row = last; row >= first; --row) {
+        delete parent->children.takeAt(row);
+      }
+      for (int row = first; row < parent->children.count(); ++row) {
+        parent->children[row]->row = row;
+      }
+      endRemoveRows();
+    }
   }
 }
 
@@ -668,15 +849,14 @@ bool LibraryModel::HasCompilations(const LibraryQuery& query) {
   q.AddCompilationRequirement(true);
   q.SetLimit(1);
 
-  QMutexLocker l(backend_->db()->Mutex());
-  if (!backend_->ExecQuery(&q)) return false;
+  QMutexLocker l(backend_->db()->ReadMutex());
+  if (!backend_->ExecReadOnlyQuery(&q)) return false;
 
   return q.Next();
 }
 
-LibraryModel::QueryResult LibraryModel::RunQuery(LibraryItem* parent) {
-  QueryResult result;
-
+LibraryQuery LibraryModel::ChildQuery(LibraryItem* parent,
+                                      bool* artist_level) const {
   // Information about what we want the children to be
   int child_level = parent == root_ ? 0 : parent->container_level + 1;
   GroupBy child_type = child_level >= 3 ? GroupBy_None : group_by_[child_level];
@@ -693,8 +873,17 @@ LibraryModel::QueryResult LibraryModel::RunQuery(LibraryItem* parent) {
     p = p->parent;
   }
 
+  *artist_level = IsArtistGroupBy(child_type);
+  return q;
+}
+
+LibraryModel::QueryResult LibraryModel::RunQuery(const LibraryQuery& query,
+                                                 bool artist_level) {
+  QueryResult result;
+  LibraryQuery q(query);
+
   // Artists GroupBy is special - we don't want compilation albums appearing
-  if (IsArtistGroupBy(child_type)) {
+  if (artist_level) {
     // Add the special Various artists node
     if (show_various_artists_ && HasCompilations(q)) {
       result.create_va = true;
@@ -704,9 +893,10 @@ LibraryModel::QueryResult LibraryModel::RunQuery(LibraryItem* parent) {
     q.AddCompilationRequirement(false);
   }
 
-  // Execute the query
-  QMutexLocker l(backend_->db()->Mutex());
-  if (!backend_->ExecQuery(&q)) return result;
+  // Execute the query.  This doesn't have to wait for scans or other writers
+  // when the database allows concurrent reads.
+  QMutexLocker l(backend_->db()->ReadMutex());
+  if (!backend_->ExecReadOnlyQuery(&q)) return result;
 
   while (q.Next()) {
     result.rows << SqlRow(q);
@@ -721,6 +911,18 @@ void LibraryModel::PostQuery(LibraryItem* parent,
   int child_level = parent == root_ ? 0 : parent->container_level + 1;
   GroupBy child_type = child_level >= 3 ? GroupBy_None : group_by_[child_level];
 
+  // Below the top level there are no dividers to add, so all the new children
+  // can be announced at once.
+  const bool batch = signal && child_level != 0;
+  if (batch) {
+    const int count = result.rows.count() + (result.create_va ? 1 : 0);
+    if (count == 0) return;
+
+    const int first = parent->children.count();
+    beginInsertRows(ItemToIndex(parent), first, first + count - 1);
+    signal = false;
+  }
+
   if (result.create_va) {
     CreateCompilationArtistNode(signal, parent);
   }
@@ -737,19 +939,122 @@ void LibraryModel::PostQuery(LibraryItem* parent,
     else
       container_nodes_[child_level][item->key] = item;
   }
+
+  if (batch) endInsertRows();
+}
+
+void LibraryModel::LazyPopulate(LibraryItem* item) {
+  if (async_populate_) {
+    LazyPopulateAsync(item, true);
+  } else {
+    LazyPopulate(item, true);
+  }
 }
 
 void LibraryModel::LazyPopulate(LibraryItem* parent, bool signal) {
+  if (populating_.contains(parent)) {
+    // Something needs the children right now, so stop waiting for the
+    // background query.
+    populating_.remove(parent);
+    populate_stale_.remove(parent);
+    RemoveLoadingIndicator(parent);
+  } else if (parent->lazy_loaded) {
+    return;
+  }
+  parent->lazy_loaded = true;
+
+  bool artist_level = false;
+  LibraryQuery q = ChildQuery(parent, &artist_level);
+  PostQuery(parent, RunQuery(q, artist_level), signal);
+}
+
+void LibraryModel::LazyPopulateAsync(LibraryItem* parent,
+                                     bool prefetch_children) {
   if (parent->lazy_loaded) return;
   parent->lazy_loaded = true;
 
-  QueryResult result = RunQuery(parent);
-  PostQuery(parent, result, signal);
+  // Show a loading indicator under the node until the query is done.
+  const int row = parent->children.count();
+  beginInsertRows(ItemToIndex(parent), row, row);
+  LibraryItem* loading =
+      new LibraryItem(LibraryItem::Type_LoadingIndicator, parent);
+  loading->display_text = tr("Loading...");
+  loading->lazy_loaded = true;
+  endInsertRows();
+
+  StartPopulateQuery(parent, prefetch_children);
+}
+
+void LibraryModel::StartPopulateQuery(LibraryItem* parent,
+                                      bool prefetch_children) {
+  const int request_id = next_populate_id_++;
+  populating_[parent] = request_id;
+
+  bool artist_level = false;
+  LibraryQuery q = ChildQuery(parent, &artist_level);
+  QFuture<LibraryModel::QueryResult> future =
+      QtConcurrent::run(this, &LibraryModel::RunQuery, q, artist_level);
+  NewClosure(future, this,
+             SLOT(LazyPopulateQueryFinished(QFuture<LibraryModel::QueryResult>,
+                                            LibraryItem*, int, bool)),
+             future, parent, request_id, prefetch_children);
+}
+
+void LibraryModel::LazyPopulateQueryFinished(
+    QFuture<LibraryModel::QueryResult> future, LibraryItem* parent,
+    int request_id, bool prefetch_children) {
+  // The node might have been deleted, reset or loaded synchronously while the
+  // query was running.  Only look at parent if it's still the one we asked
+  // about.
+  if (populating_.value(parent, -1) != request_id) return;
+
+  if (populate_stale_.remove(parent)) {
+    // The results might be missing songs that were added in the meantime.
+    StartPopulateQuery(parent, prefetch_children);
+    return;
+  }
+
+  populating_.remove(parent);
+  RemoveLoadingIndicator(parent);
+  PostQuery(parent, future.result(), true);
+
+  if (prefetch_children) PrefetchChildren(parent);
+}
+
+void LibraryModel::RemoveLoadingIndicator(LibraryItem* parent) {
+  for (LibraryItem* child : parent->children) {
+    if (child->type != LibraryItem::Type_LoadingIndicator) continue;
+
+    beginRemoveRows(ItemToIndex(parent), child->row, child->row);
+    parent->Delete(child->row);
+    endRemoveRows();
+    return;
+  }
+}
+
+void LibraryModel::PrefetchChildren(LibraryItem* parent) {
+  if (!async_populate_) return;
+
+  // The user is likely to expand one of the children next if there are only
+  // a few of them.  Don't go any deeper than that though.
+  QList<LibraryItem*> children;
+  for (LibraryItem* child : parent->children) {
+    if (child->type == LibraryItem::Type_Container && !child->lazy_loaded) {
+      children << child;
+    }
+  }
+  if (children.count() > kMaxPrefetchChildren) return;
+
+  for (LibraryItem* child : children) {
+    LazyPopulateAsync(child, false);
+  }
 }
 
 void LibraryModel::ResetAsync() {
+  bool artist_level = false;
+  LibraryQuery q = ChildQuery(root_, &artist_level);
   QFuture<LibraryModel::QueryResult> future =
-      QtConcurrent::run(this, &LibraryModel::RunQuery, root_);
+      QtConcurrent::run(this, &LibraryModel::RunQuery, q, artist_level);
   NewClosure(future, this,
              SLOT(ResetAsyncQueryFinished(QFuture<LibraryModel::QueryResult>)),
              future);
@@ -770,6 +1075,8 @@ void LibraryModel::ResetAsyncQueryFinished(
   }
 
   endResetModel();
+
+  PrefetchChildren(root_);
 }
 
 void LibraryModel::BeginReset() {
@@ -781,6 +1088,8 @@ void LibraryModel::BeginReset() {
   container_nodes_[2].clear();
   divider_nodes_.clear();
   pending_art_.clear();
+  populating_.clear();
+  populate_stale_.clear();
   smart_playlist_node_ = nullptr;
 
   root_ = new LibraryItem(this);
@@ -1037,6 +1346,15 @@ LibraryItem* LibraryModel::ItemFromSong(GroupBy type, bool signal,
                                         LibraryItem* parent, const Song& s,
                                         int container_level) {
   LibraryItem* item = InitItem(type, signal, parent, container_level);
+  SetItemFromSong(type, s, item);
+
+  FinishItem(type, signal, create_divider, parent, item);
+  if (s.url().scheme() == "cdda") item->lazy_loaded = true;
+  return item;
+}
+
+void LibraryModel::SetItemFromSong(GroupBy type, const Song& s,
+                                   LibraryItem* item) {
   int year = 0;
   int originalyear = 0;
   int effective_originalyear = 0;
@@ -1120,10 +1438,6 @@ LibraryItem* LibraryModel::ItemFromSong(GroupBy type, bool signal,
       item->sort_text = SortTextForSong(s);
       break;
   }
-
-  FinishItem(type, signal, create_divider, parent, item);
-  if (s.url().scheme() == "cdda") item->lazy_loaded = true;
-  return item;
 }
 
 void LibraryModel::FinishItem(GroupBy type, bool signal, bool create_divider,
@@ -1142,18 +1456,24 @@ void LibraryModel::FinishItem(GroupBy type, bool signal, bool create_divider,
         beginInsertRows(ItemToIndex(parent), parent->children.count(),
                         parent->children.count());
 
-      LibraryItem* divider = new LibraryItem(LibraryItem::Type_Divider, root_);
-      divider->key = divider_key;
-      divider->display_text = DividerDisplayText(type, divider_key);
-      divider->lazy_loaded = true;
-
-      divider_nodes_[divider_key] = divider;
+      CreateDividerItem(type, divider_key);
 
       if (signal) endInsertRows();
     }
   }
 }
 
+LibraryItem* LibraryModel::CreateDividerItem(GroupBy type,
+                                             const QString& divider_key) {
+  LibraryItem* divider = new LibraryItem(LibraryItem::Type_Divider, root_);
+  divider->key = divider_key;
+  divider->display_text = DividerDisplayText(type, divider_key);
+  divider->lazy_loaded = true;
+
+  divider_nodes_[divider_key] = divider;
+  return divider;
+}
+
 QString LibraryModel::TextOrUnknown(const QString& text) {
   if (text.isEmpty()) {
     return tr("Unknown");
@@ -1265,7 +1585,18 @@ void LibraryModel::GetChildSongs(LibraryItem* item, QList<QUrl>* urls,
                                  SongList* songs, QSet<int>* song_ids) const {
   switch (item->type) {
     case LibraryItem::Type_Container: {
-      const_cast<LibraryModel*>(this)->LazyPopulate(item);
+      if (!item->lazy_loaded || populating_.contains(item)) {
+        // Nothing under it has been loaded yet, so get all the songs at once
+        // instead of loading the tree a level at a time.
+        for (const Song& song : SubtreeSongs(item)) {
+          urls->append(song.url());
+          if (!song_ids->contains(song.id())) {
+            songs->append(song);
+            song_ids->insert(song.id());
+          }
+        }
+        break;
+      }
 
       QList<LibraryItem*> children = item->children;
       qSort(children.begin(), children.end(),
@@ -1289,6 +1620,68 @@ void LibraryModel::GetChildSongs(LibraryItem* item, QList<QUrl>* urls,
   }
 }
 
+SongList LibraryModel::SubtreeSongs(LibraryItem* item) const {
+  LibraryQuery q(query_options_);
+  InitQuery(GroupBy_None, &q);
+
+  // Walk up through the item's parents adding filters as necessary
+  for (LibraryItem* p = item; p && p->type == LibraryItem::Type_Container;
+       p = p->parent) {
+    FilterQuery(group_by_[p->container_level], p, &q);
+  }
+
+  // Compilations only appear under the Various artists node, so if that's
+  // turned off they don't appear at all.
+  QList<GroupBy> levels;
+  for (int i = item->container_level + 1; i < 3; ++i) {
+    if (group_by_[i] == GroupBy_None) break;
+    levels << group_by_[i];
+    if (IsArtistGroupBy(group_by_[i]) && !show_various_artists_) {
+      q.AddCompilationRequirement(false);
+    }
+  }
+  levels << GroupBy_None;
+
+  // Sort the songs by the sort text of each item they would be under, the
+  // same way GetChildSongs sorts loaded children.
+  typedef QPair<QStringList, Song> SortedSong;
+  QList<SortedSong> sorted;
+  {
+    QMutexLocker l(backend_->db()->ReadMutex());
+    if (!backend_->ExecReadOnlyQuery(&q)) return SongList();
+
+    while (q.Next()) {
+      Song song;
+      song.InitFromQuery(SqlRow(q), true);
+
+      QStringList sort_texts;
+      for (GroupBy type : levels) {
+        if (IsArtistGroupBy(type) && song.is_compilation()) {
+          sort_texts << " various";
+          continue;
+        }
+        LibraryItem tmp(type == GroupBy_None ? LibraryItem::Type_Song
+                                             : LibraryItem::Type_Container);
+        SetItemFromSong(type, song, &tmp);
+        sort_texts << tmp.SortText();
+      }
+      sorted << SortedSong(sort_texts, song);
+    }
+  }
+
+  qStableSort(sorted.begin(), sorted.end(),
+              [](const SortedSong& a, const SortedSong& b) {
+    for (int i = 0; i < a.first.count(); ++i) {
+      if (a.first[i] != b.first[i]) return a.first[i] < b.first[i];
+    }
+    return false;
+  });
+
+  SongList ret;
+  for (const SortedSong& song : sorted) ret << song.second;
+  return ret;
+}
+
 SongList LibraryModel::GetChildSongs(const QModelIndexList& indexes) const {
   QList<QUrl> dontcare;
   SongList ret;
@@ -1326,6 +1719,10 @@ bool LibraryModel::canFetchMore(const QModelIndex& parent) const {
   return !item->lazy_loaded;
 }
 
+void LibraryModel::FetchMoreNow(const QModelIndex& parent) {
+  LazyPopulate(IndexToItem(parent), true);
+}
+
 void LibraryModel::SetGroupBy(const Grouping& g) {
   group_by_ = g;
 
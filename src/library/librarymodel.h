@@ -60,6 +60,16 @@ class LibraryModel : public SimpleTreeModel<LibraryItem> {
   static const int kPrettyCoverSize;
   static const qint64 kIconCacheSize;
 
+  // SongsDiscovered and SongsDeleted reset the model instead of updating it
+  // node by node if they would change at least this many nodes and more
+  // than this fraction of the nodes already in the tree.
+  static const int kMinResetBatchSize;
+  static const double kResetBatchFraction;
+
+  // When a node is expanded its unloaded children are loaded in the
+  // background too, if there are at most this many of them.
+  static const int kMaxPrefetchChildren;
+
   enum Role {
     Role_Type = Qt::UserRole + 1,
     Role_ContainerType,
@@ -156,6 +166,10 @@ class LibraryModel : public SimpleTreeModel<LibraryItem> {
   QMimeData* mimeData(const QModelIndexList& indexes) const;
   bool canFetchMore(const QModelIndex& parent) const;
 
+  // Loads the children of the item straight away instead of in the
+  // background like fetchMore does.
+  void FetchMoreNow(const QModelIndex& parent);
+
   // Whether or not to use album cover art, if it exists, in the library view
   void set_pretty_covers(bool use_pretty_covers);
   bool use_pretty_covers() const { return use_pretty_covers_; }
@@ -190,7 +204,8 @@ signals:
   void ResetAsync();
 
  protected:
-  void LazyPopulate(LibraryItem* item) { LazyPopulate(item, true); }
+  // Called when a view expands the item.
+  void LazyPopulate(LibraryItem* item);
   void LazyPopulate(LibraryItem* item, bool signal);
 
  private slots:
@@ -202,6 +217,10 @@ signals:
 
   // Called after ResetAsync
   void ResetAsyncQueryFinished(QFuture<LibraryModel::QueryResult> future);
+  // Called after LazyPopulateAsync
+  void LazyPopulateQueryFinished(QFuture<LibraryModel::QueryResult> future,
+                                 LibraryItem* parent, int request_id,
+                                 bool prefetch_children);
 
   void AlbumArtLoaded(quint64 id, const QImage& image);
 
@@ -209,9 +228,23 @@ signals:
   // Provides some optimisations for loading the list of items in the root.
   // This gets called a lot when filtering the playlist, so it's nice to be
   // able to do it in a background thread.
-  QueryResult RunQuery(LibraryItem* parent);
+  // ChildQuery looks at parent and its ancestors so it must be called from
+  // the GUI thread, but RunQuery can be called from any thread.
+  LibraryQuery ChildQuery(LibraryItem* parent, bool* artist_level) const;
+  QueryResult RunQuery(const LibraryQuery& query, bool artist_level);
   void PostQuery(LibraryItem* parent, const QueryResult& result, bool signal);
 
+  // Like LazyPopulate but the query runs in a background thread.  The parent
+  // gets a loading indicator child until the results come back.
+  void LazyPopulateAsync(LibraryItem* parent, bool prefetch_children);
+  void StartPopulateQuery(LibraryItem* parent, bool prefetch_children);
+  void RemoveLoadingIndicator(LibraryItem* parent);
+  void PrefetchChildren(LibraryItem* parent);
+
+  // Gets all the songs under an item that hasn't been loaded yet with one
+  // query, in the same order they would appear in the tree.
+  SongList SubtreeSongs(LibraryItem* item) const;
+
   bool HasCompilations(const LibraryQuery& query);
 
   void BeginReset();
@@ -222,7 +255,7 @@ signals:
   // for each parent item, restricting the songs returned to a particular
   // album or artist for example.
   static void InitQuery(GroupBy type, LibraryQuery* q);
-  void FilterQuery(GroupBy type, LibraryItem* item, LibraryQuery* q);
+  static void FilterQuery(GroupBy type, LibraryItem* item, LibraryQuery* q);
 
   // Items can be created either from a query that's been run to populate a
   // node, or by a spontaneous SongsDiscovered emission from the backend.
@@ -235,6 +268,18 @@ signals:
 
   // The "Various Artists" node is an annoying special case.
   LibraryItem* CreateCompilationArtistNode(bool signal, LibraryItem* parent);
+  LibraryItem* CreateDividerItem(GroupBy type, const QString& divider_key);
+
+  // Key of the container at this level that a discovered song belongs in.
+  static QString ContainerKey(GroupBy type, const Song& song);
+
+  // Number of nodes that have been loaded into the tree so far.
+  int LoadedNodeCount() const;
+  bool ShouldResetForBatch(int changed_nodes) const;
+
+  // Removes the items with one rowsRemoved signal for each contiguous range
+  // of rows under each parent.
+  void RemoveItems(const QList<LibraryItem*>& items);
 
   // Smart playlists are shown in another top-level node
   void CreateSmartPlaylists();
@@ -247,6 +292,7 @@ signals:
                         int container_level);
   void FinishItem(GroupBy type, bool signal, bool create_divider,
                   LibraryItem* parent, LibraryItem* item);
+  static void SetItemFromSong(GroupBy type, const Song& s, LibraryItem* item);
 
   QString DividerKey(GroupBy type, LibraryItem* item) const;
   QString DividerDisplayText(GroupBy type, const QString& key) const;
@@ -294,6 +340,16 @@ signals:
 
   int init_task_id_;
 
+  // Whether expanding a node loads its children in the background.
+  bool async_populate_;
+
+  // Nodes whose children are being loaded by LazyPopulateAsync, and the ID of
+  // the request that's loading them.  Nodes in populate_stale_ had songs
+  // added while their query was running, so it has to be run again.
+  QHash<LibraryItem*, int> populating_;
+  QSet<LibraryItem*> populate_stale_;
+  int next_populate_id_;
+
   bool use_pretty_covers_;
   bool show_dividers_;
 
@@ -256,8 +256,14 @@ void LibraryView::RestoreFocus() {
 }
 
 bool LibraryView::RestoreLevelFocus(const QModelIndex& parent) {
-  if (model()->canFetchMore(parent)) {
-    model()->fetchMore(parent);
+  QSortFilterProxyModel* proxy = qobject_cast<QSortFilterProxyModel*>(model());
+  LibraryModel* library_model =
+      proxy ? qobject_cast<LibraryModel*>(proxy->sourceModel()) : nullptr;
+  if (!library_model) return false;
+
+  // The children are needed now, not when the background query finishes.
+  if (parent.isValid()) {
+    library_model->FetchMoreNow(proxy->mapToSource(parent));
   }
   int rows = model()->rowCount(parent);
   for (int i = 0; i < rows; i++) {
@@ -266,9 +272,8 @@ bool LibraryView::RestoreLevelFocus(const QModelIndex& parent) {
     switch (type.toInt()) {
       case LibraryItem::Type_Song:
         if (!last_selected_song_.url().isEmpty()) {
-          QModelIndex index = qobject_cast<QSortFilterProxyModel*>(model())
-                                  ->mapToSource(current);
-          SongList songs = app_->library_model()->GetChildSongs(index);
+          SongList songs =
+              library_model->GetChildSongs(proxy->mapToSource(current));
           for (const Song& song : songs) {
             if (song == last_selected_song_) {
               setCurrentIndex(current);
@@ -46,6 +46,13 @@
 namespace {
 static const char *kNoMediaFile = ".nomedia";
 static const char *kNoMusicFile   = ".nomusic";
+
+// Number of tag read batches to keep queued for each tagreader worker.
+static const int kTagReadBatchesPerWorker = 2;
+
+// New songs are sent to the backend in batches of this size while a scan is
+// still running.
+static const int kSongBatchSize = 1000;
 }
 
 QStringList LibraryWatcher::sValidImages;
@@ -84,6 +91,9 @@ LibraryWatcher::ScanTransaction::ScanTransaction(LibraryWatcher* watcher,
                                                  bool ignores_mtime)
     : progress_(0),
       progress_max_(0),
+      tag_read_task_id_(-1),
+      tag_read_progress_(0),
+      tag_read_progress_max_(0),
       dir_(dir),
       incremental_(incremental),
       ignores_mtime_(ignores_mtime),
@@ -101,10 +111,18 @@ LibraryWatcher::ScanTransaction::ScanTransaction(LibraryWatcher* watcher,
 }
 
 LibraryWatcher::ScanTransaction::~ScanTransaction() {
+  // Wait for the tag reads that are still in flight - their replies can't be
+  // deleted until they have finished.
+  watcher_->SendTagReads(this);
+  watcher_->FinishTagReads(this, 0);
+
+  if (tag_read_task_id_ != -1)
+    watcher_->task_manager_->SetTaskFinished(tag_read_task_id_);
+
   // If we're stopping then don't commit the transaction
   if (watcher_->stop_requested_) return;
 
-  if (!new_songs.isEmpty()) emit watcher_->NewOrUpdatedSongs(new_songs);
+  CommitNewSongs();
 
   if (!touched_songs.isEmpty()) emit watcher_->SongsMTimeUpdated(touched_songs);
 
@@ -137,19 +155,88 @@ void LibraryWatcher::ScanTransaction::AddToProgressMax(int n) {
   watcher_->task_manager_->SetTaskProgress(task_id_, progress_, progress_max_);
 }
 
+void LibraryWatcher::ScanTransaction::AddToTagReadProgress(int n) {
+  tag_read_progress_ += n;
+  watcher_->task_manager_->SetTaskProgress(
+      tag_read_task_id_, tag_read_progress_, tag_read_progress_max_);
+}
+
+void LibraryWatcher::ScanTransaction::AddToTagReadProgressMax(int n) {
+  if (tag_read_task_id_ == -1) {
+    QString description;
+    if (watcher_->device_name_.isEmpty())
+      description = tr("Reading tags");
+    else
+      description = tr("Reading tags on %1").arg(watcher_->device_name_);
+
+    tag_read_task_id_ = watcher_->task_manager_->StartTask(description);
+  }
+
+  tag_read_progress_max_ += n;
+  watcher_->task_manager_->SetTaskProgress(
+      tag_read_task_id_, tag_read_progress_, tag_read_progress_max_);
+}
+
+void LibraryWatcher::ScanTransaction::CommitNewSongs() {
+  if (new_songs.isEmpty()) return;
+
+  emit watcher_->NewOrUpdatedSongs(new_songs);
+  new_songs.clear();
+}
+
+uint LibraryWatcher::ScanTransaction::GetMtimeForCue(
+    const QString& cue_path) {
+  if (cue_path.isEmpty()) return 0;
+
+  QHash<QString, uint>::const_iterator it = cue_mtimes_.constFind(cue_path);
+  if (it != cue_mtimes_.constEnd()) return *it;
+
+  const uint mtime = watcher_->GetMtimeForCue(cue_path);
+  cue_mtimes_.insert(cue_path, mtime);
+  return mtime;
+}
+
+SongList LibraryWatcher::ScanTransaction::LoadCue(const QString& cue_path,
+                                                  const QString& dir_path) {
+  const uint mtime = GetMtimeForCue(cue_path);
+
+  QHash<QString, CachedCue>::const_iterator it = cues_.constFind(cue_path);
+  if (it != cues_.constEnd() && it->mtime == mtime) return it->songs;
+
+  CachedCue cue;
+  cue.mtime = mtime;
+
+  QFile file(cue_path);
+  if (file.open(QIODevice::ReadOnly)) {
+    cue.songs = watcher_->cue_parser_->Load(&file, cue_path, dir_path);
+  }
+
+  cues_.insert(cue_path, cue);
+  return cue.songs;
+}
+
+bool LibraryWatcher::ScanTransaction::IsMediaFile(const QString& file) {
+  QHash<QString, bool>::const_iterator it = media_files_.constFind(file);
+  if (it != media_files_.constEnd()) return *it;
+
+  const bool ret = TagReaderClient::Instance()->IsMediaFileBlocking(file);
+  media_files_.insert(file, ret);
+  return ret;
+}
+
 SongList LibraryWatcher::ScanTransaction::FindSongsInSubdirectory(
     const QString& path) {
   if (cached_songs_dirty_) {
-    cached_songs_ = watcher_->backend_->FindSongsInDirectory(dir_);
+    // Group the songs by the subdirectory they're in, so each lookup doesn't
+    // have to look at every song in the directory.
+    cached_songs_.clear();
+    for (const Song& song : watcher_->backend_->FindSongsInDirectory(dir_)) {
+      cached_songs_[DirectoryPart(song.url().toLocalFile())] << song;
+    }
     cached_songs_dirty_ = false;
   }
 
-  // TODO: Make this faster
-  SongList ret;
-  for (const Song& song : cached_songs_) {
-    if (song.url().toLocalFile().section('/', 0, -2) == path) ret << song;
-  }
-  return ret;
+  return cached_songs_.value(path);
 }
 
 void LibraryWatcher::ScanTransaction::SetKnownSubdirs(
@@ -197,10 +284,14 @@ void LibraryWatcher::AddDirectory(const Directory& dir,
   if (subdirs.isEmpty()) {
     // This is a new directory that we've never seen before.
     // Scan it fully.
-    ScanTransaction transaction(this, dir.id, false);
-    transaction.SetKnownSubdirs(subdirs);
-    transaction.AddToProgressMax(1);
-    ScanSubdirectory(dir.path, Subdirectory(), &transaction);
+    emit BulkInsertStarted(dir.id);
+    {
+      ScanTransaction transaction(this, dir.id, false);
+      transaction.SetKnownSubdirs(subdirs);
+      transaction.AddToProgressMax(1);
+      ScanSubdirectory(dir.path, Subdirectory(), &transaction);
+    }
+    emit BulkInsertFinished(dir.id);
   } else {
     // We can do an incremental scan - looking at the mtimes of each
     // subdirectory and only rescan if the directory has changed.
@@ -253,6 +344,7 @@ void LibraryWatcher::ScanSubdirectory(const QString& path,
 
   QMap<QString, QStringList> album_art;
   QStringList files_on_disk;
+  QSet<QString> files_on_disk_set;
   SubdirectoryList my_new_subdirs;
 
   // If a directory is moved then only its parent gets a changed notification,
@@ -294,15 +386,28 @@ void LibraryWatcher::ScanSubdirectory(const QString& path,
 
       if (sValidImages.contains(ext_part))
         album_art[dir_part] << child;
-      else if (!child_info.isHidden())
+      else if (!child_info.isHidden()) {
         files_on_disk << child;
+        files_on_disk_set << child;
+      }
     }
   }
 
   if (stop_requested_) return;
 
-  // Ask the database for a list of files in this directory
+  // Ask the database for a list of files in this directory, and index it by
+  // path so comparing it against the files on disk stays linear.  Files with
+  // a cue sheet have one song per section - the first one represents the
+  // file.
   SongList songs_in_db = t->FindSongsInSubdirectory(path);
+  QHash<QString, Song> songs_in_db_by_path;
+  songs_in_db_by_path.reserve(songs_in_db.count());
+  for (const Song& song : songs_in_db) {
+    const QString song_path = song.url().toLocalFile();
+    if (!songs_in_db_by_path.contains(song_path)) {
+      songs_in_db_by_path.insert(song_path, song);
+    }
+  }
 
   QSet<QString> cues_processed;
 
@@ -313,9 +418,11 @@ void LibraryWatcher::ScanSubdirectory(const QString& path,
     // associated cue
     QString matching_cue = NoExtensionPart(file) + ".cue";
 
-    Song matching_song;
-    if (FindSongByPath(songs_in_db, file, &matching_song)) {
-      uint matching_cue_mtime = GetMtimeForCue(matching_cue);
+    QHash<QString, Song>::const_iterator matching_it =
+        songs_in_db_by_path.constFind(file);
+    if (matching_it != songs_in_db_by_path.constEnd()) {
+      const Song& matching_song = *matching_it;
+      uint matching_cue_mtime = t->GetMtimeForCue(matching_cue);
 
       // The song is in the database and still on disk.
       // Check the mtime to see if it's been changed since it was added.
@@ -324,13 +431,13 @@ void LibraryWatcher::ScanSubdirectory(const QString& path,
       if (!file_info.exists()) {
         // Partially fixes race condition - if file was removed between being
         // added to the list and now.
-        files_on_disk.removeAll(file);
+        files_on_disk_set.remove(file);
         continue;
       }
 
       // cue sheet's path from library (if any)
       QString song_cue = matching_song.cue_path();
-      uint song_cue_mtime = GetMtimeForCue(song_cue);
+      uint song_cue_mtime = t->GetMtimeForCue(song_cue);
 
       bool cue_deleted = song_cue_mtime == 0 && matching_song.has_cue();
       bool cue_added = matching_cue_mtime != 0 && !matching_song.has_cue();
@@ -370,16 +477,17 @@ void LibraryWatcher::ScanSubdirectory(const QString& path,
 
     } else {
       // The song is on disk but not in the DB
+      // choose an image for the song(s)
+      QString image = ImageForSong(file, album_art);
+
       SongList song_list =
-          ScanNewFile(file, path, matching_cue, &cues_processed);
+          ScanNewFile(file, path, matching_cue, image, &cues_processed, t);
 
       if (song_list.isEmpty()) {
         continue;
       }
 
       qLog(Debug) << file << "created";
-      // choose an image for the song(s)
-      QString image = ImageForSong(file, album_art);
 
       for (Song song : song_list) {
         song.set_directory_id(t->dir());
@@ -393,7 +501,7 @@ void LibraryWatcher::ScanSubdirectory(const QString& path,
   // Look for deleted songs
   for (const Song& song : songs_in_db) {
     if (!song.is_unavailable() &&
-        !files_on_disk.contains(song.url().toLocalFile())) {
+        !files_on_disk_set.contains(song.url().toLocalFile())) {
       qLog(Debug) << "Song deleted from disk:" << song.url().toLocalFile();
       t->deleted_songs << song;
     }
@@ -426,9 +534,6 @@ void LibraryWatcher::UpdateCueAssociatedSongs(const QString& file,
                                               const QString& matching_cue,
                                               const QString& image,
                                               ScanTransaction* t) {
-  QFile cue(matching_cue);
-  cue.open(QIODevice::ReadOnly);
-
   SongList old_sections = backend_->GetSongsByUrl(QUrl::fromLocalFile(file));
 
   QHash<quint64, Song> sections_map;
@@ -439,7 +544,7 @@ void LibraryWatcher::UpdateCueAssociatedSongs(const QString& file,
   QSet<int> used_ids;
 
   // update every song that's in the cue and library
-  for (Song cue_song : cue_parser_->Load(&cue, matching_cue, path)) {
+  for (Song cue_song : t->LoadCue(matching_cue, path)) {
     cue_song.set_directory_id(t->dir());
 
     Song matching = sections_map[cue_song.beginning_nanosec()];
@@ -478,56 +583,125 @@ void LibraryWatcher::UpdateNonCueAssociatedSong(const QString& file,
     }
   }
 
-  Song song_on_disk;
-  song_on_disk.set_directory_id(t->dir());
-  TagReaderClient::Instance()->ReadFileBlocking(file, &song_on_disk);
-
-  if (song_on_disk.is_valid()) {
-    PreserveUserSetData(file, image, matching_song, &song_on_disk, t);
-  }
+  QueueTagRead(file, image, matching_song, t);
 }
 
 SongList LibraryWatcher::ScanNewFile(const QString& file, const QString& path,
                                      const QString& matching_cue,
-                                     QSet<QString>* cues_processed) {
+                                     const QString& image,
+                                     QSet<QString>* cues_processed,
+                                     ScanTransaction* t) {
   SongList song_list;
 
-  uint matching_cue_mtime = GetMtimeForCue(matching_cue);
+  uint matching_cue_mtime = t->GetMtimeForCue(matching_cue);
   // if it's a cue - create virtual tracks
   if (matching_cue_mtime) {
     // don't process the same cue many times
     if (cues_processed->contains(matching_cue)) return song_list;
 
-    QFile cue(matching_cue);
-    cue.open(QIODevice::ReadOnly);
-
-    // Ignore FILEs pointing to other media files. Also, watch out for incorrect
-    // media files. Playlist parser for CUEs considers every entry in sheet
-    // valid and we don't want invalid media getting into library!
+    // Ignore FILEs pointing to other media files.
     QString file_nfd = file.normalized(QString::NormalizationForm_D);
-    for (const Song& cue_song : cue_parser_->Load(&cue, matching_cue, path)) {
-      if (cue_song.url().toLocalFile().normalized(QString::NormalizationForm_D) == file_nfd) {
-        if (TagReaderClient::Instance()->IsMediaFileBlocking(file)) {
-          song_list << cue_song;
-        }
+    for (const Song& cue_song : t->LoadCue(matching_cue, path)) {
+      if (cue_song.url().toLocalFile().normalized(
+              QString::NormalizationForm_D) == file_nfd) {
+        song_list << cue_song;
       }
     }
 
+    // Also, watch out for incorrect media files. Playlist parser for CUEs
+    // considers every entry in sheet valid and we don't want invalid media
+    // getting into library!  Every track points at the same file, so it only
+    // has to be checked once.
+    if (!song_list.isEmpty() && !t->IsMediaFile(file)) {
+      song_list.clear();
+    }
+
     if (!song_list.isEmpty()) {
       *cues_processed << matching_cue;
     }
 
     // it's a normal media file
   } else {
-    Song song;
-    TagReaderClient::Instance()->ReadFileBlocking(file, &song);
+    QueueTagRead(file, image, Song(), t);
+  }
+
+  return song_list;
+}
+
+void LibraryWatcher::QueueTagRead(const QString& file, const QString& image,
+                                  const Song& matching_song,
+                                  ScanTransaction* t) {
+  PendingTagRead read;
+  read.file = file;
+  read.image = image;
+  read.matching_song = matching_song;
+
+  t->unsent_tag_reads << read;
+  t->AddToTagReadProgressMax(1);
+
+  if (t->unsent_tag_reads.count() >= TagReaderClient::kReadFilesBatchSize) {
+    SendTagReads(t);
+  }
+}
+
+void LibraryWatcher::SendTagReads(ScanTransaction* t) {
+  if (t->unsent_tag_reads.isEmpty()) return;
+
+  QStringList filenames;
+  for (const PendingTagRead& read : t->unsent_tag_reads) {
+    filenames << read.file;
+  }
 
-    if (song.is_valid()) {
-      song_list << song;
+  TagReadBatch batch;
+  batch.reply = TagReaderClient::Instance()->ReadFiles(filenames);
+  batch.reads = t->unsent_tag_reads;
+  t->unsent_tag_reads.clear();
+  t->pending_tag_reads.enqueue(batch);
+
+  // Don't let the directory walk get too far ahead of the tag reads, but
+  // queue enough to keep every tagreader worker busy.
+  FinishTagReads(t, TagReaderClient::Instance()->worker_count() *
+                        kTagReadBatchesPerWorker);
+}
+
+void LibraryWatcher::FinishTagReads(ScanTransaction* t, int max_pending) {
+  while (t->pending_tag_reads.count() > max_pending) {
+    const TagReadBatch batch = t->pending_tag_reads.dequeue();
+
+    const bool success = batch.reply->WaitForFinished();
+    const pb::tagreader::ReadFilesResponse& response =
+        batch.reply->message().read_files_response();
+
+    for (int i = 0; i < batch.reads.count(); ++i) {
+      Song song;
+      if (success && i < response.metadata_size()) {
+        song.InitFromProtobuf(response.metadata(i));
+      }
+      FinishTagRead(batch.reads[i], song, t);
     }
+
+    batch.reply->deleteLater();
+    t->AddToTagReadProgress(batch.reads.count());
   }
 
-  return song_list;
+  if (t->new_songs.count() >= kSongBatchSize && !stop_requested_) {
+    t->CommitNewSongs();
+  }
+}
+
+void LibraryWatcher::FinishTagRead(const PendingTagRead& read, Song song,
+                                   ScanTransaction* t) {
+  if (!song.is_valid()) return;
+  song.set_directory_id(t->dir());
+
+  if (read.matching_song.is_valid()) {
+    PreserveUserSetData(read.file, read.image, read.matching_song, &song, t);
+  } else {
+    qLog(Debug) << read.file << "created";
+    if (song.art_automatic().isEmpty()) song.set_art_automatic(read.image);
+
+    t->new_songs << song;
+  }
 }
 
 void LibraryWatcher::PreserveUserSetData(const QString& file,
@@ -596,18 +770,6 @@ void LibraryWatcher::RemoveDirectory(const Directory& dir) {
   }
 }
 
-bool LibraryWatcher::FindSongByPath(const SongList& list, const QString& path,
-                                    Song* out) {
-  // TODO: Make this faster
-  for (const Song& song : list) {
-    if (song.url().toLocalFile() == path) {
-      *out = song;
-      return true;
-    }
-  }
-  return false;
-}
-
 void LibraryWatcher::DirectoryChanged(const QString& subdir) {
   // Find what dir it was in
   QHash<QString, Directory>::const_iterator it =
@@ -20,9 +20,11 @@
 
 #include "directory.h"
 #include "core/song.h"
+#include "core/tagreaderclient.h"
 
 #include <QHash>
 #include <QObject>
+#include <QQueue>
 #include <QStringList>
 #include <QMap>
 
@@ -66,6 +68,11 @@ signals:
   void SubdirsMTimeUpdated(const SubdirectoryList& subdirs);
   void CompilationsNeedUpdating();
 
+  // Emitted around the first scan of a new directory, when all of its songs
+  // are added to the library at once.
+  void BulkInsertStarted(int directory_id);
+  void BulkInsertFinished(int directory_id);
+
   void ScanStarted(int task_id);
 
  public slots:
@@ -75,6 +82,22 @@ signals:
   void SetRescanPaused(bool pause);
 
  private:
+  // A file whose tags need reading before it can be added to the
+  // transaction.  If matching_song is valid the file is already in the
+  // library and the new metadata replaces it.
+  struct PendingTagRead {
+    QString file;
+    QString image;
+    Song matching_song;
+  };
+
+  // A batch of tag reads that has been sent to one tagreader worker in a
+  // single request.
+  struct TagReadBatch {
+    TagReaderReply* reply;
+    QList<PendingTagRead> reads;
+  };
+
   // This class encapsulates a full or partial scan of a directory.
   // Each directory has one or more subdirectories, and any number of
   // subdirectories can be scanned during one transaction.  ScanSubdirectory()
@@ -84,6 +107,11 @@ signals:
   // to the library.  Multiple calls to FindSongsInSubdirectory during one
   // transaction will only result in one call to
   // LibraryBackend::FindSongsInDirectory.
+  // A scan is pipelined: ScanSubdirectory() walks the directory tree, the
+  // tags of the files it finds are read concurrently by all the tagreader
+  // workers, and finished songs are committed to the backend in batches.
+  // Walking the tree and reading tags report their progress as separate
+  // tasks.
   class ScanTransaction {
    public:
     ScanTransaction(LibraryWatcher* watcher, int dir, bool incremental,
@@ -98,6 +126,21 @@ signals:
 
     void AddToProgress(int n = 1);
     void AddToProgressMax(int n);
+    void AddToTagReadProgress(int n = 1);
+    void AddToTagReadProgressMax(int n);
+
+    // Sends the new songs found so far to the backend without waiting for
+    // the end of the transaction.
+    void CommitNewSongs();
+
+    // These remember their results for the rest of the transaction, since
+    // every media file next to a cue sheet would otherwise stat and parse it
+    // again.  Returns 0 if the cue sheet doesn't exist.
+    uint GetMtimeForCue(const QString& cue_path);
+    // The songs in the cue sheet, with paths relative to dir_path.  Parsed
+    // again only if the cue sheet's mtime has changed.
+    SongList LoadCue(const QString& cue_path, const QString& dir_path);
+    bool IsMediaFile(const QString& file);
 
     int dir() const { return dir_; }
     bool is_incremental() const { return incremental_; }
@@ -110,6 +153,10 @@ signals:
     SubdirectoryList new_subdirs;
     SubdirectoryList touched_subdirs;
 
+    // Tag reads waiting for a full batch, and batches that have been sent.
+    QList<PendingTagRead> unsent_tag_reads;
+    QQueue<TagReadBatch> pending_tag_reads;
+
    private:
     ScanTransaction(const ScanTransaction&) {}
     ScanTransaction& operator=(const ScanTransaction&) { return *this; }
@@ -118,6 +165,11 @@ signals:
     int progress_;
     int progress_max_;
 
+    // The tag reading task is only started when the first tag read is queued.
+    int tag_read_task_id_;
+    int tag_read_progress_;
+    int tag_read_progress_max_;
+
     int dir_;
     // Incremental scan enters a directory only if it has changed since the
     // last scan.
@@ -130,11 +182,24 @@ signals:
 
     LibraryWatcher* watcher_;
 
-    SongList cached_songs_;
+    // Subdirectory path -> songs in that subdirectory.
+    QHash<QString, SongList> cached_songs_;
     bool cached_songs_dirty_;
 
     SubdirectoryList known_subdirs_;
     bool known_subdirs_dirty_;
+
+    struct CachedCue {
+      uint mtime;
+      SongList songs;
+    };
+
+    // Cue sheet path -> mtime, or 0 if it doesn't exist.
+    QHash<QString, uint> cue_mtimes_;
+    // Cue sheet path -> its songs.
+    QHash<QString, CachedCue> cues_;
+    // Media file path -> whether the tagreader could open it.
+    QHash<QString, bool> media_files_;
   };
 
  private slots:
@@ -146,8 +211,6 @@ signals:
                         ScanTransaction* t, bool force_noincremental = false);
 
  private:
-  static bool FindSongByPath(const SongList& list, const QString& path,
-                             Song* out);
   inline static QString NoExtensionPart(const QString& fileName);
   inline static QString ExtensionPart(const QString& fileName);
   inline static QString DirectoryPart(const QString& fileName);
@@ -178,9 +241,24 @@ signals:
   // library.
   // It may result in a multiple files added to the library when the media file
   // has many sections (like a CUE related media file).
+  // Normal media files have their tags read in the background, so the song
+  // is added to the transaction later by FinishTagReads().
   SongList ScanNewFile(const QString& file, const QString& path,
-                       const QString& matching_cue,
-                       QSet<QString>* cues_processed);
+                       const QString& matching_cue, const QString& image,
+                       QSet<QString>* cues_processed, ScanTransaction* t);
+
+  // Queues a tag read for the file.  Reads are sent to the tagreader workers
+  // in batches, and this blocks while there are already too many batches in
+  // flight.
+  void QueueTagRead(const QString& file, const QString& image,
+                    const Song& matching_song, ScanTransaction* t);
+  // Sends the queued tag reads as one batch.
+  void SendTagReads(ScanTransaction* t);
+  // Waits for in-flight batches until at most max_pending remain, adding
+  // their results to the transaction.
+  void FinishTagReads(ScanTransaction* t, int max_pending);
+  void FinishTagRead(const PendingTagRead& read, Song song,
+                     ScanTransaction* t);
 
  private:
   LibraryBackend* backend_;
@@ -29,6 +29,10 @@ MoodbarController::MoodbarController(Application* app, QObject* parent)
   connect(app_->playlist_manager(), SIGNAL(CurrentSongChanged(Song)),
           SLOT(CurrentSongChanged(Song)));
   connect(app_->player(), SIGNAL(Stopped()), SLOT(PlaybackStopped()));
+
+  // Create the loader now rather than when the first song is shown, so it can
+  // start calculating moodbars for the library in the background.
+  app_->moodbar_loader();
 }
 
 void MoodbarController::CurrentSongChanged(const Song& song) {
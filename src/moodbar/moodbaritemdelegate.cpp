@@ -52,6 +52,7 @@ void MoodbarItemDelegate::ReloadSettings() {
 
   if (new_style != style_) {
     style_ = new_style;
+    pixmaps_.Clear();
     ReloadAllColors();
   }
 }
@@ -83,9 +84,18 @@ QPixmap MoodbarItemDelegate::PixmapForIndex(const QModelIndex& index,
     data_.insert(url, data);
   }
 
+  // This index has to be repainted, at this size, when the moodbar changes,
+  // even if it's drawn from the cache now.
   data->indexes_.insert(index);
   data->desired_size_ = size;
 
+  // Most of the time the moodbar has been rendered at this size already.
+  const QPixmap cached =
+      pixmaps_.Get(MoodbarPixmapCache::Key(url, style_, size));
+  if (!cached.isNull()) {
+    return cached;
+  }
+
   switch (data->state_) {
     case Data::State_CannotLoad:
     case Data::State_LoadingData:
@@ -210,11 +220,15 @@ void MoodbarItemDelegate::StartLoadingImage(const QUrl& url, Data* data) {
 
   QFuture<QImage> future = QtConcurrent::run(
       MoodbarRenderer::RenderToImage, data->colors_, data->desired_size_);
-  NewClosure(future, this, SLOT(ImageLoaded(QUrl, QFuture<QImage>)), url,
-             future);
+  NewClosure(future, this,
+             SLOT(ImageLoaded(QUrl, MoodbarRenderer::MoodbarStyle,
+                              QFuture<QImage>)),
+             url, style_, future);
 }
 
-void MoodbarItemDelegate::ImageLoaded(const QUrl& url, QFuture<QImage> future) {
+void MoodbarItemDelegate::ImageLoaded(const QUrl& url,
+                                      MoodbarRenderer::MoodbarStyle style,
+                                      QFuture<QImage> future) {
   Data* data = data_[url];
   if (!data) {
     return;
@@ -224,16 +238,23 @@ void MoodbarItemDelegate::ImageLoaded(const QUrl& url, QFuture<QImage> future) {
     return;
   }
 
+  // The colors are being loaded again for a different style.
+  if (style != style_) {
+    return;
+  }
+
   QImage image(future.result());
+  QPixmap pixmap = QPixmap::fromImage(image);
+  pixmaps_.Insert(MoodbarPixmapCache::Key(url, style, image.size()), pixmap);
 
-  // If the desired size changed then don't even bother converting the image
-  // to a pixmap, just reload it at the new size.
+  // If the desired size changed then render it again at the new size - this
+  // one is still in the cache if the column is resized back.
   if (!image.isNull() && data->desired_size_ != image.size()) {
     StartLoadingImage(url, data);
     return;
   }
 
-  data->pixmap_ = QPixmap::fromImage(image);
+  data->pixmap_ = pixmap;
   data->state_ = Data::State_Loaded;
 
   Playlist* playlist = view_->playlist();
@@ -18,6 +18,7 @@
 #ifndef MOODBARITEMDELEGATE_H
 #define MOODBARITEMDELEGATE_H
 
+#include "moodbarpixmapcache.h"
 #include "moodbarrenderer.h"
 
 #include <QCache>
@@ -41,12 +42,17 @@ class MoodbarItemDelegate : public QItemDelegate {
   void paint(QPainter* painter, const QStyleOptionViewItem& option,
              const QModelIndex& index) const;
 
+  MoodbarPixmapCacheStatistics cache_statistics() const {
+    return pixmaps_.statistics();
+  }
+
  private slots:
   void ReloadSettings();
 
   void DataLoaded(const QUrl& url, MoodbarPipeline* pipeline);
   void ColorsLoaded(const QUrl& url, QFuture<ColorVector> future);
-  void ImageLoaded(const QUrl& url, QFuture<QImage> future);
+  void ImageLoaded(const QUrl& url, MoodbarRenderer::MoodbarStyle style,
+                   QFuture<QImage> future);
 
  private:
   struct Data {
@@ -66,6 +72,9 @@ class MoodbarItemDelegate : public QItemDelegate {
     State state_;
     ColorVector colors_;
     QSize desired_size_;
+
+    // The last pixmap that was rendered, at whatever size.  It's drawn scaled
+    // while one at the new size is rendered.
     QPixmap pixmap_;
   };
 
@@ -83,6 +92,7 @@ class MoodbarItemDelegate : public QItemDelegate {
   Application* app_;
   PlaylistView* view_;
   QCache<QUrl, Data> data_;
+  MoodbarPixmapCache pixmaps_;
 
   MoodbarRenderer::MoodbarStyle style_;
 };
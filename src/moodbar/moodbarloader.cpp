@@ -30,31 +30,74 @@
 #include "moodbarpipeline.h"
 #include "core/application.h"
 #include "core/closure.h"
+#include "core/concurrentrun.h"
 #include "core/logging.h"
+#include "core/player.h"
 #include "core/qhash_qurl.h"
+#include "core/taskmanager.h"
 #include "core/utilities.h"
+#include "library/librarybackend.h"
 
 #ifdef Q_OS_WIN32
 #include <windows.h>
 #endif
 
+const int MoodbarLoader::kMaxBatchRequests = 1;
+const int MoodbarLoader::kBatchQueryLimit = 100;
+const int MoodbarLoader::kPlaybackHoldOffMsec = 15000;
+const int MoodbarLoader::kMemoryCacheSize = 2 * 1024 * 1024;  // 2MB
+
 MoodbarLoader::MoodbarLoader(Application* app, QObject* parent)
     : QObject(parent),
+      app_(app),
       cache_(new QNetworkDiskCache(this)),
+      store_(new MoodbarStore(app->database())),
       thread_(new QThread(this)),
+      memory_cache_(kMemoryCacheSize),
       kMaxActiveRequests(qMax(1, QThread::idealThreadCount() / 2)),
+      precompute_(false),
+      batch_last_song_id_(0),
+      batch_exhausted_(false),
+      batch_query_running_(false),
+      batch_task_id_(-1),
+      batch_done_(0),
+      batch_total_(0),
+      batch_paused_for_tasks_(false),
+      playback_hold_off_(new QTimer(this)),
       save_alongside_originals_(false),
       disable_moodbar_calculation_(false) {
   cache_->setCacheDirectory(
       Utilities::GetConfigPath(Utilities::Path_MoodbarCache));
   cache_->setMaximumCacheSize(60 * 1024 *
                               1024);  // 60MB - enough for 20,000 moodbars
+  store_pool_.setMaxThreadCount(1);
+
+  // Don't compete with the player for the disk or the CPU for a while after
+  // it starts or seeks in a track.
+  playback_hold_off_->setSingleShot(true);
+  playback_hold_off_->setInterval(kPlaybackHoldOffMsec);
+  connect(playback_hold_off_, SIGNAL(timeout()), SLOT(MaybeTakeNextRequest()));
+
+  connect(app->player(), SIGNAL(Playing()), SLOT(PlaybackActivity()));
+  connect(app->player(), SIGNAL(Seeked(qlonglong)), SLOT(PlaybackActivity()));
+  connect(app->player(), SIGNAL(SongChangeRequestProcessed(QUrl, bool)),
+          SLOT(PlaybackActivity()));
+  connect(app->task_manager(), SIGNAL(PauseLibraryWatchers()),
+          SLOT(PauseBatch()));
+  connect(app->task_manager(), SIGNAL(ResumeLibraryWatchers()),
+          SLOT(ResumeBatch()));
+  connect(app->library_backend(), SIGNAL(SongsDiscovered(SongList)),
+          SLOT(LibrarySongsDiscovered()));
 
   connect(app, SIGNAL(SettingsChanged()), SLOT(ReloadSettings()));
   ReloadSettings();
+
+  // Leave startup alone as well.
+  playback_hold_off_->start();
 }
 
 MoodbarLoader::~MoodbarLoader() {
+  store_pool_.waitForDone();
   thread_->quit();
   thread_->wait(1000);
 }
@@ -66,6 +109,15 @@ void MoodbarLoader::ReloadSettings() {
       s.value("save_alongside_originals", false).toBool();
 
   disable_moodbar_calculation_ = !s.value("calculate", true).toBool();
+  precompute_ = s.value("precompute", false).toBool();
+
+  if (!precompute_ || disable_moodbar_calculation_) {
+    batch_queue_.clear();
+    FinishBatch();
+  } else {
+    batch_exhausted_ = false;
+  }
+
   MaybeTakeNextRequest();
 }
 
@@ -106,7 +158,14 @@ MoodbarLoader::Result MoodbarLoader::Load(const QUrl& url, QByteArray* data,
     }
   }
 
-  // Maybe it exists in the cache?
+  // Have we loaded it recently?
+  const QByteArray* cached = memory_cache_.object(url);
+  if (cached) {
+    *data = *cached;
+    return Loaded;
+  }
+
+  // Maybe it's been calculated for a file outside the library.
   std::unique_ptr<QIODevice> cache_device(cache_->data(url));
   if (cache_device) {
     qLog(Info) << "Loading cached moodbar data for" << filename;
@@ -116,55 +175,223 @@ MoodbarLoader::Result MoodbarLoader::Load(const QUrl& url, QByteArray* data,
     }
   }
 
+  // Or for this song in the library.  The pipeline finishes straight away
+  // with the stored data if there is any, otherwise it's queued to analyze the
+  // audio file.
+  MoodbarPipeline* pipeline = CreatePipeline(url);
+
+  MoodbarStore* store = store_.get();
+  QFuture<StoreLookup> future =
+      ConcurrentRun::Run<StoreLookup>(&store_pool_, [store, url]() {
+        StoreLookup ret;
+        ret.found_ = store->Get(url, &ret.data_);
+        return ret;
+      });
+  NewClosure(future, this,
+             SLOT(StoreLookupFinished(QFuture<MoodbarLoader::StoreLookup>,
+                                      QUrl)),
+             future, url);
+
+  *async_pipeline = pipeline;
+  return WillLoadAsync;
+}
+
+void MoodbarLoader::StoreLookupFinished(
+    QFuture<MoodbarLoader::StoreLookup> future, const QUrl& url) {
+  const StoreLookup result = future.result();
+  MoodbarPipeline* pipeline = requests_.value(url);
+  if (!pipeline) return;
+
+  if (!result.found_) {
+    // There was no existing data, analyze the audio file and create some.
+    queued_requests_ << url;
+    MaybeTakeNextRequest();
+    return;
+  }
+
+  RememberData(url, result.data_);
+
+  requests_.remove(url);
+  pipeline->SetData(result.data_);
+  QTimer::singleShot(1000, pipeline, SLOT(deleteLater()));
+}
+
+void MoodbarLoader::RememberData(const QUrl& url, const QByteArray& data) {
+  // Failures aren't remembered here, so a file that's fixed or replaced gets
+  // another go.  The store keeps songs in the library from being retried
+  // until their mtime changes.
+  if (data.isEmpty()) return;
+  memory_cache_.insert(url, new QByteArray(data), data.size());
+}
+
+MoodbarPipeline* MoodbarLoader::CreatePipeline(const QUrl& url) {
   if (!thread_->isRunning()) thread_->start(QThread::IdlePriority);
 
-  // There was no existing file, analyze the audio file and create one.
   MoodbarPipeline* pipeline = new MoodbarPipeline(url);
   pipeline->moveToThread(thread_);
-  NewClosure(pipeline, SIGNAL(Finished(bool)), this,
-             SLOT(RequestFinished(MoodbarPipeline*, QUrl)), pipeline, url);
 
   requests_[url] = pipeline;
-  queued_requests_ << url;
+  return pipeline;
+}
 
-  MaybeTakeNextRequest();
+void MoodbarLoader::StartPipeline(const QUrl& url) {
+  MoodbarPipeline* pipeline = requests_[url];
+  NewClosure(pipeline, SIGNAL(Finished(bool)), this,
+             SLOT(RequestFinished(MoodbarPipeline*, QUrl)), pipeline, url);
 
-  *async_pipeline = pipeline;
-  return WillLoadAsync;
+  active_requests_ << url;
+  QMetaObject::invokeMethod(pipeline, "Start", Qt::QueuedConnection);
 }
 
 void MoodbarLoader::MaybeTakeNextRequest() {
   Q_ASSERT(QThread::currentThread() == qApp->thread());
 
   if (active_requests_.count() >= kMaxActiveRequests ||
-      queued_requests_.isEmpty() || disable_moodbar_calculation_) {
+      disable_moodbar_calculation_) {
+    return;
+  }
+
+  // Songs that are being shown always go first.
+  if (queued_requests_.isEmpty()) {
+    if (active_requests_.isEmpty()) TakeNextBatchRequest();
     return;
   }
 
   const QUrl url = queued_requests_.takeFirst();
-  active_requests_ << url;
 
   qLog(Info) << "Creating moodbar data for" << url.toLocalFile();
-  QMetaObject::invokeMethod(requests_[url], "Start", Qt::QueuedConnection);
+  StartPipeline(url);
+}
+
+bool MoodbarLoader::IsBatchPaused() const {
+  return batch_paused_for_tasks_ || playback_hold_off_->isActive();
+}
+
+bool MoodbarLoader::TakeNextBatchRequest() {
+  if (!precompute_ || IsBatchPaused() ||
+      batch_requests_.count() >= kMaxBatchRequests) {
+    return false;
+  }
+
+  while (!batch_queue_.isEmpty()) {
+    const MoodbarStore::Pending pending = batch_queue_.takeFirst();
+    batch_last_song_id_ = pending.song_id_;
+
+    // It might have been loaded for display since the batch was queried.
+    if (requests_.contains(pending.url_) ||
+        memory_cache_.contains(pending.url_)) {
+      batch_done_++;
+      continue;
+    }
+
+    CreatePipeline(pending.url_);
+    batch_requests_ << pending.url_;
+
+    qLog(Debug) << "Creating moodbar data in the background for"
+                << pending.url_.toLocalFile();
+    StartPipeline(pending.url_);
+    return true;
+  }
+
+  // Fetch the next few songs.  This is called again when they arrive.
+  if (!batch_exhausted_ && !batch_query_running_) {
+    batch_query_running_ = true;
+
+    MoodbarStore* store = store_.get();
+    const int after_id = batch_last_song_id_;
+    QFuture<QList<MoodbarStore::Pending> > future =
+        ConcurrentRun::Run<QList<MoodbarStore::Pending> >(
+            &store_pool_, [store, after_id]() {
+              return store->NextPending(after_id, kBatchQueryLimit);
+            });
+    NewClosure(future, this, SLOT(BatchQueryFinished(
+                                 QFuture<QList<MoodbarStore::Pending> >)),
+               future);
+  }
+  return false;
+}
+
+void MoodbarLoader::BatchQueryFinished(
+    QFuture<QList<MoodbarStore::Pending> > future) {
+  batch_query_running_ = false;
+  if (!precompute_ || disable_moodbar_calculation_) return;
+
+  batch_queue_ = future.result();
+  if (batch_queue_.isEmpty()) {
+    FinishBatch();
+    batch_exhausted_ = true;
+    return;
+  }
+
+  if (batch_task_id_ == -1) {
+    batch_done_ = 0;
+    batch_total_ = 0;
+    batch_task_id_ =
+        app_->task_manager()->StartTask(tr("Calculating moodbars"));
+
+    MoodbarStore* store = store_.get();
+    QFuture<int> count_future = ConcurrentRun::Run<int>(
+        &store_pool_, [store]() { return store->PendingCount(); });
+    NewClosure(count_future, this, SLOT(BatchCountFinished(QFuture<int>)),
+               count_future);
+  }
+
+  MaybeTakeNextRequest();
+}
+
+void MoodbarLoader::BatchCountFinished(QFuture<int> future) {
+  if (batch_task_id_ == -1) return;
+
+  batch_total_ = batch_done_ + future.result();
+  app_->task_manager()->SetTaskProgress(batch_task_id_, batch_done_,
+                                        batch_total_);
+}
+
+void MoodbarLoader::FinishBatch() {
+  if (batch_task_id_ != -1) {
+    app_->task_manager()->SetTaskFinished(batch_task_id_);
+    batch_task_id_ = -1;
+  }
+  batch_last_song_id_ = 0;
+}
+
+void MoodbarLoader::PlaybackActivity() { playback_hold_off_->start(); }
+
+void MoodbarLoader::PauseBatch() { batch_paused_for_tasks_ = true; }
+
+void MoodbarLoader::ResumeBatch() {
+  batch_paused_for_tasks_ = false;
+  MaybeTakeNextRequest();
+}
+
+void MoodbarLoader::LibrarySongsDiscovered() {
+  if (!precompute_ || !batch_exhausted_) return;
+
+  // Start again from the beginning - only songs without a moodbar are
+  // returned, so this doesn't redo any work.
+  batch_exhausted_ = false;
+  MaybeTakeNextRequest();
 }
 
 void MoodbarLoader::RequestFinished(MoodbarPipeline* request, const QUrl& url) {
   Q_ASSERT(QThread::currentThread() == qApp->thread());
 
+  // Failures are stored for songs in the library too, so the background batch
+  // doesn't keep coming back to them.
+  const QByteArray data = request->success() ? request->data() : QByteArray();
+  RememberData(url, data);
+
+  MoodbarStore* store = store_.get();
+  QFuture<bool> future = ConcurrentRun::Run<bool>(
+      &store_pool_, [store, url, data]() { return store->Put(url, data); });
+  NewClosure(future, this,
+             SLOT(StorePutFinished(QFuture<bool>, QUrl, QByteArray)), future,
+             url, data);
+
   if (request->success()) {
     qLog(Info) << "Moodbar data generated successfully for"
                << url.toLocalFile();
 
-    // Save the data in the cache
-    QNetworkCacheMetaData metadata;
-    metadata.setUrl(url);
-
-    QIODevice* cache_file = cache_->prepare(metadata);
-    if (cache_file) {
-      cache_file->write(request->data());
-      cache_->insert(cache_file);
-    }
-
     // Save the data alongside the original as well if we're configured to.
     if (save_alongside_originals_) {
       const QString mood_filename(MoodFilenames(url.toLocalFile())[0]);
@@ -190,7 +417,28 @@ void MoodbarLoader::RequestFinished(MoodbarPipeline* request, const QUrl& url) {
   requests_.remove(url);
   active_requests_.remove(url);
 
+  if (batch_requests_.remove(url) && batch_task_id_ != -1) {
+    batch_done_++;
+    app_->task_manager()->SetTaskProgress(batch_task_id_, batch_done_,
+                                          qMax(batch_done_, batch_total_));
+  }
+
   QTimer::singleShot(1000, request, SLOT(deleteLater()));
 
   MaybeTakeNextRequest();
 }
+
+void MoodbarLoader::StorePutFinished(QFuture<bool> future, const QUrl& url,
+                                     const QByteArray& data) {
+  // Files that aren't in the library go in the cache instead
+  if (future.result() || data.isEmpty()) return;
+
+  QNetworkCacheMetaData metadata;
+  metadata.setUrl(url);
+
+  QIODevice* cache_file = cache_->prepare(metadata);
+  if (cache_file) {
+    cache_file->write(data);
+    cache_->insert(cache_file);
+  }
+}
@@ -18,12 +18,20 @@
 #ifndef MOODBARLOADER_H
 #define MOODBARLOADER_H
 
+#include <memory>
+
+#include <QCache>
+#include <QFuture>
 #include <QMap>
 #include <QObject>
 #include <QSet>
+#include <QThreadPool>
+#include <QUrl>
+
+#include "moodbarstore.h"
 
 class QNetworkDiskCache;
-class QUrl;
+class QTimer;
 
 class Application;
 class MoodbarPipeline;
@@ -51,25 +59,83 @@ class MoodbarLoader : public QObject {
   Result Load(const QUrl& url, QByteArray* data,
               MoodbarPipeline** async_pipeline);
 
+ private:
+  struct StoreLookup {
+    StoreLookup() : found_(false) {}
+
+    bool found_;
+    QByteArray data_;
+  };
+
  private slots:
   void ReloadSettings();
 
+  void StoreLookupFinished(QFuture<MoodbarLoader::StoreLookup> future,
+                           const QUrl& url);
+  void StorePutFinished(QFuture<bool> future, const QUrl& url,
+                        const QByteArray& data);
+  void BatchQueryFinished(QFuture<QList<MoodbarStore::Pending> > future);
+  void BatchCountFinished(QFuture<int> future);
+
   void RequestFinished(MoodbarPipeline* request, const QUrl& filename);
   void MaybeTakeNextRequest();
 
+  void PlaybackActivity();
+  void PauseBatch();
+  void ResumeBatch();
+  void LibrarySongsDiscovered();
+
  private:
   static QStringList MoodFilenames(const QString& song_filename);
 
+  MoodbarPipeline* CreatePipeline(const QUrl& url);
+  void StartPipeline(const QUrl& url);
+
+  void RememberData(const QUrl& url, const QByteArray& data);
+
+  bool IsBatchPaused() const;
+  bool TakeNextBatchRequest();
+  void FinishBatch();
+
  private:
+  static const int kMaxBatchRequests;
+  static const int kBatchQueryLimit;
+  static const int kPlaybackHoldOffMsec;
+  static const int kMemoryCacheSize;
+
+  Application* app_;
   QNetworkDiskCache* cache_;
+  std::unique_ptr<MoodbarStore> store_;
   QThread* thread_;
 
+  // The store is only used from this pool so the GUI thread never waits for
+  // the database.  It has one thread, so reads see earlier writes.
+  QThreadPool store_pool_;
+
+  // Recently loaded or calculated moodbars, so redrawing a playlist doesn't
+  // go back to the database.  Failures aren't kept here.
+  QCache<QUrl, QByteArray> memory_cache_;
+
   const int kMaxActiveRequests;
 
   QMap<QUrl, MoodbarPipeline*> requests_;
   QList<QUrl> queued_requests_;
   QSet<QUrl> active_requests_;
 
+  // Background calculation of moodbars for the whole library.  Batch requests
+  // are only started when no song being shown is waiting for its moodbar.
+  bool precompute_;
+  QList<MoodbarStore::Pending> batch_queue_;
+  QSet<QUrl> batch_requests_;
+  int batch_last_song_id_;
+  bool batch_exhausted_;
+  bool batch_query_running_;
+  int batch_task_id_;
+  int batch_done_;
+  int batch_total_;
+  bool batch_paused_for_tasks_;
+  QTimer* playback_hold_off_;
+
   bool save_alongside_originals_;
   bool disable_moodbar_calculation_;
 };
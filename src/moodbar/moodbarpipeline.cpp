@@ -185,6 +185,14 @@ void MoodbarPipeline::Stop(bool success) {
   emit Finished(success);
 }
 
+void MoodbarPipeline::SetData(const QByteArray& data) {
+  Q_ASSERT(pipeline_ == nullptr);
+
+  data_ = data;
+  success_ = !data.isEmpty();
+  emit Finished(success_);
+}
+
 void MoodbarPipeline::Cleanup() {
   Q_ASSERT(QThread::currentThread() == thread());
   Q_ASSERT(QThread::currentThread() != qApp->thread());
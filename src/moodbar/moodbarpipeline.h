@@ -41,6 +41,10 @@ class MoodbarPipeline : public QObject {
   bool success() const { return success_; }
   const QByteArray& data() const { return data_; }
 
+  // Finishes without running the pipeline, with data that was calculated
+  // before.  Empty data means it failed that time.
+  void SetData(const QByteArray& data);
+
  public slots:
   void Start();
 
@@ -0,0 +1,72 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "moodbarpixmapcache.h"
+
+#include <QUrl>
+
+// Enough for a few thousand rows of a normal sized mood column.
+const int MoodbarPixmapCache::kDefaultMaxBytes = 16 * 1024 * 1024;  // 16MB
+
+MoodbarPixmapCacheStatistics::MoodbarPixmapCacheStatistics()
+    : hits_(0), misses_(0), insertions_(0), memory_bytes_(0) {}
+
+double MoodbarPixmapCacheStatistics::HitRatio() const {
+  if (requests() == 0) return 0.0;
+  return static_cast<double>(hits_) / requests();
+}
+
+MoodbarPixmapCache::MoodbarPixmapCache(int max_bytes) : pixmaps_(max_bytes) {}
+
+QString MoodbarPixmapCache::Key(const QUrl& url,
+                                MoodbarRenderer::MoodbarStyle style,
+                                const QSize& size) {
+  return QString("%1:%2x%3:%4")
+      .arg(style)
+      .arg(size.width())
+      .arg(size.height())
+      .arg(url.toString());
+}
+
+int MoodbarPixmapCache::Cost(const QPixmap& pixmap) {
+  return pixmap.width() * pixmap.height() * qMax(1, pixmap.depth()) / 8;
+}
+
+QPixmap MoodbarPixmapCache::Get(const QString& key) {
+  QPixmap* pixmap = pixmaps_.object(key);
+  if (!pixmap) {
+    statistics_.misses_++;
+    return QPixmap();
+  }
+
+  statistics_.hits_++;
+  return *pixmap;
+}
+
+void MoodbarPixmapCache::Insert(const QString& key, const QPixmap& pixmap) {
+  if (pixmap.isNull()) return;
+
+  statistics_.insertions_++;
+  pixmaps_.insert(key, new QPixmap(pixmap), Cost(pixmap));
+}
+
+void MoodbarPixmapCache::Clear() { pixmaps_.clear(); }
+
+MoodbarPixmapCacheStatistics MoodbarPixmapCache::statistics() const {
+  MoodbarPixmapCacheStatistics ret = statistics_;
+  ret.memory_bytes_ = pixmaps_.totalCost();
+  return ret;
+}
@@ -0,0 +1,71 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MOODBAR_MOODBARPIXMAPCACHE_H_
+#define MOODBAR_MOODBARPIXMAPCACHE_H_
+
+#include <QCache>
+#include <QPixmap>
+#include <QString>
+
+#include "moodbarrenderer.h"
+
+class QUrl;
+
+struct MoodbarPixmapCacheStatistics {
+  MoodbarPixmapCacheStatistics();
+
+  quint64 hits_;
+  quint64 misses_;
+  quint64 insertions_;
+
+  // Bytes used by the pixmaps currently in the cache.
+  quint64 memory_bytes_;
+
+  quint64 requests() const { return hits_ + misses_; }
+  double HitRatio() const;
+};
+
+// Holds rendered moodbars for the playlist's mood column, keyed by the song,
+// the moodbar style and the size they were rendered at.  Pixmaps are kept up
+// to a byte budget, least recently used first out, so scrolling back over rows
+// or resizing the column back to an earlier width doesn't render them again.
+//
+// Pixmaps can only be used from the GUI thread, and so can this.
+class MoodbarPixmapCache {
+ public:
+  explicit MoodbarPixmapCache(int max_bytes = kDefaultMaxBytes);
+
+  static const int kDefaultMaxBytes;
+
+  static QString Key(const QUrl& url, MoodbarRenderer::MoodbarStyle style,
+                     const QSize& size);
+
+  // Returns a null pixmap if key isn't in the cache.
+  QPixmap Get(const QString& key);
+  void Insert(const QString& key, const QPixmap& pixmap);
+  void Clear();
+
+  MoodbarPixmapCacheStatistics statistics() const;
+
+ private:
+  static int Cost(const QPixmap& pixmap);
+
+  QCache<QString, QPixmap> pixmaps_;
+  MoodbarPixmapCacheStatistics statistics_;
+};
+
+#endif  // MOODBAR_MOODBARPIXMAPCACHE_H_
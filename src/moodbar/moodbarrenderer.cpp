@@ -111,15 +111,40 @@ ColorVector MoodbarRenderer::Colors(const QByteArray& data, MoodbarStyle style,
 
 void MoodbarRenderer::Render(const ColorVector& colors, QPainter* p,
                              const QRect& rect) {
-  // Sample the colors and map them to screen pixels.
-  ColorVector screen_colors;
-  for (int x = 0; x < rect.width(); ++x) {
+  p->drawImage(rect.topLeft(), RenderToImage(colors, rect.size()));
+}
+
+QImage MoodbarRenderer::RenderToImage(const ColorVector& colors,
+                                      const QSize& size) {
+  QImage image(size, QImage::Format_ARGB32_Premultiplied);
+  if (image.isNull() || colors.isEmpty()) {
+    image.fill(0);
+    return image;
+  }
+
+  const int width = size.width();
+  const int height = size.height();
+  const int half = height / 2;
+
+  // The saturation and value of each row only depend on y, so work out the
+  // coefficients once rather than for every pixel.
+  QVector<float> sat_coeff(half + 1);
+  QVector<float> val_coeff(half + 1);
+  for (int y = 0; y <= half; y++) {
+    float coeff = half ? float(y) / float(half) : 0.0f;
+    float coeff2 = 1.0f - ((1.0f - coeff) * (1.0f - coeff));
+    sat_coeff[y] = 1.0f - (1.0f - coeff) / 2.0f;
+    val_coeff[y] = 1.f - (1.f - coeff2) / 2.0f;
+  }
+
+  for (int x = 0; x < width; ++x) {
+    // Sample the colors and map them to screen pixels.
     int r = 0;
     int g = 0;
     int b = 0;
 
-    int start = x * colors.size() / rect.width();
-    int end = (x + 1) * colors.size() / rect.width();
+    int start = x * colors.size() / width;
+    int end = (x + 1) * colors.size() / width;
 
     if (start == end) end = qMin(start + 1, colors.size() - 1);
 
@@ -130,36 +155,26 @@ void MoodbarRenderer::Render(const ColorVector& colors, QPainter* p,
     }
 
     const int n = qMax(1, end - start);
-    screen_colors.append(QColor(r / n, g / n, b / n));
-  }
-
-  // Draw the actual moodbar.
-  for (int x = 0; x < rect.width(); x++) {
     int h, s, v;
-    screen_colors[x].getHsv(&h, &s, &v);
-
-    for (int y = 0; y <= rect.height() / 2; y++) {
-      float coeff = float(y) / float(rect.height() / 2);
-      float coeff2 = 1.0f - ((1.0f - coeff) * (1.0f - coeff));
-      coeff = 1.0f - (1.0f - coeff) / 2.0f;
-      coeff2 = 1.f - (1.f - coeff2) / 2.0f;
-
-      p->setPen(QColor::fromHsv(
-          h, qBound(0, int(float(s) * coeff), 255),
-          qBound(0, int(255.f - (255.f - float(v)) * coeff2), 255)));
-
-      p->drawPoint(rect.left() + x, rect.top() + y);
-      p->drawPoint(rect.left() + x, rect.top() + rect.height() - 1 - y);
+    QColor(r / n, g / n, b / n).getHsv(&h, &s, &v);
+
+    // Draw the column from the middle out, mirrored top and bottom.
+    for (int y = 0; y <= half; y++) {
+      const QRgb pixel =
+          QColor::fromHsv(
+              h, qBound(0, int(float(s) * sat_coeff[y]), 255),
+              qBound(0, int(255.f - (255.f - float(v)) * val_coeff[y]), 255))
+              .rgb();
+
+      if (y < height) {
+        reinterpret_cast<QRgb*>(image.scanLine(y))[x] = pixel;
+      }
+      if (height - 1 - y >= 0) {
+        reinterpret_cast<QRgb*>(image.scanLine(height - 1 - y))[x] = pixel;
+      }
     }
   }
-}
 
-QImage MoodbarRenderer::RenderToImage(const ColorVector& colors,
-                                      const QSize& size) {
-  QImage image(size, QImage::Format_ARGB32_Premultiplied);
-  QPainter p(&image);
-  Render(colors, &p, image.rect());
-  p.end();
   return image;
 }
 
@@ -0,0 +1,113 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "moodbarstore.h"
+
+#include <QMutexLocker>
+#include <QSqlQuery>
+#include <QVariant>
+
+#include "core/database.h"
+#include "core/song.h"
+
+const char* MoodbarStore::kPendingWhere =
+    " WHERE s.unavailable = 0 AND s.filetype NOT IN (%1, %2)"
+    "   AND s.filename LIKE 'file:%'"
+    "   AND NOT EXISTS (SELECT 1 FROM moodbars AS m"
+    "                   WHERE m.filename = s.filename AND m.mtime = s.mtime)";
+
+MoodbarStore::MoodbarStore(Database* db) : db_(db) {}
+
+bool MoodbarStore::Get(const QUrl& url, QByteArray* data) {
+  QMutexLocker l(db_->ReadMutex());
+  QSqlDatabase db(db_->ConnectReadOnly());
+
+  QSqlQuery q(
+      "SELECT m.data FROM moodbars AS m"
+      " WHERE m.filename = :filename"
+      "   AND EXISTS (SELECT 1 FROM songs AS s"
+      "               WHERE s.filename = m.filename AND s.mtime = m.mtime)",
+      db);
+  q.bindValue(":filename", url.toEncoded());
+  q.exec();
+  if (db_->CheckErrors(q)) return false;
+  if (!q.next()) return false;
+
+  const QByteArray compressed = q.value(0).toByteArray();
+  *data = compressed.isEmpty() ? QByteArray() : qUncompress(compressed);
+  return true;
+}
+
+bool MoodbarStore::Put(const QUrl& url, const QByteArray& data) {
+  QMutexLocker l(db_->Mutex());
+  QSqlDatabase db(db_->Connect());
+
+  // The moodbar is three bytes per sample with long runs of similar colours,
+  // so it's worth compressing.  Every track of a cue sheet shares the row for
+  // its file.
+  QSqlQuery q(
+      "INSERT OR REPLACE INTO moodbars (filename, mtime, data)"
+      " SELECT filename, mtime, :data FROM songs WHERE filename = :filename"
+      " LIMIT 1",
+      db);
+  q.bindValue(":data", data.isEmpty() ? QByteArray() : qCompress(data));
+  q.bindValue(":filename", url.toEncoded());
+  q.exec();
+  if (db_->CheckErrors(q)) return false;
+
+  return q.numRowsAffected() > 0;
+}
+
+QList<MoodbarStore::Pending> MoodbarStore::NextPending(int after_id,
+                                                       int limit) {
+  QMutexLocker l(db_->ReadMutex());
+  QSqlDatabase db(db_->ConnectReadOnly());
+
+  // The tracks of a cue sheet share a file, so only the first is returned.
+  QSqlQuery q(QString("SELECT MIN(s.ROWID), s.filename FROM songs AS s") +
+                  QString(kPendingWhere).arg(Song::Type_Stream)
+                      .arg(Song::Type_Cdda) +
+                  " AND s.ROWID > :after_id GROUP BY s.filename"
+                  " ORDER BY MIN(s.ROWID) LIMIT :limit",
+              db);
+  q.bindValue(":after_id", after_id);
+  q.bindValue(":limit", limit);
+  q.exec();
+
+  QList<Pending> ret;
+  if (db_->CheckErrors(q)) return ret;
+
+  while (q.next()) {
+    Pending pending;
+    pending.song_id_ = q.value(0).toInt();
+    pending.url_ = QUrl::fromEncoded(q.value(1).toByteArray());
+    ret << pending;
+  }
+  return ret;
+}
+
+int MoodbarStore::PendingCount() {
+  QMutexLocker l(db_->ReadMutex());
+  QSqlDatabase db(db_->ConnectReadOnly());
+
+  QSqlQuery q(QString("SELECT COUNT(DISTINCT s.filename) FROM songs AS s") +
+                  QString(kPendingWhere).arg(Song::Type_Stream)
+                      .arg(Song::Type_Cdda),
+              db);
+  q.exec();
+  if (db_->CheckErrors(q) || !q.next()) return 0;
+  return q.value(0).toInt();
+}
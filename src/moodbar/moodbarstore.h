@@ -0,0 +1,62 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MOODBAR_MOODBARSTORE_H_
+#define MOODBAR_MOODBARSTORE_H_
+
+#include <QByteArray>
+#include <QList>
+#include <QUrl>
+
+class Database;
+
+// Keeps the moodbar data for songs in the library in the moodbars table, one
+// row per file, so the tracks of a cue sheet share one.  A row is only used
+// while the mtime stored with it matches the song's, so moodbars for files
+// that have changed on disk are calculated again.  A row with no data records
+// that the pipeline failed for that file, so it isn't retried every time the
+// song is shown.
+//
+// Everything here is thread safe.
+class MoodbarStore {
+ public:
+  explicit MoodbarStore(Database* db);
+
+  struct Pending {
+    int song_id_;
+    QUrl url_;
+  };
+
+  // Returns false if there is no up to date row for this URL.  Otherwise data
+  // is set to the moodbar, which is empty if it couldn't be calculated.
+  bool Get(const QUrl& url, QByteArray* data);
+
+  // Returns false if the URL doesn't belong to a song in the library.
+  bool Put(const QUrl& url, const QByteArray& data);
+
+  // Local files in the library without an up to date moodbar, in ROWID order
+  // starting after after_id.  The table itself is the queue, so working
+  // through it picks up where it left off after a restart.
+  QList<Pending> NextPending(int after_id, int limit);
+  int PendingCount();
+
+ private:
+  static const char* kPendingWhere;
+
+  Database* db_;
+};
+
+#endif  // MOODBAR_MOODBARSTORE_H_
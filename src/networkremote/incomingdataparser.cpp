@@ -165,10 +165,13 @@ void IncomingDataParser::Parse(const pb::remote::Message& msg) {
       client->song_sender()->SendSongs(msg.request_download_songs());
       break;
     case pb::remote::SONG_OFFER_RESPONSE:
-      client->song_sender()->ResponseSongOffer(msg.response_song_offer().accepted());
+      client->song_sender()->ResponseSongOffer(
+          msg.response_song_offer().accepted(),
+          msg.response_song_offer().resume_chunk());
       break;
     case pb::remote::GET_LIBRARY:
-      emit SendLibrary(client);
+      emit SendLibrary(client, msg.request_library().sync_token(),
+                       msg.request_library().accepts_compressed());
       break;
     case pb::remote::RATE_SONG:
       RateSong(msg);
@@ -48,7 +48,8 @@ signals:
                    bool enqueue);
   void RemoveSongs(int id, const QList<int>& indices);
   void SeekTo(int seconds);
-  void SendLibrary(RemoteClient* client);
+  void SendLibrary(RemoteClient* client, qint64 sync_token,
+                   bool accepts_compressed);
   void RateCurrentSong(double);
 
   void DoGlobalSearch(QString, RemoteClient*);
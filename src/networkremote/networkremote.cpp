@@ -162,8 +162,10 @@ void NetworkRemote::AcceptConnection() {
     connect(incoming_data_parser_.get(), SIGNAL(GetLyrics()),
             outgoing_data_creator_.get(), SLOT(GetLyrics()));
 
-    connect(incoming_data_parser_.get(), SIGNAL(SendLibrary(RemoteClient*)),
-            outgoing_data_creator_.get(), SLOT(SendLibrary(RemoteClient*)));
+    connect(incoming_data_parser_.get(),
+            SIGNAL(SendLibrary(RemoteClient*, qint64, bool)),
+            outgoing_data_creator_.get(),
+            SLOT(SendLibrary(RemoteClient*, qint64, bool)));
 
     connect(incoming_data_parser_.get(),
             SIGNAL(DoGlobalSearch(QString, RemoteClient*)),
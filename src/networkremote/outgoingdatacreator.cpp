@@ -32,6 +32,7 @@
 #include "core/database.h"
 
 const quint32 OutgoingDataCreator::kFileChunkSize = 100000;  // in Bytes
+const int OutgoingDataCreator::kSyncTokenVersionBits = 32;
 
 OutgoingDataCreator::OutgoingDataCreator(Application* app)
     : app_(app),
@@ -593,33 +594,132 @@ void OutgoingDataCreator::SendLyrics(int id,
   results_.take(id);
 }
 
-void OutgoingDataCreator::SendLibrary(RemoteClient* client) {
-  // Get a temporary file name
-  QString temp_file_name = Utilities::GetTemporaryFileName();
+qint64 OutgoingDataCreator::MakeSyncToken(qint64 database_id,
+                                          qint64 version) {
+  return (database_id << kSyncTokenVersionBits) | version;
+}
+
+bool OutgoingDataCreator::ExportLibrary(Database* database, qint64 sync_token,
+                                        const QString& filename,
+                                        qint64* new_sync_token,
+                                        bool* is_delta) {
+  QMutexLocker l(database->Mutex());
 
   // Attach this file to the database
-  Database::AttachedDatabase adb(temp_file_name, "", true);
-  QSqlDatabase db(app_->database()->Connect());
+  Database::AttachedDatabase adb(filename, "", true);
+  QSqlDatabase db(database->Connect());
 
-  app_->database()->AttachDatabaseOnDbConnection("songs_export", adb, db);
+  database->AttachDatabaseOnDbConnection("songs_export", adb, db);
+  const bool ok = WriteLibraryExport(database, db, sync_token,
+                                     new_sync_token, is_delta);
 
-  // Copy the content of the song table to this temporary database
-  QSqlQuery q(QString(
-                  "create table songs_export.songs as SELECT * FROM songs "
-                  "where unavailable = 0;"),
-              db);
+  // Detach the database
+  database->DetachDatabase("songs_export");
+  return ok;
+}
 
-  if (app_->database()->CheckErrors(q)) return;
+bool OutgoingDataCreator::WriteLibraryExport(Database* database,
+                                             QSqlDatabase& db,
+                                             qint64 sync_token,
+                                             qint64* new_sync_token,
+                                             bool* is_delta) {
+  // Every change to the songs table gets a new version in songs_changes.  The
+  // latest one is read before exporting anything, so a change made while
+  // exporting is sent again next time rather than missed.  Tokens also carry
+  // a random ID stored in this database, so a token from another database,
+  // or from one that was deleted and created again, is never mistaken for
+  // one of ours.
+  QSqlQuery version_query(
+      "SELECT (SELECT MAX(database_id) FROM songs_changes_database),"
+      " (SELECT MAX(version) FROM songs_changes)",
+      db);
+  if (database->CheckErrors(version_query) || !version_query.next()) {
+    return false;
+  }
+  const qint64 database_id = version_query.value(0).toLongLong();
+  const qint64 current_version = version_query.value(1).toLongLong();
+  *new_sync_token = MakeSyncToken(database_id, current_version);
+
+  // Only send the changes if the client's library is from this database and
+  // it's cheaper than sending everything again.
+  const qint64 token_version =
+      sync_token & ((qint64(1) << kSyncTokenVersionBits) - 1);
+  *is_delta = false;
+  if (sync_token > 0 &&
+      sync_token >> kSyncTokenVersionBits == database_id &&
+      token_version <= current_version) {
+    QSqlQuery q(db);
+    q.prepare(
+        "SELECT (SELECT COUNT(*) FROM songs_changes WHERE version > ?),"
+        " (SELECT COUNT(*) FROM songs)");
+    q.addBindValue(token_version);
+    q.exec();
+    if (database->CheckErrors(q)) return false;
+
+    *is_delta = q.next() && q.value(0).toInt() * 2 < q.value(1).toInt();
+  }
 
-  // Detach the database
-  app_->database()->DetachDatabase("songs_export");
+  if (*is_delta) {
+    // Songs that were added or changed, and the filenames of songs that were
+    // removed, renamed or went missing.
+    const QString changed(
+        "SELECT song_id FROM songs_changes"
+        " WHERE version > ? AND deleted = 0");
+
+    QSqlQuery songs_query(db);
+    songs_query.prepare(
+        "CREATE TABLE songs_export.songs AS SELECT * FROM songs"
+        " WHERE unavailable = 0 AND ROWID IN (" + changed + ")");
+    songs_query.addBindValue(token_version);
+    songs_query.exec();
+    if (database->CheckErrors(songs_query)) return false;
+
+    QSqlQuery deleted_query(db);
+    deleted_query.prepare(
+        "CREATE TABLE songs_export.deleted_songs AS"
+        " SELECT filename FROM songs_changes"
+        "  WHERE version > ? AND deleted = 1"
+        " UNION"
+        " SELECT filename FROM songs"
+        "  WHERE unavailable = 1 AND ROWID IN (" + changed + ")");
+    deleted_query.addBindValue(token_version);
+    deleted_query.addBindValue(token_version);
+    deleted_query.exec();
+    if (database->CheckErrors(deleted_query)) return false;
+  } else {
+    // Copy the content of the song table to this temporary database
+    QSqlQuery q(QString(
+                    "create table songs_export.songs as SELECT * FROM songs "
+                    "where unavailable = 0;"),
+                db);
+
+    if (database->CheckErrors(q)) return false;
+  }
+
+  return true;
+}
+
+void OutgoingDataCreator::SendLibrary(RemoteClient* client,
+                                      qint64 sync_token,
+                                      bool accepts_compressed) {
+  // Get a temporary file name
+  QString temp_file_name = Utilities::GetTemporaryFileName();
+
+  qint64 new_sync_token = 0;
+  bool is_delta = false;
+  if (!ExportLibrary(app_->database(), sync_token, temp_file_name,
+                     &new_sync_token, &is_delta)) {
+    QFile::remove(temp_file_name);
+    return;
+  }
 
   // Open the file
   QFile file(temp_file_name);
 
   // Get the sha1 hash
   QByteArray sha1 = Utilities::Sha1File(file).toHex();
-  qLog(Debug) << "Library sha1" << sha1;
+  qLog(Debug) << "Library sha1" << sha1 << (is_delta ? "delta since" : "full")
+              << (is_delta ? sync_token : new_sync_token);
 
   file.open(QIODevice::ReadOnly);
 
@@ -636,6 +736,9 @@ void OutgoingDataCreator::SendLibrary(RemoteClient* client) {
   while (!file.atEnd()) {
     // Read file chunk
     data = file.read(kFileChunkSize);
+    if (accepts_compressed) {
+      data = qCompress(data);
+    }
 
     // Set chunk data
     chunk->set_chunk_count(chunk_count);
@@ -643,6 +746,9 @@ void OutgoingDataCreator::SendLibrary(RemoteClient* client) {
     chunk->set_size(file.size());
     chunk->set_data(data.data(), data.size());
     chunk->set_file_hash(sha1.data(), sha1.size());
+    chunk->set_sync_token(new_sync_token);
+    chunk->set_is_delta(is_delta);
+    chunk->set_compressed(accepts_compressed);
 
     // Send data directly to the client
     client->SendData(&msg);
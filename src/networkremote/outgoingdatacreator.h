@@ -9,6 +9,7 @@
 #include <QTimer>
 #include <QMap>
 #include <QQueue>
+#include <QSqlDatabase>
 
 #include "core/player.h"
 #include "core/application.h"
@@ -28,6 +29,8 @@
 #include "remotecontrolmessages.pb.h"
 #include "remoteclient.h"
 
+class Database;
+
 typedef QList<SongInfoProvider*> ProviderList;
 
 struct GlobalSearchRequest {
@@ -47,12 +50,24 @@ class OutgoingDataCreator : public QObject {
   ~OutgoingDataCreator();
 
   static const quint32 kFileChunkSize;
+  // Library sync tokens hold the database's ID above this many bits of
+  // songs_changes version.
+  static const int kSyncTokenVersionBits;
 
   void SetClients(QList<RemoteClient*>* clients);
 
   static void CreateSong(const Song& song, const QImage& art, const int index,
                   pb::remote::SongMetadata* song_metadata);
 
+  // Writes the part of the library a client with sync_token doesn't have to
+  // a new database in filename: either every song, or a delta with the
+  // changed songs and the filenames of the deleted ones.  Returns false if
+  // that failed.
+  static bool ExportLibrary(Database* database, qint64 sync_token,
+                            const QString& filename, qint64* new_sync_token,
+                            bool* is_delta);
+  static qint64 MakeSyncToken(qint64 database_id, qint64 version);
+
  public slots:
   void SendClementineInfo();
   void SendAllPlaylists();
@@ -77,7 +92,8 @@ class OutgoingDataCreator : public QObject {
   void DisconnectAllClients();
   void GetLyrics();
   void SendLyrics(int id, const SongInfoFetcher::Result& result);
-  void SendLibrary(RemoteClient* client);
+  void SendLibrary(RemoteClient* client, qint64 sync_token,
+                   bool accepts_compressed);
   void EnableKittens(bool aww);
   void SendKitten(const QImage& kitten);
 
@@ -105,6 +121,11 @@ class OutgoingDataCreator : public QObject {
 
   QMap<int, GlobalSearchRequest> global_search_result_map_;
 
+  // Fills in the attached songs_export database.
+  static bool WriteLibraryExport(Database* database, QSqlDatabase& db,
+                                 qint64 sync_token, qint64* new_sync_token,
+                                 bool* is_delta);
+
   void SendDataToClients(pb::remote::Message* msg);
   void SetEngineState(pb::remote::ResponseClementineInfo* msg);
   void CheckEnabledProviders();
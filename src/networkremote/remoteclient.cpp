@@ -35,6 +35,7 @@ RemoteClient::RemoteClient(Application* app, QTcpSocket* client)
 
   // Connect to the slot IncomingData when receiving data
   connect(client, SIGNAL(readyRead()), this, SLOT(IncomingData()));
+  connect(client, SIGNAL(bytesWritten(qint64)), SIGNAL(BytesWritten(qint64)));
 
   // Check if we use auth code
   QSettings s;
@@ -192,3 +193,5 @@ void RemoteClient::SendData(pb::remote::Message* msg) {
 }
 
 QAbstractSocket::SocketState RemoteClient::State() { return client_->state(); }
+
+qint64 RemoteClient::BytesToWrite() { return client_->bytesToWrite(); }
@@ -19,6 +19,8 @@ class RemoteClient : public QObject {
   // This method checks if client is authenticated before sending the data
   void SendData(pb::remote::Message* msg);
   QAbstractSocket::SocketState State();
+  // Bytes that have been sent but are still waiting in the socket's buffer.
+  qint64 BytesToWrite();
   void setDownloader(bool downloader);
   bool isDownloader() { return downloader_; }
   void DisconnectClient(pb::remote::ReasonDisconnect reason);
@@ -30,6 +32,7 @@ class RemoteClient : public QObject {
 
 signals:
   void Parse(const pb::remote::Message& msg);
+  void BytesWritten(qint64 bytes);
 
  private:
   void ParseMessage(const QByteArray& data);
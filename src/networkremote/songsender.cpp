@@ -17,11 +17,14 @@
 
 #include "songsender.h"
 
+#include <QCache>
+#include <QDateTime>
 #include <QFileInfo>
+#include <QtConcurrentRun>
 
 #include "core/application.h"
+#include "core/closure.h"
 #include "core/logging.h"
-#include "core/utilities.h"
 #include "library/librarybackend.h"
 #include "networkremote/networkremote.h"
 #include "networkremote/outgoingdatacreator.h"
@@ -29,12 +32,27 @@
 #include "playlist/playlistitem.h"
 
 const quint32 SongSender::kFileChunkSize = 100000;  // in Bytes
+const qint64 SongSender::kMaxBufferedBytes = 4 * kFileChunkSize;
+
+namespace {
+
+// Hashes of files that have been sent before, keyed by filename, size and
+// modification time.  Only used in the GUI thread.
+QCache<QString, QByteArray>* FileHashCache() {
+  static QCache<QString, QByteArray> cache(1000);
+  return &cache;
+}
+
+}  // namespace
 
 SongSender::SongSender(Application* app, RemoteClient* client)
     : app_(app),
       client_(client),
       transcoder_(
-          new Transcoder(this, NetworkRemote::kTranscoderSettingPostfix)) {
+          new Transcoder(this, NetworkRemote::kTranscoderSettingPostfix)),
+      transfer_started_(false),
+      waiting_for_transcoder_(false),
+      transfer_active_(false) {
   QSettings s;
   s.beginGroup(NetworkRemote::kSettingsGroup);
 
@@ -54,7 +72,7 @@ SongSender::SongSender(Application* app, RemoteClient* client)
 
   connect(transcoder_, SIGNAL(JobComplete(QString, QString, bool)),
           SLOT(TranscodeJobComplete(QString, QString, bool)));
-  connect(transcoder_, SIGNAL(AllJobsComplete()), SLOT(StartTransfer()));
+  connect(client_, SIGNAL(BytesWritten(qint64)), SLOT(SocketBytesWritten()));
 
   total_transcode_ = 0;
 }
@@ -62,9 +80,15 @@ SongSender::SongSender(Application* app, RemoteClient* client)
 SongSender::~SongSender() {
   disconnect(transcoder_, SIGNAL(JobComplete(QString, QString, bool)), this,
              SLOT(TranscodeJobComplete(QString, QString, bool)));
-  disconnect(transcoder_, SIGNAL(AllJobsComplete()), this,
-             SLOT(StartTransfer()));
   transcoder_->Cancel();
+
+  // Don't pull the file out from under a chunk that's still being read
+  transfer_active_ = false;
+  read_future_.waitForFinished();
+  if (transfer_.file) {
+    if (transfer_.is_transcoded) transfer_.file->remove();
+    delete transfer_.file;
+  }
 }
 
 void SongSender::SendSongs(const pb::remote::RequestDownloadSongs& request) {
@@ -111,7 +135,9 @@ void SongSender::TranscodeLosslessFiles() {
     // Add the file to the transcoder
     QString local_file = item.song_.url().toLocalFile();
 
-    transcoder_->AddTemporaryJob(local_file, transcoder_preset_);
+    transcoder_->AddTemporaryJob(local_file, transcoder_preset_,
+                                 item.song_.length_nanosec());
+    pending_transcodes_.insert(local_file);
 
     qLog(Debug) << "transcoding" << local_file;
     total_transcode_++;
@@ -120,21 +146,38 @@ void SongSender::TranscodeLosslessFiles() {
   if (total_transcode_ > 0) {
     transcoder_->Start();
     SendTranscoderStatus();
-  } else {
+  }
+
+  // Files that don't need transcoding can be sent while the others are still
+  // being converted.
+  if (download_queue_.isEmpty() || IsReady(download_queue_.head())) {
     StartTransfer();
   }
 }
 
+bool SongSender::IsReady(const DownloadItem& item) const {
+  return !pending_transcodes_.contains(item.song_.url().toLocalFile());
+}
+
 void SongSender::TranscodeJobComplete(const QString& input,
                                       const QString& output, bool success) {
   qLog(Debug) << input << "transcoded to" << output << success;
 
   // If it wasn't successful send original file
+  pending_transcodes_.remove(input);
   if (success) {
     transcoder_map_.insert(input, output);
   }
 
-  SendTranscoderStatus();
+  if (download_queue_.isEmpty()) return;
+
+  if (!transfer_started_) {
+    SendTranscoderStatus();
+    if (IsReady(download_queue_.head())) StartTransfer();
+  } else if (waiting_for_transcoder_ && IsReady(download_queue_.head())) {
+    waiting_for_transcoder_ = false;
+    OfferNextSong();
+  }
 }
 
 void SongSender::SendTranscoderStatus() {
@@ -151,6 +194,8 @@ void SongSender::SendTranscoderStatus() {
 }
 
 void SongSender::StartTransfer() {
+  if (transfer_started_) return;
+  transfer_started_ = true;
   total_transcode_ = 0;
 
   // Send total file size & file count
@@ -169,6 +214,8 @@ void SongSender::SendTotalFileSize() {
 
   response->set_file_count(download_queue_.size());
 
+  // Files that are still being transcoded are counted with their original
+  // size.
   int total = 0;
   for (DownloadItem item : download_queue_) {
     QString local_file = item.song_.url().toLocalFile();
@@ -190,6 +237,11 @@ void SongSender::OfferNextSong() {
 
   if (download_queue_.isEmpty()) {
     msg.set_type(pb::remote::DOWNLOAD_QUEUE_EMPTY);
+    transfer_started_ = false;
+  } else if (!IsReady(download_queue_.head())) {
+    // Offer it when the transcoder is done with it
+    waiting_for_transcoder_ = true;
+    return;
   } else {
     // Get the item and send the single song
     DownloadItem item = download_queue_.head();
@@ -215,20 +267,26 @@ void SongSender::OfferNextSong() {
   client_->SendData(&msg);
 }
 
-void SongSender::ResponseSongOffer(bool accepted) {
-  if (download_queue_.isEmpty()) return;
+void SongSender::ResponseSongOffer(bool accepted, int resume_chunk) {
+  if (download_queue_.isEmpty() || transfer_active_) return;
 
   // Get the item and send the single song
   DownloadItem item = download_queue_.dequeue();
-  if (accepted) SendSingleSong(item);
-
-  // And offer the next song
-  OfferNextSong();
+  if (accepted) {
+    // This offers the next song when it's done
+    SendSingleSong(item, resume_chunk);
+  } else {
+    OfferNextSong();
+  }
 }
 
-void SongSender::SendSingleSong(DownloadItem download_item) {
+void SongSender::SendSingleSong(const DownloadItem& download_item,
+                                int resume_chunk) {
   // Only local files!!!
-  if (!(download_item.song_.url().scheme() == "file")) return;
+  if (!(download_item.song_.url().scheme() == "file")) {
+    OfferNextSong();
+    return;
+  }
 
   QString local_file = download_item.song_.url().toLocalFile();
   bool is_transcoded = transcoder_map_.contains(local_file);
@@ -238,75 +296,177 @@ void SongSender::SendSingleSong(DownloadItem download_item) {
   }
 
   // Open the file
-  QFile file(local_file);
+  QFile* file = new QFile(local_file);
+  if (!file->open(QIODevice::ReadOnly)) {
+    qLog(Warning) << "Couldn't open" << local_file;
+    if (is_transcoded) file->remove();
+    delete file;
+    OfferNextSong();
+    return;
+  }
+
+  transfer_ = Transfer();
+  transfer_.item = download_item;
+  transfer_.file = file;
+  transfer_.is_transcoded = is_transcoded;
+  transfer_.chunk_count = (file->size() + kFileChunkSize - 1) / kFileChunkSize;
+
+  // The hash is sent with every chunk.  It's remembered for files that have
+  // been sent before, otherwise the first read hashes the whole file.
+  if (!is_transcoded) {
+    QFileInfo info(local_file);
+    transfer_.hash_key = QString("%1:%2:%3").arg(
+        info.absoluteFilePath(), QString::number(info.size()),
+        QString::number(info.lastModified().toTime_t()));
+    QByteArray* cached_hash = FileHashCache()->object(transfer_.hash_key);
+    if (cached_hash) transfer_.file_hash = *cached_hash;
+  }
+  transfer_.needs_hash = transfer_.file_hash.isEmpty();
+
+  // The client already has the chunks before resume_chunk
+  resume_chunk = qBound(1, resume_chunk, qMax(1, transfer_.chunk_count));
+  transfer_.first_chunk = resume_chunk;
+  transfer_.chunk_number = resume_chunk;
+  transfer_.skip_bytes = qint64(resume_chunk - 1) * kFileChunkSize;
+
+  transfer_active_ = true;
+
+  if (transfer_.chunk_count == 0) {
+    FinishTransfer();
+  } else {
+    ReadNextChunk();
+  }
+}
+
+void SongSender::ReadNextChunk() {
+  if (!transfer_active_ || transfer_.reading) return;
+
+  transfer_.reading = true;
+  read_future_ = QtConcurrent::run(
+      &SongSender::ReadChunk, transfer_.file,
+      transfer_.needs_hash && transfer_.file_hash.isEmpty(),
+      transfer_.skip_bytes);
+  transfer_.skip_bytes = 0;
+
+  NewClosure(read_future_, this, SLOT(ChunkRead(QFuture<SongSender::Chunk>)),
+             read_future_);
+}
+
+SongSender::Chunk SongSender::ReadChunk(QFile* file, bool hash_file,
+                                        qint64 skip_bytes) {
+  Chunk ret;
+
+  if (hash_file) {
+    const qint64 position = file->pos();
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    file->seek(0);
+    while (!file->atEnd()) {
+      const QByteArray data = file->read(1000000);
+      if (data.isEmpty()) break;
+      hash.addData(data);
+    }
+    ret.file_hash = hash.result().toHex();
+    file->seek(position);
+  }
+
+  if (skip_bytes) {
+    file->seek(file->pos() + skip_bytes);
+  }
+
+  ret.data = file->read(kFileChunkSize);
+  return ret;
+}
 
-  // Get sha1 for file
-  QByteArray sha1 = Utilities::Sha1File(file).toHex();
-  qLog(Debug) << "sha1 for file" << local_file << "=" << sha1;
+void SongSender::ChunkRead(QFuture<SongSender::Chunk> future) {
+  transfer_.reading = false;
+  if (!transfer_active_) return;
 
-  file.open(QIODevice::ReadOnly);
+  const Chunk data = future.result();
+  if (!data.file_hash.isEmpty()) {
+    transfer_.file_hash = data.file_hash;
+  }
 
-  QByteArray data;
   pb::remote::Message msg;
   pb::remote::ResponseSongFileChunk* chunk =
       msg.mutable_response_song_file_chunk();
   msg.set_type(pb::remote::SONG_FILE_CHUNK);
 
-  QImage null_image;
+  const DownloadItem& download_item = transfer_.item;
+  QFile* file = transfer_.file;
+
+  // Set chunk data
+  chunk->set_chunk_count(transfer_.chunk_count);
+  chunk->set_chunk_number(transfer_.chunk_number);
+  chunk->set_file_count(download_item.song_count_);
+  chunk->set_file_number(download_item.song_no_);
+  chunk->set_size(file->size());
+  chunk->set_data(data.data.data(), data.data.size());
+  if (!transfer_.file_hash.isEmpty()) {
+    chunk->set_file_hash(transfer_.file_hash.data(),
+                         transfer_.file_hash.size());
+  }
 
-  // Calculate the number of chunks
-  int chunk_count = qRound((file.size() / kFileChunkSize) + 0.5);
-  int chunk_number = 1;
+  // On the first chunk send the metadata, so the client knows
+  // what file it receives.
+  if (transfer_.chunk_number == transfer_.first_chunk) {
+    int i = app_->playlist_manager()->active()->current_row();
+    pb::remote::SongMetadata* song_metadata =
+        msg.mutable_response_song_file_chunk()->mutable_song_metadata();
+    OutgoingDataCreator::CreateSong(download_item.song_, QImage(), i,
+                                    song_metadata);
+
+    // if the file was transcoded, we have to change the filename and filesize
+    if (transfer_.is_transcoded) {
+      song_metadata->set_file_size(file->size());
+      QString basefilename = download_item.song_.basefilename();
+      QFileInfo info(basefilename);
+      basefilename.replace("." + info.suffix(),
+                           "." + transcoder_preset_.extension_);
+      song_metadata->set_filename(DataCommaSizeFromQString(basefilename));
+    }
+  }
 
-  while (!file.atEnd()) {
-    // Read file chunk
-    data = file.read(kFileChunkSize);
+  client_->SendData(&msg);
+  transfer_.chunk_number++;
 
-    // Set chunk data
-    chunk->set_chunk_count(chunk_count);
-    chunk->set_chunk_number(chunk_number);
-    chunk->set_file_count(download_item.song_count_);
-    chunk->set_file_number(download_item.song_no_);
-    chunk->set_size(file.size());
-    chunk->set_data(data.data(), data.size());
-    chunk->set_file_hash(sha1.data(), sha1.size());
-
-    // On the first chunk send the metadata, so the client knows
-    // what file it receives.
-    if (chunk_number == 1) {
-      int i = app_->playlist_manager()->active()->current_row();
-      pb::remote::SongMetadata* song_metadata =
-          msg.mutable_response_song_file_chunk()->mutable_song_metadata();
-      OutgoingDataCreator::CreateSong(download_item.song_, null_image, i,
-                                      song_metadata);
-
-      // if the file was transcoded, we have to change the filename and filesize
-      if (is_transcoded) {
-        song_metadata->set_file_size(file.size());
-        QString basefilename = download_item.song_.basefilename();
-        QFileInfo info(basefilename);
-        basefilename.replace("." + info.suffix(),
-                             "." + transcoder_preset_.extension_);
-        song_metadata->set_filename(DataCommaSizeFromQString(basefilename));
-      }
-    }
+  if (data.data.isEmpty() || file->atEnd() ||
+      transfer_.chunk_number > transfer_.chunk_count) {
+    FinishTransfer();
+    return;
+  }
 
-    // Send data directly to the client
-    client_->SendData(&msg);
+  // Otherwise wait for the socket to drain before reading any more
+  if (client_->BytesToWrite() < kMaxBufferedBytes) {
+    ReadNextChunk();
+  }
+}
 
-    // Clear working data
-    chunk->Clear();
-    data.clear();
+void SongSender::SocketBytesWritten() {
+  if (transfer_active_ && client_->BytesToWrite() < kMaxBufferedBytes) {
+    ReadNextChunk();
+  }
+}
 
-    chunk_number++;
+void SongSender::FinishTransfer() {
+  if (transfer_.needs_hash && !transfer_.hash_key.isEmpty() &&
+      !transfer_.file_hash.isEmpty()) {
+    FileHashCache()->insert(transfer_.hash_key,
+                            new QByteArray(transfer_.file_hash));
   }
 
   // If the file was transcoded, delete the temporary one
-  if (is_transcoded) {
-    file.remove();
+  if (transfer_.is_transcoded) {
+    transfer_.file->remove();
   } else {
-    file.close();
+    transfer_.file->close();
   }
+
+  delete transfer_.file;
+  transfer_ = Transfer();
+  transfer_active_ = false;
+
+  // And offer the next song
+  OfferNextSong();
 }
 
 void SongSender::SendAlbum(const Song& song) {
@@ -1,8 +1,12 @@
 #ifndef SONGSENDER_H
 #define SONGSENDER_H
 
+#include <QCryptographicHash>
+#include <QFile>
+#include <QFuture>
 #include <QMap>
 #include <QQueue>
+#include <QSet>
 #include <QUrl>
 
 #include "remotecontrolmessages.pb.h"
@@ -10,6 +14,8 @@
 #include "core/song.h"
 #include "transcoder/transcoder.h"
 
+#include "gtest/gtest_prod.h"
+
 class Application;
 class RemoteClient;
 class Transcoder;
@@ -18,6 +24,7 @@ struct DownloadItem {
   Song song_;
   int song_no_;
   int song_count_;
+  DownloadItem() : song_no_(0), song_count_(0) {}
   DownloadItem(Song s, int no, int count)
     : song_(s), song_no_(no), song_count_(count) {}
 };
@@ -29,15 +36,61 @@ class SongSender : public QObject {
   ~SongSender();
 
   static const quint32 kFileChunkSize;
+  // No more chunks are read while the socket has this much data left to send.
+  static const qint64 kMaxBufferedBytes;
 
  public slots:
   void SendSongs(const pb::remote::RequestDownloadSongs& request);
-  void ResponseSongOffer(bool accepted);
+  // resume_chunk is the first chunk the client is missing, if it already has
+  // part of the file from an interrupted download.
+  void ResponseSongOffer(bool accepted, int resume_chunk = 1);
+
+ private:
+  // The file currently being sent.  Chunks are read in the thread pool one at
+  // a time, and only while the socket isn't backed up.
+  struct Transfer {
+    Transfer()
+        : file(nullptr),
+          needs_hash(false),
+          is_transcoded(false),
+          chunk_count(0),
+          first_chunk(1),
+          chunk_number(1),
+          skip_bytes(0),
+          reading(false) {}
+
+    DownloadItem item;
+    QFile* file;
+    // Set if the file's hash wasn't already known, so the first read has to
+    // work it out.
+    bool needs_hash;
+    QByteArray file_hash;
+    QString hash_key;
+    bool is_transcoded;
+
+    int chunk_count;
+    // The first chunk sent, which carries the song's metadata.
+    int first_chunk;
+    // The next chunk to send, starting at 1.
+    int chunk_number;
+    // Bytes to skip before the next read when resuming.
+    qint64 skip_bytes;
+    bool reading;
+  };
+
+  struct Chunk {
+    QByteArray data;
+    // The hash of the whole file, if it was asked for.
+    QByteArray file_hash;
+  };
 
  private slots:
   void TranscodeJobComplete(const QString& input, const QString& output, bool success);
   void StartTransfer();
 
+  void ChunkRead(QFuture<SongSender::Chunk> future);
+  void SocketBytesWritten();
+
  private:
   Application* app_;
   RemoteClient* client_;
@@ -48,9 +101,23 @@ class SongSender : public QObject {
 
   QQueue<DownloadItem> download_queue_;
   QMap<QString, QString> transcoder_map_;
+  // Local files that haven't finished transcoding yet.
+  QSet<QString> pending_transcodes_;
   int total_transcode_;
+  bool transfer_started_;
+  bool waiting_for_transcoder_;
 
-  void SendSingleSong(DownloadItem download_item);
+  Transfer transfer_;
+  bool transfer_active_;
+  QFuture<Chunk> read_future_;
+
+  void SendSingleSong(const DownloadItem& download_item, int resume_chunk);
+  void ReadNextChunk();
+  // Reads the next chunk after skipping skip_bytes.  If hash_file is set the
+  // whole file is hashed first, so the hash can go out with every chunk.
+  static Chunk ReadChunk(QFile* file, bool hash_file, qint64 skip_bytes);
+  void FinishTransfer();
+  bool IsReady(const DownloadItem& item) const;
   void SendAlbum(const Song& song);
   void SendPlaylist(int playlist_id);
   void SendUrls(const pb::remote::RequestDownloadSongs& request);
@@ -58,6 +125,9 @@ class SongSender : public QObject {
   void SendTotalFileSize();
   void TranscodeLosslessFiles();
   void SendTranscoderStatus();
+
+  FRIEND_TEST(SongSenderTest, HashesWholeFileWithFirstChunk);
+  FRIEND_TEST(SongSenderTest, HashesWholeFileWhenResuming);
 };
 
 #endif  // SONGSENDER_H
@@ -38,6 +38,7 @@
 #include "playlistbackend.h"
 #include "playlistfilter.h"
 #include "playlistitemmimedata.h"
+#include "playlistsorter.h"
 #include "playlistundocommands.h"
 #include "playlistview.h"
 #include "queue.h"
@@ -94,6 +95,8 @@ const char* Playlist::kWriteMetadata = "write_metadata";
 const int Playlist::kUndoStackSize = 20;
 const int Playlist::kUndoItemLimit = 500;
 
+const int Playlist::kAsyncSortThreshold = 5000;
+
 const qint64 Playlist::kMinScrobblePointNsecs = 31ll * kNsecPerSec;
 const qint64 Playlist::kMaxScrobblePointNsecs = 240ll * kNsecPerSec;
 
@@ -117,6 +120,7 @@ Playlist::Playlist(PlaylistBackend* backend, TaskManager* task_manager,
       have_incremented_playcount_(false),
       playlist_sequence_(nullptr),
       ignore_sorting_(false),
+      last_sort_id_(0),
       undo_stack_(new QUndoStack(this)),
       special_type_(special_type),
       cancel_restore_(false) {
@@ -431,6 +435,13 @@ void Playlist::SongSaveComplete(TagReaderReply* reply,
 
 void Playlist::ItemReloadComplete(const QPersistentModelIndex& index) {
   if (index.isValid()) {
+    // Songs that aren't in the library keep their tags in the playlist
+    const int row = index.row();
+    RecordChange(PlaylistBackend::Change(PlaylistBackend::Change::Type_Update,
+                                         row, 1,
+                                         PlaylistItemList() << item_at(row)));
+    Save();
+
     emit dataChanged(index, index);
     emit EditingFinished(index);
   }
@@ -890,6 +901,8 @@ void Playlist::MoveItemsWithoutUndo(const QList<int>& source_rows, int pos) {
   int start = pos;
   for (int source_row : source_rows) {
     moved_items << items_.takeAt(source_row - offset);
+    RecordChange(PlaylistBackend::Change(PlaylistBackend::Change::Type_Remove,
+                                         source_row - offset, 1));
     if (pos > source_row) {
       start--;
     }
@@ -901,6 +914,9 @@ void Playlist::MoveItemsWithoutUndo(const QList<int>& source_rows, int pos) {
     moved_items[i - start]->RemoveForegroundColor(kDynamicHistoryPriority);
     items_.insert(i, moved_items[i - start]);
   }
+  RecordChange(PlaylistBackend::Change(PlaylistBackend::Change::Type_Insert,
+                                       start, moved_items.count(),
+                                       moved_items));
 
   // Update persistent indexes
   for (const QModelIndex& pidx : persistentIndexList()) {
@@ -942,11 +958,16 @@ void Playlist::MoveItemsWithoutUndo(int start, const QList<int>& dest_rows) {
   // Take the items out of the list first
   for (int i = 0; i < dest_rows.count(); i++)
     moved_items << items_.takeAt(start);
+  RecordChange(PlaylistBackend::Change(PlaylistBackend::Change::Type_Remove,
+                                       start, dest_rows.count()));
 
   // Put the items back in
   int offset = 0;
   for (int dest_row : dest_rows) {
     items_.insert(dest_row, moved_items[offset]);
+    RecordChange(PlaylistBackend::Change(
+        PlaylistBackend::Change::Type_Insert, dest_row, 1,
+        PlaylistItemList() << moved_items[offset]));
     offset++;
   }
 
@@ -1063,6 +1084,8 @@ void Playlist::InsertItemsWithoutUndo(const PlaylistItemList& items, int pos,
     }
   }
   endInsertRows();
+  RecordChange(PlaylistBackend::Change(PlaylistBackend::Change::Type_Insert,
+                                       start, items.count(), items));
 
   if (enqueue) {
     QModelIndexList indexes;
@@ -1171,6 +1194,9 @@ void Playlist::UpdateItems(const SongList& songs) {
           new_item = PlaylistItemPtr(new SongPlaylistItem(song));
         }
         items_[i] = new_item;
+        RecordChange(PlaylistBackend::Change(
+            PlaylistBackend::Change::Type_Update, i, 1,
+            PlaylistItemList() << new_item));
         emit dataChanged(index(i, 0), index(i, ColumnCount - 1));
         // Also update undo actions
         for (int i = 0; i < undo_stack_->count(); i++) {
@@ -1409,32 +1435,53 @@ QString Playlist::abbreviated_column_name(Column column) {
 void Playlist::sort(int column, Qt::SortOrder order) {
   if (ignore_sorting_) return;
 
-  PlaylistItemList new_items(items_);
-  PlaylistItemList::iterator begin = new_items.begin();
+  int first = 0;
   if (dynamic_playlist_ && current_item_index_.isValid())
-    begin += current_item_index_.row() + 1;
+    first = current_item_index_.row() + 1;
 
-  if (column == Column_Album) {
-    // When sorting by album, also take into account discs and tracks.
-    qStableSort(begin, new_items.end(), std::bind(&Playlist::CompareItems,
-                                                  Column_Track, order, _1, _2));
-    qStableSort(begin, new_items.end(),
-                std::bind(&Playlist::CompareItems, Column_Disc, order, _1, _2));
-    qStableSort(begin, new_items.end(), std::bind(&Playlist::CompareItems,
-                                                  Column_Album, order, _1, _2));
-  } else if (column == Column_Filename) {
-    // When sorting by full paths we also expect a hierarchical order. This
-    // returns a breath-first ordering of paths.
-    qStableSort(
-        begin, new_items.end(),
-        std::bind(&Playlist::CompareItems, Column_Filename, order, _1, _2));
-    qStableSort(begin, new_items.end(),
-                std::bind(&Playlist::ComparePathDepths, order, _1, _2));
-  } else {
-    qStableSort(begin, new_items.end(),
-                std::bind(&Playlist::CompareItems, column, order, _1, _2));
+  PlaylistSorter sorter(column, order);
+
+  if (items_.count() - first <= kAsyncSortThreshold) {
+    // Anything still being sorted in the background is out of date now.
+    last_sort_id_++;
+    ApplySort(column, order, sorter.Sort(items_, first));
+    return;
+  }
+
+  // Big playlists take a while, so sort in the background.  The items'
+  // metadata can change while that's happening, so the keys are copied out
+  // of them here first.
+  QFuture<QVector<int> > future = QtConcurrent::run(
+      sorter, &PlaylistSorter::SortKeys, sorter.ExtractKeys(items_, first));
+  NewClosure(future, this,
+             SLOT(SortFinished(QFuture<QVector<int> >, int, int, int, int,
+                               PlaylistItemList)),
+             future, ++last_sort_id_, column, static_cast<int>(order), first,
+             items_);
+}
+
+void Playlist::SortFinished(QFuture<QVector<int> > future, int sort_id,
+                            int column, int order, int first,
+                            const PlaylistItemList& old_items) {
+  // Another sort was started after this one.
+  if (sort_id != last_sort_id_) return;
+
+  int current_first = 0;
+  if (dynamic_playlist_ && current_item_index_.isValid())
+    current_first = current_item_index_.row() + 1;
+
+  // The playlist changed while it was being sorted, so start again.
+  if (first != current_first || items_ != old_items) {
+    sort(column, Qt::SortOrder(order));
+    return;
   }
 
+  ApplySort(column, Qt::SortOrder(order),
+            PlaylistSorter::Reorder(items_, first, future.result()));
+}
+
+void Playlist::ApplySort(int column, Qt::SortOrder order,
+                         const PlaylistItemList& new_items) {
   undo_stack_->push(
       new PlaylistUndoCommands::SortItems(this, column, order, new_items));
 
@@ -1446,6 +1493,7 @@ void Playlist::ReOrderWithoutUndo(const PlaylistItemList& new_items) {
 
   PlaylistItemList old_items = items_;
   items_ = new_items;
+  RecordChange(PlaylistBackend::Change(PlaylistBackend::Change::Type_Reset));
 
   QMap<const PlaylistItem*, int> new_rows;
   for (int i = 0; i < new_items.length(); ++i) {
@@ -1483,8 +1531,16 @@ void Playlist::SetCurrentIsPaused(bool paused) {
 void Playlist::Save() const {
   if (!backend_ || is_loading_) return;
 
-  backend_->SavePlaylistAsync(id_, items_, last_played_row(),
+  backend_->SavePlaylistAsync(id_, items_, pending_changes_, last_played_row(),
                               dynamic_playlist_);
+  pending_changes_.clear();
+}
+
+void Playlist::RecordChange(const PlaylistChange& change) {
+  // Items added while loading are already in the database
+  if (!backend_ || is_loading_) return;
+
+  pending_changes_ << change;
 }
 
 void Playlist::Restore() {
@@ -1652,6 +1708,8 @@ PlaylistItemList Playlist::RemoveItemsWithoutUndo(int row, int count) {
   }
 
   endRemoveRows();
+  RecordChange(PlaylistBackend::Change(PlaylistBackend::Change::Type_Remove,
+                                       row, count));
 
   QList<int>::iterator it = virtual_items_.begin();
   int i = 0;
@@ -1855,6 +1913,8 @@ void Playlist::ReloadItems(const QList<int>& rows) {
     PlaylistItemPtr item = item_at(row);
 
     item->Reload();
+    RecordChange(PlaylistBackend::Change(PlaylistBackend::Change::Type_Update,
+                                         row, 1, PlaylistItemList() << item));
 
     if (row == current_row()) {
       InformOfCurrentSongChange();
@@ -20,7 +20,9 @@
 
 #include <QAbstractItemModel>
 #include <QList>
+#include <QVector>
 
+#include "playlistchange.h"
 #include "playlistitem.h"
 #include "playlistsequence.h"
 #include "core/tagreaderclient.h"
@@ -161,6 +163,9 @@ class Playlist : public QAbstractListModel {
   static const int kUndoStackSize;
   static const int kUndoItemLimit;
 
+  // Playlists with more items than this are sorted in the background.
+  static const int kAsyncSortThreshold;
+
   static const qint64 kMinScrobblePointNsecs;
   static const qint64 kMaxScrobblePointNsecs;
 
@@ -383,9 +388,14 @@ signals:
   void MoveItemWithoutUndo(int source, int dest);
   void MoveItemsWithoutUndo(int start, const QList<int>& dest_rows);
   void ReOrderWithoutUndo(const PlaylistItemList& new_items);
+  void ApplySort(int column, Qt::SortOrder order,
+                 const PlaylistItemList& new_items);
 
   void RemoveItemsNotInQueue();
 
+  // Remembers a change to items_ so the next Save() only has to write that.
+  void RecordChange(const PlaylistChange& change);
+
   // Removes rows with given indices from this playlist.
   bool removeRows(QList<int>& rows);
 
@@ -398,6 +408,8 @@ signals:
                         const QPersistentModelIndex& index);
   void ItemReloadComplete(const QPersistentModelIndex& index);
   void ItemsLoaded(QFuture<PlaylistItemList> future);
+  void SortFinished(QFuture<QVector<int> > future, int sort_id, int column,
+                    int order, int first, const PlaylistItemList& old_items);
   void SongInsertVetoListenerDestroyed();
 
  private:
@@ -415,6 +427,8 @@ signals:
   bool favorite_;
 
   PlaylistItemList items_;
+  // Changes made to items_ since the last Save(), which hands them over.
+  mutable PlaylistChangeList pending_changes_;
   QList<int> virtual_items_;  // Contains the indices into items_ in the order
                               // that they will be played.
   // A map of library ID to playlist item - for fast lookups when library
@@ -437,6 +451,8 @@ signals:
 
   // Hack to stop QTreeView::setModel sorting the playlist
   bool ignore_sorting_;
+  // Identifies the latest background sort, so older ones can be ignored.
+  int last_sort_id_;
 
   QUndoStack* undo_stack_;
 
@@ -43,10 +43,15 @@ using std::shared_ptr;
 using smart_playlists::GeneratorPtr;
 
 const int PlaylistBackend::kSongTableJoins = 4;
+const int PlaylistBackend::kDeltaSavesBetweenCompactions = 200;
+const qint64 PlaylistBackend::kPositionGap = 1 << 16;
 
 PlaylistBackend::PlaylistBackend(Application* app, QObject* parent)
     : QObject(parent), app_(app), db_(app_->database()) {}
 
+PlaylistBackend::PlaylistBackend(Database* db, QObject* parent)
+    : QObject(parent), app_(nullptr), db_(db) {}
+
 PlaylistBackend::PlaylistList PlaylistBackend::GetAllPlaylists() {
   return GetPlaylists(GetPlaylists_All);
 }
@@ -160,7 +165,8 @@ QSqlQuery PlaylistBackend::GetPlaylistRows(int playlist) {
                   "    ON p.library_id = magnatune_songs.ROWID"
                   " LEFT JOIN jamendo.songs AS jamendo_songs"
                   "    ON p.library_id = jamendo_songs.ROWID"
-                  " WHERE p.playlist = :playlist";
+                  " WHERE p.playlist = :playlist"
+                  " ORDER BY p.position, p.ROWID";
   QSqlQuery q(db);
   // Forward iterations only may be faster
   q.setForwardOnly(true);
@@ -279,29 +285,21 @@ PlaylistItemPtr PlaylistBackend::RestoreCueData(
 
 void PlaylistBackend::SavePlaylistAsync(int playlist,
                                         const PlaylistItemList& items,
+                                        const ChangeList& changes,
                                         int last_played, GeneratorPtr dynamic) {
   metaObject()->invokeMethod(
       this, "SavePlaylist", Qt::QueuedConnection, Q_ARG(int, playlist),
-      Q_ARG(PlaylistItemList, items), Q_ARG(int, last_played),
+      Q_ARG(PlaylistItemList, items),
+      Q_ARG(PlaylistBackend::ChangeList, changes), Q_ARG(int, last_played),
       Q_ARG(smart_playlists::GeneratorPtr, dynamic));
 }
 
 void PlaylistBackend::SavePlaylist(int playlist, const PlaylistItemList& items,
-                                   int last_played, GeneratorPtr dynamic) {
+                                   const ChangeList& changes, int last_played,
+                                   GeneratorPtr dynamic) {
   QMutexLocker l(db_->Mutex());
   QSqlDatabase db(db_->Connect());
 
-  qLog(Debug) << "Saving playlist" << playlist;
-
-  QSqlQuery clear("DELETE FROM playlist_items WHERE playlist = :playlist", db);
-  QSqlQuery insert(
-      "INSERT INTO playlist_items"
-      " (playlist, type, library_id, radio_service, " +
-          Song::kColumnSpec +
-          ")"
-          " VALUES (:playlist, :type, :library_id, :radio_service, " +
-          Song::kBindSpec + ")",
-      db);
   QSqlQuery update(
       "UPDATE playlists SET "
       "   last_played=:last_played,"
@@ -313,18 +311,39 @@ void PlaylistBackend::SavePlaylist(int playlist, const PlaylistItemList& items,
 
   ScopedTransaction transaction(&db);
 
-  // Clear the existing items in the playlist
-  clear.bindValue(":playlist", playlist);
-  clear.exec();
-  if (db_->CheckErrors(clear)) return;
+  QList<qint64> positions = item_positions_.value(playlist);
+  if (!changes.isEmpty()) {
+    bool rewrite = delta_saves_[playlist] >= kDeltaSavesBetweenCompactions;
+    for (const Change& change : changes) {
+      if (change.type == Change::Type_Reset) {
+        rewrite = true;
+        break;
+      }
+    }
 
-  // Save the new ones
-  for (PlaylistItemPtr item : items) {
-    insert.bindValue(":playlist", playlist);
-    item->BindToQuery(&insert);
+    if (!rewrite && !item_positions_.contains(playlist) &&
+        !LoadItemPositions(playlist, db, &positions)) {
+      rewrite = true;
+    }
 
-    insert.exec();
-    db_->CheckErrors(insert);
+    if (!rewrite &&
+        !ApplyPlaylistChanges(playlist, changes, items.count(), db,
+                              &positions)) {
+      // The rows in the database didn't match what the playlist expected -
+      // maybe they were written by an older version, or some items couldn't
+      // be loaded.  Start again from scratch.
+      qLog(Debug) << "Changes to playlist" << playlist
+                  << "didn't apply cleanly, rewriting it";
+      rewrite = true;
+    }
+
+    if (rewrite) {
+      qLog(Debug) << "Saving playlist" << playlist;
+      if (!RewritePlaylistItems(playlist, items, db, &positions)) return;
+      delta_saves_[playlist] = 0;
+    } else {
+      delta_saves_[playlist]++;
+    }
   }
 
   // Update the last played track number
@@ -343,6 +362,169 @@ void PlaylistBackend::SavePlaylist(int playlist, const PlaylistItemList& items,
   if (db_->CheckErrors(update)) return;
 
   transaction.Commit();
+  if (!changes.isEmpty()) item_positions_[playlist] = positions;
+}
+
+bool PlaylistBackend::LoadItemPositions(int playlist, QSqlDatabase& db,
+                                        QList<qint64>* positions) {
+  QSqlQuery q(db);
+  q.prepare(
+      "SELECT position FROM playlist_items WHERE playlist = :playlist"
+      " ORDER BY position");
+  q.bindValue(":playlist", playlist);
+  q.exec();
+  if (db_->CheckErrors(q)) return false;
+
+  positions->clear();
+  while (q.next()) {
+    const qint64 position = q.value(0).toLongLong();
+
+    // Rows saved before positions existed all have the same one.
+    if (!positions->isEmpty() && position <= positions->last()) return false;
+    *positions << position;
+  }
+  return true;
+}
+
+bool PlaylistBackend::ApplyPlaylistChanges(int playlist,
+                                           const ChangeList& changes,
+                                           int expected_count,
+                                           QSqlDatabase& db,
+                                           QList<qint64>* positions) {
+  QSqlQuery insert(db);
+  insert.prepare(
+      "INSERT INTO playlist_items"
+      " (playlist, position, type, library_id, radio_service, " +
+      Song::kColumnSpec +
+      ")"
+      " VALUES (:playlist, :position, :type, :library_id, :radio_service, " +
+      Song::kBindSpec + ")");
+  QSqlQuery remove(db);
+  remove.prepare(
+      "DELETE FROM playlist_items"
+      " WHERE playlist = :playlist AND position >= :first"
+      " AND position <= :last");
+  QSqlQuery update(db);
+  update.prepare(
+      "UPDATE playlist_items SET"
+      " type = :type, library_id = :library_id,"
+      " radio_service = :radio_service, " +
+      Song::kUpdateSpec +
+      " WHERE playlist = :playlist AND position = :position");
+
+  // Positions are kept kPositionGap apart, so items can be inserted between
+  // two others without renumbering the ones after them.
+  for (const Change& change : changes) {
+    switch (change.type) {
+      case Change::Type_Insert: {
+        const int count = change.items.count();
+        if (change.row < 0 || change.row > positions->count()) return false;
+
+        QList<qint64> new_positions;
+        if (change.row == positions->count()) {
+          const qint64 first =
+              positions->isEmpty() ? 0 : positions->last() + kPositionGap;
+          for (int i = 0; i < count; ++i) {
+            new_positions << first + i * kPositionGap;
+          }
+        } else if (change.row == 0) {
+          const qint64 next = positions->first();
+          for (int i = 0; i < count; ++i) {
+            new_positions << next - (count - i) * kPositionGap;
+          }
+        } else {
+          const qint64 previous = (*positions)[change.row - 1];
+          const qint64 step =
+              ((*positions)[change.row] - previous) / (count + 1);
+          // No room left between these two items - renumber them all.
+          if (step < 1) return false;
+          for (int i = 0; i < count; ++i) {
+            new_positions << previous + (i + 1) * step;
+          }
+        }
+
+        for (int i = 0; i < count; ++i) {
+          insert.bindValue(":playlist", playlist);
+          insert.bindValue(":position", new_positions[i]);
+          change.items[i]->BindToQuery(&insert);
+          insert.exec();
+          if (db_->CheckErrors(insert)) return false;
+          positions->insert(change.row + i, new_positions[i]);
+        }
+        break;
+      }
+
+      case Change::Type_Remove:
+        if (change.count <= 0 || change.row < 0 ||
+            change.row + change.count > positions->count()) {
+          return false;
+        }
+
+        remove.bindValue(":playlist", playlist);
+        remove.bindValue(":first", (*positions)[change.row]);
+        remove.bindValue(":last", (*positions)[change.row + change.count - 1]);
+        remove.exec();
+        if (db_->CheckErrors(remove)) return false;
+        if (remove.numRowsAffected() != change.count) return false;
+
+        positions->erase(positions->begin() + change.row,
+                         positions->begin() + change.row + change.count);
+        break;
+
+      case Change::Type_Update:
+        if (change.row < 0 || change.row >= positions->count()) return false;
+
+        update.bindValue(":playlist", playlist);
+        update.bindValue(":position", (*positions)[change.row]);
+        change.items[0]->BindToQuery(&update);
+        update.exec();
+        if (db_->CheckErrors(update)) return false;
+        if (update.numRowsAffected() != 1) return false;
+        break;
+
+      case Change::Type_Reset:
+        return false;
+    }
+  }
+
+  return positions->count() == expected_count;
+}
+
+bool PlaylistBackend::RewritePlaylistItems(int playlist,
+                                           const PlaylistItemList& items,
+                                           QSqlDatabase& db,
+                                           QList<qint64>* positions) {
+  QSqlQuery clear(db);
+  clear.prepare("DELETE FROM playlist_items WHERE playlist = :playlist");
+  QSqlQuery insert(db);
+  insert.prepare(
+      "INSERT INTO playlist_items"
+      " (playlist, position, type, library_id, radio_service, " +
+      Song::kColumnSpec +
+      ")"
+      " VALUES (:playlist, :position, :type, :library_id, :radio_service, " +
+      Song::kBindSpec + ")");
+
+  // Clear the existing items in the playlist
+  clear.bindValue(":playlist", playlist);
+  clear.exec();
+  if (db_->CheckErrors(clear)) return false;
+
+  // Save the new ones
+  positions->clear();
+  qint64 position = 0;
+  for (PlaylistItemPtr item : items) {
+    *positions << position;
+    insert.bindValue(":playlist", playlist);
+    insert.bindValue(":position", position);
+    position += kPositionGap;
+    item->BindToQuery(&insert);
+
+    insert.exec();
+    db_->CheckErrors(insert);
+  }
+
+  return true;
 }
 
 int PlaylistBackend::CreatePlaylist(const QString& name,
@@ -380,6 +562,8 @@ void PlaylistBackend::RemovePlaylist(int id) {
   if (db_->CheckErrors(delete_items)) return;
 
   transaction.Commit();
+  delta_saves_.remove(id);
+  item_positions_.remove(id);
 }
 
 void PlaylistBackend::RenamePlaylist(int id, const QString& new_name) {
@@ -20,9 +20,12 @@
 
 #include <QHash>
 #include <QList>
+#include <QMetaType>
 #include <QMutex>
 #include <QObject>
+#include <QSqlDatabase>
 
+#include "playlistchange.h"
 #include "playlistitem.h"
 #include "smartplaylists/generator_fwd.h"
 
@@ -34,6 +37,8 @@ class PlaylistBackend : public QObject {
 
  public:
   Q_INVOKABLE PlaylistBackend(Application* app, QObject* parent = nullptr);
+  // Used by tests, which don't have an Application.
+  explicit PlaylistBackend(Database* db, QObject* parent = nullptr);
 
   struct Playlist {
     Playlist() : id(-1), favorite(false), last_played(0) {}
@@ -53,7 +58,12 @@ class PlaylistBackend : public QObject {
   };
   typedef QList<Playlist> PlaylistList;
 
+  typedef PlaylistChange Change;
+  typedef PlaylistChangeList ChangeList;
+
   static const int kSongTableJoins;
+  static const int kDeltaSavesBetweenCompactions;
+  static const qint64 kPositionGap;
 
   PlaylistList GetAllPlaylists();
   PlaylistList GetAllOpenPlaylists();
@@ -68,6 +78,7 @@ class PlaylistBackend : public QObject {
 
   int CreatePlaylist(const QString& name, const QString& special_type);
   void SavePlaylistAsync(int playlist, const PlaylistItemList& items,
+                         const PlaylistBackend::ChangeList& changes,
                          int last_played,
                          smart_playlists::GeneratorPtr dynamic);
   void RenamePlaylist(int id, const QString& new_name);
@@ -77,7 +88,11 @@ class PlaylistBackend : public QObject {
   Application* app() const { return app_; }
 
  public slots:
+  // Writes only the given changes to the database when possible, falling
+  // back to rewriting all the items if the changes don't apply cleanly or
+  // the playlist is due to be compacted.
   void SavePlaylist(int playlist, const PlaylistItemList& items,
+                    const PlaylistBackend::ChangeList& changes,
                     int last_played, smart_playlists::GeneratorPtr dynamic);
 
  private:
@@ -88,6 +103,14 @@ class PlaylistBackend : public QObject {
 
   QSqlQuery GetPlaylistRows(int playlist);
 
+  bool LoadItemPositions(int playlist, QSqlDatabase& db,
+                         QList<qint64>* positions);
+  bool ApplyPlaylistChanges(int playlist, const ChangeList& changes,
+                            int expected_count, QSqlDatabase& db,
+                            QList<qint64>* positions);
+  bool RewritePlaylistItems(int playlist, const PlaylistItemList& items,
+                            QSqlDatabase& db, QList<qint64>* positions);
+
   Song NewSongFromQuery(const SqlRow& row,
                         std::shared_ptr<NewSongFromQueryState> state);
   PlaylistItemPtr NewPlaylistItemFromQuery(
@@ -104,6 +127,13 @@ class PlaylistBackend : public QObject {
 
   Application* app_;
   Database* db_;
+
+  // Number of delta saves made to each playlist since it was last rewritten.
+  QHash<int, int> delta_saves_;
+
+  // The position column of each saved playlist's items, in playlist order.
+  // Kept after every save so a delta save doesn't have to read them back.
+  QHash<int, QList<qint64> > item_positions_;
 };
 
 #endif  // PLAYLISTBACKEND_H
@@ -0,0 +1,53 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PLAYLISTCHANGE_H
+#define PLAYLISTCHANGE_H
+
+#include <QList>
+#include <QMetaType>
+
+#include "playlistitem.h"
+
+// A change made to the items in a playlist since it was last saved.  Rows
+// refer to the state of the playlist at the time the change was made, so a
+// list of changes has to be applied in order.
+struct PlaylistChange {
+  enum Type {
+    // items were inserted at row.
+    Type_Insert,
+    // count items were removed starting at row.
+    Type_Remove,
+    // The item at row was replaced or its metadata changed.
+    Type_Update,
+    // The whole playlist was reordered - its items have to be rewritten.
+    Type_Reset,
+  };
+
+  PlaylistChange(Type type = Type_Reset, int row = 0, int count = 0,
+                 const PlaylistItemList& items = PlaylistItemList())
+      : type(type), row(row), count(count), items(items) {}
+
+  Type type;
+  int row;
+  int count;
+  PlaylistItemList items;
+};
+typedef QList<PlaylistChange> PlaylistChangeList;
+
+Q_DECLARE_METATYPE(PlaylistChangeList);
+
+#endif  // PLAYLISTCHANGE_H
@@ -18,12 +18,17 @@
 #include "playlistfilter.h"
 #include "playlistfilterparser.h"
 
+#include <QFuture>
+#include <QtConcurrentRun>
 #include <QtDebug>
 
+const int PlaylistFilter::kRowsPerChunk = 4096;
+
 PlaylistFilter::PlaylistFilter(QObject* parent)
     : QSortFilterProxyModel(parent),
       filter_tree_(new NopFilter),
-      query_hash_(0) {
+      snapshot_dirty_(true),
+      matches_dirty_(true) {
   setDynamicSortFilter(true);
 
   column_names_["title"] = Playlist::Column_Title;
@@ -52,6 +57,8 @@ PlaylistFilter::PlaylistFilter(QObject* parent)
                      << Playlist::Column_OriginalYear << Playlist::Column_Score
                      << Playlist::Column_BPM << Playlist::Column_Bitrate
                      << Playlist::Column_Rating;
+
+  filter_columns_ = column_names_.values().toSet().toList();
 }
 
 PlaylistFilter::~PlaylistFilter() {}
@@ -61,19 +68,158 @@ void PlaylistFilter::sort(int column, Qt::SortOrder order) {
   sourceModel()->sort(column, order);
 }
 
+void PlaylistFilter::setSourceModel(QAbstractItemModel* source_model) {
+  if (sourceModel()) {
+    disconnect(sourceModel(), SIGNAL(dataChanged(QModelIndex, QModelIndex)),
+               this, SLOT(SourceDataChanged(QModelIndex, QModelIndex)));
+    disconnect(sourceModel(), SIGNAL(rowsInserted(QModelIndex, int, int)),
+               this, SLOT(InvalidateSnapshot()));
+    disconnect(sourceModel(), SIGNAL(rowsRemoved(QModelIndex, int, int)),
+               this, SLOT(InvalidateSnapshot()));
+    disconnect(sourceModel(),
+               SIGNAL(rowsMoved(QModelIndex, int, int, QModelIndex, int)),
+               this, SLOT(InvalidateSnapshot()));
+    disconnect(sourceModel(), SIGNAL(layoutChanged()), this,
+               SLOT(InvalidateSnapshot()));
+    disconnect(sourceModel(), SIGNAL(modelReset()), this,
+               SLOT(InvalidateSnapshot()));
+  }
+
+  // These are connected before QSortFilterProxyModel connects its own slots,
+  // so the snapshot is up to date by the time it calls filterAcceptsRow().
+  if (source_model) {
+    connect(source_model, SIGNAL(dataChanged(QModelIndex, QModelIndex)),
+            SLOT(SourceDataChanged(QModelIndex, QModelIndex)));
+    connect(source_model, SIGNAL(rowsInserted(QModelIndex, int, int)),
+            SLOT(InvalidateSnapshot()));
+    connect(source_model, SIGNAL(rowsRemoved(QModelIndex, int, int)),
+            SLOT(InvalidateSnapshot()));
+    connect(source_model,
+            SIGNAL(rowsMoved(QModelIndex, int, int, QModelIndex, int)),
+            SLOT(InvalidateSnapshot()));
+    connect(source_model, SIGNAL(layoutChanged()), SLOT(InvalidateSnapshot()));
+    connect(source_model, SIGNAL(modelReset()), SLOT(InvalidateSnapshot()));
+  }
+
+  InvalidateSnapshot();
+  QSortFilterProxyModel::setSourceModel(source_model);
+}
+
+void PlaylistFilter::InvalidateSnapshot() { snapshot_dirty_ = true; }
+
+void PlaylistFilter::SourceDataChanged(const QModelIndex& top_left,
+                                       const QModelIndex& bottom_right) {
+  if (snapshot_dirty_) return;
+
+  // Don't bother keeping the snapshot up to date if nothing's using it.
+  if (filter_tree_->type() == FilterTree::Nop || top_left.row() < 0 ||
+      bottom_right.row() >= snapshot_.row_count()) {
+    snapshot_dirty_ = true;
+    return;
+  }
+
+  snapshot_.UpdateRows(sourceModel(), top_left.row(), bottom_right.row());
+  if (!matches_dirty_) {
+    for (int row = top_left.row(); row <= bottom_right.row(); ++row) {
+      matches_[row] = filter_tree_->accept(row, snapshot_);
+    }
+  }
+}
+
 bool PlaylistFilter::filterAcceptsRow(int row,
                                       const QModelIndex& parent) const {
   QString filter = filterRegExp().pattern();
 
-  uint hash = qHash(filter);
-  if (hash != query_hash_) {
+  if (filter != query_) {
+    const bool refine =
+        !snapshot_dirty_ && !matches_dirty_ && IsRefinement(query_, filter);
+
     // Parse the query
     FilterParser p(filter, column_names_, numerical_columns_);
     filter_tree_.reset(p.parse());
+    query_ = filter;
+
+    if (refine) {
+      UpdateMatches(true);
+    } else {
+      matches_dirty_ = true;
+    }
+  }
+
+  if (filter_tree_->type() == FilterTree::Nop) return true;
+
+  if (snapshot_dirty_) {
+    snapshot_.Build(sourceModel(), filter_columns_);
+    snapshot_dirty_ = false;
+    matches_dirty_ = true;
+  }
 
-    query_hash_ = hash;
+  if (matches_dirty_) {
+    UpdateMatches(false);
+    matches_dirty_ = false;
   }
 
   // Test the row
-  return filter_tree_->accept(row, parent, sourceModel());
+  if (parent.isValid() || row >= matches_.count()) {
+    return filter_tree_->accept(row, parent, sourceModel());
+  }
+  return matches_[row];
+}
+
+void PlaylistFilter::UpdateMatches(bool refine) const {
+  const int row_count = snapshot_.row_count();
+  if (!refine) {
+    matches_.fill(true, row_count);
+  }
+
+  if (row_count <= kRowsPerChunk) {
+    UpdateMatchesInRange(0, row_count, refine);
+    return;
+  }
+
+  // Make sure matches_ isn't shared before the chunks start writing to it.
+  matches_.detach();
+
+  QList<QFuture<void> > chunks;
+  for (int begin = 0; begin < row_count; begin += kRowsPerChunk) {
+    chunks << QtConcurrent::run(this, &PlaylistFilter::UpdateMatchesInRange,
+                                begin, qMin(begin + kRowsPerChunk, row_count),
+                                refine);
+  }
+  for (QFuture<void>& chunk : chunks) {
+    chunk.waitForFinished();
+  }
+}
+
+void PlaylistFilter::UpdateMatchesInRange(int begin, int end,
+                                          bool refine) const {
+  bool* matches = matches_.data();
+  for (int row = begin; row < end; ++row) {
+    if (refine && !matches[row]) continue;
+    matches[row] = filter_tree_->accept(row, snapshot_);
+  }
+}
+
+bool PlaylistFilter::IsRefinement(const QString& old_filter,
+                                  const QString& new_filter) {
+  if (old_filter.trimmed().isEmpty() || !new_filter.startsWith(old_filter)) {
+    return false;
+  }
+
+  // Only plain words are safe.  Typing more of a word can only make it match
+  // fewer rows, and starting another word ANDs it with the ones before.
+  // Anything else - columns, operators, quotes, negation and OR - can make
+  // rows that didn't match before match now.
+  for (const QChar& c : new_filter) {
+    if (c == ':' || c == '-' || c == '(' || c == ')' || c == '"' ||
+        c == '<' || c == '>' || c == '=' || c == '!') {
+      return false;
+    }
+  }
+  for (const QString& word :
+       new_filter.split(QRegExp("\\s+"), QString::SkipEmptyParts)) {
+    if (word == "OR" || word == "AND") return false;
+  }
+
+  return true;
 }
@@ -24,8 +24,9 @@
 #include "playlist.h"
 
 #include <QSet>
+#include <QVector>
 
-class FilterTree;
+#include "playlistfilterparser.h"
 
 class PlaylistFilter : public QSortFilterProxyModel {
   Q_OBJECT
@@ -34,20 +35,50 @@ class PlaylistFilter : public QSortFilterProxyModel {
   PlaylistFilter(QObject* parent = nullptr);
   ~PlaylistFilter();
 
+  // Rows are tested in chunks of this many on the thread pool.
+  static const int kRowsPerChunk;
+
   // QAbstractItemModel
   void sort(int column, Qt::SortOrder order = Qt::AscendingOrder);
 
+  // QAbstractProxyModel
+  void setSourceModel(QAbstractItemModel* source_model);
+
   // QSortFilterProxyModel
   // public so Playlist::NextVirtualIndex and friends can get at it
   bool filterAcceptsRow(int source_row, const QModelIndex& source_parent) const;
 
+  // Returns true if every row matching new_filter is sure to match old_filter
+  // as well, so only the rows that matched before need testing again.
+  static bool IsRefinement(const QString& old_filter,
+                           const QString& new_filter);
+
+ private slots:
+  void SourceDataChanged(const QModelIndex& top_left,
+                         const QModelIndex& bottom_right);
+  void InvalidateSnapshot();
+
  private:
+  // Tests rows against filter_tree_ and stores the results in matches_.  If
+  // refine is true only rows that matched last time are tested again.
+  void UpdateMatches(bool refine) const;
+  void UpdateMatchesInRange(int begin, int end, bool refine) const;
+
   // Mutable because they're modified from filterAcceptsRow() const
   mutable QScopedPointer<FilterTree> filter_tree_;
-  mutable uint query_hash_;
+  mutable QString query_;
+
+  // The playlist's metadata, which the filter is evaluated against instead of
+  // the model.  It's only built while there's a filter.
+  mutable FilterSnapshot snapshot_;
+  mutable bool snapshot_dirty_;
+  // Whether each row of the snapshot matches filter_tree_.
+  mutable QVector<bool> matches_;
+  mutable bool matches_dirty_;
 
   QMap<QString, int> column_names_;
   QSet<int> numerical_columns_;
+  QList<int> filter_columns_;
 };
 
 #endif  // PLAYLISTFILTER_H
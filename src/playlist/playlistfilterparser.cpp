@@ -21,6 +21,34 @@
 
 #include <QAbstractItemModel>
 
+void FilterSnapshot::Build(const QAbstractItemModel* model,
+                           const QList<int>& columns) {
+  column_ids_ = columns;
+  row_count_ = model->rowCount();
+
+  int max_column = -1;
+  for (int column : columns) max_column = qMax(max_column, column);
+
+  columns_.clear();
+  columns_.resize(max_column + 1);
+  for (int column : columns) {
+    columns_[column].resize(row_count_);
+  }
+
+  if (row_count_) UpdateRows(model, 0, row_count_ - 1);
+}
+
+void FilterSnapshot::UpdateRows(const QAbstractItemModel* model, int first,
+                                int last) {
+  // The same strings FilterTree::accept() gets from the model.
+  for (int column : column_ids_) {
+    QVector<QString>& values = columns_[column];
+    for (int row = first; row <= last; ++row) {
+      values[row] = model->index(row, column).data().toString().toLower();
+    }
+  }
+}
+
 class SearchTermComparator {
  public:
   virtual ~SearchTermComparator() {}
@@ -196,6 +224,12 @@ class FilterTerm : public FilterTree {
     }
     return false;
   }
+  virtual bool accept(int row, const FilterSnapshot& snapshot) const {
+    for (int i : columns_) {
+      if (cmp_->Matches(snapshot.value(row, i))) return true;
+    }
+    return false;
+  }
   virtual FilterType type() { return Term; }
 
  private:
@@ -215,6 +249,9 @@ class FilterColumnTerm : public FilterTree {
     QModelIndex idx(model->index(row, col, parent));
     return cmp_->Matches(idx.data().toString().toLower());
   }
+  virtual bool accept(int row, const FilterSnapshot& snapshot) const {
+    return cmp_->Matches(snapshot.value(row, col));
+  }
   virtual FilterType type() { return Column; }
 
  private:
@@ -230,6 +267,9 @@ class NotFilter : public FilterTree {
                       const QAbstractItemModel* const model) const {
     return !child_->accept(row, parent, model);
   }
+  virtual bool accept(int row, const FilterSnapshot& snapshot) const {
+    return !child_->accept(row, snapshot);
+  }
   virtual FilterType type() { return Not; }
 
  private:
@@ -247,6 +287,12 @@ class OrFilter : public FilterTree {
     }
     return false;
   }
+  virtual bool accept(int row, const FilterSnapshot& snapshot) const {
+    for (FilterTree* child : children_) {
+      if (child->accept(row, snapshot)) return true;
+    }
+    return false;
+  }
   FilterType type() { return Or; }
 
  private:
@@ -264,6 +310,12 @@ class AndFilter : public FilterTree {
     }
     return true;
   }
+  virtual bool accept(int row, const FilterSnapshot& snapshot) const {
+    for (FilterTree* child : children_) {
+      if (!child->accept(row, snapshot)) return false;
+    }
+    return true;
+  }
   FilterType type() { return And; }
 
  private:
@@ -22,15 +22,42 @@
 #include <QModelIndex>
 #include <QSet>
 #include <QString>
+#include <QVector>
 
 class QAbstractItemModel;
 
+// Lower-cased text of the columns a filter can look at, copied out of a model
+// once and stored column by column.  A filter can then be tested against
+// every row as many times as it likes without going through
+// QAbstractItemModel::data().  Reading from several threads at once is safe.
+class FilterSnapshot {
+ public:
+  FilterSnapshot() : row_count_(0) {}
+
+  void Build(const QAbstractItemModel* model, const QList<int>& columns);
+  // Copies rows first to last (inclusive) from the model again.
+  void UpdateRows(const QAbstractItemModel* model, int first, int last);
+
+  int row_count() const { return row_count_; }
+  const QString& value(int row, int column) const {
+    return columns_[column][row];
+  }
+
+ private:
+  QList<int> column_ids_;
+  // Indexed by column, then row.  Columns not in column_ids_ are empty.
+  QVector<QVector<QString> > columns_;
+  int row_count_;
+};
+
 // structure for filter parse tree
 class FilterTree {
  public:
   virtual ~FilterTree() {}
   virtual bool accept(int row, const QModelIndex& parent,
                       const QAbstractItemModel* const model) const = 0;
+  // Same as above, but reads the row from a snapshot of the model.
+  virtual bool accept(int row, const FilterSnapshot& snapshot) const = 0;
   enum FilterType { Nop = 0, Or, And, Not, Column, Term };
   virtual FilterType type() = 0;
 };
@@ -42,6 +69,9 @@ class NopFilter : public FilterTree {
                       const QAbstractItemModel* const model) const {
     return true;
   }
+  virtual bool accept(int row, const FilterSnapshot& snapshot) const {
+    return true;
+  }
   virtual FilterType type() { return Nop; }
 };
 
@@ -0,0 +1,357 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "playlistsorter.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <QVector>
+
+#include "playlist.h"
+
+// QString::localeAwareCompare uses strcoll here, so strxfrm gives keys that
+// sort the same way.  Elsewhere the lower-cased strings are kept and compared
+// with localeAwareCompare during the sort.
+#if defined(Q_OS_UNIX) && !defined(Q_OS_MAC)
+#define HAVE_STRXFRM_COLLATION
+#endif
+
+struct PlaylistSorter::Entry {
+  // Index into the list of keys.
+  int index;
+  // Where this item's string is in the text buffer.
+  int text_offset;
+  int text_length;
+  double numbers[2];
+};
+
+namespace {
+
+// Big endian, so the bytes compare in the same order as QString's operator<.
+void AppendUtf16(const QString& text, QByteArray* out) {
+  const int offset = out->size();
+  out->resize(offset + text.length() * 2);
+  char* data = out->data() + offset;
+  for (const QChar& c : text) {
+    *data++ = static_cast<char>(c.unicode() >> 8);
+    *data++ = static_cast<char>(c.unicode() & 0xff);
+  }
+}
+
+int CompareBytes(const char* a, int a_length, const char* b, int b_length) {
+  const int ret = memcmp(a, b, qMin(a_length, b_length));
+  if (ret != 0) return ret;
+  return a_length - b_length;
+}
+
+}  // namespace
+
+PlaylistSorter::PlaylistSorter(int column, Qt::SortOrder order)
+    : column_(column),
+      order_(order),
+      has_text_(false),
+      text_is_collated_(false),
+      text_first_(true),
+      number_count_(0) {
+  switch (column) {
+    case Playlist::Column_Album:
+      // Then disc and track
+      has_text_ = true;
+      text_is_collated_ = true;
+      number_count_ = 2;
+      break;
+
+    case Playlist::Column_Filename:
+      // Directory depth, then path
+      has_text_ = true;
+      text_is_collated_ = true;
+      text_first_ = false;
+      number_count_ = 1;
+      break;
+
+    case Playlist::Column_Title:
+    case Playlist::Column_Artist:
+    case Playlist::Column_Genre:
+    case Playlist::Column_AlbumArtist:
+    case Playlist::Column_Composer:
+    case Playlist::Column_Performer:
+    case Playlist::Column_Grouping:
+    case Playlist::Column_Comment:
+      has_text_ = true;
+      text_is_collated_ = true;
+      break;
+
+    case Playlist::Column_BaseFilename:
+    case Playlist::Column_Source:
+      has_text_ = true;
+      break;
+
+    case Playlist::Column_Length:
+    case Playlist::Column_Track:
+    case Playlist::Column_Disc:
+    case Playlist::Column_Year:
+    case Playlist::Column_OriginalYear:
+    case Playlist::Column_Rating:
+    case Playlist::Column_PlayCount:
+    case Playlist::Column_SkipCount:
+    case Playlist::Column_LastPlayed:
+    case Playlist::Column_Score:
+    case Playlist::Column_BPM:
+    case Playlist::Column_Bitrate:
+    case Playlist::Column_Samplerate:
+    case Playlist::Column_Filesize:
+    case Playlist::Column_Filetype:
+    case Playlist::Column_DateModified:
+    case Playlist::Column_DateCreated:
+      number_count_ = 1;
+      break;
+  }
+}
+
+QByteArray PlaylistSorter::CollationKey(const QString& text) {
+  const QString lower = text.toLower();
+  QByteArray ret;
+
+#ifdef HAVE_STRXFRM_COLLATION
+  const QByteArray local = lower.toLocal8Bit();
+  const size_t length = strxfrm(nullptr, local.constData(), 0);
+  ret.resize(length + 1);
+  strxfrm(ret.data(), local.constData(), length + 1);
+
+  // localeAwareCompare falls back to comparing the strings themselves when
+  // strcoll says they're equal.  strxfrm's terminating null stays in the key
+  // so one that's a prefix of another still sorts first.
+  AppendUtf16(lower, &ret);
+#else
+  ret = QByteArray(reinterpret_cast<const char*>(lower.constData()),
+                   lower.length() * sizeof(QChar));
+#endif
+
+  return ret;
+}
+
+PlaylistSorter::Key PlaylistSorter::ExtractKey(
+    const PlaylistItemPtr& item) const {
+  Key key;
+  double* numbers = key.numbers;
+
+  if (column_ == Playlist::Column_Filename) {
+    // This comes from the item rather than its metadata.
+    key.text = item->Url().path();
+    numbers[0] = key.text.count('/');
+  } else {
+    const Song song = item->Metadata();
+
+    switch (column_) {
+      case Playlist::Column_Title:
+        key.text = song.title();
+        break;
+      case Playlist::Column_Artist:
+        key.text = song.artist();
+        break;
+      case Playlist::Column_Album:
+        key.text = song.album();
+        numbers[0] = song.disc();
+        numbers[1] = song.track();
+        break;
+      case Playlist::Column_Genre:
+        key.text = song.genre();
+        break;
+      case Playlist::Column_AlbumArtist:
+        key.text = song.playlist_albumartist();
+        break;
+      case Playlist::Column_Composer:
+        key.text = song.composer();
+        break;
+      case Playlist::Column_Performer:
+        key.text = song.performer();
+        break;
+      case Playlist::Column_Grouping:
+        key.text = song.grouping();
+        break;
+      case Playlist::Column_Comment:
+        key.text = song.comment();
+        break;
+
+      case Playlist::Column_BaseFilename:
+        key.text = song.basefilename();
+        break;
+      case Playlist::Column_Source:
+        // Encoded URLs are ASCII, so they sort the same as UTF-16.
+        key.text = QString::fromLatin1(song.url().toEncoded());
+        break;
+
+      case Playlist::Column_Length:
+        numbers[0] = song.length_nanosec();
+        break;
+      case Playlist::Column_Track:
+        numbers[0] = song.track();
+        break;
+      case Playlist::Column_Disc:
+        numbers[0] = song.disc();
+        break;
+      case Playlist::Column_Year:
+        numbers[0] = song.year();
+        break;
+      case Playlist::Column_OriginalYear:
+        numbers[0] = song.originalyear();
+        break;
+      case Playlist::Column_Rating:
+        numbers[0] = song.rating();
+        break;
+      case Playlist::Column_PlayCount:
+        numbers[0] = song.playcount();
+        break;
+      case Playlist::Column_SkipCount:
+        numbers[0] = song.skipcount();
+        break;
+      case Playlist::Column_LastPlayed:
+        numbers[0] = song.lastplayed();
+        break;
+      case Playlist::Column_Score:
+        numbers[0] = song.score();
+        break;
+      case Playlist::Column_BPM:
+        numbers[0] = song.bpm();
+        break;
+      case Playlist::Column_Bitrate:
+        numbers[0] = song.bitrate();
+        break;
+      case Playlist::Column_Samplerate:
+        numbers[0] = song.samplerate();
+        break;
+      case Playlist::Column_Filesize:
+        numbers[0] = song.filesize();
+        break;
+      case Playlist::Column_Filetype:
+        numbers[0] = song.filetype();
+        break;
+      case Playlist::Column_DateModified:
+        numbers[0] = song.mtime();
+        break;
+      case Playlist::Column_DateCreated:
+        numbers[0] = song.ctime();
+        break;
+    }
+  }
+
+  return key;
+}
+
+int PlaylistSorter::Compare(const Entry& a, const Entry& b,
+                            const QByteArray& text) const {
+  auto compare_text = [this, &a, &b, &text]() -> int {
+    if (!has_text_) return 0;
+
+    const char* a_text = text.constData() + a.text_offset;
+    const char* b_text = text.constData() + b.text_offset;
+
+#ifndef HAVE_STRXFRM_COLLATION
+    if (text_is_collated_) {
+      return QString::localeAwareCompare(
+          QString::fromRawData(reinterpret_cast<const QChar*>(a_text),
+                               a.text_length / sizeof(QChar)),
+          QString::fromRawData(reinterpret_cast<const QChar*>(b_text),
+                               b.text_length / sizeof(QChar)));
+    }
+#endif
+
+    return CompareBytes(a_text, a.text_length, b_text, b.text_length);
+  };
+
+  if (text_first_) {
+    const int ret = compare_text();
+    if (ret != 0) return ret;
+  }
+
+  for (int i = 0; i < number_count_; ++i) {
+    if (a.numbers[i] < b.numbers[i]) return -1;
+    if (a.numbers[i] > b.numbers[i]) return 1;
+  }
+
+  if (!text_first_) return compare_text();
+  return 0;
+}
+
+PlaylistItemList PlaylistSorter::Sort(const PlaylistItemList& items,
+                                      int first) const {
+  if (items.count() - first <= 1) return items;
+  return Reorder(items, first, SortKeys(ExtractKeys(items, first)));
+}
+
+PlaylistSorter::KeyList PlaylistSorter::ExtractKeys(
+    const PlaylistItemList& items, int first) const {
+  KeyList ret;
+  ret.reserve(qMax(0, items.count() - first));
+  for (int i = first; i < items.count(); ++i) {
+    ret << ExtractKey(items[i]);
+  }
+  return ret;
+}
+
+QVector<int> PlaylistSorter::SortKeys(const KeyList& keys) const {
+  // All the keys live in one array, and all their strings in one buffer.
+  QVector<Entry> entries(keys.count());
+  QByteArray text;
+  for (int i = 0; i < keys.count(); ++i) {
+    const Key& key = keys[i];
+    Entry* entry = &entries[i];
+    entry->index = i;
+    entry->numbers[0] = key.numbers[0];
+    entry->numbers[1] = key.numbers[1];
+    entry->text_offset = text.size();
+    if (has_text_ && text_is_collated_) {
+      text.append(CollationKey(key.text));
+    } else if (has_text_) {
+      AppendUtf16(key.text, &text);
+    }
+    entry->text_length = text.size() - entry->text_offset;
+  }
+
+  // Swapping the arguments for descending order keeps equal items in the
+  // order they were in, like Playlist::CompareItems does.
+  if (order_ == Qt::AscendingOrder) {
+    std::stable_sort(entries.begin(), entries.end(),
+                     [this, &text](const Entry& a, const Entry& b) {
+      return Compare(a, b, text) < 0;
+    });
+  } else {
+    std::stable_sort(entries.begin(), entries.end(),
+                     [this, &text](const Entry& a, const Entry& b) {
+      return Compare(b, a, text) < 0;
+    });
+  }
+
+  QVector<int> ret;
+  ret.reserve(entries.count());
+  for (const Entry& entry : entries) {
+    ret << entry.index;
+  }
+  return ret;
+}
+
+PlaylistItemList PlaylistSorter::Reorder(const PlaylistItemList& items,
+                                         int first,
+                                         const QVector<int>& order) {
+  PlaylistItemList ret;
+  ret.reserve(items.count());
+  ret.append(items.mid(0, first));
+  for (int index : order) {
+    ret << items[first + index];
+  }
+  return ret;
+}
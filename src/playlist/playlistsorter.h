@@ -0,0 +1,83 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PLAYLIST_PLAYLISTSORTER_H_
+#define PLAYLIST_PLAYLISTSORTER_H_
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+#include "playlistitem.h"
+
+// Sorts playlist items by one of the playlist's columns, in the same order
+// as Playlist::CompareItems.  Everything the sort looks at is copied out of
+// each item once up front by ExtractKeys(), so the sort itself never touches
+// the items.  Strings are then turned into collation keys that can be
+// compared byte by byte.  Sorting by album also sorts by disc and track, and
+// sorting by filename puts shallower paths first, all in one pass.
+//
+// ExtractKeys() reads the items' metadata, so it has to be called on the
+// thread that owns them.  SortKeys() only uses the copied values and can be
+// called from any thread.
+class PlaylistSorter {
+ public:
+  PlaylistSorter(int column, Qt::SortOrder order);
+
+  // The values one item is sorted by.
+  struct Key {
+    Key() { numbers[0] = numbers[1] = 0; }
+
+    QString text;
+    double numbers[2];
+  };
+  typedef QVector<Key> KeyList;
+
+  // Returns items with everything from first onwards sorted.  The items
+  // before first are left where they are.
+  PlaylistItemList Sort(const PlaylistItemList& items, int first = 0) const;
+
+  // The same as Sort(), split so the slow part can run on another thread.
+  // SortKeys() returns the indexes of the keys in sorted order, and Reorder()
+  // puts the items from first onwards in that order.
+  KeyList ExtractKeys(const PlaylistItemList& items, int first) const;
+  QVector<int> SortKeys(const KeyList& keys) const;
+  static PlaylistItemList Reorder(const PlaylistItemList& items, int first,
+                                  const QVector<int>& order);
+
+ private:
+  struct Entry;
+
+  // Two keys compare as bytes the same way the lower-cased strings compare
+  // with QString::localeAwareCompare.  Where the platform can't do that the
+  // key is just the lower-cased string, and Compare() uses
+  // localeAwareCompare on it.
+  static QByteArray CollationKey(const QString& text);
+
+  Key ExtractKey(const PlaylistItemPtr& item) const;
+  int Compare(const Entry& a, const Entry& b, const QByteArray& text) const;
+
+  int column_;
+  Qt::SortOrder order_;
+
+  // What the key for column_ is made of.
+  bool has_text_;
+  bool text_is_collated_;
+  bool text_first_;
+  int number_count_;
+};
+
+#endif  // PLAYLIST_PLAYLISTSORTER_H_
@@ -276,9 +276,10 @@ void Ripper::SetupProgressInterval() {
 
 void Ripper::UpdateProgress() {
   int progress = (finished_success_ + finished_failed_) * 100;
-  QMap<QString, float> current_jobs = transcoder_->GetProgress();
-  for (float value : current_jobs.values()) {
-    progress += qBound(0, static_cast<int>(value * 100), 99);
+  QMap<QString, Transcoder::JobProgress> current_jobs =
+      transcoder_->GetProgress();
+  for (const Transcoder::JobProgress& job : current_jobs.values()) {
+    progress += qBound(0, static_cast<int>(job.progress * 100), 99);
   }
   emit Progress(progress);
   qLog(Debug) << "Progress:" << progress;
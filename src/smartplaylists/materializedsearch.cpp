@@ -0,0 +1,207 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "materializedsearch.h"
+
+#include <algorithm>
+#include <ctime>
+
+#include <QMutexLocker>
+#include <QSet>
+
+#include "library/librarybackend.h"
+
+namespace smart_playlists {
+
+const int MaterializedSearch::kMaxIdsPerQuery = 1000;
+const int MaterializedSearch::kMaxAttemptsPerSong = 8;
+
+MaterializedSearch::MaterializedSearch(LibraryBackend* backend,
+                                       const Search& search, QObject* parent)
+    : QObject(parent),
+      backend_(backend),
+      search_(search),
+      loaded_(false),
+      random_(std::time(0)) {
+  // These only remember which songs changed, so they're safe to run on the
+  // backend's thread while it still holds the database lock.
+  connect(backend_, SIGNAL(SongsDiscovered(SongList)),
+          SLOT(SongsChanged(SongList)), Qt::DirectConnection);
+  connect(backend_, SIGNAL(SongsDeleted(SongList)),
+          SLOT(SongsChanged(SongList)), Qt::DirectConnection);
+  connect(backend_, SIGNAL(SongsStatisticsChanged(SongList)),
+          SLOT(SongsChanged(SongList)), Qt::DirectConnection);
+  connect(backend_, SIGNAL(SongsRatingChanged(SongList)),
+          SLOT(SongsChanged(SongList)), Qt::DirectConnection);
+  connect(backend_, SIGNAL(DatabaseReset()), SLOT(DatabaseReset()),
+          Qt::DirectConnection);
+
+  search_.id_not_in_.clear();
+  search_.id_in_.clear();
+  search_.first_item_ = 0;
+}
+
+void MaterializedSearch::SongsChanged(const SongList& songs) {
+  QMutexLocker l(&mutex_);
+  if (!loaded_) return;
+
+  for (const Song& song : songs) {
+    if (song.id() != -1) dirty_ids_ << song.id();
+  }
+}
+
+void MaterializedSearch::DatabaseReset() {
+  QMutexLocker l(&mutex_);
+  loaded_ = false;
+  dirty_ids_.clear();
+}
+
+void MaterializedSearch::Update() {
+  QList<int> dirty_ids;
+  bool full_load = false;
+  {
+    QMutexLocker l(&mutex_);
+    if (!loaded_) {
+      // Anything that changes while the query runs is checked again next
+      // time.
+      full_load = true;
+      loaded_ = true;
+      dirty_ids_.clear();
+    } else {
+      dirty_ids.swap(dirty_ids_);
+    }
+  }
+
+  if (full_load) {
+    const QList<int> ids = backend_->FindSongIds(search_);
+
+    QMutexLocker l(&mutex_);
+    ids_.clear();
+    positions_.clear();
+    ids_.reserve(ids.count());
+    for (int id : ids) {
+      Insert(id);
+    }
+    return;
+  }
+
+  if (dirty_ids.isEmpty()) return;
+
+  // Check just the songs that changed against the search again.
+  std::sort(dirty_ids.begin(), dirty_ids.end());
+  dirty_ids.erase(std::unique(dirty_ids.begin(), dirty_ids.end()),
+                  dirty_ids.end());
+
+  QSet<int> matching;
+  Search search(search_);
+  for (int i = 0; i < dirty_ids.count(); i += kMaxIdsPerQuery) {
+    search.id_in_ = dirty_ids.mid(i, kMaxIdsPerQuery);
+    for (int id : backend_->FindSongIds(search)) {
+      matching << id;
+    }
+  }
+
+  QMutexLocker l(&mutex_);
+  for (int id : dirty_ids) {
+    if (matching.contains(id)) {
+      Insert(id);
+    } else {
+      Remove(id);
+    }
+  }
+}
+
+void MaterializedSearch::Insert(int id) {
+  if (id < 0) return;
+  if (id >= positions_.count()) {
+    const int old_count = positions_.count();
+    positions_.resize(qMax(id + 1, old_count * 2));
+    std::fill(positions_.begin() + old_count, positions_.end(), -1);
+  }
+  if (positions_[id] != -1) return;
+
+  positions_[id] = ids_.count();
+  ids_ << id;
+}
+
+void MaterializedSearch::Remove(int id) {
+  if (id < 0 || id >= positions_.count()) return;
+
+  const int position = positions_[id];
+  if (position == -1) return;
+
+  // Move the last ID into the hole.
+  const int last = ids_.last();
+  ids_[position] = last;
+  positions_[last] = position;
+  ids_.removeLast();
+  positions_[id] = -1;
+}
+
+int MaterializedSearch::count() {
+  Update();
+  QMutexLocker l(&mutex_);
+  return ids_.count();
+}
+
+bool MaterializedSearch::contains(int id) {
+  Update();
+  QMutexLocker l(&mutex_);
+  return id >= 0 && id < positions_.count() && positions_[id] != -1;
+}
+
+QList<int> MaterializedSearch::Sample(int count, const QBitArray& exclude) {
+  Update();
+  QMutexLocker l(&mutex_);
+
+  QList<int> ret;
+  if (ids_.isEmpty() || count <= 0) return ret;
+
+  auto excluded = [&exclude](int id) {
+    return id < exclude.size() && exclude.testBit(id);
+  };
+
+  // Usually the set is much bigger than the number of songs wanted and the
+  // ones excluded, so just pick IDs at random until we have enough.
+  std::uniform_int_distribution<int> distribution(0, ids_.count() - 1);
+  QSet<int> picked;
+  for (int attempt = 0;
+       attempt < count * kMaxAttemptsPerSong && ret.count() < count;
+       ++attempt) {
+    const int id = ids_[distribution(random_)];
+    if (excluded(id) || picked.contains(id)) continue;
+
+    picked << id;
+    ret << id;
+  }
+
+  if (ret.count() == count) return ret;
+
+  // Otherwise most of the set must be excluded or wanted - shuffle what's
+  // left instead.
+  QVector<int> remaining;
+  for (int id : ids_) {
+    if (!excluded(id) && !picked.contains(id)) remaining << id;
+  }
+
+  std::shuffle(remaining.begin(), remaining.end(), random_);
+  for (int i = 0; i < remaining.count() && ret.count() < count; ++i) {
+    ret << remaining[i];
+  }
+  return ret;
+}
+
+}  // namespace smart_playlists
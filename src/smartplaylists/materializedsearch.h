@@ -0,0 +1,93 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SMARTPLAYLISTS_MATERIALIZEDSEARCH_H_
+#define SMARTPLAYLISTS_MATERIALIZEDSEARCH_H_
+
+#include <random>
+
+#include <QBitArray>
+#include <QMutex>
+#include <QObject>
+#include <QVector>
+
+#include "search.h"
+#include "core/song.h"
+
+class LibraryBackend;
+
+namespace smart_playlists {
+
+// Keeps the IDs of all the songs in the library that match a Search, so
+// random and dynamic playlists can pick songs in memory instead of asking the
+// database to sort every matching row each time.
+//
+// The IDs are loaded the first time they're needed.  After that, songs the
+// LibraryBackend reports as changed are remembered and only those are checked
+// against the search again, the next time the set is used.
+//
+// Thread safe - the backend's signals can arrive on its own thread while a
+// playlist is being generated on another.
+class MaterializedSearch : public QObject {
+  Q_OBJECT
+
+ public:
+  MaterializedSearch(LibraryBackend* backend, const Search& search,
+                     QObject* parent = nullptr);
+
+  static const int kMaxIdsPerQuery;
+  static const int kMaxAttemptsPerSong;
+
+  const Search& search() const { return search_; }
+
+  // Brings the set up to date with the library.  Called by the methods below.
+  void Update();
+
+  int count();
+  bool contains(int id);
+
+  // Returns up to count different IDs from the set in a random order,
+  // skipping any whose bit is set in exclude.  exclude is indexed by ID and
+  // can be shorter than the largest ID.
+  QList<int> Sample(int count, const QBitArray& exclude);
+
+ private slots:
+  void SongsChanged(const SongList& songs);
+  void DatabaseReset();
+
+ private:
+  void Insert(int id);
+  void Remove(int id);
+
+ private:
+  LibraryBackend* backend_;
+  Search search_;
+
+  QMutex mutex_;
+  bool loaded_;
+  // Songs that have changed since the set was last updated.
+  QList<int> dirty_ids_;
+
+  QVector<int> ids_;
+  // Where each ID is in ids_, indexed by ID, or -1 if it's not there.
+  QVector<int> positions_;
+
+  std::mt19937 random_;
+};
+
+}  // namespace smart_playlists
+
+#endif  // SMARTPLAYLISTS_MATERIALIZEDSEARCH_H_
@@ -16,14 +16,19 @@
 */
 
 #include "querygenerator.h"
+#include "materializedsearch.h"
 #include "library/librarybackend.h"
 
 #include <QtDebug>
 
 namespace smart_playlists {
 
+const int QueryGenerator::kMaxIdsPerQuery = 1000;
+
 QueryGenerator::QueryGenerator() : dynamic_(false), current_pos_(0) {}
 
+QueryGenerator::~QueryGenerator() {}
+
 QueryGenerator::QueryGenerator(const QString& name, const Search& search,
                                bool dynamic)
     : search_(search), dynamic_(dynamic), current_pos_(0) {
@@ -33,13 +38,21 @@ QueryGenerator::QueryGenerator(const QString& name, const Search& search,
 void QueryGenerator::Load(const Search& search) {
   search_ = search;
   dynamic_ = false;
-  current_pos_ = 0;
+  Reset();
 }
 
 void QueryGenerator::Load(const QByteArray& data) {
   QDataStream s(data);
   s >> search_;
   s >> dynamic_;
+  Reset();
+}
+
+void QueryGenerator::Reset() {
+  candidates_.reset();
+  previous_ids_.clear();
+  previous_id_bits_.clear();
+  current_pos_ = 0;
 }
 
 QByteArray QueryGenerator::Save() const {
@@ -53,33 +66,69 @@ QByteArray QueryGenerator::Save() const {
 
 PlaylistItemList QueryGenerator::Generate() {
   previous_ids_.clear();
+  previous_id_bits_.clear();
   current_pos_ = 0;
   return GenerateMore(0);
 }
 
 PlaylistItemList QueryGenerator::GenerateMore(int count) {
   Search search_copy = search_;
-  search_copy.id_not_in_ = previous_ids_;
   if (count) {
     search_copy.limit_ = count;
   }
 
-  if (search_copy.sort_type_ != Search::Sort_Random) {
-    search_copy.first_item_ = current_pos_;
-    current_pos_ += search_copy.limit_;
+  SongList songs;
+  if (search_copy.sort_type_ == Search::Sort_Random &&
+      search_copy.limit_ != -1) {
+    songs = GenerateRandom(search_copy.limit_);
+  } else {
+    search_copy.id_not_in_ = previous_ids_;
+    if (search_copy.sort_type_ != Search::Sort_Random) {
+      search_copy.first_item_ = current_pos_;
+      current_pos_ += search_copy.limit_;
+    }
+
+    songs = backend_->FindSongs(search_copy);
   }
 
-  SongList songs = backend_->FindSongs(search_copy);
   PlaylistItemList items;
   for (const Song& song : songs) {
     items << PlaylistItemPtr(PlaylistItem::NewFromSongsTable(
                  backend_->songs_table(), song));
     previous_ids_ << song.id();
+    if (song.id() >= previous_id_bits_.size()) {
+      previous_id_bits_.resize(
+          qMax(song.id() + 1, previous_id_bits_.size() * 2));
+    }
+    previous_id_bits_.setBit(song.id());
 
     if (previous_ids_.count() > GetDynamicFuture() + GetDynamicHistory())
-      previous_ids_.removeFirst();
+      previous_id_bits_.clearBit(previous_ids_.takeFirst());
   }
   return items;
 }
 
+SongList QueryGenerator::GenerateRandom(int count) {
+  if (!candidates_) {
+    candidates_.reset(new MaterializedSearch(backend_, search_));
+  }
+
+  const QList<int> ids = candidates_->Sample(count, previous_id_bits_);
+
+  // Fetch the songs and put them back in the order they were picked.
+  QHash<int, Song> songs_by_id;
+  for (int i = 0; i < ids.count(); i += kMaxIdsPerQuery) {
+    const QList<int> chunk = ids.mid(i, kMaxIdsPerQuery);
+    for (const Song& song : backend_->GetSongsById(chunk)) {
+      songs_by_id[song.id()] = song;
+    }
+  }
+
+  SongList ret;
+  for (int id : ids) {
+    if (songs_by_id.contains(id)) ret << songs_by_id[id];
+  }
+  return ret;
+}
+
 }  // namespace
@@ -18,14 +18,21 @@
 #ifndef QUERYPLAYLISTGENERATOR_H
 #define QUERYPLAYLISTGENERATOR_H
 
+#include <memory>
+
+#include <QBitArray>
+
 #include "generator.h"
 #include "search.h"
 
 namespace smart_playlists {
 
+class MaterializedSearch;
+
 class QueryGenerator : public Generator {
  public:
   QueryGenerator();
+  ~QueryGenerator();
   QueryGenerator(const QString& name, const Search& search,
                  bool dynamic = false);
 
@@ -44,10 +51,22 @@ class QueryGenerator : public Generator {
   int GetDynamicFuture() { return search_.limit_; }
 
  private:
+  SongList GenerateRandom(int count);
+  void Reset();
+
+ private:
+  static const int kMaxIdsPerQuery;
+
   Search search_;
   bool dynamic_;
 
+  // The songs matching search_, for picking random ones without running the
+  // whole query again each time.  Created on first use.
+  std::unique_ptr<MaterializedSearch> candidates_;
+
   QList<int> previous_ids_;
+  // The same IDs as previous_ids_, as bits indexed by ID.
+  QBitArray previous_id_bits_;
   int current_pos_;
 };
 
@@ -43,9 +43,7 @@ void Search::Reset() {
   first_item_ = 0;
 }
 
-QString Search::ToSql(const QString& songs_table) const {
-  QString sql = "SELECT ROWID," + Song::kColumnSpec + " FROM " + songs_table;
-
+QStringList Search::WhereClauses() const {
   // Add search terms
   QStringList where_clauses;
   QStringList term_where_clauses;
@@ -67,11 +65,26 @@ QString Search::ToSql(const QString& songs_table) const {
     where_clauses << "(ROWID NOT IN (" + numbers + "))";
   }
 
+  if (!id_in_.isEmpty()) {
+    QString numbers;
+    for (int id : id_in_) {
+      numbers += (numbers.isEmpty() ? "" : ",") + QString::number(id);
+    }
+    where_clauses << "(ROWID IN (" + numbers + "))";
+  }
+
   // We never want to include songs that have been deleted, but are still kept
   // in the database in case the directory containing them has just been
   // unmounted.
   where_clauses << "unavailable = 0";
 
+  return where_clauses;
+}
+
+QString Search::ToSql(const QString& songs_table) const {
+  QString sql = "SELECT ROWID," + Song::kColumnSpec + " FROM " + songs_table;
+
+  const QStringList where_clauses = WhereClauses();
   if (!where_clauses.isEmpty()) {
     sql += " WHERE " + where_clauses.join(" AND ");
   }
@@ -95,6 +108,11 @@ QString Search::ToSql(const QString& songs_table) const {
   return sql;
 }
 
+QString Search::ToIdSql(const QString& songs_table) const {
+  return "SELECT ROWID FROM " + songs_table + " WHERE " +
+         WhereClauses().join(" AND ");
+}
+
 bool Search::is_valid() const {
   if (search_type_ == Type_All) return true;
   return !terms_.isEmpty();
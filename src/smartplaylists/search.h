@@ -49,10 +49,16 @@ class Search {
 
   // Not persisted, used to alter the behaviour of the query
   QList<int> id_not_in_;
+  QList<int> id_in_;
   int first_item_;
 
   void Reset();
   QString ToSql(const QString& songs_table) const;
+  // Just the IDs of the matching songs, in no particular order.
+  QString ToIdSql(const QString& songs_table) const;
+
+ private:
+  QStringList WhereClauses() const;
 };
 
 }  // namespace
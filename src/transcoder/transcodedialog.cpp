@@ -188,9 +188,10 @@ void TranscodeDialog::JobComplete(const QString& input, const QString& output,
 void TranscodeDialog::UpdateProgress() {
   int progress = (finished_success_ + finished_failed_) * 100;
 
-  QMap<QString, float> current_jobs = transcoder_->GetProgress();
-  for (float value : current_jobs.values()) {
-    progress += qBound(0, int(value * 100), 99);
+  QMap<QString, Transcoder::JobProgress> current_jobs =
+      transcoder_->GetProgress();
+  for (const Transcoder::JobProgress& job : current_jobs.values()) {
+    progress += qBound(0, int(job.progress * 100), 99);
   }
 
   ui_->progress_bar->setValue(progress);
@@ -17,23 +17,29 @@
 
 #include "transcoder.h"
 
+#include <algorithm>
 #include <memory>
 
 #include <QCoreApplication>
 #include <QDir>
 #include <QFile>
+#include <QFileInfo>
 #include <QSettings>
 #include <QThread>
 #include <QtDebug>
 
 #include "core/logging.h"
 #include "core/signalchecker.h"
+#include "core/timeconstants.h"
 #include "core/utilities.h"
 
 using std::shared_ptr;
 
 int Transcoder::JobFinishedEvent::sEventType = -1;
 
+const int Transcoder::kEstimatedBytesPerSecond = 40000;  // 320kbps
+const int Transcoder::kReadBlockSize = 256 * 1024;
+
 TranscoderPreset::TranscoderPreset(Song::FileType type, const QString& name,
                                    const QString& extension,
                                    const QString& codec_mimetype,
@@ -275,11 +281,17 @@ Song::FileType Transcoder::PickBestFormat(QList<Song::FileType> supported) {
   return supported[0];
 }
 
+qint64 Transcoder::Job::cost() const {
+  if (length_nanosec > 0) return length_nanosec;
+  return size * kNsecPerSec / kEstimatedBytesPerSecond;
+}
+
 void Transcoder::AddJob(const QString& input, const TranscoderPreset& preset,
-                        const QString& output) {
+                        const QString& output, qint64 length_nanosec) {
   Job job;
   job.input = input;
   job.preset = preset;
+  job.length_nanosec = length_nanosec;
 
   // Use the supplied filename if there was one, otherwise take the file
   // extension off the input filename and append the correct one.
@@ -301,16 +313,31 @@ void Transcoder::AddJob(const QString& input, const TranscoderPreset& preset,
     }
   }
 
-  queued_jobs_ << job;
+  QueueJob(job);
 }
 
-void Transcoder::AddTemporaryJob(const QString &input, const TranscoderPreset &preset) {
+void Transcoder::AddTemporaryJob(const QString& input,
+                                 const TranscoderPreset& preset,
+                                 qint64 length_nanosec) {
   Job job;
   job.input = input;
   job.output = Utilities::GetTemporaryFileName();
   job.preset = preset;
+  job.length_nanosec = length_nanosec;
+
+  QueueJob(job);
+}
 
-  queued_jobs_ << job;
+void Transcoder::QueueJob(Job job) {
+  job.size = QFileInfo(job.input).size();
+
+  // Keep the queue sorted longest first.  Jobs of the same length stay in the
+  // order they were added.
+  const qint64 cost = job.cost();
+  QList<Job>::iterator it = std::upper_bound(
+      queued_jobs_.begin(), queued_jobs_.end(), cost,
+      [](qint64 cost, const Job& other) { return cost > other.cost(); });
+  queued_jobs_.insert(it, job);
 }
 
 void Transcoder::Start() {
@@ -407,13 +434,16 @@ bool Transcoder::StartJob(const Job& job) {
   GstElement* decode = CreateElement("decodebin", state->pipeline_);
   GstElement* convert = CreateElement("audioconvert", state->pipeline_);
   GstElement* resample = CreateElement("audioresample", state->pipeline_);
+  // Lets the encoder run in its own thread, so decoding the next buffer
+  // doesn't have to wait for the previous one to be encoded.
+  GstElement* queue = CreateElement("queue", state->pipeline_);
   GstElement* codec = CreateElementForMimeType(
       "Codec/Encoder/Audio", job.preset.codec_mimetype_, state->pipeline_);
   GstElement* muxer = CreateElementForMimeType(
       "Codec/Muxer", job.preset.muxer_mimetype_, state->pipeline_);
   GstElement* sink = CreateElement("filesink", state->pipeline_);
 
-  if (!src || !decode || !convert || !sink) return false;
+  if (!src || !decode || !convert || !queue || !sink) return false;
 
   if (!codec && !job.preset.codec_mimetype_.isEmpty()) {
     LogLine(tr("Couldn't find an encoder for %1, check you have the correct "
@@ -430,14 +460,16 @@ bool Transcoder::StartJob(const Job& job) {
   // Join them together
   gst_element_link(src, decode);
   if (codec && muxer)
-    gst_element_link_many(convert, resample, codec, muxer, sink, nullptr);
+    gst_element_link_many(convert, resample, queue, codec, muxer, sink,
+                          nullptr);
   else if (codec)
-    gst_element_link_many(convert, resample, codec, sink, nullptr);
+    gst_element_link_many(convert, resample, queue, codec, sink, nullptr);
   else if (muxer)
-    gst_element_link_many(convert, resample, muxer, sink, nullptr);
+    gst_element_link_many(convert, resample, queue, muxer, sink, nullptr);
 
   // Set properties
   g_object_set(src, "location", job.input.toUtf8().constData(), nullptr);
+  g_object_set(src, "blocksize", kReadBlockSize, nullptr);
   g_object_set(sink, "location", job.output.toUtf8().constData(), nullptr);
 
   // Set callbacks
@@ -449,6 +481,7 @@ bool Transcoder::StartJob(const Job& job) {
 
   // Start the pipeline
   gst_element_set_state(state->pipeline_, GST_STATE_PLAYING);
+  state->timer_.start();
 
   // GStreamer now transcodes in another thread, so we can return now and do
   // something else.  Keep the JobState object around.  It'll post an event
@@ -496,8 +529,12 @@ bool Transcoder::event(QEvent* e) {
     // Emit the finished signal
     emit JobComplete(input, output, finished_event->success_);
 
-    // Start some more jobs
-    MaybeStartNextJob();
+    // Start some more jobs.  Keep going if one fails to start, so a thread
+    // doesn't sit idle until the next job finishes.
+    forever {
+      StartJobStatus status = MaybeStartNextJob();
+      if (status == AllThreadsBusy || status == NoMoreJobs) break;
+    }
 
     return true;
   }
@@ -532,8 +569,8 @@ void Transcoder::Cancel() {
   }
 }
 
-QMap<QString, float> Transcoder::GetProgress() const {
-  QMap<QString, float> ret;
+QMap<QString, Transcoder::JobProgress> Transcoder::GetProgress() const {
+  QMap<QString, JobProgress> ret;
 
   for (const auto& state : current_jobs_) {
     if (!state->pipeline_) continue;
@@ -544,7 +581,17 @@ QMap<QString, float> Transcoder::GetProgress() const {
     gst_element_query_position(state->pipeline_, GST_FORMAT_TIME, &position);
     gst_element_query_duration(state->pipeline_, GST_FORMAT_TIME, &duration);
 
-    ret[state->job_.input] = float(position) / duration;
+    JobProgress progress;
+    progress.progress = float(position) / duration;
+
+    const qint64 elapsed_msec = state->timer_.elapsed();
+    if (elapsed_msec > 0) {
+      progress.speed = float(position) / kNsecPerMsec / elapsed_msec;
+      progress.bytes_per_second =
+          float(state->job_.size) * progress.progress * 1000 / elapsed_msec;
+    }
+
+    ret[state->job_.input] = progress;
   }
 
   return ret;
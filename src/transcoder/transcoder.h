@@ -22,6 +22,7 @@
 
 #include <gst/gst.h>
 
+#include <QElapsedTimer>
 #include <QObject>
 #include <QStringList>
 #include <QEvent>
@@ -49,6 +50,22 @@ class Transcoder : public QObject {
  public:
   Transcoder(QObject* parent = nullptr, const QString& settings_postfix = "");
 
+  // Used to guess how long a file is when the caller didn't say.
+  static const int kEstimatedBytesPerSecond;
+  // Size of the blocks read from the input file.
+  static const int kReadBlockSize;
+
+  struct JobProgress {
+    JobProgress() : progress(0.0), speed(0.0), bytes_per_second(0.0) {}
+
+    // Between 0 and 1.
+    float progress;
+    // Seconds of audio transcoded per second.
+    float speed;
+    // Bytes of the input file read per second.
+    float bytes_per_second;
+  };
+
   static TranscoderPreset PresetForFileType(Song::FileType type);
   static QList<TranscoderPreset> GetAllPresets();
   static Song::FileType PickBestFormat(QList<Song::FileType> supported);
@@ -56,12 +73,19 @@ class Transcoder : public QObject {
   int max_threads() const { return max_threads_; }
   void set_max_threads(int count) { max_threads_ = count; }
 
+  // Jobs are started longest first, so the short ones can fill the gaps at the
+  // end instead of one long job running on its own after everything else is
+  // done.  length_nanosec is used to decide which jobs are longest, if it's 0
+  // the length is guessed from the size of the file.
   void AddJob(const QString& input, const TranscoderPreset& preset,
-              const QString& output = QString());
-  void AddTemporaryJob(const QString& input, const TranscoderPreset& preset);
+              const QString& output = QString(), qint64 length_nanosec = 0);
+  void AddTemporaryJob(const QString& input, const TranscoderPreset& preset,
+                       qint64 length_nanosec = 0);
 
-  QMap<QString, float> GetProgress() const;
+  // Keyed by the input filename of each running job.
+  QMap<QString, JobProgress> GetProgress() const;
   int QueuedJobsCount() const { return queued_jobs_.count(); }
+  int RunningJobsCount() const { return current_jobs_.count(); }
 
  public slots:
   void Start();
@@ -78,9 +102,16 @@ signals:
  private:
   // The description of a file to transcode - lives in the main thread.
   struct Job {
+    Job() : length_nanosec(0), size(0) {}
+
+    // How long the job is likely to take, in nanoseconds of audio.
+    qint64 cost() const;
+
     QString input;
     QString output;
     TranscoderPreset preset;
+    qint64 length_nanosec;
+    qint64 size;
   };
 
   // State held by a job and shared across gstreamer callbacks - lives in the
@@ -100,6 +131,7 @@ signals:
     Transcoder* parent_;
     GstElement* pipeline_;
     GstElement* convert_element_;
+    QElapsedTimer timer_;
   };
 
   // Event passed from a GStreamer callback to the Transcoder when a job
@@ -122,6 +154,7 @@ signals:
 
   StartJobStatus MaybeStartNextJob();
   bool StartJob(const Job& job);
+  void QueueJob(Job job);
 
   GstElement* CreateElement(const QString& factory_name,
                             GstElement* bin = nullptr,
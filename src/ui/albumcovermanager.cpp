@@ -48,11 +48,13 @@
 #include <QMessageBox>
 #include <QPainter>
 #include <QProgressBar>
+#include <QScrollBar>
 #include <QSettings>
 #include <QShortcut>
 #include <QTimer>
 
 const char* AlbumCoverManager::kSettingsGroup = "CoverManager";
+const int AlbumCoverManager::kPrioritizeDelayMsec = 100;
 
 AlbumCoverManager::AlbumCoverManager(Application* app,
                                      LibraryBackend* library_backend,
@@ -77,10 +79,14 @@ AlbumCoverManager::AlbumCoverManager(Application* app,
       progress_bar_(new QProgressBar(this)),
       abort_progress_(new QPushButton(this)),
       jobs_(0),
+      prioritize_timer_(new QTimer(this)),
       library_backend_(library_backend) {
   ui_->setupUi(this);
   ui_->albums->set_cover_manager(this);
 
+  prioritize_timer_->setSingleShot(true);
+  prioritize_timer_->setInterval(kPrioritizeDelayMsec);
+
   // Icons
   ui_->action_fetch->setIcon(IconLoader::Load("download", IconLoader::Base));
   ui_->export_covers->setIcon(
@@ -172,6 +178,14 @@ void AlbumCoverManager::Init() {
           SLOT(ArtistChanged(QListWidgetItem*)));
   connect(ui_->filter, SIGNAL(textChanged(QString)), SLOT(UpdateFilter()));
   connect(filter_group, SIGNAL(triggered(QAction*)), SLOT(UpdateFilter()));
+  connect(ui_->filter, SIGNAL(textChanged(QString)),
+          SLOT(SchedulePrioritizeVisibleCovers()));
+  connect(filter_group, SIGNAL(triggered(QAction*)),
+          SLOT(SchedulePrioritizeVisibleCovers()));
+  connect(ui_->albums->verticalScrollBar(), SIGNAL(valueChanged(int)),
+          SLOT(SchedulePrioritizeVisibleCovers()));
+  connect(prioritize_timer_, SIGNAL(timeout()),
+          SLOT(PrioritizeVisibleCovers()));
   connect(ui_->view, SIGNAL(clicked()), ui_->view, SLOT(showMenu()));
   connect(ui_->fetch, SIGNAL(clicked()), SLOT(FetchAlbumCovers()));
   connect(ui_->export_covers, SIGNAL(clicked()), SLOT(ExportCovers()));
@@ -349,6 +363,7 @@ void AlbumCoverManager::ArtistChanged(QListWidgetItem* current) {
   }
 
   UpdateFilter();
+  PrioritizeVisibleCovers();
 }
 
 void AlbumCoverManager::CoverImageLoaded(quint64 id, const QImage& image) {
@@ -394,6 +409,31 @@ void AlbumCoverManager::UpdateFilter() {
   ui_->without_cover->setText(QString::number(without_cover));
 }
 
+void AlbumCoverManager::SchedulePrioritizeVisibleCovers() {
+  // Don't restart the timer, so covers keep being prioritized every
+  // kPrioritizeDelayMsec while the list is scrolling.
+  if (!prioritize_timer_->isActive()) prioritize_timer_->start();
+}
+
+void AlbumCoverManager::PrioritizeVisibleCovers() {
+  if (cover_loading_tasks_.isEmpty()) return;
+
+  // Load the covers the user can see before the ones they'd have to scroll to.
+  const QRect viewport = ui_->albums->viewport()->rect();
+  QSet<quint64> visible;
+  for (QMap<quint64, QListWidgetItem*>::const_iterator it =
+           cover_loading_tasks_.constBegin();
+       it != cover_loading_tasks_.constEnd(); ++it) {
+    QListWidgetItem* item = it.value();
+    if (!item->isHidden() &&
+        ui_->albums->visualItemRect(item).intersects(viewport)) {
+      visible << it.key();
+    }
+  }
+
+  app_->album_cover_loader()->PrioritizeTasks(visible);
+}
+
 bool AlbumCoverManager::ShouldHide(const QListWidgetItem& item,
                                    const QString& filter,
                                    HideCovers hide) const {
@@ -43,6 +43,7 @@ class QMenu;
 class QNetworkAccessManager;
 class QPushButton;
 class QProgressBar;
+class QTimer;
 
 class AlbumCoverManager : public QMainWindow {
   Q_OBJECT
@@ -53,6 +54,7 @@ class AlbumCoverManager : public QMainWindow {
   ~AlbumCoverManager();
 
   static const char* kSettingsGroup;
+  static const int kPrioritizeDelayMsec;
 
   LibraryBackend* backend() const;
   QIcon no_cover_icon() const { return no_cover_icon_; }
@@ -81,6 +83,8 @@ signals:
   void ArtistChanged(QListWidgetItem* current);
   void CoverImageLoaded(quint64 id, const QImage& image);
   void UpdateFilter();
+  void SchedulePrioritizeVisibleCovers();
+  void PrioritizeVisibleCovers();
   void FetchAlbumCovers();
   void ExportCovers();
   void AlbumCoverFetched(quint64 id, const QImage& image,
@@ -185,6 +189,10 @@ signals:
   QPushButton* abort_progress_;
   int jobs_;
 
+  // Limits how often the visible covers are prioritized while the list is
+  // scrolling or the filter is being typed in.
+  QTimer* prioritize_timer_;
+
   LibraryBackend* library_backend_;
 
   FRIEND_TEST(AlbumCoverManagerTest, HidesItemsWithCover);
@@ -155,6 +155,7 @@ void AppearanceSettingsPage::Load() {
   ui_->moodbar_calculate->setChecked(!s.value("calculate", true).toBool());
   ui_->moodbar_save->setChecked(
       s.value("save_alongside_originals", false).toBool());
+  ui_->moodbar_precompute->setChecked(s.value("precompute", false).toBool());
   s.endGroup();
 
   InitMoodbarPreviews();
@@ -202,6 +203,7 @@ void AppearanceSettingsPage::Save() {
   s.setValue("show", ui_->moodbar_show->isChecked());
   s.setValue("style", ui_->moodbar_style->currentIndex());
   s.setValue("save_alongside_originals", ui_->moodbar_save->isChecked());
+  s.setValue("precompute", ui_->moodbar_precompute->isChecked());
   s.endGroup();
 }
 
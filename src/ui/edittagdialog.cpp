@@ -62,6 +62,7 @@ EditTagDialog::EditTagDialog(Application* app, QWidget* parent)
       cover_art_is_set_(false),
       results_dialog_(new TrackSelectionDialog(this)) {
   QIcon nocover = IconLoader::Load("nocover", IconLoader::Other);
+  cover_options_.need_original_image_ = true;
   cover_options_.default_output_image_ =
       AlbumCoverLoader::ScaleAndPad(cover_options_,
           nocover.pixmap(nocover.availableSizes().last())
@@ -28,6 +28,7 @@
 #include <QLinearGradient>
 #include <QMenu>
 #include <QMessageBox>
+#include <QSet>
 #include <QSettings>
 #include <QShortcut>
 #include <QSignalMapper>
@@ -1896,14 +1897,26 @@ void MainWindow::EditTracks() {
 }
 
 void MainWindow::EditTagDialogAccepted() {
+  Playlist* playlist = app_->playlist_manager()->current();
+
+  QSet<PlaylistItem*> edited_items;
   for (PlaylistItemPtr item : edit_tag_dialog_->playlist_items()) {
-    item->Reload();
+    edited_items << item.get();
   }
 
-  // This is really lame but we don't know what rows have changed
-  ui_->playlist->view()->update();
+  // Reloading the rows in the playlist saves their new tags as well
+  QList<int> rows;
+  for (int row = 0; row < playlist->rowCount(); ++row) {
+    PlaylistItem* item = playlist->item_at(row).get();
+    if (edited_items.remove(item)) rows << row;
+  }
+  playlist->ReloadItems(rows);
 
-  app_->playlist_manager()->current()->Save();
+  // The current playlist might have changed since the dialog was opened
+  for (PlaylistItem* item : edited_items) {
+    item->Reload();
+  }
+  ui_->playlist->view()->update();
 }
 
 void MainWindow::DiscoverStreamDetails() {
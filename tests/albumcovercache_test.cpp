@@ -0,0 +1,106 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QImage>
+
+#include "covers/albumcovercache.h"
+
+namespace {
+
+QImage MakeImage(int size, QRgb colour) {
+  QImage image(size, size, QImage::Format_ARGB32);
+  image.fill(colour);
+  return image;
+}
+
+class AlbumCoverCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() {
+    disk_dir_ = QDir::temp().filePath(
+        QString("clementine_albumcovercache_test_%1")
+            .arg(QCoreApplication::applicationPid()));
+  }
+
+  void TearDown() {
+    QDir dir(disk_dir_);
+    for (const QString& file : dir.entryList(QDir::Files)) {
+      dir.remove(file);
+    }
+    QDir().rmdir(disk_dir_);
+  }
+
+  QString disk_dir_;
+};
+
+TEST_F(AlbumCoverCacheTest, HitsAndMisses) {
+  AlbumCoverCache cache;
+  const QImage image = MakeImage(16, qRgb(255, 0, 0));
+
+  EXPECT_TRUE(cache.Get("a").isNull());
+  cache.Insert("a", image);
+  EXPECT_EQ(image, cache.Get("a"));
+
+  AlbumCoverCacheStatistics stats = cache.statistics();
+  EXPECT_EQ(1, stats.memory_hits_);
+  EXPECT_EQ(0, stats.disk_hits_);
+  EXPECT_EQ(1, stats.misses_);
+  EXPECT_EQ(1, stats.insertions_);
+  EXPECT_EQ(image.byteCount(), stats.memory_bytes_);
+  EXPECT_DOUBLE_EQ(0.5, stats.HitRatio());
+}
+
+TEST_F(AlbumCoverCacheTest, EvictsLeastRecentlyUsed) {
+  const QImage image = MakeImage(16, qRgb(0, 255, 0));
+  AlbumCoverCache cache(image.byteCount() * 2);
+
+  cache.Insert("a", image);
+  cache.Insert("b", image);
+  cache.Get("a");
+  cache.Insert("c", image);
+
+  EXPECT_FALSE(cache.Get("a").isNull());
+  EXPECT_TRUE(cache.Get("b").isNull());
+  EXPECT_FALSE(cache.Get("c").isNull());
+  EXPECT_LE(cache.statistics().memory_bytes_, image.byteCount() * 2);
+}
+
+TEST_F(AlbumCoverCacheTest, DiskTierSurvivesNewCache) {
+  const QImage image = MakeImage(16, qRgb(0, 0, 255));
+  {
+    AlbumCoverCache cache;
+    cache.SetDiskCacheDir(disk_dir_);
+    cache.Insert("a", image);
+  }
+
+  AlbumCoverCache cache;
+  cache.SetDiskCacheDir(disk_dir_);
+  const QImage loaded = cache.Get("a");
+  ASSERT_FALSE(loaded.isNull());
+  EXPECT_EQ(image.size(), loaded.size());
+  EXPECT_EQ(image.pixel(0, 0), loaded.pixel(0, 0));
+  EXPECT_EQ(1, cache.statistics().disk_hits_);
+
+  // The second lookup comes from memory
+  cache.Get("a");
+  EXPECT_EQ(1, cache.statistics().memory_hits_);
+}
+
+}  // namespace
@@ -0,0 +1,104 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Times loading a 100000 song catalogue with AddOrUpdateSongs in bulk, and
+// with a CatalogImport.
+
+#include <memory>
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QtDebug>
+
+#include "core/database.h"
+#include "core/song.h"
+#include "library/catalogimport.h"
+#include "library/library.h"
+#include "library/librarybackend.h"
+
+namespace {
+
+const int kSongCount = 100000;
+
+class CatalogImportBenchmark : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    database_.reset(new MemoryDatabase(nullptr));
+    backend_.reset(new LibraryBackend);
+    backend_->Init(database_.get(), Library::kSongsTable, QString(), QString(),
+                   Library::kFtsTable);
+  }
+
+  static Song MakeSong(int i) {
+    Song song;
+    song.Init(QString("title %1").arg(i), "artist", "album", 100);
+    song.set_url(QUrl(QString("http://example.com/%1.mp3").arg(i)));
+    song.set_valid(true);
+    return song;
+  }
+
+  // One song per line
+  static bool ParseCatalogue(QIODevice* device, CatalogImport* import) {
+    QTextStream stream(device);
+    forever {
+      const QString line = stream.readLine();
+      if (line.isNull()) return true;
+      import->AddSongs(SongList() << MakeSong(line.toInt()));
+    }
+  }
+
+  std::unique_ptr<Database> database_;
+  std::unique_ptr<LibraryBackend> backend_;
+};
+
+TEST_F(CatalogImportBenchmark, AddOrUpdateSongs) {
+  SongList songs;
+  for (int i = 0; i < kSongCount; ++i) songs << MakeSong(i);
+
+  QElapsedTimer timer;
+  timer.start();
+  backend_->BeginBulkInsert(-1);
+  for (int i = 0; i < kSongCount; i += CatalogImport::kBatchSize) {
+    backend_->AddOrUpdateSongs(songs.mid(i, CatalogImport::kBatchSize));
+  }
+  backend_->EndBulkInsert(-1);
+  qDebug() << "Inserted" << kSongCount << "songs in" << timer.elapsed()
+           << "ms";
+
+  EXPECT_EQ(kSongCount, backend_->GetAllSongs().count());
+}
+
+TEST_F(CatalogImportBenchmark, CatalogImport) {
+  QByteArray data;
+  for (int i = 0; i < kSongCount; ++i) data += QByteArray::number(i) + "\n";
+  QBuffer buffer(&data);
+  buffer.open(QIODevice::ReadOnly);
+
+  QElapsedTimer timer;
+  timer.start();
+  CatalogImport import(backend_.get());
+  ASSERT_TRUE(import.Run(&buffer, &ParseCatalogue));
+  qDebug() << "Imported" << kSongCount << "songs in" << timer.elapsed()
+           << "ms";
+
+  EXPECT_EQ(kSongCount, backend_->GetAllSongs().count());
+}
+
+}  // namespace
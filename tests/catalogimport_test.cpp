@@ -0,0 +1,333 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <memory>
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <QBuffer>
+#include <QFile>
+#include <QFuture>
+#include <QPair>
+#include <QSettings>
+#include <QSignalSpy>
+#include <QSqlQuery>
+#include <QTextStream>
+#include <QThreadPool>
+
+#include "core/concurrentrun.h"
+#include "core/database.h"
+#include "core/song.h"
+#include "core/utilities.h"
+#include "library/catalogimport.h"
+#include "library/library.h"
+#include "library/librarybackend.h"
+#include "library/libraryquery.h"
+#include "smartplaylists/search.h"
+
+namespace {
+
+// Fails to read anything after the first fail_at bytes.
+class FailingBuffer : public QBuffer {
+ public:
+  FailingBuffer(QByteArray* data, qint64 fail_at)
+      : QBuffer(data), fail_at_(fail_at) {}
+
+ protected:
+  qint64 readData(char* data, qint64 max_size) {
+    if (pos() >= fail_at_) return -1;
+    return QBuffer::readData(data, qMin(max_size, fail_at_ - pos()));
+  }
+
+ private:
+  qint64 fail_at_;
+};
+
+class CatalogImportTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    database_.reset(new MemoryDatabase(nullptr));
+    backend_.reset(new LibraryBackend);
+    // Like the internet services, without any directories
+    backend_->Init(database_.get(), Library::kSongsTable, QString(), QString(),
+                   Library::kFtsTable);
+  }
+
+  static Song MakeSong(int i, const QString& artist) {
+    Song song;
+    song.Init(QString("title %1").arg(i), artist, "album", 100);
+    song.set_url(QUrl(QString("http://example.com/%1.mp3").arg(i)));
+    song.set_valid(true);
+    return song;
+  }
+
+  static SongList MakeSongs(int count, const QString& artist) {
+    SongList ret;
+    for (int i = 0; i < count; ++i) ret << MakeSong(i, artist);
+    return ret;
+  }
+
+  // One song per line, "title artist", and then "end".
+  static QByteArray MakeCatalogue(int count, const QString& artist) {
+    QByteArray ret;
+    for (int i = 0; i < count; ++i) {
+      ret += QString("%1 %2\n").arg(i).arg(artist).toUtf8();
+    }
+    return ret + "end\n";
+  }
+
+  // Fails if the catalogue stops before the end, like an XML parser would.
+  static bool ParseCatalogue(QIODevice* device, CatalogImport* import) {
+    QTextStream stream(device);
+    forever {
+      const QString line = stream.readLine();
+      if (line.isNull()) return false;
+      if (line == "end") return true;
+
+      const QStringList fields = line.split(' ');
+      import->AddSongs(SongList() << MakeSong(fields[0].toInt(), fields[1]));
+    }
+  }
+
+  QStringList ArtistsMatching(const QString& filter) {
+    QueryOptions opt;
+    opt.set_filter(filter);
+    return backend_->GetAllArtists(opt);
+  }
+
+  std::unique_ptr<Database> database_;
+  std::unique_ptr<LibraryBackend> backend_;
+};
+
+TEST_F(CatalogImportTest, ReplacesSongs) {
+  backend_->AddOrUpdateSongs(MakeSongs(10, "old"));
+  ASSERT_EQ(10, backend_->GetAllSongs().count());
+  QSignalSpy reset(backend_.get(), SIGNAL(DatabaseReset()));
+
+  CatalogImport import(backend_.get());
+  ASSERT_TRUE(import.Run(MakeSongs(5, "new")));
+  EXPECT_EQ(5, import.song_count());
+  EXPECT_EQ(1, reset.count());
+
+  SongList songs = backend_->GetAllSongs();
+  ASSERT_EQ(5, songs.count());
+  for (const Song& song : songs) {
+    EXPECT_EQ("new", song.artist());
+  }
+
+  // The FTS index should have been rebuilt too
+  EXPECT_EQ(QStringList() << "new", ArtistsMatching("new"));
+  EXPECT_TRUE(ArtistsMatching("old").isEmpty());
+}
+
+TEST_F(CatalogImportTest, ParsesDevice) {
+  backend_->AddOrUpdateSongs(MakeSongs(10, "old"));
+
+  // More than one batch and more than one read
+  const int count = CatalogImport::kBatchSize * 2 + 1;
+  QByteArray data = MakeCatalogue(count, "new");
+  ASSERT_GT(data.size(), CatalogImport::kReadBufferSize);
+  QBuffer buffer(&data);
+  buffer.open(QIODevice::ReadOnly);
+
+  QList<int> progress;
+  CatalogImport import(backend_.get());
+  import.set_progress_function([&progress](int n) { progress << n; });
+  ASSERT_TRUE(import.Run(&buffer, &ParseCatalogue));
+
+  EXPECT_EQ(count, import.song_count());
+  EXPECT_EQ(count, backend_->GetAllSongs().count());
+  ASSERT_FALSE(progress.isEmpty());
+  EXPECT_EQ(count, progress.last());
+
+  // Songs get ROWIDs in the order they were added
+  EXPECT_EQ("title 0", backend_->GetSongById(1).title());
+  EXPECT_EQ(QString("title %1").arg(count - 1),
+            backend_->GetSongById(count).title());
+}
+
+TEST_F(CatalogImportTest, ReplacesExtraTables) {
+  database_->Connect().exec("CREATE TABLE extra (value INTEGER)");
+  database_->Connect().exec("INSERT INTO extra (value) VALUES (42)");
+
+  QByteArray data = MakeCatalogue(3, "new");
+  QBuffer buffer(&data);
+  buffer.open(QIODevice::ReadOnly);
+
+  CatalogImport import(backend_.get());
+  import.AddTable("extra");
+  ASSERT_TRUE(import.Run(&buffer, [](QIODevice* device,
+                                     CatalogImport* import) {
+    QList<QVariantList> rows;
+    for (int i = 0; i < 3; ++i) rows << (QVariantList() << i);
+    import->AddRows("extra", QStringList() << "value", rows);
+    return ParseCatalogue(device, import);
+  }));
+
+  QSqlQuery q("SELECT value FROM extra ORDER BY value", database_->Connect());
+  ASSERT_TRUE(q.exec());
+  QList<int> values;
+  while (q.next()) values << q.value(0).toInt();
+  EXPECT_EQ(QList<int>() << 0 << 1 << 2, values);
+}
+
+TEST_F(CatalogImportTest, MissingTableKeepsOldCatalogue) {
+  backend_->AddOrUpdateSongs(MakeSongs(10, "old"));
+  QSignalSpy reset(backend_.get(), SIGNAL(DatabaseReset()));
+
+  QByteArray data = MakeCatalogue(3, "new");
+  QBuffer buffer(&data);
+  buffer.open(QIODevice::ReadOnly);
+
+  CatalogImport import(backend_.get());
+  import.AddTable("missing");
+  EXPECT_FALSE(import.Run(&buffer, &ParseCatalogue));
+  EXPECT_EQ(10, backend_->GetAllSongs().count());
+  EXPECT_EQ(0, reset.count());
+}
+
+TEST_F(CatalogImportTest, TruncatedCatalogueKeepsOldCatalogue) {
+  backend_->AddOrUpdateSongs(MakeSongs(10, "old"));
+  QSignalSpy reset(backend_.get(), SIGNAL(DatabaseReset()));
+
+  // More than one batch, so some songs were written before it went wrong
+  QByteArray data = MakeCatalogue(CatalogImport::kBatchSize * 2, "new");
+  data.truncate(data.size() / 2);
+  QBuffer buffer(&data);
+  buffer.open(QIODevice::ReadOnly);
+
+  CatalogImport import(backend_.get());
+  EXPECT_FALSE(import.Run(&buffer, &ParseCatalogue));
+  EXPECT_EQ(10, backend_->GetAllSongs().count());
+  EXPECT_EQ(0, reset.count());
+}
+
+TEST_F(CatalogImportTest, ReadErrorKeepsOldCatalogue) {
+  backend_->AddOrUpdateSongs(MakeSongs(10, "old"));
+
+  // The catalogue is complete, but the device fails before it's all read
+  QByteArray data = MakeCatalogue(CatalogImport::kBatchSize * 2, "new");
+  FailingBuffer buffer(&data, data.size() / 2);
+  buffer.open(QIODevice::ReadOnly);
+
+  CatalogImport import(backend_.get());
+  EXPECT_FALSE(import.Run(&buffer, [](QIODevice* device,
+                                      CatalogImport* import) {
+    ParseCatalogue(device, import);
+    return true;
+  }));
+  EXPECT_EQ(10, backend_->GetAllSongs().count());
+}
+
+// Jamendo keeps its catalogue in an attached database of its own, and the
+// whole file is replaced.
+class CatalogImportAttachedTest : public CatalogImportTest {
+ protected:
+  virtual void SetUp() {
+    // WAL needs a database file, and so do connections on other threads.
+    QSettings s;
+    s.setValue(QString(Database::kSettingsGroup) + "/wal", true);
+    s.sync();
+
+    path_ = Utilities::MakeTempDir();
+    database_.reset(new Database(nullptr, nullptr, path_ + "/main.db"));
+    database_->AttachDatabase(
+        "jamendo", Database::AttachedDatabase(path_ + "/jamendo.db",
+                                              ":/schema/jamendo.sql", false));
+    database_->RecreateAttachedDb("jamendo");
+
+    backend_.reset(new LibraryBackend);
+    backend_->Init(database_.get(), "jamendo.songs", QString(), QString(),
+                   "jamendo.songs_fts");
+
+    // Keep the same thread, and its connections, for the whole test
+    pool_.setMaxThreadCount(1);
+    pool_.setExpiryTimeout(-1);
+  }
+
+  virtual void TearDown() {
+    pool_.waitForDone();
+    Utilities::RemoveRecursive(path_);
+
+    QSettings s;
+    s.remove(QString(Database::kSettingsGroup) + "/wal");
+  }
+
+  bool Import(int count, const QString& artist) {
+    CatalogImport import(backend_.get());
+    import.set_attached_database("jamendo");
+    return import.Run(MakeSongs(count, artist));
+  }
+
+  // Reads the songs on the pool's thread, through both of its connections.
+  QPair<int, int> CountOnOtherThread() {
+    LibraryBackend* backend = backend_.get();
+    QFuture<QPair<int, int> > future =
+        ConcurrentRun::Run<QPair<int, int> >(&pool_, [backend]() {
+          const smart_playlists::Search all(
+              smart_playlists::Search::Type_All,
+              smart_playlists::Search::TermList(),
+              smart_playlists::Search::Sort_FieldAsc,
+              smart_playlists::SearchTerm::Field_Artist, -1);
+          return qMakePair(backend->GetAllSongs().count(),
+                           backend->FindSongIds(all).count());
+        });
+    return future.result();
+  }
+
+  QString JournalMode() {
+    QSqlQuery q("PRAGMA jamendo.journal_mode", database_->Connect());
+    if (!q.exec() || !q.next()) return QString();
+    return q.value(0).toString().toLower();
+  }
+
+  QThreadPool pool_;
+  QString path_;
+};
+
+TEST_F(CatalogImportAttachedTest, ReplacesDatabase) {
+  ASSERT_TRUE(Import(10, "old"));
+  EXPECT_EQ(10, backend_->GetAllSongs().count());
+  EXPECT_EQ(qMakePair(10, 10), CountOnOtherThread());
+
+  // The other thread's connections still have the old file attached
+  QSignalSpy reset(backend_.get(), SIGNAL(DatabaseReset()));
+  ASSERT_TRUE(Import(5, "new"));
+  EXPECT_EQ(1, reset.count());
+
+  SongList songs = backend_->GetAllSongs();
+  ASSERT_EQ(5, songs.count());
+  EXPECT_EQ("new", songs[0].artist());
+  EXPECT_EQ(QStringList() << "new", ArtistsMatching("new"));
+  EXPECT_EQ(qMakePair(5, 5), CountOnOtherThread());
+
+  // The new file is in WAL mode like the old one, and nothing is left over
+  EXPECT_EQ("wal", JournalMode());
+  EXPECT_FALSE(QFile::exists(path_ + "/jamendo.db.import"));
+}
+
+TEST_F(CatalogImportAttachedTest, Recreate) {
+  ASSERT_TRUE(Import(10, "old"));
+  EXPECT_EQ(qMakePair(10, 10), CountOnOtherThread());
+
+  database_->RecreateAttachedDb("jamendo");
+  EXPECT_TRUE(backend_->GetAllSongs().isEmpty());
+  EXPECT_EQ(qMakePair(0, 0), CountOnOtherThread());
+  EXPECT_EQ("wal", JournalMode());
+}
+
+}  // namespace
@@ -21,15 +21,20 @@
 #include "gtest/gtest.h"
 
 #include "core/database.h"
+#include "core/scopedtransaction.h"
 
-#include <QtDebug>
+#include <QFile>
+#include <QSemaphore>
+#include <QSettings>
 #include <QSqlQuery>
+#include <QTemporaryFile>
+#include <QThread>
 #include <QVariant>
 
 class DatabaseTest : public ::testing::Test {
  protected:
   virtual void SetUp() {
-    database_.reset(new MemoryDatabase);
+    database_.reset(new MemoryDatabase(nullptr));
   }
 
   std::unique_ptr<Database> database_;
@@ -148,3 +153,133 @@ TEST_F(DatabaseTest, FTSCursorWorks) {
   rc = Database::FTSNext(cursor, &token, &bytes, &start_offset, &end_offset, &position);
   EXPECT_EQ(SQLITE_DONE, rc);
 }
+
+namespace {
+
+// Holds the write mutex in an open transaction that has inserted one row,
+// until it's told to commit.
+class WriterThread : public QThread {
+ public:
+  explicit WriterThread(Database* database) : database_(database) {}
+
+  QSemaphore started_;
+  QSemaphore commit_;
+
+ protected:
+  void run() {
+    QMutexLocker l(database_->Mutex());
+    QSqlDatabase db(database_->Connect());
+    ScopedTransaction transaction(&db);
+
+    QSqlQuery q("INSERT INTO test (value) VALUES (1)", db);
+    q.exec();
+
+    started_.release();
+    commit_.tryAcquire(1, 10000);
+    transaction.Commit();
+  }
+
+ private:
+  Database* database_;
+};
+
+class DatabaseJournalTest : public ::testing::Test {
+ protected:
+  void TearDown() {
+    CloseDatabase();
+    QFile::remove(file_.fileName() + "-wal");
+    QFile::remove(file_.fileName() + "-shm");
+
+    QSettings s;
+    s.remove(QString(Database::kSettingsGroup) + "/wal");
+  }
+
+  // WAL needs a database file - it doesn't work in memory.
+  void CreateDatabase(bool wal) {
+    QSettings s;
+    s.setValue(QString(Database::kSettingsGroup) + "/wal", wal);
+    s.sync();
+
+    ASSERT_TRUE(file_.open());
+    database_.reset(new Database(nullptr, nullptr, file_.fileName()));
+
+    QMutexLocker l(database_->Mutex());
+    QSqlQuery q(database_->Connect());
+    ASSERT_TRUE(q.exec("CREATE TABLE test (value INTEGER)"));
+  }
+
+  // Closes this thread's connections too, so the file can be opened again.
+  void CloseDatabase() {
+    if (!database_) return;
+    const QString writer = database_->Connect().connectionName();
+    const QString reader = database_->ConnectReadOnly().connectionName();
+    database_.reset();
+
+    QSqlDatabase::removeDatabase(writer);
+    if (reader != writer) QSqlDatabase::removeDatabase(reader);
+  }
+
+  QString JournalMode() {
+    QMutexLocker l(database_->Mutex());
+    QSqlQuery q(database_->Connect());
+    if (!q.exec("PRAGMA journal_mode") || !q.next()) return QString();
+    return q.value(0).toString().toLower();
+  }
+
+  int ReadRowCount() {
+    QMutexLocker l(database_->ReadMutex());
+    QSqlQuery q(database_->ConnectReadOnly());
+    if (!q.exec("SELECT COUNT(*) FROM test") || !q.next()) return -1;
+    return q.value(0).toInt();
+  }
+
+  QTemporaryFile file_;
+  std::unique_ptr<Database> database_;
+};
+
+}  // namespace
+
+TEST_F(DatabaseJournalTest, WalIsOffByDefault) {
+  CreateDatabase(false);
+  EXPECT_FALSE(database_->concurrent_reads());
+  EXPECT_EQ(database_->Mutex(), database_->ReadMutex());
+  EXPECT_EQ("delete", JournalMode());
+
+  // Readers share the writer's connection
+  EXPECT_EQ(database_->Connect().connectionName(),
+            database_->ConnectReadOnly().connectionName());
+  EXPECT_EQ(0, ReadRowCount());
+}
+
+TEST_F(DatabaseJournalTest, ReadsDontWaitForWriters) {
+  CreateDatabase(true);
+  ASSERT_TRUE(database_->concurrent_reads());
+  EXPECT_TRUE(database_->ReadMutex() == nullptr);
+  EXPECT_EQ("wal", JournalMode());
+
+  WriterThread writer(database_.get());
+  writer.start();
+  ASSERT_TRUE(writer.started_.tryAcquire(1, 10000));
+
+  // The writer still holds the mutex, but readers see the database as it was
+  // before the transaction started.
+  EXPECT_EQ(0, ReadRowCount());
+
+  writer.commit_.release();
+  ASSERT_TRUE(writer.wait(10000));
+  EXPECT_EQ(1, ReadRowCount());
+}
+
+TEST_F(DatabaseJournalTest, TurningWalOffRestoresRollbackJournal) {
+  CreateDatabase(true);
+  EXPECT_EQ("wal", JournalMode());
+
+  // Open the same file again with WAL turned off
+  CloseDatabase();
+  QSettings s;
+  s.setValue(QString(Database::kSettingsGroup) + "/wal", false);
+  database_.reset(new Database(nullptr, nullptr, file_.fileName()));
+
+  EXPECT_EQ("delete", JournalMode());
+  EXPECT_FALSE(QFile::exists(file_.fileName() + "-wal"));
+}
@@ -0,0 +1,79 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Times the Hartley transform the analyzers used to use against each
+// RealFFT kernel the CPU supports, for each analyzer size.
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <cstdlib>
+
+#include <QElapsedTimer>
+#include <QVector>
+#include <QtDebug>
+
+#include "analyzers/fht.h"
+#include "analyzers/realfft.h"
+
+namespace {
+
+QVector<float> RandomSamples(int count) {
+  QVector<float> ret(count);
+  for (int i = 0; i < count; ++i) {
+    ret[i] = static_cast<float>(qrand()) / RAND_MAX * 2 - 1;
+  }
+  return ret;
+}
+
+TEST(FHTBenchmark, Power2) {
+  const RealFFT::Kernel kernels[] = {
+      RealFFT::Kernel_Scalar, RealFFT::Kernel_SSE2, RealFFT::Kernel_AVX2};
+  const char* kernel_names[] = {"scalar", "sse2", "avx2"};
+
+  for (int exp = 7; exp <= 12; ++exp) {
+    const int size = 1 << exp;
+    // Keep the amount of work roughly the same for each size
+    const int iterations = (1 << 22) / (size * exp);
+    const QVector<float> input = RandomSamples(size);
+    QVector<float> buffer(size);
+
+    FHT hartley(exp, FHT::Backend_Hartley);
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < iterations; ++i) {
+      buffer = input;
+      hartley.power2(buffer.data());
+    }
+    const double hartley_usec = timer.nsecsElapsed() / 1000.0 / iterations;
+    qDebug() << "size" << size << "hartley" << hartley_usec << "us";
+
+    for (int k = 0; k < 3; ++k) {
+      if (!RealFFT::IsSupported(kernels[k])) continue;
+
+      RealFFT fft(size, kernels[k]);
+      timer.restart();
+      for (int i = 0; i < iterations; ++i) {
+        fft.Power2(input.constData(), buffer.data());
+      }
+      const double usec = timer.nsecsElapsed() / 1000.0 / iterations;
+      qDebug() << "size" << size << kernel_names[k] << usec << "us"
+               << "speedup" << hartley_usec / usec;
+    }
+  }
+}
+
+}  // namespace
@@ -0,0 +1,101 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <cstdlib>
+
+#include <QVector>
+
+#include "analyzers/fht.h"
+#include "analyzers/realfft.h"
+
+namespace {
+
+QVector<float> RandomSamples(int count) {
+  QVector<float> ret(count);
+  for (int i = 0; i < count; ++i) {
+    ret[i] = static_cast<float>(qrand()) / RAND_MAX * 2 - 1;
+  }
+  return ret;
+}
+
+// Values are compared relative to the largest one in the spectrum, since
+// rounding errors grow with it.
+void ExpectSpectraEqual(const QVector<float>& expected,
+                        const QVector<float>& actual, int count) {
+  float largest = 0;
+  for (int i = 0; i < count; ++i) largest = qMax(largest, expected[i]);
+
+  for (int i = 0; i < count; ++i) {
+    EXPECT_NEAR(expected[i], actual[i], largest * 1e-5) << "bin " << i;
+  }
+}
+
+TEST(FHTTest, FFTMatchesHartley) {
+  for (int exp = 4; exp <= 12; ++exp) {
+    const int size = 1 << exp;
+    const QVector<float> input = RandomSamples(size);
+
+    QVector<float> expected(input);
+    FHT(exp, FHT::Backend_Hartley).power2(expected.data());
+
+    QVector<float> actual(input);
+    FHT(exp, FHT::Backend_FFT).power2(actual.data());
+
+    ExpectSpectraEqual(expected, actual, size / 2);
+  }
+}
+
+TEST(FHTTest, KernelsMatchScalar) {
+  const RealFFT::Kernel kernels[] = {RealFFT::Kernel_SSE2,
+                                     RealFFT::Kernel_AVX2};
+
+  for (RealFFT::Kernel kernel : kernels) {
+    if (!RealFFT::IsSupported(kernel)) continue;
+
+    for (int exp = 4; exp <= 12; ++exp) {
+      const int size = 1 << exp;
+      const QVector<float> input = RandomSamples(size);
+
+      QVector<float> expected(size / 2);
+      RealFFT(size, RealFFT::Kernel_Scalar)
+          .Power2(input.constData(), expected.data());
+
+      RealFFT fft(size, kernel);
+      ASSERT_EQ(kernel, fft.kernel());
+      QVector<float> actual(size / 2);
+      fft.Power2(input.constData(), actual.data());
+      ExpectSpectraEqual(expected, actual, size / 2);
+
+      // Odd lengths exercise the scalar tails
+      QVector<float> scaled(input);
+      fft.Scale(scaled.data(), size - 1, 0.5f);
+      QVector<float> averaged(input);
+      fft.Ewma(averaged.data(), expected.constData(), size / 2 - 1, 0.25f);
+      for (int i = 0; i < size - 1; ++i) {
+        EXPECT_FLOAT_EQ(input[i] * 0.5f, scaled[i]);
+      }
+      for (int i = 0; i < size / 2 - 1; ++i) {
+        EXPECT_FLOAT_EQ(input[i] * 0.25f + expected[i] * 0.75f, averaged[i]);
+      }
+    }
+  }
+}
+
+}  // namespace
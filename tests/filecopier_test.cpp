@@ -0,0 +1,171 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+
+#include "core/filecopier.h"
+#include "core/filesystemmusicstorage.h"
+#include "core/utilities.h"
+
+namespace {
+
+class FileCopierTest : public ::testing::Test {
+ protected:
+  void SetUp() {
+    path_ = Utilities::MakeTempDir();
+    source_ = path_ + "/source.mp3";
+    destination_ = path_ + "/destination.mp3";
+  }
+
+  void TearDown() {
+    FileCopier::set_first_method(FileCopier::Method_Clone);
+    Utilities::RemoveRecursive(path_);
+  }
+
+  // Writes a file that takes a few chunks to copy, so progress is reported
+  // more than once.
+  QByteArray WriteSource() {
+    QByteArray data;
+    data.reserve(2 * FileCopier::kChunkSize + 123);
+    while (data.size() < 2 * FileCopier::kChunkSize + 123) {
+      data.append(char(data.size() % 251));
+    }
+
+    QFile file(source_);
+    file.open(QIODevice::WriteOnly);
+    file.write(data);
+    return data;
+  }
+
+  QByteArray ReadFile(const QString& filename) {
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) return QByteArray();
+    return file.readAll();
+  }
+
+  QString path_;
+  QString source_;
+  QString destination_;
+};
+
+TEST_F(FileCopierTest, CopiesWithEachMethod) {
+  const QByteArray data = WriteSource();
+
+  QList<FileCopier::Method> methods;
+  methods << FileCopier::Method_Clone << FileCopier::Method_CopyFileRange
+          << FileCopier::Method_Sendfile << FileCopier::Method_ReadWrite;
+
+  for (FileCopier::Method first_method : methods) {
+    SCOPED_TRACE(first_method);
+    FileCopier::set_first_method(first_method);
+    QFile::remove(destination_);
+
+    QList<qint64> progress;
+    FileCopier::Method method;
+    ASSERT_TRUE(FileCopier::Copy(
+        source_, destination_,
+        [&progress](qint64 copied, qint64 total) {
+          EXPECT_EQ(2 * FileCopier::kChunkSize + 123, total);
+          progress << copied;
+        },
+        &method));
+
+    EXPECT_GE(method, first_method);
+    EXPECT_TRUE(data == ReadFile(destination_));
+
+    // Progress only goes forwards, and ends at the size of the file
+    ASSERT_FALSE(progress.isEmpty());
+    for (int i = 1; i < progress.count(); ++i) {
+      EXPECT_GT(progress[i], progress[i - 1]);
+    }
+    EXPECT_EQ(data.size(), progress.last());
+  }
+}
+
+TEST_F(FileCopierTest, KeepsPermissions) {
+  WriteSource();
+  const QFile::Permissions permissions =
+      QFile::ReadOwner | QFile::WriteOwner | QFile::ReadGroup;
+  QFile::setPermissions(source_, permissions);
+
+  ASSERT_TRUE(FileCopier::Copy(source_, destination_));
+  EXPECT_EQ(QFile::permissions(source_), QFile::permissions(destination_));
+}
+
+TEST_F(FileCopierTest, DoesNotOverwrite) {
+  WriteSource();
+  QFile file(destination_);
+  file.open(QIODevice::WriteOnly);
+  file.write("existing");
+  file.close();
+
+  EXPECT_FALSE(FileCopier::Copy(source_, destination_));
+  EXPECT_EQ(QByteArray("existing"), ReadFile(destination_));
+}
+
+TEST_F(FileCopierTest, MissingSource) {
+  EXPECT_FALSE(FileCopier::Copy(source_, destination_));
+  EXPECT_FALSE(QFile::exists(destination_));
+}
+
+TEST_F(FileCopierTest, StorageReportsProgress) {
+  const QByteArray data = WriteSource();
+  FilesystemMusicStorage storage(path_);
+
+  QList<float> progress;
+  MusicStorage::CopyJob job;
+  job.source_ = source_;
+  job.destination_ = "Artist/Album/01 - Title.mp3";
+  job.overwrite_ = false;
+  job.mark_as_listened_ = false;
+  job.remove_original_ = false;
+  job.progress_ = [&progress](float value) { progress << value; };
+
+  ASSERT_TRUE(storage.CopyToStorage(job));
+  EXPECT_TRUE(data == ReadFile(path_ + "/" + job.destination_));
+  EXPECT_TRUE(QFile::exists(source_));
+
+  ASSERT_FALSE(progress.isEmpty());
+  EXPECT_FLOAT_EQ(1.0, progress.last());
+
+  // A second copy to the same place fails unless it's allowed to overwrite
+  EXPECT_FALSE(storage.CopyToStorage(job));
+  job.overwrite_ = true;
+  EXPECT_TRUE(storage.CopyToStorage(job));
+}
+
+TEST_F(FileCopierTest, StorageMovesFiles) {
+  const QByteArray data = WriteSource();
+  FilesystemMusicStorage storage(path_);
+
+  MusicStorage::CopyJob job;
+  job.source_ = source_;
+  job.destination_ = "moved.mp3";
+  job.overwrite_ = false;
+  job.mark_as_listened_ = false;
+  job.remove_original_ = true;
+
+  ASSERT_TRUE(storage.CopyToStorage(job));
+  EXPECT_FALSE(QFile::exists(source_));
+  EXPECT_TRUE(data == ReadFile(path_ + "/moved.mp3"));
+}
+
+}  // namespace
@@ -0,0 +1,90 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Times adding 100000 songs to the library in batches, the way a first scan
+// does, with and without a bulk insert.
+
+#include <memory>
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <QElapsedTimer>
+#include <QtDebug>
+
+#include "core/database.h"
+#include "core/song.h"
+#include "library/library.h"
+#include "library/librarybackend.h"
+
+namespace {
+
+const int kSongCount = 100000;
+const int kBatchSize = 1000;
+
+class LibraryBackendBenchmark : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    database_.reset(new MemoryDatabase(nullptr));
+    backend_.reset(new LibraryBackend);
+    backend_->Init(database_.get(), Library::kSongsTable, Library::kDirsTable,
+                   Library::kSubdirsTable, Library::kFtsTable);
+    backend_->AddDirectory("/tmp");
+
+    for (int i = 0; i < kSongCount; ++i) {
+      Song song;
+      song.set_directory_id(1);
+      song.set_url(QUrl::fromLocalFile(QString("/tmp/%1.mp3").arg(i)));
+      song.set_title(QString("Title%1").arg(i));
+      song.set_artist(QString("Artist%1").arg(i % 1000));
+      song.set_album(QString("Album%1").arg(i % 5000));
+      song.set_mtime(1);
+      song.set_ctime(1);
+      song.set_filesize(1);
+      songs_ << song;
+    }
+  }
+
+  void AddSongs() {
+    for (int i = 0; i < songs_.count(); i += kBatchSize) {
+      backend_->AddOrUpdateSongs(songs_.mid(i, kBatchSize));
+    }
+  }
+
+  std::unique_ptr<Database> database_;
+  std::unique_ptr<LibraryBackend> backend_;
+  SongList songs_;
+};
+
+TEST_F(LibraryBackendBenchmark, Normal) {
+  QElapsedTimer timer;
+  timer.start();
+  AddSongs();
+  qDebug() << "Inserted" << kSongCount << "songs in" << timer.elapsed()
+           << "ms";
+}
+
+TEST_F(LibraryBackendBenchmark, Bulk) {
+  QElapsedTimer timer;
+  timer.start();
+  backend_->BeginBulkInsert(1);
+  AddSongs();
+  backend_->EndBulkInsert(1);
+  qDebug() << "Inserted" << kSongCount << "songs in" << timer.elapsed()
+           << "ms in bulk";
+}
+
+}  // namespace
@@ -0,0 +1,162 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <memory>
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <QSqlQuery>
+#include <QVariant>
+
+#include "core/database.h"
+#include "core/song.h"
+#include "library/library.h"
+#include "library/librarybackend.h"
+
+namespace {
+
+class LibraryBackendBulkInsertTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    database_.reset(new MemoryDatabase(nullptr));
+    backend_.reset(new LibraryBackend);
+    backend_->Init(database_.get(), Library::kSongsTable, Library::kDirsTable,
+                   Library::kSubdirsTable, Library::kFtsTable);
+
+    // These get IDs 1 and 2
+    backend_->AddDirectory("/tmp");
+    backend_->AddDirectory("/");
+  }
+
+  static SongList MakeSongs(int directory_id, int count, int first = 0) {
+    SongList ret;
+    for (int i = first; i < first + count; ++i) {
+      Song song;
+      song.set_directory_id(directory_id);
+      song.set_url(QUrl::fromLocalFile(
+          QString("/%1/%2.mp3").arg(directory_id).arg(i)));
+      song.set_title(QString("Title%1").arg(i));
+      song.set_mtime(1);
+      song.set_ctime(1);
+      song.set_filesize(1);
+      ret << song;
+    }
+    return ret;
+  }
+
+  // The number of songs the FTS index finds with this title.
+  int FtsMatches(const QString& title) {
+    QSqlDatabase db(database_->Connect());
+    QSqlQuery q(QString("SELECT COUNT(*) FROM %1 WHERE ftstitle MATCH ?")
+                    .arg(Library::kFtsTable),
+                db);
+    q.addBindValue(title);
+    if (!q.exec() || !q.next()) return -1;
+    return q.value(0).toInt();
+  }
+
+  int FtsRows() {
+    QSqlDatabase db(database_->Connect());
+    QSqlQuery q(QString("SELECT COUNT(*) FROM %1").arg(Library::kFtsTable),
+                db);
+    if (!q.exec() || !q.next()) return -1;
+    return q.value(0).toInt();
+  }
+
+  std::unique_ptr<Database> database_;
+  std::unique_ptr<LibraryBackend> backend_;
+};
+
+TEST_F(LibraryBackendBulkInsertTest, IndexesWhenFinished) {
+  const SongList songs = MakeSongs(1, 5000);
+
+  backend_->BeginBulkInsert(1);
+  for (int i = 0; i < songs.count(); i += 1000) {
+    backend_->AddOrUpdateSongs(songs.mid(i, 1000));
+  }
+
+  // The songs are in the library but can't be searched for yet
+  EXPECT_EQ(5000, backend_->GetAllSongs().count());
+  EXPECT_EQ(0, FtsRows());
+
+  backend_->EndBulkInsert(1);
+
+  EXPECT_EQ(5000, FtsRows());
+  EXPECT_EQ(1, FtsMatches("Title42"));
+  EXPECT_EQ(1, FtsMatches("Title4999"));
+}
+
+TEST_F(LibraryBackendBulkInsertTest, MatchesNormalInsert) {
+  backend_->AddOrUpdateSongs(MakeSongs(2, 100));
+
+  backend_->BeginBulkInsert(1);
+  backend_->AddOrUpdateSongs(MakeSongs(1, 100));
+  backend_->EndBulkInsert(1);
+
+  // Both copies of every song are found
+  EXPECT_EQ(200, FtsRows());
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(2, FtsMatches(QString("Title%1").arg(i)));
+  }
+}
+
+TEST_F(LibraryBackendBulkInsertTest, OtherDirectoriesAreIndexed) {
+  backend_->BeginBulkInsert(1);
+  backend_->AddOrUpdateSongs(MakeSongs(1, 10));
+
+  // Songs added to another directory in the meantime are searchable straight
+  // away
+  backend_->AddOrUpdateSongs(MakeSongs(2, 10, 100));
+  EXPECT_EQ(10, FtsRows());
+  EXPECT_EQ(1, FtsMatches("Title105"));
+  EXPECT_EQ(0, FtsMatches("Title5"));
+
+  backend_->EndBulkInsert(1);
+  EXPECT_EQ(20, FtsRows());
+  EXPECT_EQ(1, FtsMatches("Title5"));
+}
+
+TEST_F(LibraryBackendBulkInsertTest, Nested) {
+  backend_->BeginBulkInsert(1);
+  backend_->BeginBulkInsert(1);
+  backend_->AddOrUpdateSongs(MakeSongs(1, 10));
+
+  backend_->EndBulkInsert(1);
+  EXPECT_EQ(0, FtsRows());
+
+  backend_->EndBulkInsert(1);
+  EXPECT_EQ(10, FtsRows());
+}
+
+TEST_F(LibraryBackendBulkInsertTest, IndexesInterruptedInsertOnStartup) {
+  backend_->AddOrUpdateSongs(MakeSongs(2, 10, 100));
+  backend_->BeginBulkInsert(1);
+  backend_->AddOrUpdateSongs(MakeSongs(1, 10));
+
+  // Quit before the bulk insert finished and start again
+  backend_.reset(new LibraryBackend);
+  backend_->Init(database_.get(), Library::kSongsTable, Library::kDirsTable,
+                 Library::kSubdirsTable, Library::kFtsTable);
+  EXPECT_EQ(10, FtsRows());
+
+  backend_->LoadDirectories();
+  EXPECT_EQ(20, FtsRows());
+  EXPECT_EQ(1, FtsMatches("Title5"));
+  EXPECT_EQ(1, FtsMatches("Title105"));
+}
+
+}  // namespace
@@ -0,0 +1,107 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Times removing and adding back a quarter of the songs in a fully loaded
+// library tree, and counts the row signals the views would have to handle.
+
+#include <memory>
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <QElapsedTimer>
+#include <QSignalSpy>
+#include <QtDebug>
+
+#include "core/database.h"
+#include "core/song.h"
+#include "library/library.h"
+#include "library/librarybackend.h"
+#include "library/librarymodel.h"
+
+namespace {
+
+const int kAlbums = 50;
+const int kSongsPerAlbum = 20;
+
+class LibraryModelBenchmark : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    database_.reset(new MemoryDatabase(nullptr));
+    backend_.reset(new LibraryBackend);
+    backend_->Init(database_.get(), Library::kSongsTable, Library::kDirsTable,
+                   Library::kSubdirsTable, Library::kFtsTable);
+    backend_->AddDirectory("/tmp");
+    model_.reset(new LibraryModel(backend_.get(), nullptr));
+  }
+
+  std::unique_ptr<Database> database_;
+  std::unique_ptr<LibraryBackend> backend_;
+  std::unique_ptr<LibraryModel> model_;
+};
+
+TEST_F(LibraryModelBenchmark, RemoveAndAddSongs) {
+  SongList songs;
+  for (int album = 0; album < kAlbums; ++album) {
+    for (int i = 0; i < kSongsPerAlbum; ++i) {
+      Song song;
+      song.Init(QString("Title %1").arg(i), "Artist",
+                QString("Album %1").arg(album), 123);
+      song.set_directory_id(1);
+      song.set_url(QUrl("file:///tmp/foo"));
+      song.set_mtime(1);
+      song.set_ctime(1);
+      song.set_filesize(1);
+      backend_->AddOrUpdateSongs(SongList() << song);
+
+      song.set_id(songs.count() + 1);
+      songs << song;
+    }
+  }
+  model_->Init(false);
+
+  QModelIndex artist_index = model_->index(0, 0, QModelIndex());
+  model_->fetchMore(artist_index);
+  for (int album = 0; album < kAlbums; ++album) {
+    model_->fetchMore(model_->index(album, 0, artist_index));
+  }
+
+  QSignalSpy spy_remove(model_.get(),
+                        SIGNAL(rowsRemoved(QModelIndex, int, int)));
+  QSignalSpy spy_insert(model_.get(),
+                        SIGNAL(rowsInserted(QModelIndex, int, int)));
+
+  // Take every fourth song out of every album and put them back again.
+  SongList some;
+  for (int i = 0; i < songs.count(); i += 4) some << songs[i];
+
+  QElapsedTimer timer;
+  timer.start();
+  backend_->DeleteSongs(some);
+  const qint64 delete_msec = timer.restart();
+  for (Song& song : some) song.set_id(-1);
+  backend_->AddOrUpdateSongs(some);
+  const qint64 add_msec = timer.elapsed();
+
+  qDebug() << some.count() << "songs removed in" << delete_msec << "ms with"
+           << spy_remove.count() << "signals, added in" << add_msec
+           << "ms with" << spy_insert.count() << "signals";
+
+  EXPECT_EQ(kAlbums, spy_insert.count());
+  EXPECT_EQ(some.count(), spy_remove.count());
+}
+
+}  // namespace
@@ -26,18 +26,27 @@
 #include "library/library.h"
 
 #include <QtDebug>
+#include <QEventLoop>
 #include <QThread>
+#include <QTimer>
 #include <QSignalSpy>
 #include <QSortFilterProxyModel>
+#include <QTemporaryFile>
 
 namespace {
 
 class LibraryModelTest : public ::testing::Test {
  protected:
-  void SetUp() {
-    database_.reset(new MemoryDatabase);
+  void SetUp() { CreateModel(new MemoryDatabase(nullptr)); }
+
+  void CreateModel(Database* database) {
+    model_sorted_.reset();
+    model_.reset();
+    backend_.reset();
+    database_.reset(database);
+
     backend_.reset(new LibraryBackend);
-    backend_->Init(database_, Library::kSongsTable,
+    backend_->Init(database_.get(), Library::kSongsTable,
                    Library::kDirsTable, Library::kSubdirsTable, Library::kFtsTable);
     model_.reset(new LibraryModel(backend_.get(), nullptr));
 
@@ -72,7 +81,16 @@ class LibraryModelTest : public ::testing::Test {
     return AddSong(song);
   }
 
-  std::shared_ptr<Database> database_;
+  // Runs the event loop until the model emits signal, for the results of
+  // background queries.
+  void WaitFor(const char* signal) {
+    QEventLoop loop;
+    QObject::connect(model_.get(), signal, &loop, SLOT(quit()));
+    QTimer::singleShot(10000, &loop, SLOT(quit()));
+    loop.exec();
+  }
+
+  std::unique_ptr<Database> database_;
   std::unique_ptr<LibraryBackend> backend_;
   std::unique_ptr<LibraryModel> model_;
   std::unique_ptr<QSortFilterProxyModel> model_sorted_;
@@ -229,8 +247,9 @@ TEST_F(LibraryModelTest, RemoveSongsLazyLoaded) {
 
   backend_->DeleteSongs(SongList() << one << two);
 
-  ASSERT_EQ(2, spy_preremove.count());
-  ASSERT_EQ(2, spy_remove.count());
+  // Both songs were next to each other so they go in one signal
+  ASSERT_EQ(1, spy_preremove.count());
+  ASSERT_EQ(1, spy_remove.count());
   ASSERT_EQ(0, spy_reset.count());
 
   artist_index = model_->index(0, 0, QModelIndex());
@@ -304,4 +323,175 @@ TEST_F(LibraryModelTest, RemoveEmptyArtists) {
   ASSERT_EQ(0, model_->rowCount(QModelIndex()));
 }
 
+TEST_F(LibraryModelTest, AddSongsToLoadedAlbum) {
+  AddSong("Title", "Artist", "Album", 123);
+  model_->Init(false);
+
+  QModelIndex artist_index = model_->index(0, 0, QModelIndex());
+  model_->fetchMore(artist_index);
+  QModelIndex album_index = model_->index(0, 0, artist_index);
+  model_->fetchMore(album_index);
+  ASSERT_EQ(1, model_->rowCount(album_index));
+
+  QSignalSpy spy_insert(model_.get(), SIGNAL(rowsInserted(QModelIndex,int,int)));
+  QSignalSpy spy_reset(model_.get(), SIGNAL(modelReset()));
+
+  SongList songs;
+  for (int i = 0; i < 50; ++i) {
+    Song song;
+    song.Init(QString("Title %1").arg(i), "Artist", "Album", 123);
+    song.set_directory_id(1);
+    song.set_mtime(1);
+    song.set_ctime(1);
+    song.set_url(QUrl("file:///tmp/foo"));
+    song.set_filesize(1);
+    songs << song;
+  }
+  backend_->AddOrUpdateSongs(songs);
+
+  // All the new songs go under the album in one signal
+  ASSERT_EQ(1, spy_insert.count());
+  EXPECT_EQ(album_index, spy_insert[0][0].value<QModelIndex>());
+  EXPECT_EQ(1, spy_insert[0][1].toInt());
+  EXPECT_EQ(50, spy_insert[0][2].toInt());
+  ASSERT_EQ(0, spy_reset.count());
+  ASSERT_EQ(51, model_->rowCount(album_index));
+}
+
+TEST_F(LibraryModelTest, AddManySongsResets) {
+  AddSong("Title", "Artist", "Album", 123);
+  model_->Init(false);
+
+  QSignalSpy spy_insert(model_.get(), SIGNAL(rowsInserted(QModelIndex,int,int)));
+  QSignalSpy spy_reset(model_.get(), SIGNAL(modelReset()));
+
+  SongList songs;
+  for (int i = 0; i < LibraryModel::kMinResetBatchSize; ++i) {
+    Song song;
+    song.Init("Title", QString("Artist %1").arg(i), "Album", 123);
+    song.set_directory_id(1);
+    song.set_mtime(1);
+    song.set_ctime(1);
+    song.set_url(QUrl("file:///tmp/foo"));
+    song.set_filesize(1);
+    songs << song;
+  }
+  backend_->AddOrUpdateSongs(songs);
+
+  // That's most of the tree, so it gets loaded again instead
+  ASSERT_EQ(0, spy_insert.count());
+  ASSERT_EQ(1, spy_reset.count());
+
+  // Every artist plus the one divider for the letter A
+  ASSERT_EQ(LibraryModel::kMinResetBatchSize + 2,
+            model_->rowCount(QModelIndex()));
+}
+
+TEST_F(LibraryModelTest, RemoveSongRanges) {
+  SongList songs;
+  for (int i = 0; i < 20; ++i) {
+    Song song = AddSong(QString("Title %1").arg(i), "Artist", "Album", 123);
+    song.set_id(i + 1);
+    songs << song;
+  }
+  model_->Init(false);
+
+  QModelIndex artist_index = model_->index(0, 0, QModelIndex());
+  model_->fetchMore(artist_index);
+  QModelIndex album_index = model_->index(0, 0, artist_index);
+  model_->fetchMore(album_index);
+  ASSERT_EQ(20, model_->rowCount(album_index));
+
+  QSignalSpy spy_remove(model_.get(), SIGNAL(rowsRemoved(QModelIndex,int,int)));
+  QSignalSpy spy_reset(model_.get(), SIGNAL(modelReset()));
+
+  // Two separate runs of songs
+  backend_->DeleteSongs(songs.mid(0, 5) + songs.mid(10, 5));
+
+  ASSERT_EQ(2, spy_remove.count());
+  EXPECT_EQ(10, spy_remove[0][1].toInt());
+  EXPECT_EQ(14, spy_remove[0][2].toInt());
+  EXPECT_EQ(0, spy_remove[1][1].toInt());
+  EXPECT_EQ(4, spy_remove[1][2].toInt());
+  ASSERT_EQ(0, spy_reset.count());
+
+  ASSERT_EQ(10, model_->rowCount(album_index));
+  EXPECT_EQ("Title 5", model_->index(0, 0, album_index).data().toString());
+  EXPECT_EQ("Title 15", model_->index(5, 0, album_index).data().toString());
+}
+
+TEST_F(LibraryModelTest, GetChildSongsWithoutLoading) {
+  AddSong("Title 2", "Artist", "Album 2", 123);
+  AddSong("Title 1", "Artist", "Album 2", 123);
+  AddSong("Title 1", "Artist", "Album 1", 123);
+  model_->Init(false);
+
+  QModelIndex artist_index = model_->index(0, 0, QModelIndex());
+  ASSERT_TRUE(model_->canFetchMore(artist_index));
+
+  // The songs come back in the order they'd be shown in the tree
+  SongList songs = model_->GetChildSongs(artist_index);
+  ASSERT_EQ(3, songs.count());
+  EXPECT_EQ("Album 1", songs[0].album());
+  EXPECT_EQ("Album 2", songs[1].album());
+  EXPECT_EQ("Title 1", songs[1].title());
+  EXPECT_EQ("Album 2", songs[2].album());
+  EXPECT_EQ("Title 2", songs[2].title());
+
+  // Without loading anything into the model
+  EXPECT_TRUE(model_->canFetchMore(artist_index));
+}
+
+TEST_F(LibraryModelTest, LazyPopulateAsync) {
+  // The queries run on other threads, which would each get their own empty
+  // in-memory database.
+  QTemporaryFile file;
+  ASSERT_TRUE(file.open());
+  CreateModel(new Database(nullptr, nullptr, file.fileName()));
+
+  // Too many artists for them all to be loaded in advance
+  const int kArtists = LibraryModel::kMaxPrefetchChildren + 1;
+  for (int i = 0; i < kArtists; ++i) {
+    AddSong("Title", QString("Artist %1").arg(i), "Album", 123);
+  }
+
+  model_->Init(true);
+  WaitFor(SIGNAL(modelReset()));
+
+  // Every artist plus the divider for the letter A
+  ASSERT_EQ(kArtists + 1, model_->rowCount(QModelIndex()));
+  QModelIndex artist_index;
+  for (int row = 0; row < model_->rowCount(QModelIndex()); ++row) {
+    QModelIndex index = model_->index(row, 0, QModelIndex());
+    EXPECT_TRUE(index.data().toString() == "A" || model_->canFetchMore(index));
+    if (index.data().toString() == "Artist 0") artist_index = index;
+  }
+  ASSERT_TRUE(artist_index.isValid());
+
+  // Nothing is loaded until the results come back
+  model_->fetchMore(artist_index);
+  EXPECT_FALSE(model_->canFetchMore(artist_index));
+  ASSERT_EQ(1, model_->rowCount(artist_index));
+  EXPECT_EQ("Loading...", model_->index(0, 0, artist_index).data().toString());
+
+  QSignalSpy spy_insert(model_.get(), SIGNAL(rowsInserted(QModelIndex,int,int)));
+  WaitFor(SIGNAL(rowsInserted(QModelIndex,int,int)));
+
+  // The loading indicator was replaced by the album in one signal
+  ASSERT_LE(1, spy_insert.count());
+  EXPECT_EQ(artist_index, spy_insert[0][0].value<QModelIndex>());
+  ASSERT_EQ(1, model_->rowCount(artist_index));
+  QModelIndex album_index = model_->index(0, 0, artist_index);
+  EXPECT_EQ("Album", album_index.data().toString());
+
+  // That's the only album, so its songs are loaded without asking
+  EXPECT_FALSE(model_->canFetchMore(album_index));
+  ASSERT_EQ(1, model_->rowCount(album_index));
+  EXPECT_EQ("Loading...", model_->index(0, 0, album_index).data().toString());
+  WaitFor(SIGNAL(rowsInserted(QModelIndex,int,int)));
+
+  ASSERT_EQ(1, model_->rowCount(album_index));
+  EXPECT_EQ("Title", model_->index(0, 0, album_index).data().toString());
+}
+
 } // namespace
@@ -0,0 +1,67 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Times loading 500000 songs into the library search index, and searching it
+// a letter at a time as a query is typed.
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QtDebug>
+
+#include "globalsearch/librarysearchindex.h"
+
+namespace {
+
+TEST(LibrarySearchIndexBenchmark, LoadAndType) {
+  const QStringList words = QStringList() << "love"
+                                          << "night"
+                                          << "dance"
+                                          << "heart"
+                                          << "fire"
+                                          << "blue"
+                                          << "dream"
+                                          << "rain";
+  const int kSongs = 500000;
+
+  LibrarySearchIndex index;
+  QElapsedTimer timer;
+  timer.start();
+  index.BeginLoad();
+  for (int i = 0; i < kSongs; ++i) {
+    QStringList fields;
+    fields << QString("%1 %2 %3").arg(words[i % 8], words[(i / 8) % 8],
+                                      QString::number(i))
+           << QString("album%1").arg(i / 12)
+           << QString("artist%1").arg(i / 100);
+    index.LoadSong(i + 1, fields);
+  }
+  index.EndLoad();
+  qDebug() << "Loaded" << kSongs << "songs in" << timer.elapsed() << "ms";
+
+  const QString typed = "artist12 love nig";
+  for (int i = 1; i <= typed.length(); ++i) {
+    const QString query = typed.left(i);
+    timer.restart();
+    const int count = index.Search(query, 500).count();
+    qDebug() << query << count << "results in"
+             << timer.nsecsElapsed() / 1000000.0 << "ms";
+  }
+}
+
+}  // namespace
@@ -0,0 +1,145 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include "core/song.h"
+#include "globalsearch/librarysearchindex.h"
+
+namespace {
+
+Song MakeSong(int id, const QString& title, const QString& artist,
+              const QString& album, int year = -1) {
+  Song song;
+  song.Init(title, artist, album, 100);
+  song.set_id(id);
+  song.set_year(year);
+  return song;
+}
+
+class LibrarySearchIndexTest : public ::testing::Test {
+ protected:
+  void SetUp() {
+    index_.AddOrUpdateSongs(
+        SongList() << MakeSong(1, "Paranoid Android", "Radiohead", "OK Computer")
+                   << MakeSong(2, "Karma Police", "Radiohead", "OK Computer")
+                   << MakeSong(3, "Radio Ga Ga", "Queen", "The Works", 1984)
+                   << MakeSong(4, "Café del Mar", "Energy 52", "Café del Mar")
+                   << MakeSong(5, "Firestarter", "The Prodigy", "Android"));
+  }
+
+  LibrarySearchIndex index_;
+};
+
+TEST_F(LibrarySearchIndexTest, Tokenize) {
+  EXPECT_EQ(QStringList() << "cafe"
+                          << "del"
+                          << "mar",
+            LibrarySearchIndex::Tokenize("Café del-Mar!"));
+  EXPECT_EQ(QStringList() << "ac"
+                          << "dc",
+            LibrarySearchIndex::Tokenize("AC/DC"));
+  EXPECT_TRUE(LibrarySearchIndex::Tokenize(" ...").isEmpty());
+}
+
+TEST_F(LibrarySearchIndexTest, PrefixesMatchAnyColumn) {
+  EXPECT_EQ(QList<int>() << 3 << 1 << 2, index_.Search("radio", 10));
+  EXPECT_EQ(QList<int>() << 4, index_.Search("cafe", 10));
+  EXPECT_EQ(QList<int>() << 4, index_.Search("CAF", 10));
+  EXPECT_EQ(QList<int>() << 3, index_.Search("1984", 10));
+  EXPECT_TRUE(index_.Search("zzz", 10).isEmpty());
+  EXPECT_TRUE(index_.Search("", 10).isEmpty());
+}
+
+TEST_F(LibrarySearchIndexTest, AllTermsMustMatch) {
+  EXPECT_EQ(QList<int>() << 2, index_.Search("radiohead karma", 10));
+  EXPECT_EQ(QList<int>() << 2, index_.Search("karma radiohead", 10));
+  EXPECT_TRUE(index_.Search("queen karma", 10).isEmpty());
+}
+
+TEST_F(LibrarySearchIndexTest, ColumnRestrictions) {
+  EXPECT_EQ(QList<int>() << 1 << 2, index_.Search("artist:radio", 10));
+  EXPECT_EQ(QList<int>() << 3, index_.Search("title:radio", 10));
+  EXPECT_TRUE(index_.Search("title:radiohead", 10).isEmpty());
+  // Colons that aren't column names separate words
+  EXPECT_EQ(QList<int>() << 2, index_.Search("radiohead:karma", 10));
+}
+
+TEST_F(LibrarySearchIndexTest, Ranking) {
+  // Exact words count for more than prefixes
+  EXPECT_EQ(QList<int>() << 3 << 1 << 2, index_.Search("radio", 10));
+  // Titles count for more than albums
+  EXPECT_EQ(QList<int>() << 1 << 5, index_.Search("android", 10));
+  EXPECT_EQ(QList<int>() << 1, index_.Search("android", 1));
+}
+
+TEST_F(LibrarySearchIndexTest, Narrowing) {
+  EXPECT_EQ(3, index_.Search("r", 10).count());
+  EXPECT_EQ(3, index_.Search("ra", 10).count());
+  EXPECT_EQ(QList<int>() << 1 << 2, index_.Search("radiohe", 10));
+  EXPECT_EQ(QList<int>() << 1 << 2, index_.Search("radiohead p", 10));
+  EXPECT_EQ(QList<int>() << 1, index_.Search("radiohead para", 10));
+
+  // Going back must widen the results again
+  EXPECT_EQ(QList<int>() << 3 << 1 << 2, index_.Search("radio", 10));
+
+  // Changes to the library aren't hidden by the previous results
+  index_.Search("radio", 10);
+  index_.AddOrUpdateSongs(SongList()
+                          << MakeSong(6, "Radio", "Corrs", "In Blue"));
+  EXPECT_EQ(4, index_.Search("radio", 10).count());
+}
+
+TEST_F(LibrarySearchIndexTest, UpdatesAndRemovals) {
+  index_.AddOrUpdateSongs(SongList()
+                          << MakeSong(2, "Lucky", "Radiohead", "OK Computer"));
+  EXPECT_TRUE(index_.Search("karma", 10).isEmpty());
+  EXPECT_EQ(QList<int>() << 2, index_.Search("lucky", 10));
+
+  index_.RemoveSongs(SongList() << MakeSong(1, "", "", "")
+                                << MakeSong(2, "", "", "")
+                                << MakeSong(3, "", "", ""));
+  EXPECT_EQ(2, index_.song_count());
+  EXPECT_TRUE(index_.Search("radio", 10).isEmpty());
+  EXPECT_EQ(QList<int>() << 4, index_.Search("mar", 10));
+
+  index_.Clear();
+  EXPECT_EQ(0, index_.song_count());
+  EXPECT_TRUE(index_.Search("android", 10).isEmpty());
+}
+
+TEST_F(LibrarySearchIndexTest, LoadDoesNotOverwriteNewerChanges) {
+  LibrarySearchIndex index;
+  index.BeginLoad();
+  index.AddOrUpdateSongs(SongList() << MakeSong(1, "New", "Artist", "Album"));
+  index.RemoveSongs(SongList() << MakeSong(2, "", "", ""));
+
+  QStringList old_fields;
+  old_fields << "Old"
+             << "Album"
+             << "Artist";
+  index.LoadSong(1, old_fields);
+  index.LoadSong(2, old_fields);
+  index.LoadSong(3, old_fields);
+  index.EndLoad();
+
+  EXPECT_EQ(2, index.song_count());
+  EXPECT_EQ(QList<int>() << 1, index.Search("new", 10));
+  EXPECT_EQ(QList<int>() << 3, index.Search("old", 10));
+}
+
+}  // namespace
@@ -0,0 +1,107 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Times rescanning a flat directory that hasn't changed since it was last
+// scanned, at a few sizes so it's easy to see how the time grows.
+
+#include <memory>
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QtDebug>
+
+#include "core/database.h"
+#include "core/song.h"
+#include "core/taskmanager.h"
+#include "core/utilities.h"
+#include "library/library.h"
+#include "library/librarybackend.h"
+#include "library/librarywatcher.h"
+
+namespace {
+
+class LibraryWatcherBenchmark : public ::testing::TestWithParam<int> {
+ protected:
+  virtual void SetUp() {
+    database_.reset(new MemoryDatabase(nullptr));
+    backend_.reset(new LibraryBackend);
+    backend_->Init(database_.get(), Library::kSongsTable, Library::kDirsTable,
+                   Library::kSubdirsTable, Library::kFtsTable);
+
+    watcher_.reset(new LibraryWatcher);
+    watcher_->set_backend(backend_.get());
+    watcher_->set_task_manager(&task_manager_);
+
+    path_ = Utilities::MakeTempDir();
+  }
+
+  virtual void TearDown() { Utilities::RemoveRecursive(path_); }
+
+  std::unique_ptr<Database> database_;
+  std::unique_ptr<LibraryBackend> backend_;
+  std::unique_ptr<LibraryWatcher> watcher_;
+  TaskManager task_manager_;
+  QString path_;
+};
+
+TEST_P(LibraryWatcherBenchmark, RescanUnchangedDirectory) {
+  const int song_count = GetParam();
+  backend_->AddDirectory(path_);
+
+  SongList songs;
+  for (int i = 0; i < song_count; ++i) {
+    const QString filename = QString("%1/%2.mp3").arg(path_).arg(i);
+    QFile file(filename);
+    ASSERT_TRUE(file.open(QIODevice::WriteOnly));
+    file.close();
+
+    Song song;
+    song.set_directory_id(1);
+    song.set_url(QUrl::fromLocalFile(filename));
+    song.set_title(QString::number(i));
+    song.set_mtime(QFileInfo(filename).lastModified().toTime_t());
+    song.set_ctime(1);
+    song.set_filesize(1);
+    songs << song;
+  }
+  backend_->AddOrUpdateSongs(songs);
+
+  Directory dir;
+  dir.id = 1;
+  dir.path = path_;
+
+  // An mtime of 0 forces the subdirectory to be compared against the disk.
+  Subdirectory subdir;
+  subdir.directory_id = 1;
+  subdir.path = path_;
+  subdir.mtime = 0;
+
+  QElapsedTimer timer;
+  timer.start();
+  watcher_->AddDirectory(dir, SubdirectoryList() << subdir);
+  qDebug() << "Rescanned" << song_count << "files in" << timer.elapsed()
+           << "ms";
+}
+
+INSTANTIATE_TEST_CASE_P(Sizes, LibraryWatcherBenchmark,
+                        ::testing::Values(12500, 25000, 50000));
+
+}  // namespace
@@ -0,0 +1,142 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <memory>
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSignalSpy>
+
+#include "core/database.h"
+#include "core/song.h"
+#include "core/taskmanager.h"
+#include "library/library.h"
+#include "library/librarybackend.h"
+#include "library/librarywatcher.h"
+
+namespace {
+
+class LibraryWatcherTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    database_.reset(new MemoryDatabase(nullptr));
+    backend_.reset(new LibraryBackend);
+    backend_->Init(database_.get(), Library::kSongsTable, Library::kDirsTable,
+                   Library::kSubdirsTable, Library::kFtsTable);
+
+    watcher_.reset(new LibraryWatcher);
+    watcher_->set_backend(backend_.get());
+    watcher_->set_task_manager(&task_manager_);
+
+    path_ = QDir::temp().filePath(
+        QString("clementine_librarywatcher_test_%1")
+            .arg(QCoreApplication::applicationPid()));
+    QDir().mkpath(path_);
+    path_ = QFileInfo(path_).canonicalFilePath();
+  }
+
+  virtual void TearDown() {
+    QDir dir(path_);
+    for (const QString& file : dir.entryList(QDir::Files)) {
+      dir.remove(file);
+    }
+    QDir().rmdir(path_);
+  }
+
+  // Creates count empty files on disk and adds a song for each of them to
+  // the library, as if they had been scanned before.
+  void CreateSongs(int count) {
+    backend_->AddDirectory(path_);
+
+    SongList songs;
+    for (int i = 0; i < count; ++i) {
+      const QString filename = QString("%1/%2.mp3").arg(path_).arg(i);
+      QFile file(filename);
+      ASSERT_TRUE(file.open(QIODevice::WriteOnly));
+      file.close();
+
+      Song song;
+      song.set_directory_id(1);
+      song.set_url(QUrl::fromLocalFile(filename));
+      song.set_title(QString::number(i));
+      song.set_mtime(QFileInfo(filename).lastModified().toTime_t());
+      song.set_ctime(1);
+      song.set_filesize(1);
+      songs << song;
+    }
+    backend_->AddOrUpdateSongs(songs);
+  }
+
+  std::unique_ptr<Database> database_;
+  std::unique_ptr<LibraryBackend> backend_;
+  std::unique_ptr<LibraryWatcher> watcher_;
+  TaskManager task_manager_;
+  QString path_;
+};
+
+TEST_F(LibraryWatcherTest, RescanUnchangedDirectory) {
+  CreateSongs(1000);
+
+  QSignalSpy new_spy(watcher_.get(), SIGNAL(NewOrUpdatedSongs(SongList)));
+  QSignalSpy deleted_spy(watcher_.get(), SIGNAL(SongsDeleted(SongList)));
+
+  Directory dir;
+  dir.id = 1;
+  dir.path = path_;
+
+  // An mtime of 0 forces the subdirectory to be compared against the disk.
+  Subdirectory subdir;
+  subdir.directory_id = 1;
+  subdir.path = path_;
+  subdir.mtime = 0;
+
+  watcher_->AddDirectory(dir, SubdirectoryList() << subdir);
+
+  // Nothing changed on disk, so nothing should have been added or deleted.
+  EXPECT_EQ(0, new_spy.count());
+  EXPECT_EQ(0, deleted_spy.count());
+}
+
+TEST_F(LibraryWatcherTest, DeletedFilesAreDetected) {
+  CreateSongs(100);
+  QFile::remove(path_ + "/42.mp3");
+
+  QSignalSpy deleted_spy(watcher_.get(), SIGNAL(SongsDeleted(SongList)));
+
+  Directory dir;
+  dir.id = 1;
+  dir.path = path_;
+
+  Subdirectory subdir;
+  subdir.directory_id = 1;
+  subdir.path = path_;
+  subdir.mtime = 0;
+
+  watcher_->AddDirectory(dir, SubdirectoryList() << subdir);
+
+  ASSERT_EQ(1, deleted_spy.count());
+  SongList deleted = deleted_spy[0][0].value<SongList>();
+  ASSERT_EQ(1, deleted.count());
+  EXPECT_EQ(path_ + "/42.mp3", deleted[0].url().toLocalFile());
+}
+
+}  // namespace
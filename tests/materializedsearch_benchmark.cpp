@@ -0,0 +1,120 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Times picking random songs from a 200000 song library with a long history
+// excluded, from a MaterializedSearch and with the ORDER BY random() query
+// QueryGenerator used before.
+
+#include <memory>
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <QBitArray>
+#include <QElapsedTimer>
+#include <QtDebug>
+
+#include "core/database.h"
+#include "core/song.h"
+#include "library/library.h"
+#include "library/librarybackend.h"
+#include "smartplaylists/materializedsearch.h"
+#include "smartplaylists/search.h"
+
+using smart_playlists::MaterializedSearch;
+using smart_playlists::Search;
+using smart_playlists::SearchTerm;
+
+namespace {
+
+const int kSongCount = 200000;
+const int kIterations = 20;
+const int kHistory = 1000;
+
+class MaterializedSearchBenchmark : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    database_.reset(new MemoryDatabase(nullptr));
+    backend_.reset(new LibraryBackend);
+    backend_->Init(database_.get(), Library::kSongsTable, Library::kDirsTable,
+                   Library::kSubdirsTable, Library::kFtsTable);
+    backend_->AddDirectory("/music");
+
+    // Every other song is by "even".
+    SongList songs;
+    for (int i = 0; i < kSongCount; ++i) {
+      Song song;
+      song.Init(QString::number(i), i % 2 ? "odd" : "even", "album", 100);
+      song.set_directory_id(1);
+      song.set_url(QUrl::fromLocalFile(QString("/music/%1.mp3").arg(i)));
+      song.set_mtime(1);
+      song.set_ctime(1);
+      song.set_filesize(1);
+      songs << song;
+    }
+    backend_->BeginBulkInsert(1);
+    backend_->AddOrUpdateSongs(songs);
+    backend_->EndBulkInsert(1);
+  }
+
+  std::unique_ptr<Database> database_;
+  std::unique_ptr<LibraryBackend> backend_;
+};
+
+TEST_F(MaterializedSearchBenchmark, Sample) {
+  const Search search(
+      Search::Type_And,
+      Search::TermList() << SearchTerm(SearchTerm::Field_Artist,
+                                       SearchTerm::Op_Equals, "even"),
+      Search::Sort_Random, SearchTerm::Field_Title, 10);
+
+  QList<int> history;
+  QBitArray history_bits(kSongCount + 1);
+  for (int i = 0; i < kHistory; ++i) {
+    history << i * 2 + 1;
+    history_bits.setBit(i * 2 + 1);
+  }
+
+  QElapsedTimer timer;
+  timer.start();
+  MaterializedSearch materialized(backend_.get(), search);
+  ASSERT_EQ(kSongCount / 2, materialized.count());
+  qDebug() << "Loading" << kSongCount / 2 << "matching songs took"
+           << timer.elapsed() << "ms";
+
+  // Both ways read the same 10 songs in full at the end.
+  timer.restart();
+  for (int i = 0; i < kIterations; ++i) {
+    const QList<int> ids = materialized.Sample(10, history_bits);
+    EXPECT_EQ(10, backend_->GetSongsById(ids).count());
+  }
+  const qint64 sample_nsec = timer.nsecsElapsed() / kIterations;
+
+  // What QueryGenerator used to do - ORDER BY random() with a NOT IN list.
+  Search sql_search(search);
+  sql_search.id_not_in_ = history;
+  timer.restart();
+  for (int i = 0; i < kIterations; ++i) {
+    EXPECT_EQ(10, backend_->FindSongs(sql_search).count());
+  }
+  const qint64 sql_nsec = timer.nsecsElapsed() / kIterations;
+
+  qDebug() << "Picking 10 of" << kSongCount << "songs with" << kHistory
+           << "excluded:" << sample_nsec / 1000 << "us in memory,"
+           << sql_nsec / 1000 << "us with NOT IN";
+}
+
+}  // namespace
@@ -0,0 +1,175 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <memory>
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <QBitArray>
+#include <QSet>
+
+#include "core/database.h"
+#include "core/song.h"
+#include "library/library.h"
+#include "library/librarybackend.h"
+#include "smartplaylists/materializedsearch.h"
+#include "smartplaylists/querygenerator.h"
+#include "smartplaylists/search.h"
+
+using smart_playlists::MaterializedSearch;
+using smart_playlists::QueryGenerator;
+using smart_playlists::Search;
+using smart_playlists::SearchTerm;
+
+namespace {
+
+class MaterializedSearchTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    database_.reset(new MemoryDatabase(nullptr));
+    backend_.reset(new LibraryBackend);
+    backend_->Init(database_.get(), Library::kSongsTable, Library::kDirsTable,
+                   Library::kSubdirsTable, Library::kFtsTable);
+    backend_->AddDirectory("/music");
+  }
+
+  Song MakeSong(int i, const QString& artist) {
+    Song song;
+    song.Init(QString::number(i), artist, "album", 100);
+    song.set_directory_id(1);
+    song.set_url(QUrl::fromLocalFile(QString("/music/%1.mp3").arg(i)));
+    song.set_mtime(1);
+    song.set_ctime(1);
+    song.set_filesize(1);
+    return song;
+  }
+
+  // Adds count songs, every other one by "even".
+  void AddSongs(int count) {
+    SongList songs;
+    for (int i = 0; i < count; ++i) {
+      songs << MakeSong(i, i % 2 ? "odd" : "even");
+    }
+    backend_->BeginBulkInsert(1);
+    backend_->AddOrUpdateSongs(songs);
+    backend_->EndBulkInsert(1);
+  }
+
+  static Search ArtistSearch(const QString& artist) {
+    return Search(Search::Type_And,
+                  Search::TermList() << SearchTerm(SearchTerm::Field_Artist,
+                                                   SearchTerm::Op_Equals,
+                                                   artist),
+                  Search::Sort_Random, SearchTerm::Field_Title, 10);
+  }
+
+  std::unique_ptr<Database> database_;
+  std::unique_ptr<LibraryBackend> backend_;
+};
+
+TEST_F(MaterializedSearchTest, MatchesSearch) {
+  AddSongs(10);
+
+  MaterializedSearch search(backend_.get(), ArtistSearch("even"));
+  EXPECT_EQ(5, search.count());
+  for (const Song& song : backend_->GetAllSongs()) {
+    EXPECT_EQ(song.artist() == "even", search.contains(song.id()));
+  }
+}
+
+TEST_F(MaterializedSearchTest, FollowsLibraryChanges) {
+  AddSongs(10);
+  MaterializedSearch search(backend_.get(), ArtistSearch("even"));
+  ASSERT_EQ(5, search.count());
+
+  // A new song that matches
+  backend_->AddOrUpdateSongs(SongList() << MakeSong(10, "even"));
+  EXPECT_EQ(6, search.count());
+
+  // One that doesn't
+  backend_->AddOrUpdateSongs(SongList() << MakeSong(11, "odd"));
+  EXPECT_EQ(6, search.count());
+
+  // A song that stops matching
+  Song changed = backend_->GetSongById(1);
+  ASSERT_EQ("even", changed.artist());
+  changed.set_artist("odd");
+  backend_->AddOrUpdateSongs(SongList() << changed);
+  EXPECT_EQ(5, search.count());
+  EXPECT_FALSE(search.contains(1));
+
+  // And one that starts
+  changed.set_artist("even");
+  backend_->AddOrUpdateSongs(SongList() << changed);
+  EXPECT_TRUE(search.contains(1));
+
+  // Deleted and unavailable songs
+  backend_->DeleteSongs(SongList() << backend_->GetSongById(1));
+  EXPECT_FALSE(search.contains(1));
+  backend_->MarkSongsUnavailable(SongList() << backend_->GetSongById(3));
+  EXPECT_FALSE(search.contains(3));
+  EXPECT_EQ(4, search.count());
+}
+
+TEST_F(MaterializedSearchTest, SampleSkipsExcluded) {
+  AddSongs(100);
+  MaterializedSearch search(backend_.get(), ArtistSearch("even"));
+
+  QBitArray exclude(200);
+  for (int id = 1; id <= 90; ++id) exclude.setBit(id);
+
+  // Only ids 91 to 100 are left, half of them by "even".
+  const QList<int> ids = search.Sample(10, exclude);
+  EXPECT_EQ(5, ids.count());
+  EXPECT_EQ(5, ids.toSet().count());
+  for (int id : ids) {
+    EXPECT_GT(id, 90);
+    EXPECT_TRUE(search.contains(id));
+  }
+}
+
+TEST_F(MaterializedSearchTest, DynamicPlaylistDoesNotRepeat) {
+  AddSongs(200);
+
+  QueryGenerator generator("test", ArtistSearch("even"), true);
+  generator.set_library(backend_.get());
+
+  // 100 songs match - the history and future of a dynamic playlist are
+  // smaller than that, so recent songs shouldn't come up again.
+  const int window =
+      generator.GetDynamicHistory() + generator.GetDynamicFuture();
+  ASSERT_LT(window, 100);
+
+  QList<int> ids;
+  for (const PlaylistItemPtr& item : generator.Generate()) {
+    ids << item->Metadata().id();
+  }
+  while (ids.count() < 300) {
+    for (const PlaylistItemPtr& item : generator.GenerateMore(5)) {
+      EXPECT_EQ("even", item->Metadata().artist());
+      ids << item->Metadata().id();
+    }
+  }
+
+  for (int i = 0; i < ids.count(); ++i) {
+    for (int j = qMax(0, i - window); j < i; ++j) {
+      EXPECT_NE(ids[i], ids[j]) << "positions " << j << " and " << i;
+    }
+  }
+}
+
+}  // namespace
@@ -0,0 +1,98 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <QImage>
+#include <QPixmap>
+#include <QUrl>
+
+#include "moodbar/moodbarpixmapcache.h"
+#include "moodbar/moodbarrenderer.h"
+
+namespace {
+
+QPixmap MakePixmap(int width, int height) {
+  QPixmap pixmap(width, height);
+  pixmap.fill(Qt::red);
+  return pixmap;
+}
+
+TEST(MoodbarPixmapCacheTest, HitsAndMisses) {
+  MoodbarPixmapCache cache;
+  const QPixmap pixmap = MakePixmap(100, 16);
+
+  EXPECT_TRUE(cache.Get("a").isNull());
+  cache.Insert("a", pixmap);
+  EXPECT_EQ(pixmap.size(), cache.Get("a").size());
+
+  MoodbarPixmapCacheStatistics stats = cache.statistics();
+  EXPECT_EQ(1u, stats.hits_);
+  EXPECT_EQ(1u, stats.misses_);
+  EXPECT_EQ(1u, stats.insertions_);
+  EXPECT_LT(0u, stats.memory_bytes_);
+  EXPECT_DOUBLE_EQ(0.5, stats.HitRatio());
+}
+
+TEST(MoodbarPixmapCacheTest, EvictsLeastRecentlyUsed) {
+  const QPixmap pixmap = MakePixmap(100, 16);
+  MoodbarPixmapCache cache(100 * 16 * pixmap.depth() / 8 * 2);
+
+  cache.Insert("a", pixmap);
+  cache.Insert("b", pixmap);
+  cache.Get("a");
+  cache.Insert("c", pixmap);
+
+  EXPECT_FALSE(cache.Get("a").isNull());
+  EXPECT_TRUE(cache.Get("b").isNull());
+  EXPECT_FALSE(cache.Get("c").isNull());
+}
+
+TEST(MoodbarPixmapCacheTest, KeyIncludesStyleAndSize) {
+  const QUrl url("file:///music/song.mp3");
+  const QString key = MoodbarPixmapCache::Key(
+      url, MoodbarRenderer::Style_Normal, QSize(100, 16));
+
+  EXPECT_EQ(key, MoodbarPixmapCache::Key(url, MoodbarRenderer::Style_Normal,
+                                         QSize(100, 16)));
+  EXPECT_NE(key, MoodbarPixmapCache::Key(url, MoodbarRenderer::Style_Angry,
+                                         QSize(100, 16)));
+  EXPECT_NE(key, MoodbarPixmapCache::Key(url, MoodbarRenderer::Style_Normal,
+                                         QSize(101, 16)));
+  EXPECT_NE(key, MoodbarPixmapCache::Key(QUrl("file:///music/other.mp3"),
+                                         MoodbarRenderer::Style_Normal,
+                                         QSize(100, 16)));
+}
+
+TEST(MoodbarPixmapCacheTest, RenderedImageIsMirrored) {
+  ColorVector colors;
+  for (int i = 0; i < 1000; ++i) {
+    colors << QColor::fromHsv(i * 359 / 1000, 200, 200);
+  }
+
+  const QImage image = MoodbarRenderer::RenderToImage(colors, QSize(50, 15));
+  ASSERT_EQ(QSize(50, 15), image.size());
+
+  for (int x = 0; x < image.width(); ++x) {
+    for (int y = 0; y < image.height() / 2; ++y) {
+      EXPECT_EQ(image.pixel(x, y), image.pixel(x, image.height() - 1 - y));
+      EXPECT_EQ(255, qAlpha(image.pixel(x, y)));
+    }
+  }
+}
+
+}  // namespace
@@ -0,0 +1,191 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <memory>
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <QFuture>
+#include <QSqlQuery>
+#include <QTemporaryFile>
+#include <QThreadPool>
+
+#include "core/concurrentrun.h"
+#include "core/database.h"
+#include "core/song.h"
+#include "library/library.h"
+#include "library/librarybackend.h"
+#include "moodbar/moodbarstore.h"
+
+namespace {
+
+class MoodbarStoreTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() { Init(new MemoryDatabase(nullptr)); }
+
+  void Init(Database* database) {
+    store_.reset();
+    backend_.reset();
+    database_.reset(database);
+    backend_.reset(new LibraryBackend);
+    backend_->Init(database_.get(), Library::kSongsTable, Library::kDirsTable,
+                   Library::kSubdirsTable, Library::kFtsTable);
+    backend_->AddDirectory("/tmp");
+    store_.reset(new MoodbarStore(database_.get()));
+
+    backend_->AddOrUpdateSongs(SongList() << MakeSong(1, 1) << MakeSong(2, 1));
+  }
+
+  static Song MakeSong(int number, int mtime) {
+    Song song;
+    song.set_directory_id(1);
+    song.set_url(Url(number));
+    song.set_title(QString("Title%1").arg(number));
+    song.set_mtime(mtime);
+    song.set_ctime(1);
+    song.set_filesize(1);
+    return song;
+  }
+
+  static QUrl Url(int number) {
+    return QUrl::fromLocalFile(QString("/tmp/%1.mp3").arg(number));
+  }
+
+  std::unique_ptr<Database> database_;
+  std::unique_ptr<LibraryBackend> backend_;
+  std::unique_ptr<MoodbarStore> store_;
+};
+
+TEST_F(MoodbarStoreTest, RoundTrip) {
+  QByteArray data;
+  EXPECT_FALSE(store_->Get(Url(1), &data));
+
+  const QByteArray moodbar(3000, 'x');
+  EXPECT_TRUE(store_->Put(Url(1), moodbar));
+  EXPECT_TRUE(store_->Get(Url(1), &data));
+  EXPECT_TRUE(moodbar == data);
+
+  EXPECT_FALSE(store_->Get(Url(2), &data));
+}
+
+TEST_F(MoodbarStoreTest, RemembersFailures) {
+  ASSERT_TRUE(store_->Put(Url(1), QByteArray()));
+
+  QByteArray data("old");
+  EXPECT_TRUE(store_->Get(Url(1), &data));
+  EXPECT_TRUE(data.isEmpty());
+}
+
+TEST_F(MoodbarStoreTest, SongsOutsideLibrary) {
+  EXPECT_FALSE(store_->Put(Url(3), QByteArray("moodbar")));
+
+  QByteArray data;
+  EXPECT_FALSE(store_->Get(Url(3), &data));
+}
+
+TEST_F(MoodbarStoreTest, ChangedFilesAreCalculatedAgain) {
+  ASSERT_TRUE(store_->Put(Url(1), QByteArray("moodbar")));
+  EXPECT_EQ(1, store_->PendingCount());
+
+  backend_->AddOrUpdateSongs(SongList() << MakeSong(1, 2));
+
+  QByteArray data;
+  EXPECT_FALSE(store_->Get(Url(1), &data));
+  EXPECT_EQ(2, store_->PendingCount());
+}
+
+TEST_F(MoodbarStoreTest, Pending) {
+  QList<MoodbarStore::Pending> pending = store_->NextPending(0, 10);
+  ASSERT_EQ(2, pending.count());
+  EXPECT_EQ(Url(1), pending[0].url_);
+  EXPECT_EQ(Url(2), pending[1].url_);
+
+  // Carries on after the last one it returned
+  pending = store_->NextPending(pending[0].song_id_, 10);
+  ASSERT_EQ(1, pending.count());
+  EXPECT_EQ(Url(2), pending[0].url_);
+
+  // Songs with a moodbar aren't pending, even if it failed
+  ASSERT_TRUE(store_->Put(Url(2), QByteArray()));
+  pending = store_->NextPending(0, 10);
+  ASSERT_EQ(1, pending.count());
+  EXPECT_EQ(Url(1), pending[0].url_);
+  EXPECT_EQ(1, store_->PendingCount());
+}
+
+TEST_F(MoodbarStoreTest, CueSheetTracksShareMoodbar) {
+  // More songs in the same file as song 1, like the tracks of a cue sheet
+  Song track = MakeSong(1, 1);
+  track.set_cue_path("/tmp/1.cue");
+  Song second_track(track);
+  second_track.set_beginning_nanosec(100);
+  backend_->AddOrUpdateSongs(SongList() << track << second_track);
+
+  // Every file is only pending once
+  EXPECT_EQ(2, store_->PendingCount());
+  QList<MoodbarStore::Pending> pending = store_->NextPending(0, 10);
+  ASSERT_EQ(2, pending.count());
+  EXPECT_EQ(Url(1), pending[0].url_);
+  EXPECT_EQ(Url(2), pending[1].url_);
+
+  ASSERT_TRUE(store_->Put(Url(1), QByteArray("moodbar")));
+  EXPECT_EQ(1, store_->PendingCount());
+
+  QSqlDatabase db(database_->Connect());
+  QSqlQuery q("SELECT COUNT(*) FROM moodbars", db);
+  ASSERT_TRUE(q.exec() && q.next());
+  EXPECT_EQ(1, q.value(0).toInt());
+
+  // Deleting one track keeps the moodbar for the others
+  backend_->DeleteSongs(SongList() << backend_->GetSongsByUrl(Url(1))[0]);
+  QByteArray data;
+  EXPECT_TRUE(store_->Get(Url(1), &data));
+  EXPECT_EQ(QByteArray("moodbar"), data);
+}
+
+TEST_F(MoodbarStoreTest, WorksFromAnotherThread) {
+  // Each thread gets its own connection to an in-memory database, so this
+  // needs a real file.
+  QTemporaryFile file;
+  ASSERT_TRUE(file.open());
+  Init(new Database(nullptr, nullptr, file.fileName()));
+
+  // This is how MoodbarLoader uses the store.
+  QThreadPool pool;
+  pool.setMaxThreadCount(1);
+  MoodbarStore* store = store_.get();
+
+  const QUrl url = Url(1);
+  const QByteArray moodbar(3000, 'x');
+  QFuture<bool> put = ConcurrentRun::Run<bool>(
+      &pool, [store, url, moodbar]() { return store->Put(url, moodbar); });
+  QFuture<QByteArray> get =
+      ConcurrentRun::Run<QByteArray>(&pool, [store, url]() {
+        QByteArray ret;
+        store->Get(url, &ret);
+        return ret;
+      });
+
+  EXPECT_TRUE(put.result());
+  EXPECT_TRUE(moodbar == get.result());
+
+  QByteArray data;
+  EXPECT_TRUE(store_->Get(url, &data));
+  EXPECT_TRUE(moodbar == data);
+}
+
+}  // namespace
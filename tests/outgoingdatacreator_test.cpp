@@ -0,0 +1,188 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <memory>
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <QFile>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QStringList>
+#include <QVariant>
+
+#include "core/database.h"
+#include "core/song.h"
+#include "core/utilities.h"
+#include "library/library.h"
+#include "library/librarybackend.h"
+#include "networkremote/outgoingdatacreator.h"
+
+namespace {
+
+class LibraryExportTest : public ::testing::Test {
+ protected:
+  void SetUp() {
+    database_.reset(new MemoryDatabase(nullptr));
+    backend_.reset(new LibraryBackend);
+    backend_->Init(database_.get(), Library::kSongsTable, Library::kDirsTable,
+                   Library::kSubdirsTable, Library::kFtsTable);
+    backend_->AddDirectory("/music");
+
+    SongList songs;
+    for (int i = 0; i < 10; ++i) {
+      Song song;
+      song.Init(QString("Title %1").arg(i), "Artist", "Album", 100);
+      song.set_directory_id(1);
+      song.set_url(QUrl::fromLocalFile(QString("/music/%1.mp3").arg(i)));
+      song.set_mtime(1);
+      song.set_ctime(1);
+      song.set_filesize(1);
+      songs << song;
+    }
+    backend_->AddOrUpdateSongs(songs);
+  }
+
+  void TearDown() {
+    for (const QString& filename : filenames_) {
+      QFile::remove(filename);
+    }
+  }
+
+  // Exports the library for a client with sync_token, and returns the
+  // filename of the export.
+  QString Export(qint64 sync_token, qint64* new_sync_token, bool* is_delta) {
+    const QString filename = Utilities::GetTemporaryFileName();
+    filenames_ << filename;
+    EXPECT_TRUE(OutgoingDataCreator::ExportLibrary(
+        database_.get(), sync_token, filename, new_sync_token, is_delta));
+    return filename;
+  }
+
+  // Returns one column of a table in an exported database.
+  QStringList ReadColumn(const QString& filename, const QString& table,
+                         const QString& column) {
+    QStringList ret;
+    {
+      QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "export");
+      db.setDatabaseName(filename);
+      EXPECT_TRUE(db.open());
+
+      QSqlQuery q(QString("SELECT %1 FROM %2 ORDER BY %1").arg(column, table),
+                  db);
+      while (q.next()) {
+        ret << q.value(0).toString();
+      }
+    }
+    QSqlDatabase::removeDatabase("export");
+    return ret;
+  }
+
+  Song SongWithTitle(const QString& title) {
+    for (const Song& song : backend_->GetAllSongs()) {
+      if (song.title() == title) return song;
+    }
+    return Song();
+  }
+
+  std::unique_ptr<Database> database_;
+  std::unique_ptr<LibraryBackend> backend_;
+  QStringList filenames_;
+};
+
+}  // namespace
+
+TEST_F(LibraryExportTest, FirstRequestGetsEverything) {
+  qint64 token = 0;
+  bool is_delta = true;
+  const QString filename = Export(0, &token, &is_delta);
+
+  EXPECT_FALSE(is_delta);
+  EXPECT_LT(0, token);
+  EXPECT_EQ(10, ReadColumn(filename, "songs", "title").count());
+}
+
+TEST_F(LibraryExportTest, DeltaHasChangedAndDeletedSongs) {
+  qint64 token = 0;
+  bool is_delta = false;
+  Export(0, &token, &is_delta);
+
+  Song changed = SongWithTitle("Title 3");
+  changed.set_title("New title");
+  backend_->AddOrUpdateSongs(SongList() << changed);
+  const Song deleted = SongWithTitle("Title 5");
+  backend_->DeleteSongs(SongList() << deleted);
+
+  qint64 new_token = 0;
+  const QString filename = Export(token, &new_token, &is_delta);
+  EXPECT_TRUE(is_delta);
+  EXPECT_LT(token, new_token);
+  EXPECT_EQ(QStringList() << "New title",
+            ReadColumn(filename, "songs", "title"));
+  EXPECT_EQ(QStringList() << QString(deleted.url().toEncoded()),
+            ReadColumn(filename, "deleted_songs", "filename"));
+
+  // Nothing changed since the last delta
+  const QString empty_filename = Export(new_token, &token, &is_delta);
+  EXPECT_TRUE(is_delta);
+  EXPECT_EQ(new_token, token);
+  EXPECT_TRUE(ReadColumn(empty_filename, "songs", "title").isEmpty());
+}
+
+TEST_F(LibraryExportTest, PlayCountsAreNotSent) {
+  qint64 token = 0;
+  bool is_delta = false;
+  Export(0, &token, &is_delta);
+
+  {
+    QMutexLocker l(database_->Mutex());
+    QSqlQuery q(database_->Connect());
+    ASSERT_TRUE(q.exec("UPDATE songs SET playcount = playcount + 1,"
+                       " lastplayed = 1000, score = 50"));
+  }
+
+  qint64 new_token = 0;
+  const QString filename = Export(token, &new_token, &is_delta);
+  EXPECT_TRUE(is_delta);
+  EXPECT_EQ(token, new_token);
+  EXPECT_TRUE(ReadColumn(filename, "songs", "title").isEmpty());
+}
+
+TEST_F(LibraryExportTest, TokenFromAnotherDatabaseGetsEverything) {
+  qint64 token = 0;
+  bool is_delta = false;
+  Export(0, &token, &is_delta);
+
+  // The same version from a database with a different ID
+  const qint64 version =
+      token & ((qint64(1) << OutgoingDataCreator::kSyncTokenVersionBits) - 1);
+  const qint64 database_id =
+      token >> OutgoingDataCreator::kSyncTokenVersionBits;
+  const qint64 other_token =
+      OutgoingDataCreator::MakeSyncToken(database_id ^ 1, version);
+
+  qint64 new_token = 0;
+  QString filename = Export(other_token, &new_token, &is_delta);
+  EXPECT_FALSE(is_delta);
+  EXPECT_EQ(token, new_token);
+  EXPECT_EQ(10, ReadColumn(filename, "songs", "title").count());
+
+  // Tokens from before they had an ID are just a version
+  filename = Export(version, &new_token, &is_delta);
+  EXPECT_FALSE(is_delta);
+  EXPECT_EQ(10, ReadColumn(filename, "songs", "title").count());
+}
@@ -0,0 +1,120 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <memory>
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QTemporaryFile>
+#include <QTimer>
+
+#include "core/database.h"
+#include "core/song.h"
+#include "playlist/playlist.h"
+#include "playlist/playlistbackend.h"
+#include "playlist/playlistsequence.h"
+#include "playlist/songplaylistitem.h"
+#include "mock_settingsprovider.h"
+
+namespace {
+
+// A stream that gets a new title when it's reloaded, like a file does after
+// its tags are edited.
+class EditedStreamItem : public SongPlaylistItem {
+ public:
+  explicit EditedStreamItem(const Song& song)
+      : SongPlaylistItem(song), edited_(false) {}
+
+  void Reload() { edited_ = true; }
+  Song Metadata() const { return DatabaseSongMetadata(); }
+
+ protected:
+  Song DatabaseSongMetadata() const {
+    Song ret = SongPlaylistItem::DatabaseSongMetadata();
+    if (edited_) ret.set_title("edited");
+    return ret;
+  }
+
+ private:
+  bool edited_;
+};
+
+class PlaylistBackendTest : public ::testing::Test {
+ protected:
+  void SetUp() {
+    // Saves happen on the backend's thread, so this needs a real file.
+    ASSERT_TRUE(file_.open());
+    database_.reset(new Database(nullptr, nullptr, file_.fileName()));
+    backend_.reset(new PlaylistBackend(database_.get()));
+    sequence_.reset(new PlaylistSequence(nullptr, new DummySettingsProvider));
+
+    const int id = backend_->CreatePlaylist("Test", QString());
+    playlist_.reset(new Playlist(backend_.get(), nullptr, nullptr, id));
+    playlist_->set_sequence(sequence_.get());
+
+    QEventLoop loop;
+    QObject::connect(playlist_.get(), SIGNAL(RestoreFinished()), &loop,
+                     SLOT(quit()));
+    QTimer::singleShot(10000, &loop, SLOT(quit()));
+    loop.exec();
+  }
+
+  // Runs the saves the playlist queued up.
+  void FinishSaving() { QCoreApplication::processEvents(); }
+
+  static Song MakeStream(const QString& title) {
+    Song song;
+    song.Init(title, "artist", "album", 100);
+    song.set_url(QUrl("http://example.com/" + title));
+    song.set_filetype(Song::Type_Stream);
+    song.set_valid(true);
+    return song;
+  }
+
+  QTemporaryFile file_;
+  std::unique_ptr<Database> database_;
+  std::unique_ptr<PlaylistBackend> backend_;
+  std::unique_ptr<PlaylistSequence> sequence_;
+  std::unique_ptr<Playlist> playlist_;
+};
+
+TEST_F(PlaylistBackendTest, SavesEditedTags) {
+  playlist_->InsertItems(PlaylistItemList()
+                         << PlaylistItemPtr(new SongPlaylistItem(
+                                MakeStream("first")))
+                         << PlaylistItemPtr(
+                                new EditedStreamItem(MakeStream("second"))));
+  FinishSaving();
+
+  PlaylistItemList items = backend_->GetPlaylistItems(playlist_->id());
+  ASSERT_EQ(2, items.count());
+  EXPECT_EQ("second", items[1]->Metadata().title());
+
+  // This is what the tag editor does once it has saved the file
+  playlist_->ReloadItems(QList<int>() << 1);
+  FinishSaving();
+
+  items = backend_->GetPlaylistItems(playlist_->id());
+  ASSERT_EQ(2, items.count());
+  EXPECT_EQ("first", items[0]->Metadata().title());
+  EXPECT_EQ("edited", items[1]->Metadata().title());
+  EXPECT_EQ("artist", items[1]->Metadata().artist());
+}
+
+}  // namespace
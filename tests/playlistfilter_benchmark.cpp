@@ -0,0 +1,104 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Times filtering a 100000 row playlist as the filter is typed, against the
+// model row by row and with PlaylistFilter's snapshot.
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <memory>
+
+#include <QElapsedTimer>
+#include <QStandardItemModel>
+#include <QtDebug>
+
+#include "playlist/playlist.h"
+#include "playlist/playlistfilter.h"
+#include "playlist/playlistfilterparser.h"
+
+namespace {
+
+const int kRowCount = 100000;
+
+class PlaylistFilterBenchmark : public ::testing::Test {
+ protected:
+  void SetUp() {
+    filter_.setSourceModel(&source_);
+
+    // Every third row is by The Beatles
+    for (int n = 0; n < kRowCount; ++n) {
+      QList<QStandardItem*> row;
+      for (int column = 0; column < Playlist::ColumnCount; ++column) {
+        row << new QStandardItem;
+      }
+      row[Playlist::Column_Title]->setText(QString("Song %1").arg(n));
+      row[Playlist::Column_Artist]->setText(n % 3 == 0 ? "The Beatles"
+                                                       : "Beat Happening");
+      row[Playlist::Column_Album]->setText(QString("Album %1").arg(n % 100));
+      row[Playlist::Column_Year]->setText(QString::number(1960 + n % 40));
+      source_.appendRow(row);
+    }
+  }
+
+  // Evaluates the filter row by row against the model, the way PlaylistFilter
+  // used to.
+  int CountMatchesWithoutSnapshot(const QString& query) {
+    QMap<QString, int> columns;
+    columns["title"] = Playlist::Column_Title;
+    columns["artist"] = Playlist::Column_Artist;
+    columns["album"] = Playlist::Column_Album;
+    columns["year"] = Playlist::Column_Year;
+    QSet<int> numerical_columns;
+    numerical_columns << Playlist::Column_Year;
+
+    std::unique_ptr<FilterTree> tree(
+        FilterParser(query, columns, numerical_columns).parse());
+    int ret = 0;
+    for (int row = 0; row < source_.rowCount(); ++row) {
+      if (tree->accept(row, QModelIndex(), &source_)) ret++;
+    }
+    return ret;
+  }
+
+  QStandardItemModel source_;
+  PlaylistFilter filter_;
+};
+
+TEST_F(PlaylistFilterBenchmark, Typing) {
+  QElapsedTimer timer;
+  timer.start();
+  CountMatchesWithoutSnapshot("beat");
+  CountMatchesWithoutSnapshot("beatl");
+  qDebug() << "row by row:" << timer.elapsed() << "ms";
+
+  timer.restart();
+  filter_.setFilterFixedString("beat");
+  qDebug() << "snapshot and first query:" << timer.elapsed() << "ms";
+
+  timer.restart();
+  filter_.setFilterFixedString("beatl");
+  qDebug() << "refined query:" << timer.elapsed() << "ms";
+
+  timer.restart();
+  filter_.setFilterFixedString("album:\"album 1\"");
+  qDebug() << "new query:" << timer.elapsed() << "ms";
+
+  EXPECT_EQ(CountMatchesWithoutSnapshot("album:\"album 1\""),
+            filter_.rowCount());
+}
+
+}  // namespace
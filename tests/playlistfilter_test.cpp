@@ -0,0 +1,130 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <memory>
+
+#include <QStandardItemModel>
+
+#include "playlist/playlist.h"
+#include "playlist/playlistfilter.h"
+#include "playlist/playlistfilterparser.h"
+
+namespace {
+
+class PlaylistFilterTest : public ::testing::Test {
+ protected:
+  void SetUp() { filter_.setSourceModel(&source_); }
+
+  // Every third row is by The Beatles, and the years go round 1960-1999.
+  void AddRows(int count) {
+    for (int i = 0; i < count; ++i) {
+      const int n = source_.rowCount();
+      QList<QStandardItem*> row;
+      for (int column = 0; column < Playlist::ColumnCount; ++column) {
+        row << new QStandardItem;
+      }
+      row[Playlist::Column_Title]->setText(QString("Song %1").arg(n));
+      row[Playlist::Column_Artist]->setText(n % 3 == 0 ? "The Beatles"
+                                                       : "Beat Happening");
+      row[Playlist::Column_Album]->setText(QString("Album %1").arg(n % 100));
+      row[Playlist::Column_Year]->setText(QString::number(1960 + n % 40));
+      source_.appendRow(row);
+    }
+  }
+
+  // Evaluates the filter row by row against the model, the way PlaylistFilter
+  // used to.
+  int CountMatchesWithoutSnapshot(const QString& query) {
+    QMap<QString, int> columns;
+    columns["title"] = Playlist::Column_Title;
+    columns["artist"] = Playlist::Column_Artist;
+    columns["album"] = Playlist::Column_Album;
+    columns["year"] = Playlist::Column_Year;
+    QSet<int> numerical_columns;
+    numerical_columns << Playlist::Column_Year;
+
+    std::unique_ptr<FilterTree> tree(
+        FilterParser(query, columns, numerical_columns).parse());
+    int ret = 0;
+    for (int row = 0; row < source_.rowCount(); ++row) {
+      if (tree->accept(row, QModelIndex(), &source_)) ret++;
+    }
+    return ret;
+  }
+
+  QStandardItemModel source_;
+  PlaylistFilter filter_;
+};
+
+TEST_F(PlaylistFilterTest, MatchesModelEvaluation) {
+  AddRows(10000);
+
+  const char* queries[] = {"beatles",
+                           "beat",
+                           "song 12",
+                           "artist:beatles",
+                           "year:>1990",
+                           "-beatles",
+                           "beatles OR album:\"album 7\"",
+                           "year:<=1965 beatles",
+                           "\"the beatles\""};
+  for (const char* query : queries) {
+    filter_.setFilterFixedString(query);
+    EXPECT_EQ(CountMatchesWithoutSnapshot(query), filter_.rowCount()) << query;
+  }
+
+  filter_.setFilterFixedString(QString());
+  EXPECT_EQ(10000, filter_.rowCount());
+}
+
+TEST_F(PlaylistFilterTest, Refinement) {
+  EXPECT_TRUE(PlaylistFilter::IsRefinement("beat", "beatl"));
+  EXPECT_TRUE(PlaylistFilter::IsRefinement("beat", "beat les"));
+  EXPECT_FALSE(PlaylistFilter::IsRefinement("", "beat"));
+  EXPECT_FALSE(PlaylistFilter::IsRefinement("beatl", "beat"));
+  EXPECT_FALSE(PlaylistFilter::IsRefinement("beat O", "beat OR x"));
+  EXPECT_FALSE(PlaylistFilter::IsRefinement("beat", "beat -les"));
+  EXPECT_FALSE(PlaylistFilter::IsRefinement("year", "year:1965"));
+
+  AddRows(10000);
+  filter_.setFilterFixedString("beat");
+  EXPECT_EQ(10000, filter_.rowCount());
+  filter_.setFilterFixedString("beatl");
+  EXPECT_EQ(CountMatchesWithoutSnapshot("beatl"), filter_.rowCount());
+  filter_.setFilterFixedString("beatles song 99");
+  EXPECT_EQ(CountMatchesWithoutSnapshot("beatles song 99"),
+            filter_.rowCount());
+}
+
+TEST_F(PlaylistFilterTest, FollowsModelChanges) {
+  AddRows(100);
+  filter_.setFilterFixedString("beatles");
+  EXPECT_EQ(34, filter_.rowCount());
+
+  source_.item(1, Playlist::Column_Artist)->setText("The Beatles");
+  EXPECT_EQ(35, filter_.rowCount());
+
+  AddRows(3);
+  EXPECT_EQ(36, filter_.rowCount());
+
+  source_.removeRows(0, 3);
+  EXPECT_EQ(34, filter_.rowCount());
+}
+
+}  // namespace
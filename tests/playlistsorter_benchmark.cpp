@@ -0,0 +1,82 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Times sorting 100000 playlist items by album with PlaylistSorter, and the
+// way Playlist::sort used to do it with Playlist::CompareItems.
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <functional>
+
+#include <QElapsedTimer>
+#include <QtDebug>
+
+#include "core/song.h"
+#include "core/timeconstants.h"
+#include "playlist/playlist.h"
+#include "playlist/playlistsorter.h"
+#include "playlist/songplaylistitem.h"
+
+using std::placeholders::_1;
+using std::placeholders::_2;
+
+namespace {
+
+PlaylistItemList MakeItems(int count) {
+  const char* albums[] = {"Abbey Road", "abbey road", "Revolver", "Help!",
+                          "", "eclair", "Rubber Soul"};
+  PlaylistItemList ret;
+  for (int i = 0; i < count; ++i) {
+    Song song;
+    song.Init(QString("Title %1").arg(qrand() % 50), "Artist",
+              albums[qrand() % 7], (qrand() % 300) * kNsecPerSec);
+    song.set_disc(qrand() % 3);
+    song.set_track(qrand() % 20);
+    song.set_year(1960 + qrand() % 10);
+    ret << PlaylistItemPtr(new SongPlaylistItem(song));
+  }
+  return ret;
+}
+
+TEST(PlaylistSorterBenchmark, Album) {
+  PlaylistItemList items = MakeItems(100000);
+
+  QElapsedTimer timer;
+  timer.start();
+  qStableSort(items.begin(), items.end(),
+              std::bind(&Playlist::CompareItems, Playlist::Column_Track,
+                        Qt::AscendingOrder, _1, _2));
+  qStableSort(items.begin(), items.end(),
+              std::bind(&Playlist::CompareItems, Playlist::Column_Disc,
+                        Qt::AscendingOrder, _1, _2));
+  qStableSort(items.begin(), items.end(),
+              std::bind(&Playlist::CompareItems, Playlist::Column_Album,
+                        Qt::AscendingOrder, _1, _2));
+  qDebug() << "CompareItems:" << timer.elapsed() << "ms";
+
+  const PlaylistSorter sorter(Playlist::Column_Album, Qt::AscendingOrder);
+  timer.restart();
+  const PlaylistSorter::KeyList keys = sorter.ExtractKeys(items, 0);
+  qDebug() << "PlaylistSorter: extracting keys took" << timer.elapsed()
+           << "ms";
+
+  timer.restart();
+  sorter.SortKeys(keys);
+  qDebug() << "PlaylistSorter: sorting took" << timer.elapsed() << "ms";
+}
+
+}  // namespace
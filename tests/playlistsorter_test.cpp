@@ -0,0 +1,109 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <functional>
+
+#include "core/song.h"
+#include "core/timeconstants.h"
+#include "playlist/playlist.h"
+#include "playlist/playlistsorter.h"
+#include "playlist/songplaylistitem.h"
+
+using std::placeholders::_1;
+using std::placeholders::_2;
+
+namespace {
+
+PlaylistItemList MakeItems(int count) {
+  const char* albums[] = {"Abbey Road", "abbey road", "Revolver", "Help!",
+                          "", "eclair", "Rubber Soul"};
+  PlaylistItemList ret;
+  for (int i = 0; i < count; ++i) {
+    Song song;
+    song.Init(QString("Title %1").arg(qrand() % 50), "Artist",
+              albums[qrand() % 7], (qrand() % 300) * kNsecPerSec);
+    song.set_disc(qrand() % 3);
+    song.set_track(qrand() % 20);
+    song.set_year(1960 + qrand() % 10);
+    ret << PlaylistItemPtr(new SongPlaylistItem(song));
+  }
+  return ret;
+}
+
+// How Playlist::sort used to do it.
+PlaylistItemList SortWithCompareItems(PlaylistItemList items, int column,
+                                      Qt::SortOrder order) {
+  if (column == Playlist::Column_Album) {
+    qStableSort(items.begin(), items.end(),
+                std::bind(&Playlist::CompareItems, Playlist::Column_Track,
+                          order, _1, _2));
+    qStableSort(items.begin(), items.end(),
+                std::bind(&Playlist::CompareItems, Playlist::Column_Disc,
+                          order, _1, _2));
+  }
+  qStableSort(items.begin(), items.end(),
+              std::bind(&Playlist::CompareItems, column, order, _1, _2));
+  return items;
+}
+
+TEST(PlaylistSorterTest, MatchesCompareItems) {
+  const PlaylistItemList items = MakeItems(1000);
+  const int columns[] = {Playlist::Column_Album, Playlist::Column_Title,
+                         Playlist::Column_Length, Playlist::Column_Year};
+
+  for (int column : columns) {
+    for (Qt::SortOrder order : {Qt::AscendingOrder, Qt::DescendingOrder}) {
+      EXPECT_TRUE(SortWithCompareItems(items, column, order) ==
+                  PlaylistSorter(column, order).Sort(items))
+          << "column " << column << " order " << order;
+    }
+  }
+}
+
+TEST(PlaylistSorterTest, LeavesItemsBeforeFirst) {
+  const PlaylistItemList items = MakeItems(100);
+  const PlaylistItemList sorted =
+      PlaylistSorter(Playlist::Column_Title, Qt::AscendingOrder)
+          .Sort(items, 40);
+
+  EXPECT_TRUE(items.mid(0, 40) == sorted.mid(0, 40));
+  EXPECT_TRUE(SortWithCompareItems(items.mid(40), Playlist::Column_Title,
+                                   Qt::AscendingOrder) == sorted.mid(40));
+}
+
+TEST(PlaylistSorterTest, SortsExtractedKeys) {
+  const PlaylistItemList items = MakeItems(100);
+  const PlaylistSorter sorter(Playlist::Column_Title, Qt::AscendingOrder);
+  const PlaylistItemList expected = sorter.Sort(items, 10);
+
+  const PlaylistSorter::KeyList keys = sorter.ExtractKeys(items, 10);
+  ASSERT_EQ(90, keys.count());
+
+  // Changing the items after their keys were taken doesn't change the order
+  for (PlaylistItemPtr item : items) {
+    Song song = item->Metadata();
+    song.set_title("Changed");
+    item->SetTemporaryMetadata(song);
+  }
+
+  EXPECT_TRUE(expected ==
+              PlaylistSorter::Reorder(items, 10, sorter.SortKeys(keys)));
+}
+
+}  // namespace
@@ -0,0 +1,76 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QTemporaryFile>
+
+#include "networkremote/songsender.h"
+
+namespace {
+
+class SongSenderTest : public ::testing::Test {
+ protected:
+  void SetUp() {
+    // Two and a half chunks
+    while (data_.size() < int(SongSender::kFileChunkSize * 5 / 2)) {
+      data_.append(char(data_.size() % 251));
+    }
+    expected_hash_ =
+        QCryptographicHash::hash(data_, QCryptographicHash::Sha1).toHex();
+
+    ASSERT_TRUE(file_.open());
+    file_.write(data_);
+    file_.seek(0);
+  }
+
+  QByteArray ChunkData(int chunk) {
+    return data_.mid(chunk * SongSender::kFileChunkSize,
+                     SongSender::kFileChunkSize);
+  }
+
+  QByteArray data_;
+  QByteArray expected_hash_;
+  QTemporaryFile file_;
+};
+
+}  // namespace
+
+TEST_F(SongSenderTest, HashesWholeFileWithFirstChunk) {
+  SongSender::Chunk chunk = SongSender::ReadChunk(&file_, true, 0);
+  EXPECT_EQ(expected_hash_, chunk.file_hash);
+  EXPECT_TRUE(ChunkData(0) == chunk.data);
+
+  // The rest of the file is read from where the first chunk left off
+  chunk = SongSender::ReadChunk(&file_, false, 0);
+  EXPECT_TRUE(chunk.file_hash.isEmpty());
+  EXPECT_TRUE(ChunkData(1) == chunk.data);
+
+  chunk = SongSender::ReadChunk(&file_, false, 0);
+  EXPECT_TRUE(ChunkData(2) == chunk.data);
+  EXPECT_TRUE(file_.atEnd());
+}
+
+TEST_F(SongSenderTest, HashesWholeFileWhenResuming) {
+  // The client already has the first two chunks
+  const SongSender::Chunk chunk =
+      SongSender::ReadChunk(&file_, true, 2 * SongSender::kFileChunkSize);
+  EXPECT_EQ(expected_hash_, chunk.file_hash);
+  EXPECT_TRUE(ChunkData(2) == chunk.data);
+}
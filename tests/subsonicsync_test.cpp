@@ -0,0 +1,344 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <memory>
+
+#include "test_utils.h"
+#include "gtest/gtest.h"
+
+#include <QEventLoop>
+#include <QHostAddress>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QThread>
+#include <QTimer>
+#include <QWaitCondition>
+
+#include "core/closure.h"
+#include "core/database.h"
+#include "internet/subsonic/subsonicservice.h"
+#include "internet/subsonic/subsonicsyncstore.h"
+#include "library/librarybackend.h"
+
+namespace {
+
+// A stand-in Subsonic server on localhost that answers getAlbumList2 and
+// getAlbum from a map of albums, one connection at a time on its own thread.
+class FakeSubsonicServer : public QThread {
+ public:
+  FakeSubsonicServer() : port_(0), stop_(false), fail_album_list_(false) {}
+
+  ~FakeSubsonicServer() {
+    stop_ = true;
+    wait();
+  }
+
+  // Returns the port it's listening on.
+  quint16 Start() {
+    QMutexLocker l(&mutex_);
+    start();
+    while (port_ == 0) started_.wait(&mutex_);
+    return port_;
+  }
+
+  void SetAlbum(const QString& id, const QStringList& songs) {
+    QMutexLocker l(&mutex_);
+    albums_[id] = songs;
+  }
+
+  void RemoveAlbum(const QString& id) {
+    QMutexLocker l(&mutex_);
+    albums_.remove(id);
+  }
+
+  void set_fail_album_list(bool fail) {
+    QMutexLocker l(&mutex_);
+    fail_album_list_ = fail;
+  }
+
+  int request_count(const QString& view) {
+    QMutexLocker l(&mutex_);
+    return request_counts_[view];
+  }
+
+ protected:
+  void run() {
+    QTcpServer server;
+    server.listen(QHostAddress::LocalHost);
+    {
+      QMutexLocker l(&mutex_);
+      port_ = server.serverPort();
+      started_.wakeAll();
+    }
+
+    while (!stop_) {
+      if (!server.waitForNewConnection(50)) continue;
+      std::unique_ptr<QTcpSocket> socket(server.nextPendingConnection());
+      Handle(socket.get());
+    }
+  }
+
+ private:
+  void Handle(QTcpSocket* socket) {
+    QByteArray request;
+    while (!request.contains("\r\n\r\n") && socket->waitForReadyRead(5000)) {
+      request += socket->readAll();
+    }
+
+    // "GET /rest/getAlbum.view?id=... HTTP/1.1"
+    const QByteArray path = request.split(' ').value(1);
+    const QUrl url = QUrl::fromEncoded("http://localhost" + path);
+    const QString view = url.path().section('/', -1).section('.', 0, 0);
+
+    QByteArray body;
+    {
+      QMutexLocker l(&mutex_);
+      request_counts_[view]++;
+
+      if (view == "getAlbumList2") {
+        body = AlbumList(url.queryItemValue("offset").toInt(),
+                         url.queryItemValue("size").toInt());
+      } else if (view == "getAlbum") {
+        body = Album(url.queryItemValue("id"));
+      }
+    }
+
+    socket->write(
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/xml\r\n"
+        "Connection: close\r\n"
+        "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+        "\r\n" + body);
+    socket->waitForBytesWritten(5000);
+    socket->disconnectFromHost();
+    if (socket->state() != QAbstractSocket::UnconnectedState) {
+      socket->waitForDisconnected(5000);
+    }
+  }
+
+  QByteArray AlbumList(int offset, int size) const {
+    if (fail_album_list_) {
+      return "<subsonic-response status=\"failed\">"
+             "<error code=\"0\" message=\"Broken\"/></subsonic-response>";
+    }
+
+    QByteArray ret = "<subsonic-response status=\"ok\"><albumList2>";
+    const QStringList ids = albums_.keys();
+    for (const QString& id : ids.mid(offset, size)) {
+      ret += QString(
+                 "<album id=\"%1\" name=\"Album %1\" artist=\"Artist\" "
+                 "songCount=\"%2\" created=\"2016-01-01T00:00:00\"/>")
+                 .arg(id)
+                 .arg(albums_[id].count())
+                 .toUtf8();
+    }
+    return ret + "</albumList2></subsonic-response>";
+  }
+
+  QByteArray Album(const QString& id) const {
+    if (!albums_.contains(id)) {
+      return "<subsonic-response status=\"failed\">"
+             "<error code=\"70\" message=\"Not found\"/></subsonic-response>";
+    }
+
+    QByteArray ret = "<subsonic-response status=\"ok\">";
+    ret += QString("<album id=\"%1\" name=\"Album %1\" artist=\"Artist\">")
+               .arg(id)
+               .toUtf8();
+    for (const QString& song : albums_[id]) {
+      ret += QString(
+                 "<song id=\"%1\" title=\"%1\" album=\"Album %2\" "
+                 "artist=\"Artist\" duration=\"100\"/>")
+                 .arg(song, id)
+                 .toUtf8();
+    }
+    return ret + "</album></subsonic-response>";
+  }
+
+  QMutex mutex_;
+  QWaitCondition started_;
+  quint16 port_;
+  volatile bool stop_;
+
+  QMap<QString, QStringList> albums_;
+  bool fail_album_list_;
+  QMap<QString, int> request_counts_;
+};
+
+// Sends the scanner's requests to the fake server and keeps track of how many
+// are in flight at once.
+class FakeApiClient : public SubsonicApiClient {
+ public:
+  explicit FakeApiClient(quint16 port)
+      : port_(port), in_flight_(0), max_in_flight_(0) {}
+
+  QUrl BuildRequestUrl(const QString& view) const {
+    return QUrl(QString("http://127.0.0.1:%1/rest/%2.view").arg(port_).arg(
+        view));
+  }
+
+  QNetworkReply* Send(const QUrl& url) {
+    QNetworkReply* reply = network_.get(QNetworkRequest(url));
+    max_in_flight_ = qMax(max_in_flight_, ++in_flight_);
+    NewClosure(reply, SIGNAL(finished()), [this]() { in_flight_--; });
+    return reply;
+  }
+
+  bool IsAmpache() const { return false; }
+
+  int max_in_flight() const { return max_in_flight_; }
+
+ private:
+  QNetworkAccessManager network_;
+  quint16 port_;
+  int in_flight_;
+  int max_in_flight_;
+};
+
+class SubsonicSyncTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    client_.reset(new FakeApiClient(server_.Start()));
+    scanner_.reset(new SubsonicLibraryScanner(client_.get()));
+  }
+
+  static QString AlbumId(int i) {
+    return QString("al-%1").arg(i, 4, 10, QChar('0'));
+  }
+
+  // Adds albums with one song each.
+  void AddAlbums(int count) {
+    for (int i = 0; i < count; ++i) {
+      server_.SetAlbum(AlbumId(i), QStringList() << AlbumId(i) + "-0");
+    }
+  }
+
+  void Scan(const QMap<QString, QString>& known_albums =
+                QMap<QString, QString>()) {
+    QEventLoop loop;
+    QObject::connect(scanner_.get(), SIGNAL(ScanFinished()), &loop,
+                     SLOT(quit()));
+    QTimer::singleShot(30000, &loop, SLOT(quit()));
+
+    scanner_->Scan(known_albums);
+    if (scanner_->is_scanning()) loop.exec();
+    ASSERT_FALSE(scanner_->is_scanning());
+  }
+
+  FakeSubsonicServer server_;
+  std::unique_ptr<FakeApiClient> client_;
+  std::unique_ptr<SubsonicLibraryScanner> scanner_;
+};
+
+TEST_F(SubsonicSyncTest, FirstScanFetchesEverything) {
+  // More than two pages of albums
+  const int count = SubsonicLibraryScanner::kAlbumChunkSize * 2 + 10;
+  AddAlbums(count);
+
+  Scan();
+  ASSERT_TRUE(scanner_->succeeded());
+  EXPECT_EQ(count, scanner_->album_fingerprints().count());
+  EXPECT_EQ(count, scanner_->changed_albums().count());
+  EXPECT_TRUE(scanner_->RemovedAlbums().isEmpty());
+  EXPECT_EQ(count, server_.request_count("getAlbum"));
+  EXPECT_GE(server_.request_count("getAlbumList2"), 3);
+
+  // Requests are made in parallel, but not too many at once
+  EXPECT_GT(client_->max_in_flight(), 1);
+  EXPECT_LE(client_->max_in_flight(),
+            SubsonicLibraryScanner::kConcurrentRequests);
+}
+
+TEST_F(SubsonicSyncTest, FetchesOnlyChangedAlbums) {
+  AddAlbums(20);
+  Scan();
+  ASSERT_TRUE(scanner_->succeeded());
+  const QMap<QString, QString> known = scanner_->album_fingerprints();
+  const int album_requests = server_.request_count("getAlbum");
+
+  server_.SetAlbum(AlbumId(3), QStringList() << AlbumId(3) + "-0"
+                                             << AlbumId(3) + "-1");
+  server_.RemoveAlbum(AlbumId(5));
+  server_.SetAlbum(AlbumId(100), QStringList() << AlbumId(100) + "-0");
+
+  Scan(known);
+  ASSERT_TRUE(scanner_->succeeded());
+  EXPECT_EQ(QStringList() << AlbumId(3) << AlbumId(100),
+            scanner_->changed_albums().keys());
+  EXPECT_EQ(QStringList() << AlbumId(5), scanner_->RemovedAlbums());
+  EXPECT_EQ(album_requests + 2, server_.request_count("getAlbum"));
+  EXPECT_EQ(2, scanner_->changed_albums()[AlbumId(3)].count());
+
+  // Nothing changed since
+  Scan(scanner_->album_fingerprints());
+  ASSERT_TRUE(scanner_->succeeded());
+  EXPECT_TRUE(scanner_->changed_albums().isEmpty());
+  EXPECT_EQ(album_requests + 2, server_.request_count("getAlbum"));
+}
+
+TEST_F(SubsonicSyncTest, FailedScan) {
+  AddAlbums(5);
+  server_.set_fail_album_list(true);
+
+  Scan();
+  EXPECT_FALSE(scanner_->succeeded());
+  EXPECT_EQ(0, server_.request_count("getAlbum"));
+}
+
+TEST_F(SubsonicSyncTest, UpdatesSongs) {
+  MemoryDatabase database(nullptr);
+  LibraryBackend backend;
+  backend.Init(&database, SubsonicService::kSongsTable, QString::null,
+               QString::null, SubsonicService::kFtsTable);
+  SubsonicSyncStore store(&backend);
+
+  AddAlbums(10);
+  Scan();
+  ASSERT_TRUE(scanner_->succeeded());
+  ASSERT_TRUE(store.AlbumFingerprints().isEmpty());
+  ASSERT_TRUE(store.Replace(scanner_->changed_albums(),
+                            scanner_->album_fingerprints()));
+  EXPECT_EQ(10, backend.GetAllSongs().count());
+  EXPECT_EQ(scanner_->album_fingerprints(), store.AlbumFingerprints());
+
+  const QUrl kept_url("subsonic://" + AlbumId(3) + "-0");
+  const int kept_id = backend.GetSongByUrl(kept_url).id();
+  ASSERT_NE(-1, kept_id);
+
+  server_.SetAlbum(AlbumId(3), QStringList() << AlbumId(3) + "-0"
+                                             << AlbumId(3) + "-1");
+  server_.RemoveAlbum(AlbumId(5));
+
+  Scan(store.AlbumFingerprints());
+  ASSERT_TRUE(scanner_->succeeded());
+  store.Update(scanner_->RemovedAlbums(), scanner_->changed_albums(),
+               scanner_->album_fingerprints());
+
+  EXPECT_EQ(10, backend.GetAllSongs().count());
+  EXPECT_EQ(kept_id, backend.GetSongByUrl(kept_url).id());
+  EXPECT_NE(-1,
+            backend.GetSongByUrl(QUrl("subsonic://" + AlbumId(3) + "-1")).id());
+  EXPECT_EQ(-1,
+            backend.GetSongByUrl(QUrl("subsonic://" + AlbumId(5) + "-0")).id());
+  EXPECT_EQ(scanner_->album_fingerprints(), store.AlbumFingerprints());
+}
+
+}  // namespace
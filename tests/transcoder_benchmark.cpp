@@ -0,0 +1,151 @@
+/* This file is part of Clementine.
+
+   Clementine is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   Clementine is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with Clementine.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Transcodes a generated corpus of WAV files and reports how fast it went.
+//
+// Usage: transcoder_benchmark [file count] [threads]
+//
+// Every eighth file is ten minutes long and the rest are between 20 seconds
+// and two minutes, so how well the long files are scheduled shows up in the
+// total time.
+
+#include <cmath>
+#include <iostream>
+
+#include <gst/gst.h>
+
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QTimer>
+
+#include "core/timeconstants.h"
+#include "core/utilities.h"
+#include "transcoder/transcoder.h"
+
+namespace {
+
+const int kSampleRate = 44100;
+const int kChannels = 2;
+
+bool WriteWav(const QString& filename, int seconds) {
+  QFile file(filename);
+  if (!file.open(QIODevice::WriteOnly)) return false;
+
+  const quint32 data_size = quint32(seconds) * kSampleRate * kChannels * 2;
+
+  QDataStream s(&file);
+  s.setByteOrder(QDataStream::LittleEndian);
+  s.writeRawData("RIFF", 4);
+  s << quint32(36 + data_size);
+  s.writeRawData("WAVEfmt ", 8);
+  s << quint32(16) << quint16(1) << quint16(kChannels) << quint32(kSampleRate)
+    << quint32(kSampleRate * kChannels * 2) << quint16(kChannels * 2)
+    << quint16(16);
+  s.writeRawData("data", 4);
+  s << data_size;
+
+  // A second of a sine wave, repeated
+  QByteArray second;
+  QDataStream samples(&second, QIODevice::WriteOnly);
+  samples.setByteOrder(QDataStream::LittleEndian);
+  for (int i = 0; i < kSampleRate; ++i) {
+    const qint16 value = qint16(sin(i * 2 * M_PI * 440 / kSampleRate) * 8000);
+    for (int c = 0; c < kChannels; ++c) samples << value;
+  }
+  for (int i = 0; i < seconds; ++i) file.write(second);
+
+  return true;
+}
+
+int FileLength(int i) {
+  if (i % 8 == 0) return 600;
+  return 20 + (i * 37) % 100;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  QCoreApplication app(argc, argv);
+  gst_init(nullptr, nullptr);
+
+  const QStringList args = app.arguments();
+  const int file_count = args.count() > 1 ? args[1].toInt() : 24;
+  const int threads = args.count() > 2 ? args[2].toInt() : 0;
+
+  const QString dir = Utilities::MakeTempDir();
+  std::cout << "Generating " << file_count << " files in "
+            << dir.toLocal8Bit().constData() << std::endl;
+
+  Transcoder transcoder;
+  if (threads > 0) transcoder.set_max_threads(threads);
+
+  const TranscoderPreset preset =
+      Transcoder::PresetForFileType(Song::Type_OggVorbis);
+  qint64 total_seconds = 0;
+  for (int i = 0; i < file_count; ++i) {
+    const QString input = QString("%1/%2.wav").arg(dir).arg(i);
+    if (!WriteWav(input, FileLength(i))) {
+      std::cerr << "Couldn't write " << input.toLocal8Bit().constData()
+                << std::endl;
+      return 1;
+    }
+    total_seconds += FileLength(i);
+    transcoder.AddJob(input, preset, QString("%1/%2.ogg").arg(dir).arg(i),
+                      FileLength(i) * kNsecPerSec);
+  }
+
+  QElapsedTimer timer;
+  timer.start();
+  transcoder.Start();
+
+  // Print what's going on every second until everything's finished
+  QTimer wakeup_timer;
+  wakeup_timer.start(1000);
+  QElapsedTimer status_timer;
+  status_timer.start();
+  while (transcoder.RunningJobsCount() || transcoder.QueuedJobsCount()) {
+    app.processEvents(QEventLoop::WaitForMoreEvents);
+    if (status_timer.elapsed() < 1000) continue;
+    status_timer.restart();
+
+    float speed = 0;
+    for (const Transcoder::JobProgress& job : transcoder.GetProgress()) {
+      speed += job.speed;
+    }
+    std::cout << "running " << transcoder.RunningJobsCount() << ", queued "
+              << transcoder.QueuedJobsCount() << ", " << speed << "x realtime"
+              << std::endl;
+  }
+  const double seconds = timer.elapsed() / 1000.0;
+
+  int succeeded = 0;
+  for (int i = 0; i < file_count; ++i) {
+    if (QFileInfo(QString("%1/%2.ogg").arg(dir).arg(i)).size() > 0) {
+      succeeded++;
+    }
+  }
+  const int failed = file_count - succeeded;
+
+  std::cout << succeeded << " files transcoded, " << failed << " failed in "
+            << seconds << "s - " << file_count / seconds << " files/sec, "
+            << total_seconds / seconds << "x realtime" << std::endl;
+
+  Utilities::RemoveRecursive(dir);
+  return failed ? 1 : 0;
+}